@@ -40,6 +40,12 @@
 extern const char* data_sfx_files[];
 extern const char* data_bgm_files[];
 
+#ifdef PERF_TRACE
+//From perf.c
+void perf_begin(int zone);
+void perf_end(int zone);
+#endif
+
 //------------------------------------------------------------------------------
 
 static Config* config;
@@ -99,6 +105,8 @@ void audio_play_bgm(int id)
 
 	unload_bgm();
 
+	PERF_BEGIN(PERFZONE_BGM_LOAD);
+
 	//Try to load the BGM track in OGG format
 	snprintf(path, ARRAY_LENGTH(path), "%s%s.ogg", config->assets_dir, data_bgm_files[id]);
 	bgm = LoadMusicStream(path);
@@ -109,6 +117,8 @@ void audio_play_bgm(int id)
 		bgm = LoadMusicStream(path);
 	}
 
+	PERF_END(PERFZONE_BGM_LOAD);
+
 	if (IsMusicReady(bgm)) {
 		bgm_loaded = true;
 	}
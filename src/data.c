@@ -281,6 +281,97 @@ const int data_gush_move_pattern_2[] = {
 	0,
 };
 
+const int* const data_gush_move_patterns[] = {
+	[GUSH_MOVE_PATTERN_1] = data_gush_move_pattern_1,
+	[GUSH_MOVE_PATTERN_2] = data_gush_move_pattern_2,
+};
+
+//Names of the parts of the gameplay state, as shown in divergence reports
+const char* data_playhash_part_names[] = {
+	[PLAYHASH_PLAYER]          = "player",
+	[PLAYHASH_BUS]             = "bus",
+	[PLAYHASH_CAM]             = "cam",
+	[PLAYHASH_OBJS]            = "objs",
+	[PLAYHASH_GUSHES]          = "gushes",
+	[PLAYHASH_MOVING_PEELS]    = "moving_peels",
+	[PLAYHASH_PUSHABLE_CRATES] = "pushable_crates",
+	[PLAYHASH_SEQUENCE]        = "sequence_step",
+	[PLAYHASH_SCORE]           = "score",
+	[PLAYHASH_TIME]            = "time",
+};
+
+//Short names of the phases of a frame, as shown by the performance overlay
+const char* data_perf_phase_names[] = {
+	[PERF_BEGIN_UPDATE]                   = "BEGIN",
+	[PERF_UPDATE_REMAINING_TIME]          = "TIMELEFT",
+	[PERF_UPDATE_SCORE_COUNT]             = "SCORECNT",
+	[PERF_MOVE_OBJECTS]                   = "MOVEOBJS",
+	[PERF_HANDLE_CAR_THROWN_PEEL]         = "CARPEEL",
+	[PERF_MOVE_PLAYER]                    = "MOVEPLYR",
+	[PERF_HANDLE_SOLIDS]                  = "SOLIDS",
+	[PERF_HANDLE_PASSAGEWAYS]             = "PASSAGES",
+	[PERF_HANDLE_PLAYER_INTERACTIONS]     = "INTERACT",
+	[PERF_HANDLE_TRIGGERS]                = "TRIGGERS",
+	[PERF_DO_PLAYER_STATE_SPECIFICS]      = "PLYRSTATE",
+	[PERF_HANDLE_FALL_SOUND]              = "FALLSND",
+	[PERF_HANDLE_RESPAWN]                 = "RESPAWN",
+	[PERF_HANDLE_PLAYER_STATE_CHANGE]     = "STATECHG",
+	[PERF_MOVE_CAMERA]                    = "CAMERA",
+	[PERF_UPDATE_ACTIVE_RANGES]           = "ACTRANGES",
+	[PERF_KEEP_PLAYER_WITHIN_LIMITS]      = "LIMITS",
+	[PERF_HANDLE_PLAYER_ANIMATION_CHANGE] = "ANIMCHG",
+	[PERF_UPDATE_ANIMATIONS]              = "ANIMS",
+	[PERF_MOVE_PUSH_ARROW]                = "PUSHARROW",
+	[PERF_POSITION_BUS_STOP_SIGN]         = "BUSSTOP",
+	[PERF_POSITION_LIGHT_POLE]            = "LIGHTPOLE",
+	[PERF_UPDATE_SEQUENCE]                = "SEQUENCE",
+	[PERF_DRAW_PLAY]                      = "DRAWPLAY",
+	[PERF_DRAW_MENU]                      = "DRAWMENU",
+	[PERF_AUDIO]                          = "AUDIO",
+	[PERF_PRESENT]                        = "PRESENT",
+};
+
+//Names of the phases and zones as recorded by --trace
+const char* data_perf_trace_phase_names[] = {
+	[PERF_BEGIN_UPDATE]                   = "begin_update",
+	[PERF_UPDATE_REMAINING_TIME]          = "update_remaining_time",
+	[PERF_UPDATE_SCORE_COUNT]             = "update_score_count",
+	[PERF_MOVE_OBJECTS]                   = "move_objects",
+	[PERF_HANDLE_CAR_THROWN_PEEL]         = "handle_car_thrown_peel",
+	[PERF_MOVE_PLAYER]                    = "move_player",
+	[PERF_HANDLE_SOLIDS]                  = "handle_solids",
+	[PERF_HANDLE_PASSAGEWAYS]             = "handle_passageways",
+	[PERF_HANDLE_PLAYER_INTERACTIONS]     = "handle_player_interactions",
+	[PERF_HANDLE_TRIGGERS]                = "handle_triggers",
+	[PERF_DO_PLAYER_STATE_SPECIFICS]      = "do_player_state_specifics",
+	[PERF_HANDLE_FALL_SOUND]              = "handle_fall_sound",
+	[PERF_HANDLE_RESPAWN]                 = "handle_respawn",
+	[PERF_HANDLE_PLAYER_STATE_CHANGE]     = "handle_player_state_change",
+	[PERF_MOVE_CAMERA]                    = "move_camera",
+	[PERF_UPDATE_ACTIVE_RANGES]           = "update_active_ranges",
+	[PERF_KEEP_PLAYER_WITHIN_LIMITS]      = "keep_player_within_limits",
+	[PERF_HANDLE_PLAYER_ANIMATION_CHANGE] = "handle_player_animation_change",
+	[PERF_UPDATE_ANIMATIONS]              = "update_animations",
+	[PERF_MOVE_PUSH_ARROW]                = "move_push_arrow",
+	[PERF_POSITION_BUS_STOP_SIGN]         = "position_bus_stop_sign",
+	[PERF_POSITION_LIGHT_POLE]            = "position_light_pole",
+	[PERF_UPDATE_SEQUENCE]                = "update_sequence",
+	[PERF_DRAW_PLAY]                      = "draw_play",
+	[PERF_DRAW_MENU]                      = "draw_menu",
+	[PERF_AUDIO]                          = "UpdateMusicStream",
+	[PERF_PRESENT]                        = "EndDrawing",
+};
+
+const char* data_perf_trace_zone_names[] = {
+	[PERFZONE_HANDLE_INPUT]  = "handle_input",
+	[PERFZONE_MENU]          = "menu",
+	[PERFZONE_PLAY_UPDATE]   = "play_update",
+	[PERFZONE_RENDERER_DRAW] = "renderer_draw",
+	[PERFZONE_LEVEL_LOAD]    = "levelload_load",
+	[PERFZONE_BGM_LOAD]      = "LoadMusicStream",
+	[PERFZONE_AUDIO_MIX]     = "audio_mix",
+};
+
 const char* data_menu_display_names[] = {
 	[MENU_MAIN]             = "",
 	[MENU_DIFFICULTY]       = "DIFFICULTY SELECT",
@@ -32,6 +32,8 @@
 #define ALEXVSBUS_DEFS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
 
@@ -44,8 +46,50 @@
 #define RELEASE "2025.06.16.0"
 #define REPOSITORY "https://github.com/M374LX/alexvsbus"
 
-//Maximum delta time
-#define MAX_DT (1.0f / 30.0f)
+//Maximum delta time, as a frame taking longer than this is a stall (such as
+//while the window is being dragged) rather than slow hardware, after which the
+//game resumes from where it was instead of jumping ahead
+#define MAX_DT (1.0f / 4.0f)
+
+//Number of gameplay updates (ticks) per second, as the gameplay logic always
+//runs at fixed time steps regardless of the frame rate
+#define PLAY_TICK_RATE 120
+#define PLAY_DT (1.0f / PLAY_TICK_RATE)
+
+//Numeric type of the positions, velocities, accelerations, and timers used by
+//the gameplay logic (PlayNum), which is float by default or, if
+//PLAY_FIXED_POINT is defined at build time, a signed 20.12 fixed-point number,
+//whose results are the same regardless of the compiler, its flags, and the CPU
+//
+//The 20 integer bits are enough for MAX_LEVEL_SIZE screens, and the float
+//versions of the macros expand to exactly the expressions they replace
+//
+//PN(): converts a constant or an integer to PlayNum
+//PN_TO_INT(): converts to an integer, truncating toward zero like a cast
+//PN_TO_FLOAT(): converts to float (for drawing only)
+//PN_MUL_DT(): multiplies by the delta time of a gameplay context
+//PN_DT(): the delta time of a gameplay context, which the timers count down by
+#ifdef PLAY_FIXED_POINT
+typedef int32_t PlayNum;
+
+#define PLAYNUM_FRAC_BITS 12
+#define PLAYNUM_ONE (1 << PLAYNUM_FRAC_BITS)
+
+#define PN(x) ((PlayNum)((x) * PLAYNUM_ONE))
+#define PN_TO_INT(a) ((int)((a) / PLAYNUM_ONE))
+#define PN_TO_FLOAT(a) ((float)(a) / PLAYNUM_ONE)
+#define PN_MUL_DT(ctx, a) \
+	((PlayNum)(((int64_t)(a) * (ctx)->delta_frac + ((int64_t)1 << 31)) >> 32))
+#define PN_DT(ctx) PN_MUL_DT(ctx, PLAYNUM_ONE)
+#else
+typedef float PlayNum;
+
+#define PN(x) (x)
+#define PN_TO_INT(a) ((int)(a))
+#define PN_TO_FLOAT(a) (a)
+#define PN_MUL_DT(ctx, a) ((a) * (ctx)->delta_time)
+#define PN_DT(ctx) ((ctx)->delta_time)
+#endif
 
 //Screen types
 enum {
@@ -337,12 +381,114 @@ enum {
 	SPR_TOUCH_RIGHT_HELD = 136,
 	SPR_TOUCH_JUMP = 137,
 	SPR_TOUCH_JUMP_HELD = 138,
+	NUM_SPRITES = 139,
 };
 
 //Logo width in pixels
 #define LOGO_WIDTH_SMALL 224
 #define LOGO_WIDTH_LARGE 296
 
+//Number of level columns held by the texture caching the level blocks drawn
+//from them, which must be more than the number visible at once
+#define LEVEL_LAYER_COLUMNS 32
+
+//Opacity of the scanlines drawn over the last row of pixels of each line of
+//the virtual screen when scaled by two or more
+#define SCANLINE_OPACITY 127
+
+//Maximum number of quads held by the sprite batch before they are sent to the
+//GPU, which is the size of rlgl's own batch on OpenGL ES 2.0
+#define SPRITE_BATCH_MAX_QUADS 2048
+
+//Maximum numbers of blocks of text kept laid out by the text cache, and of
+//characters and glyphs stored for all of them, beyond which the cache is
+//emptied
+#define TEXT_CACHE_MAX_ENTRIES 64
+#define TEXT_CACHE_MAX_CHARS 8192
+#define TEXT_CACHE_MAX_GLYPHS 8192
+
+//Largest distance between the positions of something on two consecutive ticks
+//that is interpolated when drawing, beyond which it is considered to have
+//moved instantly (like when the player character respawns)
+#define INTERP_MAX_DISTANCE 64
+
+//Layers of the render queue, into which the objects of PlayCtx.objs[] within
+//the camera's view are sorted once per frame, each drawn at a different point
+//among the rest of the gameplay
+enum {
+	RLAYER_OBJS_BEHIND = 0, //Drawn behind the player character
+	RLAYER_OBJS_FRONT = 1, //Coins and banana peels
+	RLAYER_SIGN_BASES = 2, //Overhead sign bases
+	NUM_RLAYERS = 3,
+};
+
+//Maximum number of sprites in each layer of the render queue, far more than
+//can fit in the camera's view
+#define RENDER_QUEUE_MAX_ITEMS 512
+
+
+
+//==========================================================================
+// Constants: performance overlay
+//
+
+//Number of frames over which the performance overlay computes its statistics
+//and draws its graph
+#define PERF_NUM_FRAMES 128
+
+//Frame time in microseconds shown as the full height of the graph
+#define PERF_GRAPH_MAX_US 33333
+
+//Phases of a frame timed separately by the performance overlay, which are the
+//steps of play_update() followed by the other main parts of a frame
+enum {
+	PERF_BEGIN_UPDATE = 0,
+	PERF_UPDATE_REMAINING_TIME = 1,
+	PERF_UPDATE_SCORE_COUNT = 2,
+	PERF_MOVE_OBJECTS = 3,
+	PERF_HANDLE_CAR_THROWN_PEEL = 4,
+	PERF_MOVE_PLAYER = 5,
+	PERF_HANDLE_SOLIDS = 6,
+	PERF_HANDLE_PASSAGEWAYS = 7,
+	PERF_HANDLE_PLAYER_INTERACTIONS = 8,
+	PERF_HANDLE_TRIGGERS = 9,
+	PERF_DO_PLAYER_STATE_SPECIFICS = 10,
+	PERF_HANDLE_FALL_SOUND = 11,
+	PERF_HANDLE_RESPAWN = 12,
+	PERF_HANDLE_PLAYER_STATE_CHANGE = 13,
+	PERF_MOVE_CAMERA = 14,
+	PERF_UPDATE_ACTIVE_RANGES = 15,
+	PERF_KEEP_PLAYER_WITHIN_LIMITS = 16,
+	PERF_HANDLE_PLAYER_ANIMATION_CHANGE = 17,
+	PERF_UPDATE_ANIMATIONS = 18,
+	PERF_MOVE_PUSH_ARROW = 19,
+	PERF_POSITION_BUS_STOP_SIGN = 20,
+	PERF_POSITION_LIGHT_POLE = 21,
+	PERF_UPDATE_SEQUENCE = 22,
+	PERF_DRAW_PLAY = 23, //Including the HUD
+	PERF_DRAW_MENU = 24,
+	PERF_AUDIO = 25, //BGM streaming
+	PERF_PRESENT = 26, //Including the wait for vertical sync
+	NUM_PERF_PHASES = 27,
+};
+
+//Zones recorded by --trace besides the phases, which can contain phases
+enum {
+	PERFZONE_HANDLE_INPUT = 0,
+	PERFZONE_MENU = 1,
+	PERFZONE_PLAY_UPDATE = 2,
+	PERFZONE_RENDERER_DRAW = 3,
+	PERFZONE_LEVEL_LOAD = 4,
+	PERFZONE_BGM_LOAD = 5,
+	PERFZONE_AUDIO_MIX = 6, //Recorded on the audio thread
+	NUM_PERF_ZONES = 7,
+};
+
+//Maximum number of events kept by --trace for the main thread and for the
+//audio thread, beyond which the oldest ones are overwritten
+#define PERF_TRACE_MAX_EVENTS (1 << 20)
+#define PERF_TRACE_MAX_AUDIO_EVENTS (1 << 16)
+
 
 
 //==========================================================================
@@ -403,21 +549,33 @@ enum {
 // Constants: gameplay
 //
 
-//Maximum numbers
-#define MAX_LEVEL_COLUMNS 480
-#define MAX_OBJS 160
-#define MAX_CRATE_BLOCKS 32
-#define MAX_DEEP_HOLES 32
-#define MAX_GUSHES 32
+//Maximum numbers (the sizes of most other arrays of a gameplay context depend
+//on the level file)
+#define MAX_LEVEL_SIZE 1000 //In screens of VSCREEN_MAX_WIDTH pixels
+#define MAX_LEVEL_FILE_SIZE (1024 * 1024)
 #define MAX_MOVING_PEELS 2
 #define MAX_PASSAGEWAYS 4
 #define MAX_PUSHABLE_CRATES MAX_PASSAGEWAYS
 #define MAX_CUTSCENE_OBJECTS 2
-#define MAX_SOLIDS 96
-#define MAX_TRIGGERS 8
-#define MAX_RESPAWN_POINTS 32
+#define MAX_COLUMN_SOLIDS 16
 #define MAX_COIN_SPARKS 12
 #define MAX_CRACK_PARTICLES 12
+#define MAX_PLAY_EVENTS 64
+#define MAX_SNAPSHOT_ARRAYS 10
+
+//Default number of ticks between the state hashes stored in a replay
+#define REPLAY_HASH_INTERVAL PLAY_TICK_RATE
+
+//Build stored in replays, which tells apart the fixed-point builds, as their
+//replays cannot be played back by the others and vice versa
+#ifdef PLAY_FIXED_POINT
+#define REPLAY_BUILD RELEASE "-fixed"
+#else
+#define REPLAY_BUILD RELEASE
+#endif
+
+//Maximum number of level columns checked at once when looking for solids
+#define MAX_SOLID_QUERY_COLUMNS 8
 
 //A level block is the basic unit for positioning objects in the level
 #define LEVEL_BLOCK_SIZE (TILE_SIZE * 3)
@@ -446,6 +604,7 @@ enum {
 	LVLCOL_PASSAGEWAY_LEFT = 4,
 	LVLCOL_PASSAGEWAY_MIDDLE = 5,
 	LVLCOL_PASSAGEWAY_RIGHT = 6,
+	NUM_LVLCOL_TYPES = 7
 };
 
 //Solid types
@@ -477,8 +636,25 @@ enum {
 	OBJ_PARKED_CAR_SILVER = 13,
 	OBJ_PARKED_CAR_YELLOW = 14,
 	OBJ_PARKED_TRUCK = 15,
+	NUM_OBJ_TYPES = 16,
+};
+
+//Lists of the objects the player character interacts with, each kept in
+//ascending order of X position
+enum {
+	OBJLIST_COINS = 0,
+	OBJLIST_PEELS = 1,
+	OBJLIST_GUSHES = 2,
+	OBJLIST_GUSH_CRACKS = 3,
+	OBJLIST_ROPES = 4,
+	OBJLIST_SPRINGS = 5,
+	NUM_OBJLISTS = 6
 };
 
+//How far to the right of its X position an interactive object's bounding box
+//can extend
+#define OBJ_MAX_INTERACTION_WIDTH 16
+
 //Even if the player presses the jump button before the character hits the
 //floor, a timer is started and a jump is triggered if the character hits
 //the floor before this amount of time passes
@@ -511,6 +687,7 @@ enum {
 	PLAYER_ANIM_SLIPREV = 5, //Reverse slip
 	PLAYER_ANIM_THROWBACK = 6,
 	PLAYER_ANIM_GRABROPE = 7,
+	NUM_PLAYER_ANIMS = 8
 };
 
 //Car colors
@@ -535,10 +712,20 @@ enum {
 #define PASSING_CAR_Y 184
 #define HEN_Y 224
 
+//Gush movement patterns (indices within data_gush_move_patterns[])
+enum {
+	GUSH_MOVE_PATTERN_1 = 0,
+	GUSH_MOVE_PATTERN_2 = 1,
+};
+
 //Camera velocity
 #define CAMERA_XVEL 720
 #define CAMERA_YVEL 408
 
+//How far beyond each side of the camera's view things are still updated and
+//drawn (greater than the width of the widest object, the parked truck)
+#define ACTIVE_WINDOW_MARGIN 384
+
 //Animations
 enum {
 	ANIM_PLAYER = 0,
@@ -574,6 +761,33 @@ enum {
 	SEQ_FINISHED = 255,
 };
 
+//Types of events produced by play_update() for the audio and the UI
+enum {
+	PLAYEVT_SFX = 0, //Value: sound effect to play (SFX_*)
+	PLAYEVT_SFX_STOP = 1, //Value: sound effect to stop (SFX_*)
+	PLAYEVT_COIN_COLLECTED = 2, //Value: points earned
+	PLAYEVT_FALL = 3,
+	PLAYEVT_RESPAWN = 4, //Value: index within respawn_points[] or NONE
+	PLAYEVT_SCORE_TICK = 5, //Value: remaining time
+	PLAYEVT_SEQUENCE_CHANGE = 6, //Value: new sequence step
+};
+
+//Parts of the gameplay state hashed separately by play_state_hash(), so the
+//part in which two runs diverged can be identified
+enum {
+	PLAYHASH_PLAYER = 0,
+	PLAYHASH_BUS = 1,
+	PLAYHASH_CAM = 2,
+	PLAYHASH_OBJS = 3,
+	PLAYHASH_GUSHES = 4,
+	PLAYHASH_MOVING_PEELS = 5,
+	PLAYHASH_PUSHABLE_CRATES = 6,
+	PLAYHASH_SEQUENCE = 7,
+	PLAYHASH_SCORE = 8,
+	PLAYHASH_TIME = 9,
+	NUM_PLAYHASH_PARTS = 10,
+};
+
 
 
 //==========================================================================
@@ -627,6 +841,45 @@ typedef struct {
 
 
 
+//==========================================================================
+// Structs: graphics
+//
+
+//Quad drawn from the image containing the game's graphics, in screen
+//coordinates and normalized texture coordinates, with u0 greater than u1 if
+//flipped horizontally and v0 greater than v1 if flipped vertically
+typedef struct {
+	float left, top, right, bottom;
+	float u0, v0, u1, v1;
+	unsigned char alpha;
+} SpriteQuad;
+
+//Block of text in the text cache, found by its contents, color, and position
+//on the screen, along with the size of the area drawn on (as the glyphs
+//outside of it are left out), and whose glyphs are stored as quads ready to be
+//copied to the sprite batch
+typedef struct {
+	uint32_t hash;
+	int len;
+	int color;
+	int x, y;
+	int max_x, max_y;
+	int text_start; //Position of a copy of the text in the character pool
+	int first_glyph;
+	int num_glyphs;
+} TextCacheEntry;
+
+//Sprite in the render queue, of which only the region given by sx, sy, sw, and
+//sh (relative to the sprite's top-left corner) is drawn if sw is not NONE
+typedef struct {
+	int spr;
+	int x, y;
+	int frame;
+	int sx, sy, sw, sh;
+} RenderItem;
+
+
+
 //==========================================================================
 // Structs: input
 //
@@ -647,6 +900,23 @@ typedef struct {
 
 
 
+//==========================================================================
+// Structs: config and level file reading
+//
+
+//Line-by-line reader of a config or level file
+typedef struct {
+	char* data;
+	bool owns_data; //False if the text was given by the caller
+	int offset;
+	int num_lines_read;
+	int max_lines; //Zero for no limit
+	bool data_ended;
+	bool invalid;
+} LineReader;
+
+
+
 //==========================================================================
 // Structs: menu
 //
@@ -704,15 +974,15 @@ typedef struct {
 //
 
 typedef struct {
-	float x, y;
-	float xvel, yvel;
-	float xdest;
-	float xmin;
-	float xmax;
+	PlayNum x, y;
+	PlayNum xvel, yvel;
+	PlayNum xdest;
+	PlayNum xmin;
+	PlayNum xmax;
 
 	bool follow_player;
-	float follow_player_min_x;
-	float follow_player_max_x;
+	PlayNum follow_player_min_x;
+	PlayNum follow_player_max_x;
 
 	bool fixed_at_leftmost;
 	bool fixed_at_rightmost;
@@ -724,24 +994,24 @@ typedef struct {
 	bool on_floor;
 	bool fell; //Fell into a deep hole
 	int height;
-	float flicker_delay;
+	PlayNum flicker_delay;
 	int anim_type; //Animation type
 
-	float x, y; //Position
-	float xvel, yvel; //Velocity
-	float acc; //Acceleration
-	float dec; //Deceleration
-	float grav; //Gravity
+	PlayNum x, y; //Position
+	PlayNum xvel, yvel; //Velocity
+	PlayNum acc; //Acceleration
+	PlayNum dec; //Deceleration
+	PlayNum grav; //Gravity
 
 	int old_state;
-	float oldx, oldy;
+	PlayNum oldx, oldy;
 	int old_anim_type;
 } Player;
 
 typedef struct {
-	float x; //Position
-	float xvel; //Velocity
-	float acc; //Acceleration
+	PlayNum x; //Position
+	PlayNum xvel; //Velocity
+	PlayNum acc; //Acceleration
 
 	int route_sign;
 	int num_characters; //Number of characters at the rear door
@@ -750,6 +1020,11 @@ typedef struct {
 typedef struct {
 	int type; //LVLCOL_* constants
 	int num_crates; //Number of stacked unpushable crates
+
+	//Solids overlapping the level column, as indices within the solids[] array
+	//of the gameplay context in ascending order
+	int num_solids;
+	uint16_t solids[MAX_COLUMN_SOLIDS];
 } LevelColumn;
 
 //Struct used for most game objects, which need only a type and a position
@@ -758,47 +1033,62 @@ typedef struct {
 	int x, y;
 } Obj;
 
+//Links of an object within one of the object lists (OBJLIST_* constants),
+//which are doubly linked lists through PlayCtx.objs[]
+typedef struct {
+	int list; //OBJLIST_* constants or NONE if not in a list
+	int prev, next; //Indices within PlayCtx.objs[] or NONE
+} ObjListNode;
+
+typedef struct {
+	int first, last; //Indices within PlayCtx.objs[] or NONE if empty
+
+	//Object close to the player character from which searches start, so they
+	//take constant time as the player character moves through the level
+	int cursor;
+} ObjList;
+
 typedef struct {
 	int obj; //Index of the gush within PlayCtx.objs[]
-	float y;
-	float yvel;
-	float ydest; //Destination Y position
-	const int* move_pattern;
+	PlayNum y;
+	PlayNum yvel;
+	PlayNum ydest; //Destination Y position
+	int move_pattern; //GUSH_MOVE_PATTERN_*
 	int move_pattern_pos;
 } Gush;
 
 //Rope grabbed by the player character
 typedef struct {
 	int obj; //Index of the rope within PlayCtx.objs[]
-	float x;
-	float xmin, xmax;
-	float xvel;
+	PlayNum x;
+	PlayNum xmin, xmax;
+	PlayNum xvel;
 } GrabbedRope;
 
 //Moving banana peel
 typedef struct {
 	int obj; //Index of the peel within PlayCtx.objs[]
-	float x, y;
-	float xvel, yvel;
-	float grav;
-	float xdest, ydest; //Destination position
+	PlayNum x, y;
+	PlayNum xvel, yvel;
+	PlayNum grav;
+	PlayNum xdest, ydest; //Destination position
 } MovingPeel;
 
 typedef struct {
 	int obj; //Index of the crate within PlayCtx.objs[]
-	float x;
+	PlayNum x;
 	bool show_arrow;
 	bool pushed;
-	float xmax;
+	PlayNum xmax;
 	int solid; //Index within PlayCtx.solids[]
 } PushableCrate;
 
 typedef struct {
 	int sprite;
-	float x, y;
-	float xvel, yvel;
-	float acc;
-	float grav;
+	PlayNum x, y;
+	PlayNum xvel, yvel;
+	PlayNum acc;
+	PlayNum grav;
 	bool in_bus;
 } CutsceneObject;
 
@@ -826,20 +1116,36 @@ typedef struct {
 	int what; //CAR_BLUE, CAR_SILVER, CAR_YELLOW, or TRIGGER_HEN
 } Trigger;
 
+//Block of memory from which the level-dependent arrays of a gameplay context
+//are taken, which is kept and reused by later levels if large enough
+typedef struct {
+	char* data;
+	size_t size; //Number of bytes in use
+	size_t capacity; //Number of bytes allocated
+} PlayArena;
+
+//Range of elements of an array in ascending order of X position that are
+//within the active window (the camera's view plus ACTIVE_WINDOW_MARGIN on each
+//side), whose bounds are advanced as the camera moves
+typedef struct {
+	int first;
+	int end; //One past the last element
+} ActiveRange;
+
 //Either a single car that appears when triggered and throws a banana peel or
 //the traffic jam of the ending sequence, but not used for parked cars
 typedef struct {
-	float x;
-	float xvel;
+	PlayNum x;
+	PlayNum xvel;
 	int type; //CAR_BLUE, CAR_SILVER, CAR_YELLOW, or TRAFFIC_JAM
 	bool threw_peel;
 	int peel_throw_x; //Throw a banana peel when the car reaches this X position
 } Car;
 
 typedef struct {
-	float x;
-	float xvel;
-	float acc;
+	PlayNum x;
+	PlayNum xvel;
+	PlayNum acc;
 } Hen;
 
 typedef struct {
@@ -848,16 +1154,21 @@ typedef struct {
 } CoinSpark;
 
 typedef struct {
-	float x, y;
-	float xvel, yvel;
-	float grav;
+	int type; //PLAYEVT_*
+	int value;
+} PlayEvent;
+
+typedef struct {
+	PlayNum x, y;
+	PlayNum xvel, yvel;
+	PlayNum grav;
 } CrackParticle;
 
 //Arrow indicating that a crate is pushable
 typedef struct {
-	float xoffs;
-	float xvel;
-	float delay;
+	PlayNum xoffs;
+	PlayNum xvel;
+	PlayNum delay;
 } PushArrow;
 
 //Animation
@@ -867,11 +1178,12 @@ typedef struct {
 	bool reverse;
 	int frame;
 	int num_frames;
-	float delay;
-	float max_delay;
+	PlayNum delay;
+	PlayNum max_delay;
 } Anim;
 
-//Gameplay context
+//Gameplay context, which holds the entire state of a play session, so more
+//than one session can exist at the same time
 typedef struct {
 	int difficulty;
 	int level_num;
@@ -884,7 +1196,7 @@ typedef struct {
 
 	int score;
 	int time;
-	float time_delay;
+	PlayNum time_delay;
 	bool time_running;
 	bool time_up;
 	bool goal_reached;
@@ -894,21 +1206,68 @@ typedef struct {
 	int bus_stop_sign_x;
 	int pole_x;
 
-	float crate_push_remaining;
+	PlayNum crate_push_remaining;
 
 	PlayCamera cam;
 	Player player;
 	Bus bus;
 
-	LevelColumn level_columns[MAX_LEVEL_COLUMNS];
-	Obj objs[MAX_OBJS];
-	Gush gushes[MAX_GUSHES];
+	//Storage for the arrays below whose sizes depend on the level, allocated
+	//as a single block when the level is loaded
+	PlayArena arena;
+
+	int num_level_columns;
+	LevelColumn* level_columns;
+
+	int max_objs; //Capacity of objs[] and the arrays indexed like it
+	Obj* objs;
+	ObjListNode* obj_nodes;
+	ObjList obj_lists[NUM_OBJLISTS];
+
+	//Indices within objs[] in ascending order of X position, and the position
+	//of each object within obj_order[] (NONE if not present)
+	int* obj_order;
+	int* obj_order_pos;
+	int num_ordered_objs;
+
+	//Room for a list of indices within objs[], used while updating
+	int* obj_scratch;
+
+	//Gushes from the level file come first in gushes[], in ascending order of
+	//X position, followed by the ones opened from gush cracks during play
+	int max_gushes;
+	int num_level_gushes;
+	Gush* gushes;
+
+	//Gushes from the level file all move in unison, so only this state is
+	//updated every tick and then copied to the ones within the active window
+	Gush gush_phase;
+
+	int num_solids;
+	int max_solids;
+	Solid* solids;
+
+	int num_triggers;
+	Trigger* triggers;
+
+	int num_respawn_points;
+	RespawnPoint* respawn_points;
+
+	//Parts of obj_order[], gushes[], and passageways[] within the active window
+	ActiveRange active_objs;
+	ActiveRange active_gushes;
+	ActiveRange active_passageways;
+
+	//Index within triggers[] of the next trigger to be reached and index
+	//within respawn_points[] of the last respawn point found to be behind the
+	//player character (or NONE), both of which are in ascending order of X
+	//position
+	int next_trigger;
+	int respawn_point;
+
 	MovingPeel moving_peels[MAX_MOVING_PEELS];
 	Passageway passageways[MAX_PASSAGEWAYS];
 	PushableCrate pushable_crates[MAX_PUSHABLE_CRATES];
-	RespawnPoint respawn_points[MAX_RESPAWN_POINTS];
-	Solid solids[MAX_SOLIDS];
-	Trigger triggers[MAX_TRIGGERS];
 	CutsceneObject cutscene_objects[MAX_CUTSCENE_OBJECTS];
 
 	GrabbedRope grabbed_rope;
@@ -941,12 +1300,217 @@ typedef struct {
 
 	//Sequence
 	int sequence_step;
-	float sequence_delay;
+	PlayNum sequence_delay;
 	bool skip_initial_sequence;
 	bool wipe_in;
 	bool wipe_out;
+
+	//Events not yet taken by play_take_event(), in a ring buffer in which the
+	//oldest events are overwritten when full
+	PlayEvent events[MAX_PLAY_EVENTS];
+	int first_event;
+	int num_events;
+
+	//Time elapsed since the previous update
+	float delta_time;
+#ifdef PLAY_FIXED_POINT
+	int64_t delta_frac; //delta_time in units of 2^-32 seconds
+#endif
+
+	//Player's input
+	bool ignore_user_input;
+	bool input_left,  old_input_left;
+	bool input_right, old_input_right;
+	bool input_jump,  old_input_jump;
+	PlayNum jump_timeout;
 } PlayCtx;
 
+//Hashes of the parts of the gameplay state (PLAYHASH_* constants)
+typedef struct {
+	uint32_t parts[NUM_PLAYHASH_PARTS];
+} StateHash;
+
+//Beginning of a snapshot taken by play_snapshot(), which is followed by a copy
+//of the gameplay context (with its pointers set to NULL) and by the contents of
+//its arena
+//
+//Pointers are stored as offsets within the arena, so the snapshot can be
+//restored at any address and written to a file, but only read back by a build
+//of the game with the same PlayCtx layout
+typedef struct {
+	char magic[4];
+	uint32_t ctx_size; //sizeof(PlayCtx)
+	uint64_t arena_size;
+
+	//Offsets of the level-dependent arrays within the arena (UINT64_MAX for a
+	//NULL pointer)
+	uint64_t offsets[MAX_SNAPSHOT_ARRAYS];
+} PlaySnapshotHeader;
+
+
+
+//Level loading state, used only while a level file is being read
+typedef struct {
+	PlayCtx* ctx;
+	bool invalid;
+
+	int x_max;
+	int num_objs;
+	int num_crate_blocks;
+	int num_gushes, num_gush_cracks;
+	int num_solids;
+	int num_deep_holes, num_passageways;
+	int num_respawn_points;
+	int num_triggers, num_car_triggers;
+
+	//Numbers of elements counted before reading the level file, used to
+	//allocate the storage of the gameplay context
+	int count_level_size;
+	int count_objs;
+	int count_gushes;
+	int count_solids;
+	int count_triggers;
+	int count_respawn_points;
+} LevelLoader;
+
+
+
+//==========================================================================
+// Structs: replay
+//
+
+//Sequence of ticks with the same input state
+typedef struct {
+	long num_ticks;
+	int input;
+} ReplayRun;
+
+//Input recorded during a level, along with what is needed to start the level
+//in the same way when playing it back
+typedef struct {
+	char build[32]; //Value of REPLAY_BUILD in the build that recorded the replay
+	char level[32]; //Level filename
+	int difficulty;
+	int level_num;
+	bool skip_initial_sequence;
+	int vscreen_width; //Affects the camera, which affects the gameplay
+	int initial_score;
+	int final_score;
+	long num_ticks;
+
+	ReplayRun* runs;
+	int num_runs;
+	int capacity;
+
+	//Hash of the gameplay state after every hash_interval ticks (or none if
+	//zero), which allows finding where a playback diverged
+	int hash_interval;
+	StateHash* hashes;
+	int num_hashes;
+	int hash_capacity;
+} Replay;
+
+
+
+//==========================================================================
+// Structs: headless simulation
+//
+
+//Sequence of ticks with the same input state (combination of INPUT_LEFT,
+//INPUT_RIGHT, and INPUT_JUMP), as read from an input script
+typedef struct {
+	int num_ticks;
+	int input;
+} SimInputRun;
+
+typedef struct {
+	SimInputRun* runs;
+	int num_runs;
+} SimScript;
+
+//Outcome of simulating a level
+typedef struct {
+	long ticks;
+	int score;
+	int time;
+	bool goal_reached;
+	bool time_up;
+	bool finished;
+	int coins_collected;
+	int falls;
+	uint32_t hash; //Hash of the final state
+} SimResult;
+
+//Benchmark results of a level
+typedef struct {
+	char level[16]; //Filename
+	long ticks;
+	double ns_per_tick; //Mean
+	double p50_ns, p99_ns; //Percentiles of the time taken by a tick
+	double loads_per_sec;
+} BenchResult;
+
+//Job of the batch mode (a level and an input script to run it with)
+typedef struct {
+	int level; //Index within the list of distinct levels in the manifest
+	const char* script_path;
+	bool script_invalid;
+	bool out_of_memory;
+	SimResult result;
+} BatchJob;
+
+//Batch mode worker thread
+typedef struct {
+	//Range of indices of the jobs the worker has yet to run, with the first
+	//index in the lower 32 bits and the end (exclusive) in the upper 32 bits,
+	//so both can be updated together atomically, as other workers may steal
+	//jobs from the end
+	uint64_t jobs;
+
+	//Keep other fields away from the cache line containing the range
+	char padding[56];
+
+	int index;
+	int num_jobs_run;
+	long num_ticks;
+	double elapsed_ms;
+	PlayCtx ctx;
+} BatchWorker;
+
+
+
+//==========================================================================
+// Structs: performance overlay
+//
+
+//Statistics shown by the performance overlay, in microseconds, over the last
+//num_frames frames (at most PERF_NUM_FRAMES)
+typedef struct {
+	int num_frames;
+	int frame_min, frame_avg, frame_p99;
+	int phase_avg[NUM_PERF_PHASES];
+	int other_avg; //Time not taken by any of the phases
+
+	//Time taken by each frame, from the oldest to the newest
+	int frames[PERF_NUM_FRAMES];
+} PerfStats;
+
+//Event recorded by --trace, with the times in seconds
+typedef struct {
+	double start;
+	double end;
+	short id; //Phase (PERF_*) or zone (PERFZONE_*)
+	bool is_zone;
+} PerfTraceEvent;
+
+//Ring buffer of events recorded by --trace, each written by a single thread
+typedef struct {
+	PerfTraceEvent* events;
+	int capacity;
+	int next;
+	int count;
+} PerfTraceRing;
+
 
 
 //==========================================================================
@@ -955,5 +1519,28 @@ typedef struct {
 
 #define ARRAY_LENGTH(arr) (sizeof(arr) / sizeof(arr[0]))
 
+//Timing of the phases of a frame for the performance overlay and --trace,
+//which are only included if PERF_OVERLAY or PERF_TRACE (respectively) is
+//defined at build time and otherwise expand to nothing
+//
+//PERF_MARK(): starts timing from the current moment
+//PERF_LAP(): adds the time since the last mark or lap to a phase (PERF_*)
+//PERF_BEGIN(), PERF_END(): delimit a zone (PERFZONE_*), for --trace only
+#if defined(PERF_OVERLAY) || defined(PERF_TRACE)
+#define PERF_MARK() perf_mark()
+#define PERF_LAP(phase) perf_lap(phase)
+#else
+#define PERF_MARK()
+#define PERF_LAP(phase)
+#endif
+
+#ifdef PERF_TRACE
+#define PERF_BEGIN(zone) perf_begin(zone)
+#define PERF_END(zone) perf_end(zone)
+#else
+#define PERF_BEGIN(zone)
+#define PERF_END(zone)
+#endif
+
 #endif //ALEXVSBUS_DEFS_H
 
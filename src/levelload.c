@@ -35,85 +35,240 @@
 //------------------------------------------------------------------------------
 
 //From lineread.c
-bool lineread_open(const char* path);
-bool lineread_invalid();
-bool lineread_ended();
-void lineread_getline(char* dst);
+void lineread_open_text(LineReader* lr, const char* text);
+void lineread_close(LineReader* lr);
+bool lineread_invalid(LineReader* lr);
+bool lineread_ended(LineReader* lr);
+void lineread_getline(LineReader* lr, char* dst);
 int lineread_num_tokens(const char* str);
 int lineread_token_int(const char* str, int token);
 
+//From play.c
+bool play_alloc_level(PlayCtx* ctx, int num_level_columns, int max_objs,
+	int max_gushes, int max_solids, int num_triggers, int num_respawn_points);
+bool play_index_solid(PlayCtx* ctx, int solid);
+void play_set_obj_list(PlayCtx* ctx, int obj, int list);
+
 //From util.c
 bool str_starts_with(const char* str, const char* start);
 int get_file_size(const char* path);
+char* load_file_text(const char* path);
+void unload_file_text(char* text);
 
 //From data.c
-extern const int data_gush_move_pattern_1[];
+extern const int* const data_gush_move_patterns[];
 
 //------------------------------------------------------------------------------
 
-static PlayCtx* ctx;
+//Function prototypes
+static int count_level(LevelLoader* ld, LineReader* lr);
+static int alloc_level(LevelLoader* ld);
+static int read_level(LevelLoader* ld, LineReader* lr);
+static void add_obj(LevelLoader* ld, int type, int x, int y, bool use_y);
+static void add_crate_block(LevelLoader* ld, int x, int w, int h);
+static void add_deep_hole(LevelLoader* ld, int x, int w);
+static void add_passageway(LevelLoader* ld, int x, int y);
+static void add_respawn_point(LevelLoader* ld, int x, int y);
+static void add_trigger(LevelLoader* ld, int x, int what);
+static void validate_positions(LevelLoader* ld);
+static void convert_positions(LevelLoader* ld);
+static int add_solid(LevelLoader* ld, int type, int x, int y, int width, int height);
+static void add_solids(LevelLoader* ld);
+static void index_solids(LevelLoader* ld);
+static void index_objs(LevelLoader* ld);
+static void sort_objs(LevelLoader* ld);
 
-static bool invalid;
+//------------------------------------------------------------------------------
 
-static int x_max;
-static int num_objs;
-static int num_crate_blocks;
-static int num_gushes, num_gush_cracks;
-static int num_solids;
-static int num_deep_holes, num_passageways;
-static int num_respawn_points;
-static int num_triggers, num_car_triggers;
+//Loads a level from the contents of a level file already in memory (as a
+//null-terminated string) into a gameplay context, which should have been
+//cleared by play_clear()
+int levelload_load_text(PlayCtx* ctx, const char* text)
+{
+	LevelLoader loader;
+	LevelLoader* ld = &loader;
+	LineReader lr;
+	int err;
 
-//------------------------------------------------------------------------------
+	ld->ctx = ctx;
+	ld->invalid = false;
 
-//Function prototypes
-static void add_obj(int type, int x, int y, bool use_y);
-static void add_crate_block(int x, int w, int h);
-static void add_deep_hole(int x, int w);
-static void add_passageway(int x, int y);
-static void add_respawn_point(int x, int y);
-static void add_trigger(int x, int what);
-static void validate_positions();
-static void convert_positions();
-static int add_solid(int type, int x, int y, int width, int height);
-static void add_solids();
+	if (strlen(text) > MAX_LEVEL_FILE_SIZE) {
+		return LVLERR_TOO_LARGE;
+	}
 
-//------------------------------------------------------------------------------
+	//The text is read twice: first to count the elements of the level, so
+	//the storage of the gameplay context can be allocated at once, and then
+	//to actually load them
+	lineread_open_text(&lr, text);
+	lr.max_lines = 0;
+	err = count_level(ld, &lr);
+	lineread_close(&lr);
 
-void levelload_init(PlayCtx* pctx)
+	if (err != LVLERR_NONE) {
+		return err;
+	}
+
+	err = alloc_level(ld);
+	if (err != LVLERR_NONE) {
+		return err;
+	}
+
+	lineread_open_text(&lr, text);
+	lr.max_lines = 0;
+	err = read_level(ld, &lr);
+	lineread_close(&lr);
+
+	return err;
+}
+
+//Loads a level file into a gameplay context, which should have been cleared by
+//play_clear()
+int levelload_load(PlayCtx* ctx, const char* filename)
 {
-	ctx = pctx;
+	char* text;
+	int err;
+
+	if (get_file_size(filename) > MAX_LEVEL_FILE_SIZE) {
+		return LVLERR_TOO_LARGE;
+	}
+
+	text = load_file_text(filename);
+	if (text == NULL) {
+		return LVLERR_CANNOT_OPEN;
+	}
+
+	err = levelload_load_text(ctx, text);
+	unload_file_text(text);
+
+	return err;
 }
 
-int levelload_load(const char* filename)
+//------------------------------------------------------------------------------
+
+//Counts the elements of a level file, without validating anything other than
+//the level size, which read_level() does afterwards
+static int count_level(LevelLoader* ld, LineReader* lr)
 {
 	char tmp[48];
-	bool no_objects = true;
-	int x;
-	int i;
 
-	invalid = false;
+	ld->count_level_size = NONE;
+	ld->count_objs = 0;
+	ld->count_gushes = 0;
+	ld->count_triggers = 0;
+	ld->count_respawn_points = 0;
+
+	//First floor solid
+	ld->count_solids = 1;
+
+	while (!lineread_ended(lr)) {
+		lineread_getline(lr, tmp);
 
-	//The maximum allowed file size is 4 kB
-	if (get_file_size(filename) > 4096) {
+		if (lineread_invalid(lr)) {
+			return LVLERR_INVALID;
+		}
+
+		if (str_starts_with(tmp, "level-size ")) {
+			int size = lineread_token_int(tmp, 1);
+
+			//Error: size out of the allowed range
+			if (size < 8 || size > MAX_LEVEL_SIZE) {
+				return LVLERR_INVALID;
+			}
+
+			ld->count_level_size = size;
+		} else if (str_starts_with(tmp, "car-")) {
+			ld->count_objs++;
+			ld->count_solids += 7;
+		} else if (str_starts_with(tmp, "truck ")) {
+			ld->count_objs++;
+			ld->count_solids += 2;
+		} else if (str_starts_with(tmp, "hydrant ") ||
+				str_starts_with(tmp, "overhead-sign ")) {
+			ld->count_objs++;
+			ld->count_solids++;
+		} else if (str_starts_with(tmp, "gush")) {
+			//Both "gush" and "gush-crack"
+			ld->count_objs++;
+			ld->count_gushes++;
+		} else if (str_starts_with(tmp, "rope ")) {
+			ld->count_objs += 2;
+		} else if (str_starts_with(tmp, "passageway")) {
+			//Spring and pushable crate, plus the floor solid to the right,
+			//four passageway solids, and the pushable crate's solid
+			ld->count_objs += 2;
+			ld->count_solids += 6;
+		} else if (str_starts_with(tmp, "crates ")) {
+			ld->count_solids++;
+		} else if (str_starts_with(tmp, "deep-hole ")) {
+			//Floor solid to the right
+			ld->count_solids++;
+		} else if (str_starts_with(tmp, "trigger-")) {
+			ld->count_triggers++;
+
+			//Banana peel thrown by a triggered car
+			if (!str_starts_with(tmp, "trigger-hen ")) {
+				ld->count_objs++;
+			}
+		} else if (str_starts_with(tmp, "respawn-point ")) {
+			ld->count_respawn_points++;
+		} else if (tmp[0] != '\0' && !str_starts_with(tmp, "sky-color ") &&
+				!str_starts_with(tmp, "bgm ") &&
+				!str_starts_with(tmp, "goal-scene ")) {
+
+			//Any other object
+			ld->count_objs++;
+		}
+	}
+
+	//Error: level size not defined
+	if (ld->count_level_size == NONE) {
+		return LVLERR_INVALID;
+	}
+
+	return LVLERR_NONE;
+}
+
+//Allocates the storage of the gameplay context for the elements counted by
+//count_level()
+static int alloc_level(LevelLoader* ld)
+{
+	int num_level_columns = ld->count_level_size * VSCREEN_MAX_WIDTH_LEVEL_BLOCKS;
+
+	//Solids are referred to by 16-bit indices in the level columns
+	if (ld->count_solids > UINT16_MAX) {
 		return LVLERR_TOO_LARGE;
 	}
 
-	if (!lineread_open(filename)) {
-		return LVLERR_CANNOT_OPEN;
+	if (!play_alloc_level(ld->ctx, num_level_columns, ld->count_objs,
+			ld->count_gushes, ld->count_solids, ld->count_triggers,
+			ld->count_respawn_points)) {
+
+		return LVLERR_TOO_LARGE;
 	}
 
-	x_max = NONE;
-	num_objs = 0;
-	num_crate_blocks = 0;
-	num_gushes = 0;
-	num_gush_cracks = 0;
-	num_solids = 0;
-	num_deep_holes = 0;
-	num_passageways = 0;
-	num_respawn_points = 0;
-	num_triggers = 0;
-	num_car_triggers = 0;
+	return LVLERR_NONE;
+}
+
+static int read_level(LevelLoader* ld, LineReader* lr)
+{
+	PlayCtx* ctx = ld->ctx;
+	char tmp[48];
+	bool no_objects = true;
+	int x;
+	int i;
+
+	ld->x_max = NONE;
+	ld->num_objs = 0;
+	ld->num_crate_blocks = 0;
+	ld->num_gushes = 0;
+	ld->num_gush_cracks = 0;
+	ld->num_solids = 0;
+	ld->num_deep_holes = 0;
+	ld->num_passageways = 0;
+	ld->num_respawn_points = 0;
+	ld->num_triggers = 0;
+	ld->num_car_triggers = 0;
 
 	ctx->level_size = NONE;
 	ctx->bg_color = NONE;
@@ -123,13 +278,13 @@ int levelload_load(const char* filename)
 	x = VSCREEN_MAX_WIDTH_LEVEL_BLOCKS;
 
 	//Read file
-	while (!lineread_ended()) {
+	while (!lineread_ended(lr)) {
 		int num_tokens;
 		int token1, token2, token3;
 
-		lineread_getline(tmp);
+		lineread_getline(lr, tmp);
 
-		if (lineread_invalid()) {
+		if (lineread_invalid(lr)) {
 			return LVLERR_INVALID;
 		}
 
@@ -158,12 +313,12 @@ int levelload_load(const char* filename)
 			}
 
 			//Error: size out of the allowed range
-			if (token1 < 8 || token1 > 24) {
+			if (token1 < 8 || token1 > MAX_LEVEL_SIZE) {
 				return LVLERR_INVALID;
 			}
 
 			//Just before the last screen
-			x_max = (token1 - 1) * VSCREEN_MAX_WIDTH_LEVEL_BLOCKS;
+			ld->x_max = (token1 - 1) * VSCREEN_MAX_WIDTH_LEVEL_BLOCKS;
 
 			ctx->level_size = token1 * VSCREEN_MAX_WIDTH;
 
@@ -224,87 +379,83 @@ int levelload_load(const char* filename)
 		x += token1;
 
 		if (str_starts_with(tmp, "banana-peel ")) {
-			add_obj(OBJ_BANANA_PEEL, x, token2, true);
+			add_obj(ld, OBJ_BANANA_PEEL, x, token2, true);
 		} else if (str_starts_with(tmp, "car-blue ")) {
-			add_obj(OBJ_PARKED_CAR_BLUE, x, NONE, false);
+			add_obj(ld, OBJ_PARKED_CAR_BLUE, x, NONE, false);
 		} else if (str_starts_with(tmp, "car-silver ")) {
-			add_obj(OBJ_PARKED_CAR_SILVER, x, NONE, false);
+			add_obj(ld, OBJ_PARKED_CAR_SILVER, x, NONE, false);
 		} else if (str_starts_with(tmp, "car-yellow ")) {
-			add_obj(OBJ_PARKED_CAR_YELLOW, x, NONE, false);
+			add_obj(ld, OBJ_PARKED_CAR_YELLOW, x, NONE, false);
 		} else if (str_starts_with(tmp, "coin-silver ")) {
-			add_obj(OBJ_COIN_SILVER, x, token2, true);
+			add_obj(ld, OBJ_COIN_SILVER, x, token2, true);
 		} else if (str_starts_with(tmp, "coin-gold ")) {
-			add_obj(OBJ_COIN_GOLD, x, token2, true);
+			add_obj(ld, OBJ_COIN_GOLD, x, token2, true);
 		} else if (str_starts_with(tmp, "crates ")) {
-			add_crate_block(x, token2, token3);
+			add_crate_block(ld, x, token2, token3);
 		} else if (str_starts_with(tmp, "gush ")) {
-			add_obj(OBJ_GUSH, x, NONE, false);
-
-			if (num_gushes >= MAX_GUSHES) {
-				return LVLERR_INVALID;
-			}
+			add_obj(ld, OBJ_GUSH, x, NONE, false);
 
-			ctx->gushes[num_gushes].obj = num_objs - 1;
-			ctx->gushes[num_gushes].y = GUSH_INITIAL_Y;
-			ctx->gushes[num_gushes].move_pattern = data_gush_move_pattern_1;
-			ctx->gushes[num_gushes].move_pattern_pos = 0;
-			ctx->gushes[num_gushes].yvel = data_gush_move_pattern_1[0];
-			ctx->gushes[num_gushes].ydest = data_gush_move_pattern_1[1];
+			ctx->gushes[ld->num_gushes].obj = ld->num_objs - 1;
+			ctx->gushes[ld->num_gushes].y = PN(GUSH_INITIAL_Y);
+			ctx->gushes[ld->num_gushes].move_pattern = GUSH_MOVE_PATTERN_1;
+			ctx->gushes[ld->num_gushes].move_pattern_pos = 0;
+			ctx->gushes[ld->num_gushes].yvel = PN(data_gush_move_patterns[GUSH_MOVE_PATTERN_1][0]);
+			ctx->gushes[ld->num_gushes].ydest = PN(data_gush_move_patterns[GUSH_MOVE_PATTERN_1][1]);
 
-			num_gushes++;
+			ld->num_gushes++;
 		} else if (str_starts_with(tmp, "gush-crack ")) {
-			add_obj(OBJ_GUSH_CRACK, x, NONE, false);
+			add_obj(ld, OBJ_GUSH_CRACK, x, NONE, false);
 		} else if (str_starts_with(tmp, "hydrant ")) {
-			add_obj(OBJ_HYDRANT, x, NONE, false);
+			add_obj(ld, OBJ_HYDRANT, x, NONE, false);
 		} else if (str_starts_with(tmp, "overhead-sign ")) {
-			add_obj(OBJ_OVERHEAD_SIGN, x, token2, true);
+			add_obj(ld, OBJ_OVERHEAD_SIGN, x, token2, true);
 		} else if (str_starts_with(tmp, "rope ")) {
-			add_obj(OBJ_ROPE_HORIZONTAL, x, NONE, false);
-			add_obj(OBJ_ROPE_VERTICAL, x, NONE, false);
+			add_obj(ld, OBJ_ROPE_HORIZONTAL, x, NONE, false);
+			add_obj(ld, OBJ_ROPE_VERTICAL, x, NONE, false);
 		} else if (str_starts_with(tmp, "spring ")) {
 			//10 is the Y position corresponding to the floor
-			add_obj(OBJ_SPRING, x, 10, true);
+			add_obj(ld, OBJ_SPRING, x, 10, true);
 		} else if (str_starts_with(tmp, "truck ")) {
-			add_obj(OBJ_PARKED_TRUCK, x, NONE, false);
+			add_obj(ld, OBJ_PARKED_TRUCK, x, NONE, false);
 		} else if (str_starts_with(tmp, "trigger-car-blue ")) {
-			add_trigger(x, CAR_BLUE);
+			add_trigger(ld, x, CAR_BLUE);
 		} else if (str_starts_with(tmp, "trigger-car-silver ")) {
-			add_trigger(x, CAR_SILVER);
+			add_trigger(ld, x, CAR_SILVER);
 		} else if (str_starts_with(tmp, "trigger-car-yellow ")) {
-			add_trigger(x, CAR_YELLOW);
+			add_trigger(ld, x, CAR_YELLOW);
 		} else if (str_starts_with(tmp, "trigger-hen ")) {
-			add_trigger(x, TRIGGER_HEN);
+			add_trigger(ld, x, TRIGGER_HEN);
 		} else if (str_starts_with(tmp, "respawn-point ")) {
-			add_respawn_point(x, token2);
+			add_respawn_point(ld, x, token2);
 		} else if (str_starts_with(tmp, "deep-hole ")) {
-			add_deep_hole(x, token2);
+			add_deep_hole(ld, x, token2);
 		} else if (str_starts_with(tmp, "passageway ")) {
-			add_passageway(x, token2);
+			add_passageway(ld, x, token2);
 
 			//Spring under passageway exit (14 is the Y position corresponding
 			//to a passageway bottom)
-			add_obj(OBJ_SPRING, x + token2 - 1, 14, true);
+			add_obj(ld, OBJ_SPRING, x + token2 - 1, 14, true);
 
 			//Pushable crate over passageway entry
-			add_obj(OBJ_CRATE_PUSHABLE, x, NONE, false);
-			ctx->pushable_crates[num_passageways - 1].obj = num_objs - 1;
+			add_obj(ld, OBJ_CRATE_PUSHABLE, x, NONE, false);
+			ctx->pushable_crates[ld->num_passageways - 1].obj = ld->num_objs - 1;
 		} else if (str_starts_with(tmp, "passageway-arrow ")) {
-			add_passageway(x, token2);
+			add_passageway(ld, x, token2);
 
 			//Spring under passageway exit (14 is the Y position corresponding
 			//to a passageway bottom)
-			add_obj(OBJ_SPRING, x + token2 - 1, 14, true);
+			add_obj(ld, OBJ_SPRING, x + token2 - 1, 14, true);
 
 			//Pushable crate over passageway entry
-			add_obj(OBJ_CRATE_PUSHABLE, x, NONE, false);
-			ctx->pushable_crates[num_passageways - 1].obj = num_objs - 1;
-			ctx->pushable_crates[num_passageways - 1].show_arrow = true;
+			add_obj(ld, OBJ_CRATE_PUSHABLE, x, NONE, false);
+			ctx->pushable_crates[ld->num_passageways - 1].obj = ld->num_objs - 1;
+			ctx->pushable_crates[ld->num_passageways - 1].show_arrow = true;
 		} else {
 			//Error: invalid object type
 			return LVLERR_INVALID;
 		}
 
-		if (invalid) {
+		if (ld->invalid) {
 			return LVLERR_INVALID;
 		}
 
@@ -316,25 +467,18 @@ int levelload_load(const char* filename)
 		return LVLERR_INVALID;
 	}
 
-	//Error: running out of gushes due to gush cracks
-	if (num_gushes + num_gush_cracks > MAX_GUSHES) {
-		return LVLERR_INVALID;
-	}
-
-	//Error: running out of positions in ctx->objs[] due to banana peels
-	//thrown by triggered cars
-	if (num_objs + num_car_triggers > MAX_OBJS) {
-		return LVLERR_INVALID;
-	}
+	ctx->num_level_gushes = ld->num_gushes;
+	ctx->num_triggers = ld->num_triggers;
+	ctx->num_respawn_points = ld->num_respawn_points;
 
 	//Error: the number of respawn points is not the same as the number of
 	//deep holes
-	if (num_respawn_points != num_deep_holes) {
+	if (ld->num_respawn_points != ld->num_deep_holes) {
 		return LVLERR_INVALID;
 	}
 
 	//Ensure there are no unpushable crates on deep holes or passageway edges
-	for (i = 0; i < MAX_LEVEL_COLUMNS; i++) {
+	for (i = 0; i < ctx->num_level_columns; i++) {
 		int type = ctx->level_columns[i].type;
 		int num_crates = ctx->level_columns[i].num_crates;
 
@@ -345,26 +489,30 @@ int levelload_load(const char* filename)
 		}
 	}
 
-	validate_positions();
-	convert_positions();
+	validate_positions(ld);
+	convert_positions(ld);
 
-	if (invalid) {
+	if (ld->invalid) {
 		return LVLERR_INVALID;
 	}
 
 	//Set properties for ctx->pushable_crates[] (there is exactly one pushable
 	//crate for each passageway)
-	for (i = 0; i < num_passageways; i++) {
+	for (i = 0; i < ld->num_passageways; i++) {
 		int obj = ctx->pushable_crates[i].obj;
 
 		x = ctx->objs[obj].x;
-		ctx->pushable_crates[i].x = x;
-		ctx->pushable_crates[i].xmax = x + LEVEL_BLOCK_SIZE;
+		ctx->pushable_crates[i].x = PN(x);
+		ctx->pushable_crates[i].xmax = PN(x + LEVEL_BLOCK_SIZE);
 	}
 
-	add_solids();
+	add_solids(ld);
+	ctx->num_solids = ld->num_solids;
+	index_solids(ld);
+	index_objs(ld);
+	sort_objs(ld);
 
-	if (invalid) {
+	if (ld->invalid) {
 		return LVLERR_INVALID;
 	}
 
@@ -373,88 +521,84 @@ int levelload_load(const char* filename)
 
 //------------------------------------------------------------------------------
 
-static void add_obj(int type, int x, int y, bool use_y)
+static void add_obj(LevelLoader* ld, int type, int x, int y, bool use_y)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if there are too many objects
-	if (num_objs >= MAX_OBJS) {
-		invalid = true;
+	if (ld->num_objs >= ctx->max_objs) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check if the object's position is within the allowed range
-	if (y > 14 || (y != NONE && y < 2) || (use_y && y == NONE) || x > x_max) {
-		invalid = true;
+	if (y > 14 || (y != NONE && y < 2) || (use_y && y == NONE) || x > ld->x_max) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check object repetition
-	for (i = 0; i < num_objs; i++) {
+	for (i = 0; i < ld->num_objs; i++) {
 		Obj obj = ctx->objs[i];
 
 		if (obj.type == type && obj.x == x && obj.y == y) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 	}
 
-	ctx->objs[num_objs].type = type;
-	ctx->objs[num_objs].x = x;
-	ctx->objs[num_objs].y = y;
+	ctx->objs[ld->num_objs].type = type;
+	ctx->objs[ld->num_objs].x = x;
+	ctx->objs[ld->num_objs].y = y;
 
-	num_objs++;
+	ld->num_objs++;
 }
 
 //Add a block of unpushable crates
-static void add_crate_block(int x, int w, int h)
+static void add_crate_block(LevelLoader* ld, int x, int w, int h)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
-		return;
-	}
-
-	//Check if there are too many crate blocks
-	if (num_crate_blocks >= MAX_CRATE_BLOCKS) {
-		invalid = true;
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if the crate block's size is within the allowed range
 	if (w < 1 || w > 4 || h < 1 || h > 5) {
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
 	//Check if the crate block's position is within the allowed range
-	if (x > x_max - 4) {
-		invalid = true;
+	if (x > ld->x_max - 4) {
+		ld->invalid = true;
 		return;
 	}
 
-	if (x + w > x_max - 4) {
+	if (x + w > ld->x_max - 4) {
 		//Error: crate block width extends beyond or too close to level's
 		//right boundary
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
 	if (ctx->level_columns[x - 1].num_crates == h) {
 		//Error: the crate block is adjacent to another crate block with the
 		//same height
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
 	for (i = 0; i < w; i++) {
 		//Check repetition or overlap of crates
 		if (ctx->level_columns[x + i].num_crates != 0) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
@@ -462,33 +606,28 @@ static void add_crate_block(int x, int w, int h)
 		ctx->level_columns[x + i].num_crates = h;
 	}
 
-	num_crate_blocks++;
+	ld->num_crate_blocks++;
 }
 
-static void add_deep_hole(int x, int w)
+static void add_deep_hole(LevelLoader* ld, int x, int w)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
-		return;
-	}
-
-	//Check if there are too many deep holes
-	if (num_deep_holes >= MAX_DEEP_HOLES) {
-		invalid = true;
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if the hole's position and size are within the allowed range
-	if (x > x_max - 4 || w < 2 || w > 16) {
-		invalid = true;
+	if (x > ld->x_max - 4 || w < 2 || w > 16) {
+		ld->invalid = true;
 		return;
 	}
 
-	if (x + w > x_max - 2) {
+	if (x + w > ld->x_max - 2) {
 		//Error: hole width extends beyond or too close to level's right
 		//boundary
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
@@ -498,7 +637,7 @@ static void add_deep_hole(int x, int w)
 		//Check if the deep hole is being added to a level column that already
 		//has a deep hole or passageway
 		if (ctx->level_columns[x + i].type != LVLCOL_NORMAL_FLOOR) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
@@ -513,33 +652,34 @@ static void add_deep_hole(int x, int w)
 		ctx->level_columns[x + i].type = type;
 	}
 
-	num_deep_holes++;
+	ld->num_deep_holes++;
 }
 
-static void add_passageway(int x, int w)
+static void add_passageway(LevelLoader* ld, int x, int w)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if there are too many passageways
-	if (num_passageways >= MAX_PASSAGEWAYS) {
-		invalid = true;
+	if (ld->num_passageways >= MAX_PASSAGEWAYS) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check if the passageway's position and size are within the allowed range
-	if (x > x_max - 4 || w < 2 || w > 32) {
-		invalid = true;
+	if (x > ld->x_max - 4 || w < 2 || w > 32) {
+		ld->invalid = true;
 		return;
 	}
 
-	if (x + w > x_max - 2) {
+	if (x + w > ld->x_max - 2) {
 		//Error: passageway width extends beyond or too close to level's right
 		//boundary
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
@@ -551,7 +691,7 @@ static void add_passageway(int x, int w)
 		//Check if the passageway is being added to a level column that already
 		//has a deep hole or passageway
 		if (ctx->level_columns[x + i].type != LVLCOL_NORMAL_FLOOR) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
@@ -566,124 +706,127 @@ static void add_passageway(int x, int w)
 		ctx->level_columns[x + i].type = type;
 	}
 
-	ctx->passageways[num_passageways].x = x;
-	ctx->passageways[num_passageways].width = w;
-	ctx->passageways[num_passageways].exit_opened = false;
+	ctx->passageways[ld->num_passageways].x = x;
+	ctx->passageways[ld->num_passageways].width = w;
+	ctx->passageways[ld->num_passageways].exit_opened = false;
 
-	num_passageways++;
+	ld->num_passageways++;
 }
 
-static void add_respawn_point(int x, int y)
+static void add_respawn_point(LevelLoader* ld, int x, int y)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if there are too many respawn points
-	if (num_respawn_points >= MAX_RESPAWN_POINTS) {
-		invalid = true;
+	if (ld->num_respawn_points >= ctx->num_respawn_points) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check if the respawn point's position is within the allowed range
-	if (x > x_max || y < 3 || y > 15) {
-		invalid = true;
+	if (x > ld->x_max || y < 3 || y > 15) {
+		ld->invalid = true;
 		return;
 	}
 
 	//An X position cannot be shared by two or more respawn points
-	for (i = 0; i < num_respawn_points; i++) {
+	for (i = 0; i < ld->num_respawn_points; i++) {
 		RespawnPoint rp = ctx->respawn_points[i];
 
 		if (rp.x == x) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 	}
 
-	ctx->respawn_points[num_respawn_points].x = x;
-	ctx->respawn_points[num_respawn_points].y = y;
+	ctx->respawn_points[ld->num_respawn_points].x = x;
+	ctx->respawn_points[ld->num_respawn_points].y = y;
 
-	num_respawn_points++;
+	ld->num_respawn_points++;
 }
 
-static void add_trigger(int x, int what)
+static void add_trigger(LevelLoader* ld, int x, int what)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Check if there are too many triggers
-	if (num_triggers >= MAX_TRIGGERS) {
-		invalid = true;
+	if (ld->num_triggers >= ctx->num_triggers) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check if the trigger's position is within the allowed range
-	if (x > x_max - 20) {
-		invalid = true;
+	if (x > ld->x_max - 20) {
+		ld->invalid = true;
 		return;
 	}
 
 	//Check trigger repetition or excessive proximity
-	for (i = 0; i < num_triggers; i++) {
+	for (i = 0; i < ld->num_triggers; i++) {
 		int tx = ctx->triggers[i].x;
 
 		if (tx == x || tx > x - 28) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 	}
 
-	ctx->triggers[num_triggers].x = x;
-	ctx->triggers[num_triggers].what = what;
+	ctx->triggers[ld->num_triggers].x = x;
+	ctx->triggers[ld->num_triggers].what = what;
 
-	num_triggers++;
+	ld->num_triggers++;
 
 	if (what != TRIGGER_HEN) {
-		num_car_triggers++;
+		ld->num_car_triggers++;
 	}
 }
 
-static void validate_positions()
+static void validate_positions(LevelLoader* ld)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Ensure every respawn point is at a valid Y position and close enough
 	//to the corresponding deep hole but not placed after it or over another
 	//deep hole
-	for (i = 0; i < num_respawn_points; i++) {
+	for (i = 0; i < ld->num_respawn_points; i++) {
 		int x = ctx->respawn_points[i].x;
 		int y = ctx->respawn_points[i].y;
 		int type = ctx->level_columns[x].type;
 
 		if (y != 9 - ctx->level_columns[x].num_crates) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
 		if (type != LVLCOL_NORMAL_FLOOR && type != LVLCOL_DEEP_HOLE_RIGHT) {
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
 		if (ctx->level_columns[x + 1].type == LVLCOL_DEEP_HOLE_LEFT) continue;
 		if (ctx->level_columns[x + 2].type == LVLCOL_DEEP_HOLE_LEFT) continue;
 
-		invalid = true;
+		ld->invalid = true;
 		return;
 	}
 
 	//Validate object positions
-	for (i = 0; i < num_objs; i++) {
+	for (i = 0; i < ld->num_objs; i++) {
 		int x = ctx->objs[i].x;
 		int y = ctx->objs[i].y;
 		int j;
@@ -693,7 +836,7 @@ static void validate_positions()
 
 		if (y == 11) {
 			//Middle of the floor
-			invalid = true;
+			ld->invalid = true;
 			return;
 		}
 
@@ -704,7 +847,7 @@ static void validate_positions()
 					&& col_type != LVLCOL_PASSAGEWAY_MIDDLE
 					&& col_type != LVLCOL_PASSAGEWAY_RIGHT) {
 
-				invalid = true;
+				ld->invalid = true;
 				return;
 			}
 		}
@@ -712,7 +855,7 @@ static void validate_positions()
 		switch (ctx->objs[i].type) {
 			case OBJ_BANANA_PEEL:
 				if (y != 14 && y != 10 - col_num_crates) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
@@ -721,12 +864,12 @@ static void validate_positions()
 			case OBJ_COIN_SILVER:
 			case OBJ_COIN_GOLD:
 				if (y < 3) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
 				if (y < 11 && y > 10 - col_num_crates) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
@@ -736,12 +879,12 @@ static void validate_positions()
 			case OBJ_GUSH_CRACK:
 			case OBJ_HYDRANT:
 				if (col_num_crates != 0) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
 				if (col_type != LVLCOL_NORMAL_FLOOR) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
@@ -749,7 +892,7 @@ static void validate_positions()
 
 			case OBJ_OVERHEAD_SIGN:
 				if (y > 4) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
@@ -763,14 +906,14 @@ static void validate_positions()
 					col_num_crates = ctx->level_columns[x + j].num_crates;
 
 					if (col_num_crates > 0) {
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 
 					if (col_type != LVLCOL_NORMAL_FLOOR
 							&& col_type != LVLCOL_PASSAGEWAY_MIDDLE) {
 
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 				}
@@ -783,14 +926,14 @@ static void validate_positions()
 					col_num_crates = ctx->level_columns[x + j].num_crates;
 
 					if (col_num_crates > 0) {
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 
 					if (col_type != LVLCOL_NORMAL_FLOOR
 							&& col_type != LVLCOL_PASSAGEWAY_MIDDLE) {
 
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 				}
@@ -800,7 +943,7 @@ static void validate_positions()
 			case OBJ_ROPE_HORIZONTAL:
 				//Check if the X position corresponds to a light pole
 				if (x % 16 != 0) {
-					invalid = true;
+					ld->invalid = true;
 					return;
 				}
 
@@ -809,19 +952,19 @@ static void validate_positions()
 			case OBJ_SPRING:
 				if (y == 10) {
 					if (col_num_crates != 0) {
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 
 					if (col_type != LVLCOL_NORMAL_FLOOR
 							&& col_type != LVLCOL_PASSAGEWAY_MIDDLE) {
 
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 				} else if (y == 14) {
 					if (col_type != LVLCOL_PASSAGEWAY_RIGHT) {
-						invalid = true;
+						ld->invalid = true;
 						return;
 					}
 				}
@@ -833,16 +976,17 @@ static void validate_positions()
 
 //Convert positions (and also the width in the case of passageways) from level
 //blocks to pixels
-static void convert_positions()
+static void convert_positions(LevelLoader* ld)
 {
+	PlayCtx* ctx = ld->ctx;
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Convert positions of objects in ctx->objs[]
-	for (i = 0; i < num_objs; i++) {
+	for (i = 0; i < ld->num_objs; i++) {
 		int x = ctx->objs[i].x * LEVEL_BLOCK_SIZE;
 		int y = ctx->objs[i].y;
 
@@ -913,7 +1057,7 @@ static void convert_positions()
 	}
 
 	//Convert respawn point positions
-	for (i = 0; i < num_respawn_points; i++) {
+	for (i = 0; i < ld->num_respawn_points; i++) {
 		ctx->respawn_points[i].x *= LEVEL_BLOCK_SIZE;
 		ctx->respawn_points[i].x += 3;
 
@@ -922,50 +1066,53 @@ static void convert_positions()
 	}
 
 	//Convert trigger positions
-	for (i = 0; i < num_triggers; i++) {
+	for (i = 0; i < ld->num_triggers; i++) {
 		ctx->triggers[i].x *= LEVEL_BLOCK_SIZE;
 	}
 
 	//Convert passageway positions and widths
-	for (i = 0; i < num_passageways; i++) {
+	for (i = 0; i < ld->num_passageways; i++) {
 		ctx->passageways[i].x *= LEVEL_BLOCK_SIZE;
 		ctx->passageways[i].width *= LEVEL_BLOCK_SIZE;
 	}
 }
 
-static int add_solid(int type, int x, int y, int width, int height)
+static int add_solid(LevelLoader* ld, int type, int x, int y, int width, int height)
 {
-	if (invalid) {
+	PlayCtx* ctx = ld->ctx;
+
+	if (ld->invalid) {
 		return -1;
 	}
 
 	//Check if there are too many solids
-	if (num_solids >= MAX_SOLIDS) {
-		invalid = true;
+	if (ld->num_solids >= ctx->max_solids) {
+		ld->invalid = true;
 		return -1;
 	}
 
-	ctx->solids[num_solids].type = type;
-	ctx->solids[num_solids].left = x;
-	ctx->solids[num_solids].right = x + width;
-	ctx->solids[num_solids].top = y;
-	ctx->solids[num_solids].bottom = y + height;
-	num_solids++;
+	ctx->solids[ld->num_solids].type = type;
+	ctx->solids[ld->num_solids].left = x;
+	ctx->solids[ld->num_solids].right = x + width;
+	ctx->solids[ld->num_solids].top = y;
+	ctx->solids[ld->num_solids].bottom = y + height;
+	ld->num_solids++;
 
-	return num_solids - 1;
+	return ld->num_solids - 1;
 }
 
-static void add_solids()
+static void add_solids(LevelLoader* ld)
 {
+	PlayCtx* ctx = ld->ctx;
 	int num_level_columns = (ctx->level_size / LEVEL_BLOCK_SIZE);
 	int i;
 
-	if (invalid) {
+	if (ld->invalid) {
 		return;
 	}
 
 	//Add first floor solid
-	add_solid(SOL_FULL, 0, 264, LEVEL_BLOCK_SIZE, 80);
+	add_solid(ld, SOL_FULL, 0, 264, LEVEL_BLOCK_SIZE, 80);
 
 	//Add other floor solids
 	for (i = 1; i < num_level_columns; i++) {
@@ -973,53 +1120,53 @@ static void add_solids()
 
 		switch (ctx->level_columns[i].type) {
 			case LVLCOL_NORMAL_FLOOR:
-				ctx->solids[num_solids - 1].right += LEVEL_BLOCK_SIZE;
+				ctx->solids[ld->num_solids - 1].right += LEVEL_BLOCK_SIZE;
 				break;
 
 			case LVLCOL_DEEP_HOLE_LEFT:
-				ctx->solids[num_solids - 1].right += 12;
+				ctx->solids[ld->num_solids - 1].right += 12;
 				break;
 
 			case LVLCOL_DEEP_HOLE_RIGHT:
 				x = (LEVEL_BLOCK_SIZE * i) + 14;
-				add_solid(SOL_FULL, x, 264, 10, 80);
+				add_solid(ld, SOL_FULL, x, 264, 10, 80);
 				break;
 
 			case LVLCOL_PASSAGEWAY_LEFT:
-				ctx->solids[num_solids - 1].right += 6;
+				ctx->solids[ld->num_solids - 1].right += 6;
 				break;
 
 			case LVLCOL_PASSAGEWAY_RIGHT:
 				x = (LEVEL_BLOCK_SIZE * (i + 1));
-				add_solid(SOL_FULL, x, 264, 0, 80);
+				add_solid(ld, SOL_FULL, x, 264, 0, 80);
 				break;
 		}
 
 		//Too many solids
-		if (invalid) {
+		if (ld->invalid) {
 			return;
 		}
 	}
 
 	//Add passageway solids
-	for (i = 0; i < num_passageways; i++) {
+	for (i = 0; i < ld->num_passageways; i++) {
 		int x = ctx->passageways[i].x;
 		int w = ctx->passageways[i].width;
 
 		//Bottom solid
-		add_solid(SOL_FULL, x + 8, 360, w - 8, 4);
+		add_solid(ld, SOL_FULL, x + 8, 360, w - 8, 4);
 
 		//Passageway entry solid
-		add_solid(SOL_PASSAGEWAY_ENTRY, x + 6, 264, 18, 13);
+		add_solid(ld, SOL_PASSAGEWAY_ENTRY, x + 6, 264, 18, 13);
 
 		//Top floor solid
 		x += LEVEL_BLOCK_SIZE;
 		w -= (LEVEL_BLOCK_SIZE * 2);
-		add_solid(SOL_FULL, x, 264, w, 13);
+		add_solid(ld, SOL_FULL, x, 264, w, 13);
 
 		//Passageway exit solid
 		x += w;
-		add_solid(SOL_PASSAGEWAY_EXIT, x, 264, 22, 13);
+		add_solid(ld, SOL_PASSAGEWAY_EXIT, x, 264, 22, 13);
 	}
 
 	//Add solids for unpushable crates
@@ -1032,17 +1179,17 @@ static void add_solids()
 		if (num_crates == num_crates_prev) {
 			//If multiple consecutive level columns share the same number of
 			//crates, just extend the previous solid instead of adding a new one
-			ctx->solids[num_solids - 1].right += LEVEL_BLOCK_SIZE;
+			ctx->solids[ld->num_solids - 1].right += LEVEL_BLOCK_SIZE;
 		} else {
 			int x = i * LEVEL_BLOCK_SIZE;
 			int y = (11 - num_crates) * LEVEL_BLOCK_SIZE;
 			int w = LEVEL_BLOCK_SIZE;
 			int h = num_crates * LEVEL_BLOCK_SIZE;
 
-			add_solid(SOL_FULL, x, y, w, h);
+			add_solid(ld, SOL_FULL, x, y, w, h);
 
 			//Too many solids
-			if (invalid) {
+			if (ld->invalid) {
 				return;
 			}
 		}
@@ -1050,56 +1197,158 @@ static void add_solids()
 
 	//Add solids for pushable crates (there is exactly one pushable crate for
 	//each passageway)
-	for (i = 0; i < num_passageways; i++) {
-		int x = (int)ctx->pushable_crates[i].x;
+	for (i = 0; i < ld->num_passageways; i++) {
+		int x = PN_TO_INT(ctx->pushable_crates[i].x);
 		int y = PUSHABLE_CRATE_Y;
 		int w = LEVEL_BLOCK_SIZE;
 		int h = LEVEL_BLOCK_SIZE;
 
-		ctx->pushable_crates[i].solid = add_solid(SOL_FULL, x, y, w, h);
+		ctx->pushable_crates[i].solid = add_solid(ld, SOL_FULL, x, y, w, h);
 
 		//Too many solids
-		if (invalid) {
+		if (ld->invalid) {
 			return;
 		}
 	}
 
 	//Add solids for objects in ctx->objs[] (except pushable crates)
-	for (i = 0; i < num_objs; i++) {
+	for (i = 0; i < ld->num_objs; i++) {
 		int x = ctx->objs[i].x;
 		int y = ctx->objs[i].y;
 
 		switch (ctx->objs[i].type) {
 			case OBJ_HYDRANT:
-				add_solid(SOL_FULL, x + 4, y + 8, 8, 4);
+				add_solid(ld, SOL_FULL, x + 4, y + 8, 8, 4);
 				break;
 
 			case OBJ_OVERHEAD_SIGN:
-				add_solid(SOL_FULL, x + 12, y, 4, 32);
+				add_solid(ld, SOL_FULL, x + 12, y, 4, 32);
 				break;
 
 			case OBJ_PARKED_CAR_BLUE:
 			case OBJ_PARKED_CAR_SILVER:
 			case OBJ_PARKED_CAR_YELLOW:
-				add_solid(SOL_FULL, x + 4, y + 18, 20, 4);
-				add_solid(SOL_SLOPE_UP, x + 27, y + 2, 15, 15);
-				add_solid(SOL_VERTICAL, x + 48, y + 2, 16, 4);
-				add_solid(SOL_SLOPE_DOWN, x + 66, y + 2, 18, 18);
-				add_solid(SOL_KEEP_ON_TOP, x + 88, y + 20, 16, 4);
-				add_solid(SOL_KEEP_ON_TOP, x + 104, y + 22, 16, 4);
-				add_solid(SOL_FULL, x + 120, y + 24, 8, 4);
+				add_solid(ld, SOL_FULL, x + 4, y + 18, 20, 4);
+				add_solid(ld, SOL_SLOPE_UP, x + 27, y + 2, 15, 15);
+				add_solid(ld, SOL_VERTICAL, x + 48, y + 2, 16, 4);
+				add_solid(ld, SOL_SLOPE_DOWN, x + 66, y + 2, 18, 18);
+				add_solid(ld, SOL_KEEP_ON_TOP, x + 88, y + 20, 16, 4);
+				add_solid(ld, SOL_KEEP_ON_TOP, x + 104, y + 22, 16, 4);
+				add_solid(ld, SOL_FULL, x + 120, y + 24, 8, 4);
 				break;
 
 			case OBJ_PARKED_TRUCK:
-				add_solid(SOL_FULL, x, y + 4, 224, 96);
-				add_solid(SOL_FULL, x + 224, y + 23, 55, 80);
+				add_solid(ld, SOL_FULL, x, y + 4, 224, 96);
+				add_solid(ld, SOL_FULL, x + 224, y + 23, 55, 80);
 				break;
 		}
 
 		//Too many solids
-		if (invalid) {
+		if (ld->invalid) {
+			return;
+		}
+	}
+}
+
+//Builds the lists of solids overlapping each level column, which allow the
+//gameplay code to check only the solids near the player character
+static void index_solids(LevelLoader* ld)
+{
+	PlayCtx* ctx = ld->ctx;
+	int i;
+
+	if (ld->invalid) {
+		return;
+	}
+
+	for (i = 0; i < ld->num_solids; i++) {
+		if (!play_index_solid(ctx, i)) {
+			ld->invalid = true;
+			return;
+		}
+	}
+
+	//Keep a free slot in every level column for each pushable crate's solid to
+	//move into
+	for (i = 0; i < ctx->num_level_columns; i++) {
+		if (ctx->level_columns[i].num_solids >
+				MAX_COLUMN_SOLIDS - MAX_PUSHABLE_CRATES) {
+			ld->invalid = true;
 			return;
 		}
 	}
 }
 
+//Adds the objects the player character interacts with to the object lists
+static void index_objs(LevelLoader* ld)
+{
+	PlayCtx* ctx = ld->ctx;
+	int i;
+
+	if (ld->invalid) {
+		return;
+	}
+
+	for (i = 0; i < ld->num_objs; i++) {
+		int list = NONE;
+
+		switch (ctx->objs[i].type) {
+			case OBJ_COIN_SILVER:
+			case OBJ_COIN_GOLD:
+				list = OBJLIST_COINS;
+				break;
+
+			case OBJ_BANANA_PEEL:
+				list = OBJLIST_PEELS;
+				break;
+
+			case OBJ_GUSH:
+				list = OBJLIST_GUSHES;
+				break;
+
+			case OBJ_GUSH_CRACK:
+				list = OBJLIST_GUSH_CRACKS;
+				break;
+
+			case OBJ_ROPE_VERTICAL:
+				list = OBJLIST_ROPES;
+				break;
+
+			case OBJ_SPRING:
+				list = OBJLIST_SPRINGS;
+				break;
+		}
+
+		if (list != NONE) {
+			play_set_obj_list(ctx, i, list);
+		}
+	}
+}
+
+//Fills ctx->obj_order[] with the indices of the objects in ascending order of
+//X position, which the objects are already almost in, as positions in level
+//files are relative to the previous ones
+static void sort_objs(LevelLoader* ld)
+{
+	PlayCtx* ctx = ld->ctx;
+	int i, j;
+
+	if (ld->invalid) {
+		return;
+	}
+
+	for (i = 0; i < ld->num_objs; i++) {
+		int x = ctx->objs[i].x;
+
+		for (j = i; j > 0 && ctx->objs[ctx->obj_order[j - 1]].x > x; j--) {
+			ctx->obj_order[j] = ctx->obj_order[j - 1];
+			ctx->obj_order_pos[ctx->obj_order[j]] = j;
+		}
+
+		ctx->obj_order[j] = i;
+		ctx->obj_order_pos[i] = j;
+	}
+
+	ctx->num_ordered_objs = ld->num_objs;
+}
+
@@ -30,67 +30,93 @@
 
 #include "defs.h"
 
-#include <raylib.h>
 #include <stdlib.h>
 #include <string.h>
 
 //------------------------------------------------------------------------------
 
-static char* data;
-static int offset;
-static int num_lines_read;
-static bool data_ended;
-static bool invalid;
+//From util.c
+char* load_file_text(const char* path);
+void unload_file_text(char* text);
 
 //------------------------------------------------------------------------------
 
 //Function prototypes
 static void trim_spaces(char* str);
-static void end_data(char* dst);
+static void end_data(LineReader* lr, char* dst);
 
 //------------------------------------------------------------------------------
 
-bool lineread_open(const char* path)
+bool lineread_open(LineReader* lr, const char* path)
 {
-	offset = 0;
-	num_lines_read = 0;
-	data_ended = false;
-	invalid = false;
+	lr->offset = 0;
+	lr->num_lines_read = 0;
+	lr->max_lines = 255;
+	lr->data_ended = false;
+	lr->invalid = false;
 
-	data = LoadFileText(path);
+	lr->data = load_file_text(path);
+	lr->owns_data = true;
 
-	if (data == NULL) {
+	if (lr->data == NULL) {
 		return false;
 	}
 
 	return true;
 }
 
-bool lineread_invalid()
+//Reads from text already in memory, which is not modified or released and must
+//remain valid until the reader is closed
+void lineread_open_text(LineReader* lr, const char* text)
 {
-	return invalid;
+	lr->offset = 0;
+	lr->num_lines_read = 0;
+	lr->max_lines = 255;
+	lr->data_ended = false;
+	lr->invalid = false;
+
+	lr->data = (char*)text;
+	lr->owns_data = false;
 }
 
-bool lineread_ended()
+//Releases the file's data if the end has not been reached
+void lineread_close(LineReader* lr)
 {
-	return data_ended;
+	if (lr->data != NULL) {
+		if (lr->owns_data) {
+			unload_file_text(lr->data);
+		}
+		lr->data = NULL;
+	}
+
+	lr->data_ended = true;
+}
+
+bool lineread_invalid(LineReader* lr)
+{
+	return lr->invalid;
+}
+
+bool lineread_ended(LineReader* lr)
+{
+	return lr->data_ended;
 }
 
-void lineread_getline(char* dst)
+void lineread_getline(LineReader* lr, char* dst)
 {
 	int len;
 	int i;
 
-	if (data_ended) {
+	if (lr->data_ended) {
 		dst[0] = '\0';
 
 		return;
 	}
 
 	//Error: too many lines in the file
-	if (num_lines_read >= 255) {
-		invalid = true;
-		end_data(dst);
+	if (lr->max_lines > 0 && lr->num_lines_read >= lr->max_lines) {
+		lr->invalid = true;
+		end_data(lr, dst);
 
 		return;
 	}
@@ -98,15 +124,15 @@ void lineread_getline(char* dst)
 	dst[0] = '\0';
 	i = 0;
 	while (1) {
-		unsigned char c = data[offset];
-		offset++;
+		unsigned char c = lr->data[lr->offset];
+		lr->offset++;
 
 		if (c == '\n') {
 			dst[i] = '\0';
 			break;
 		} else if (c == '\0') {
 			dst[i] = '\0';
-			end_data(dst);
+			end_data(lr, dst);
 			break;
 		}
 
@@ -125,8 +151,8 @@ void lineread_getline(char* dst)
 
 	//Error: line too long
 	if (len > 32) {
-		invalid = true;
-		end_data(dst);
+		lr->invalid = true;
+		end_data(lr, dst);
 
 		return;
 	}
@@ -141,8 +167,8 @@ void lineread_getline(char* dst)
 		if (c >= 'a' && c <=  'z') continue; //Alphabetic (lower case)
 		if (c == '-')  continue; //Hyphen
 
-		invalid = true;
-		end_data(dst);
+		lr->invalid = true;
+		end_data(lr, dst);
 
 		return;
 	}
@@ -157,7 +183,7 @@ void lineread_getline(char* dst)
 		}
 	}
 
-	num_lines_read++;
+	lr->num_lines_read++;
 }
 
 //Returns the number of tokens
@@ -274,10 +300,9 @@ static void trim_spaces(char* str)
 	str[j] = '\0';
 }
 
-static void end_data(char* dst)
+static void end_data(LineReader* lr, char* dst)
 {
-	UnloadFileText(data);
-	data_ended = true;
+	lineread_close(lr);
 	dst[0] = '\0';
 }
 
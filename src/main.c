@@ -42,6 +42,7 @@
 bool renderer_init(DisplayParams* dp, Config* cfg, PlayCtx* pctx, MenuCtx* mctx);
 bool renderer_load_gfx();
 void renderer_draw(int screen_type, int input_state, int wipe_value);
+void renderer_set_interpolation(PlayCtx* prev_pctx, float alpha);
 void renderer_show_save_error(bool show);
 void renderer_cleanup();
 
@@ -50,6 +51,8 @@ void audio_init(Config* cfg);
 void audio_load_sfx();
 void audio_stop_bgm();
 void audio_play_bgm(int id);
+void audio_play_sfx(int id);
+void audio_stop_sfx(int id);
 void audio_stop_all_sfx();
 void audio_update();
 void audio_handle_toggling();
@@ -63,23 +66,34 @@ void input_handle_touch();
 int input_read();
 
 //From play.c
-PlayCtx* play_init(DisplayParams* dp);
-void play_clear();
-void play_set_input(int input_held);
-void play_update(float dt);
-void play_adapt_to_screen_size();
+void play_clear(PlayCtx* ctx);
+void play_set_input(PlayCtx* ctx, int input_held);
+void play_update(PlayCtx* ctx, float dt);
+void play_adapt_to_screen_size(PlayCtx* ctx, int vscreen_width);
+bool play_copy_for_drawing(PlayCtx* dst, const PlayCtx* src);
+bool play_take_event(PlayCtx* ctx, PlayEvent* evt);
+void play_state_hash(const PlayCtx* ctx, StateHash* hash);
+void play_free(PlayCtx* ctx);
+
+//From replay.c
+void replay_begin(Replay* rp, const char* level, int difficulty, int level_num,
+	bool skip_initial_sequence, int vscreen_width, int score);
+bool replay_record(Replay* rp, int input);
+bool replay_hash_due(const Replay* rp);
+bool replay_record_hash(Replay* rp, const StateHash* hash);
+bool replay_save(Replay* rp, const char* path);
+void replay_free(Replay* rp);
 
 //From lineread.c
-bool lineread_open(const char* path);
-bool lineread_ended();
-void lineread_getline(char* dst);
+bool lineread_open(LineReader* lr, const char* path);
+bool lineread_ended(LineReader* lr);
+void lineread_getline(LineReader* lr, char* dst);
 int lineread_num_tokens(const char* str);
 const char* lineread_token(const char* str, int token);
 int lineread_token_int(const char* str, int token);
 
 //From levelload.c
-void levelload_init(PlayCtx* ctx);
-int levelload_load(const char* filename);
+int levelload_load(PlayCtx* ctx, const char* filename);
 
 //From menu.c
 MenuCtx* menu_init(DisplayParams* dp, Config* cfg);
@@ -111,6 +125,18 @@ void window_setup(DisplayParams* dp, Config* cfg);
 bool window_is_fullscreen();
 void window_update();
 
+#if defined(PERF_OVERLAY) || defined(PERF_TRACE)
+//From perf.c
+void perf_mark();
+void perf_lap(int phase);
+void perf_end_frame();
+void perf_toggle();
+bool perf_trace_start(const char* path);
+bool perf_trace_finish();
+void perf_begin(int zone);
+void perf_end(int zone);
+#endif
+
 //From data.c
 extern const int data_screen_widths[];
 extern const int data_screen_heights[];
@@ -128,6 +154,8 @@ static struct {
 	bool version;
 	const char* config;
 	const char* assets_dir;
+	const char* record_path;
+	const char* trace_path;
 	bool touch_enabled;
 	bool fullscreen;
 	bool windowed;
@@ -161,8 +189,21 @@ static bool progress_checked;
 static int screen_type;
 
 //Gameplay
+static PlayCtx play_session;
 static PlayCtx* play_ctx;
 
+//Copy of the gameplay context from before the last tick, which allows the
+//renderer to interpolate between the two most recent ticks
+static PlayCtx prev_play_ctx;
+static bool has_prev_play_ctx;
+
+//Time not yet consumed by gameplay ticks
+static float play_time_accumulator;
+
+//Input recording of the current level (if --record is used)
+static Replay replay;
+static bool recording;
+
 //Delayed action
 static int delayed_action_type;
 static float action_delay;
@@ -196,6 +237,10 @@ static void cleanup();
 static void get_delta_time();
 static void handle_input();
 static void handle_menu_action();
+static void update_play();
+static void save_prev_play_ctx();
+static void finish_recording();
+static void handle_play_events();
 static void handle_pause();
 static void check_game_progress();
 static void handle_level_end();
@@ -280,6 +325,28 @@ static void parse_cli(int argc, char* argv[])
 			if (argv[i][0] != '\0' && !str_only_whitespaces(argv[i])) {
 				cli.assets_dir = argv[i];
 			}
+		} else if (strcmp(a, "--record") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			if (argv[i][0] != '\0' && !str_only_whitespaces(argv[i])) {
+				cli.record_path = argv[i];
+			}
+#ifdef PERF_TRACE
+		} else if (strcmp(a, "--trace") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			if (argv[i][0] != '\0' && !str_only_whitespaces(argv[i])) {
+				cli.trace_path = argv[i];
+			}
+#endif
 		} else if (strcmp(a, "--vscreen-size") == 0) {
 			i++;
 			if (i >= argc) {
@@ -414,7 +481,7 @@ static bool parse_vscreen_size_arg(const char* arg)
 
 static void show_help()
 {
-	char msg[2048];
+	char msg[4096];
 	char tmp[16];
 	int i;
 
@@ -427,6 +494,13 @@ static void show_help()
 		"-f, --fullscreen         Run in fullscreen mode\n"
 		"-w, --windowed           Run in windowed mode\n"
 		"--assets-dir <directory> Set assets directory to use\n"
+		"--record <file>          Record the input of each level played to a file,\n"
+		"                         which is overwritten when another level starts,\n"
+		"                         for playback with alexvsbus-sim --replay\n"
+#ifdef PERF_TRACE
+		"--trace <file>           Write the time taken by each stage of the main\n"
+		"                         loop to a Chrome trace-event file on exit\n"
+#endif
 		"--window-scale <scale>   Set window scale (1 to 3)\n"
 		"--vscreen-size <size>    Set the size of the virtual screen (vscreen)\n"
 		"--fixed-window-mode      Remove the ability to toggle between fullscreen\n"
@@ -546,8 +620,14 @@ static bool init()
 	find_config_path();
 	load_config();
 	audio_init(&config);
+#ifdef PERF_TRACE
+	if (cli.trace_path != NULL && !perf_trace_start(cli.trace_path)) {
+		show_error("Not enough memory for the trace");
+		return false;
+	}
+#endif
 	input_init(&display_params, &config);
-	play_ctx = play_init(&display_params);
+	play_ctx = &play_session;
 	menu_ctx = menu_init(&display_params, &config);
 
 	if (!renderer_init(&display_params, &config, play_ctx, menu_ctx)) {
@@ -560,7 +640,6 @@ static bool init()
 		return false;
 	}
 
-	levelload_init(play_ctx);
 	audio_load_sfx();
 	audio_handle_toggling();
 	window_setup(&display_params, &config);
@@ -571,7 +650,7 @@ static bool init()
 	delayed_action_type = NONE;
 	wipe_cmd = NONE;
 
-	play_clear();
+	play_clear(play_ctx);
 	show_title();
 
 	return true;
@@ -587,21 +666,29 @@ static void main_loop()
 		}
 
 		get_delta_time();
+
+		PERF_BEGIN(PERFZONE_HANDLE_INPUT);
 		handle_input();
+		PERF_END(PERFZONE_HANDLE_INPUT);
+
+		PERF_MARK();
 		audio_update();
+		PERF_LAP(PERF_AUDIO);
 
 		if (menu_is_open()) {
+			PERF_BEGIN(PERFZONE_MENU);
 			menu_handle_keys(input_held, input_hit);
 			menu_update(delta_time);
 			handle_menu_action();
+			PERF_END(PERFZONE_MENU);
 
 			//Menu just closed
 			if (!menu_is_open()) {
 				wait_input_up = true;
 			}
 		} else if (screen_type == SCR_PLAY) {
-			play_set_input(input_held);
-			play_update(delta_time);
+			update_play();
+			handle_play_events();
 			handle_pause();
 			check_game_progress();
 			handle_level_end();
@@ -611,18 +698,38 @@ static void main_loop()
 		audio_handle_toggling();
 		update_screen_wipe();
 		adapt_to_screen_size();
+		renderer_set_interpolation(has_prev_play_ctx ? &prev_play_ctx : NULL,
+			play_time_accumulator / PLAY_DT);
+		PERF_BEGIN(PERFZONE_RENDERER_DRAW);
 		renderer_draw(screen_type, input_held, wipe_value);
+		PERF_END(PERFZONE_RENDERER_DRAW);
+
 		window_update();
+
+#ifdef PERF_OVERLAY
+		perf_end_frame();
+#endif
 	}
 }
 
 static void cleanup()
 {
 	save_config();
+	finish_recording();
+	replay_free(&replay);
+
+#ifdef PERF_TRACE
+	if (!perf_trace_finish()) {
+		show_error("Unable to write the trace file");
+	}
+#endif
 
 	renderer_cleanup();
 	audio_cleanup();
 
+	play_free(&prev_play_ctx);
+	play_free(&play_session);
+
 	if (IsWindowReady()) {
 		CloseWindow();
 	}
@@ -634,7 +741,8 @@ static void get_delta_time()
 {
 	delta_time = GetFrameTime();
 
-	//Limit delta time to prevent problems with collision detection
+	//The gameplay logic runs in steps of one tick however long a frame takes,
+	//so the delta time is only limited to skip over stalls
 	if (delta_time > MAX_DT) delta_time = MAX_DT;
 }
 
@@ -672,6 +780,14 @@ static void handle_input()
 	if (input_hit & INPUT_CFG_AUDIO_TOGGLE) {
 		config.audio_enabled = !config.audio_enabled;
 	}
+
+#ifdef PERF_OVERLAY
+	//Not an input action, so it is neither recorded in replays nor seen by
+	//the menus
+	if (IsKeyPressed(KEY_F3)) {
+		perf_toggle();
+	}
+#endif
 }
 
 static void handle_menu_action()
@@ -709,6 +825,85 @@ static void handle_menu_action()
 	menu_ctx->action = NONE;
 }
 
+//Runs as many fixed-length gameplay ticks as needed to catch up with the time
+//elapsed since the previous frame
+//
+//The input is set on every tick, even if it has not changed, so the recording
+//contains exactly what each tick received
+static void update_play()
+{
+	play_time_accumulator += delta_time;
+
+	while (play_time_accumulator >= PLAY_DT) {
+		play_time_accumulator -= PLAY_DT;
+
+		if (recording && !replay_record(&replay, input_held)) {
+			//Out of memory
+			recording = false;
+		}
+
+		save_prev_play_ctx();
+		play_set_input(play_ctx, input_held);
+		play_update(play_ctx, PLAY_DT);
+
+		if (recording && replay_hash_due(&replay)) {
+			StateHash hash;
+
+			play_state_hash(play_ctx, &hash);
+			if (!replay_record_hash(&replay, &hash)) {
+				//Out of memory
+				recording = false;
+			}
+		}
+
+		//Stop when the level ends, as the next one might be started
+		if (play_ctx->sequence_step == SEQ_FINISHED) {
+			finish_recording();
+			play_time_accumulator = 0;
+			break;
+		}
+	}
+}
+
+//Keeps a copy of the gameplay context for the renderer to interpolate from,
+//which is not done if out of memory
+static void save_prev_play_ctx()
+{
+	has_prev_play_ctx = play_copy_for_drawing(&prev_play_ctx, play_ctx);
+}
+
+//Writes the input recording of the level being played (if any) to the file
+//passed to --record
+static void finish_recording()
+{
+	if (!recording) return;
+
+	recording = false;
+	replay.final_score = play_ctx->score;
+
+	if (!replay_save(&replay, cli.record_path)) {
+		show_error("Unable to write the input recording");
+	}
+}
+
+//Takes the events produced by the gameplay ticks run since the previous frame
+static void handle_play_events()
+{
+	PlayEvent evt;
+
+	while (play_take_event(play_ctx, &evt)) {
+		switch (evt.type) {
+			case PLAYEVT_SFX:
+				audio_play_sfx(evt.value);
+				break;
+
+			case PLAYEVT_SFX_STOP:
+				audio_stop_sfx(evt.value);
+				break;
+		}
+	}
+}
+
 static void handle_pause()
 {
 	bool pause = (input_hit & INPUT_PAUSE) > 0;
@@ -856,7 +1051,7 @@ static void adapt_to_screen_size()
 	}
 
 	if (screen_type == SCR_PLAY || screen_type == SCR_PLAY_FREEZE) {
-		play_adapt_to_screen_size();
+		play_adapt_to_screen_size(play_ctx, display_params.vscreen_width);
 	}
 
 	menu_adapt_to_screen_size();
@@ -866,6 +1061,8 @@ static void adapt_to_screen_size()
 
 static void show_title()
 {
+	finish_recording();
+
 	screen_type = SCR_BLANK;
 
 	play_ctx->score = 0;
@@ -908,10 +1105,13 @@ static void start_level(int level_num, int difficulty, bool skip_initial_sequenc
 
 	snprintf(filename, ARRAY_LENGTH(filename), "%slevel%d%c", config.assets_dir, level_num, diffch);
 
+	finish_recording();
 	renderer_show_save_error(false);
-	play_clear();
+	play_clear(play_ctx);
 
-	err = levelload_load(filename);
+	PERF_BEGIN(PERFZONE_LEVEL_LOAD);
+	err = levelload_load(play_ctx, filename);
+	PERF_END(PERFZONE_LEVEL_LOAD);
 	if (err != LVLERR_NONE) {
 		char msg[64] = "";
 
@@ -966,15 +1166,27 @@ static void start_level(int level_num, int difficulty, bool skip_initial_sequenc
 	audio_play_bgm(play_ctx->bgm);
 	wipe_cmd = WIPECMD_IN;
 
-	play_adapt_to_screen_size();
+	play_adapt_to_screen_size(play_ctx, display_params.vscreen_width);
+
+	if (cli.record_path != NULL) {
+		replay_begin(&replay, file_from_path(filename), difficulty, level_num,
+			skip_initial_sequence, display_params.vscreen_width, play_ctx->score);
+
+		recording = true;
+	}
+
+	//Nothing to interpolate from
+	save_prev_play_ctx();
+	play_time_accumulator = 0;
 }
 
 //Note: the parameter refers to the difficulty the player has just finished, not
 //the one to move to after the ending sequence
 static void start_ending_sequence(int difficulty)
 {
+	finish_recording();
 	renderer_show_save_error(false);
-	play_clear();
+	play_clear(play_ctx);
 
 	progress_checked = false;
 	screen_type = SCR_PLAY;
@@ -991,7 +1203,11 @@ static void start_ending_sequence(int difficulty)
 	audio_play_bgm(play_ctx->bgm);
 	wipe_cmd = WIPECMD_IN;
 
-	play_adapt_to_screen_size();
+	play_adapt_to_screen_size(play_ctx, display_params.vscreen_width);
+
+	//Nothing to interpolate from
+	save_prev_play_ctx();
+	play_time_accumulator = 0;
 }
 
 static bool find_assets_dir()
@@ -1074,6 +1290,7 @@ static void find_config_path()
 
 static void load_config()
 {
+	LineReader lr;
 	char tmp[48];
 
 	//Defaults
@@ -1091,9 +1308,9 @@ static void load_config()
 	config.progress_difficulty = DIFFICULTY_NORMAL;
 	config.progress_level = 1;
 
-	if (get_file_size(config_path) <= 4096 && lineread_open(config_path)) {
-		while (!lineread_ended()) {
-			lineread_getline(tmp);
+	if (get_file_size(config_path) <= 4096 && lineread_open(&lr, config_path)) {
+		while (!lineread_ended(&lr)) {
+			lineread_getline(&lr, tmp);
 
 			if (lineread_num_tokens(tmp) != 2) {
 				continue;
@@ -0,0 +1,369 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * perf.c
+ *
+ * Description:
+ * Measurement of the time taken by each phase of a frame, as shown by the
+ * performance overlay (only included if PERF_OVERLAY is defined at build time)
+ * and recorded to a Chrome trace-event file by --trace (only included if
+ * PERF_TRACE is defined at build time)
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "defs.h"
+
+#if defined(PERF_OVERLAY) || defined(PERF_TRACE)
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+
+//From data.c
+extern const char* data_perf_trace_phase_names[];
+extern const char* data_perf_trace_zone_names[];
+
+//------------------------------------------------------------------------------
+
+//Time (in seconds) of the last mark or lap
+static double last_mark;
+
+#ifdef PERF_OVERLAY
+static bool visible;
+
+//Time (in seconds) of the end of the last frame
+static double last_frame_end;
+
+//Time (in seconds) taken by each phase during the current frame, which can
+//include several gameplay ticks
+static double cur_phases[NUM_PERF_PHASES];
+
+//Ring buffers holding the times (in microseconds) of the last frames
+static int frames[PERF_NUM_FRAMES];
+static int phases[PERF_NUM_FRAMES][NUM_PERF_PHASES];
+static int next_frame;
+static int num_frames;
+#endif
+
+#ifdef PERF_TRACE
+static bool tracing;
+static const char* trace_path;
+static double trace_start;
+static bool audio_attached;
+
+//Start time (in seconds) of each zone
+static double zone_starts[NUM_PERF_ZONES];
+
+//Preallocated when tracing starts, so recording an event never allocates
+static PerfTraceRing main_ring;
+static PerfTraceRing audio_ring;
+#endif
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+#ifdef PERF_OVERLAY
+static int compare_us(const void* a, const void* b);
+#endif
+#ifdef PERF_TRACE
+static void add_trace_event(PerfTraceRing* ring, double start, double end,
+	int id, bool is_zone);
+static void on_audio_mixed(void* buffer, unsigned int frames);
+static bool write_trace();
+static void write_ring(FILE* f, PerfTraceRing* ring, int tid);
+#endif
+
+//------------------------------------------------------------------------------
+
+void perf_mark()
+{
+	last_mark = GetTime();
+}
+
+void perf_lap(int phase)
+{
+	double now = GetTime();
+
+#ifdef PERF_OVERLAY
+	cur_phases[phase] += now - last_mark;
+#endif
+#ifdef PERF_TRACE
+	if (tracing) {
+		add_trace_event(&main_ring, last_mark, now, phase, false);
+	}
+#endif
+
+	last_mark = now;
+}
+
+#ifdef PERF_OVERLAY
+
+//Called once at the end of every frame, after all of its phases
+void perf_end_frame()
+{
+	double now = GetTime();
+	int i;
+
+	if (last_frame_end > 0) {
+		frames[next_frame] = (int)((now - last_frame_end) * 1000000);
+
+		for (i = 0; i < NUM_PERF_PHASES; i++) {
+			phases[next_frame][i] = (int)(cur_phases[i] * 1000000);
+		}
+
+		next_frame = (next_frame + 1) % PERF_NUM_FRAMES;
+		if (num_frames < PERF_NUM_FRAMES) {
+			num_frames++;
+		}
+	}
+
+	memset(cur_phases, 0, sizeof(cur_phases));
+	last_frame_end = now;
+}
+
+void perf_toggle()
+{
+	visible = !visible;
+}
+
+bool perf_is_visible()
+{
+	return visible;
+}
+
+void perf_get_stats(PerfStats* stats)
+{
+	int sorted[PERF_NUM_FRAMES];
+	long frame_sum = 0;
+	long phase_sum = 0;
+	int i, j;
+
+	memset(stats, 0, sizeof(PerfStats));
+	stats->num_frames = num_frames;
+
+	if (num_frames == 0) return;
+
+	for (i = 0; i < num_frames; i++) {
+		int f = (next_frame - num_frames + i + PERF_NUM_FRAMES) % PERF_NUM_FRAMES;
+
+		stats->frames[i] = frames[f];
+		sorted[i] = frames[f];
+		frame_sum += frames[f];
+
+		for (j = 0; j < NUM_PERF_PHASES; j++) {
+			stats->phase_avg[j] += phases[f][j];
+		}
+	}
+
+	for (j = 0; j < NUM_PERF_PHASES; j++) {
+		phase_sum += stats->phase_avg[j];
+		stats->phase_avg[j] /= num_frames;
+	}
+
+	qsort(sorted, num_frames, sizeof(int), compare_us);
+
+	stats->frame_min = sorted[0];
+	stats->frame_avg = frame_sum / num_frames;
+	stats->frame_p99 = sorted[num_frames * 99 / 100];
+	stats->other_avg = (frame_sum - phase_sum) / num_frames;
+}
+#endif //PERF_OVERLAY
+
+#ifdef PERF_TRACE
+//Starts recording the phases and zones to be written as a Chrome trace-event
+//file to the given path by perf_trace_finish(), returning false if out of
+//memory
+//
+//Should be called after the audio device is initialized, so the audio thread
+//can also be traced
+bool perf_trace_start(const char* path)
+{
+	main_ring.capacity  = PERF_TRACE_MAX_EVENTS;
+	audio_ring.capacity = PERF_TRACE_MAX_AUDIO_EVENTS;
+	main_ring.events  = malloc(main_ring.capacity  * sizeof(PerfTraceEvent));
+	audio_ring.events = malloc(audio_ring.capacity * sizeof(PerfTraceEvent));
+
+	if (main_ring.events == NULL || audio_ring.events == NULL) {
+		free(main_ring.events);
+		free(audio_ring.events);
+		main_ring.events  = NULL;
+		audio_ring.events = NULL;
+
+		return false;
+	}
+
+	trace_path = path;
+	trace_start = GetTime();
+	tracing = true;
+
+	if (IsAudioDeviceReady()) {
+		AttachAudioMixedProcessor(on_audio_mixed);
+		audio_attached = true;
+	}
+
+	return true;
+}
+
+//Stops recording and writes the trace file, returning false on error
+//
+//Should be called before the audio device is closed
+bool perf_trace_finish()
+{
+	bool ok;
+
+	if (!tracing) return true;
+
+	//Once detached, the audio thread no longer writes to its ring
+	if (audio_attached) {
+		DetachAudioMixedProcessor(on_audio_mixed);
+		audio_attached = false;
+	}
+
+	tracing = false;
+	ok = write_trace();
+
+	free(main_ring.events);
+	free(audio_ring.events);
+	main_ring.events  = NULL;
+	audio_ring.events = NULL;
+
+	return ok;
+}
+
+void perf_begin(int zone)
+{
+	zone_starts[zone] = GetTime();
+}
+
+void perf_end(int zone)
+{
+	if (tracing) {
+		add_trace_event(&main_ring, zone_starts[zone], GetTime(), zone, true);
+	}
+}
+#endif //PERF_TRACE
+
+//------------------------------------------------------------------------------
+
+#ifdef PERF_OVERLAY
+static int compare_us(const void* a, const void* b)
+{
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+
+	return (x > y) - (x < y);
+}
+#endif
+
+#ifdef PERF_TRACE
+static void add_trace_event(PerfTraceRing* ring, double start, double end,
+	int id, bool is_zone)
+{
+	PerfTraceEvent* evt = &ring->events[ring->next];
+
+	evt->start = start;
+	evt->end = end;
+	evt->id = id;
+	evt->is_zone = is_zone;
+
+	ring->next = (ring->next + 1) % ring->capacity;
+	if (ring->count < ring->capacity) {
+		ring->count++;
+	}
+}
+
+//Called on the audio thread after each buffer requested by the audio device
+//has been mixed
+//
+//As raylib provides no way to run code at the start of the mixing, the event
+//only marks when it ended
+static void on_audio_mixed(void* buffer, unsigned int frames)
+{
+	double now = GetTime();
+
+	(void)buffer;
+	(void)frames;
+
+	add_trace_event(&audio_ring, now, now, PERFZONE_AUDIO_MIX, true);
+}
+
+static bool write_trace()
+{
+	FILE* f;
+	bool ok;
+
+	f = fopen(trace_path, "w");
+	if (f == NULL) return false;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+		"\"args\":{\"name\":\"main\"}},\n");
+	fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+		"\"args\":{\"name\":\"audio\"}}");
+
+	write_ring(f, &main_ring, 1);
+	write_ring(f, &audio_ring, 2);
+
+	fprintf(f, "\n]}\n");
+
+	ok = !ferror(f);
+	if (fclose(f) != 0) ok = false;
+
+	return ok;
+}
+
+//Writes the events of a ring, from the oldest to the newest, with the times
+//in microseconds since the start of the trace
+static void write_ring(FILE* f, PerfTraceRing* ring, int tid)
+{
+	int i;
+
+	for (i = 0; i < ring->count; i++) {
+		int index = (ring->next - ring->count + i + ring->capacity) % ring->capacity;
+		PerfTraceEvent* evt = &ring->events[index];
+		double ts = (evt->start - trace_start) * 1000000;
+		double dur = (evt->end - evt->start) * 1000000;
+		const char* name;
+
+		if (evt->is_zone) {
+			name = data_perf_trace_zone_names[evt->id];
+		} else {
+			name = data_perf_trace_phase_names[evt->id];
+		}
+
+		if (evt->end > evt->start) {
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":1,\"tid\":%d}", name, ts, dur, tid);
+		} else {
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+				"\"pid\":1,\"tid\":%d}", name, ts, tid);
+		}
+	}
+}
+#endif //PERF_TRACE
+
+#endif
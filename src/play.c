@@ -30,313 +30,829 @@
 
 #include "defs.h"
 
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 //------------------------------------------------------------------------------
 
-//From audio.c
-void audio_stop_sfx(int id);
-void audio_play_sfx(int id);
-
 //From data.c
-extern const int data_gush_move_pattern_1[];
-extern const int data_gush_move_pattern_2[];
+extern const int* const data_gush_move_patterns[];
+
+#if defined(PERF_OVERLAY) || defined(PERF_TRACE)
+//From perf.c
+void perf_mark();
+void perf_lap(int phase);
+void perf_begin(int zone);
+void perf_end(int zone);
+#endif
 
 //------------------------------------------------------------------------------
 
-static DisplayParams* display_params;
-static PlayCtx ctx; //Gameplay context
+//Function prototypes
+static void position_camera(PlayCtx* ctx);
+static void set_animation(PlayCtx* ctx, int anim, bool running, bool loop, bool reverse,
+	int num_frames, PlayNum delay);
+static void start_animation(PlayCtx* ctx, int anim);
+static void add_crack_particles(PlayCtx* ctx, int x, int y);
+static void move_bus_to_end(PlayCtx* ctx);
+static void show_player_in_bus(PlayCtx* ctx);
+static void start_score_count(PlayCtx* ctx);
+static void update_step(PlayCtx* ctx, float dt);
+static void begin_update(PlayCtx* ctx);
+static void update_remaining_time(PlayCtx* ctx);
+static void update_score_count(PlayCtx* ctx);
+static void move_objects(PlayCtx* ctx);
+static void handle_car_thrown_peel(PlayCtx* ctx);
+static void move_player(PlayCtx* ctx);
+static void handle_solids(PlayCtx* ctx);
+static void handle_passageways(PlayCtx* ctx);
+static void handle_player_interactions(PlayCtx* ctx);
+static void handle_triggers(PlayCtx* ctx);
+static void do_player_state_specifics(PlayCtx* ctx);
+static void handle_fall_sound(PlayCtx* ctx);
+static void handle_respawn(PlayCtx* ctx);
+static void handle_player_state_change(PlayCtx* ctx);
+static void move_camera(PlayCtx* ctx);
+static void keep_player_within_limits(PlayCtx* ctx);
+static void handle_player_animation_change(PlayCtx* ctx);
+static void update_animations(PlayCtx* ctx);
+static void move_push_arrow(PlayCtx* ctx);
+static void position_bus_stop_sign(PlayCtx* ctx);
+static void position_light_pole(PlayCtx* ctx);
+static void update_sequence(PlayCtx* ctx);
+static void get_column_range(PlayCtx* ctx, int left, int right, int* first,
+	int* last);
+static void unindex_solid(PlayCtx* ctx, int solid);
+static int query_solids(PlayCtx* ctx, int first, int last, int* result);
+static void unlink_obj(PlayCtx* ctx, int obj);
+static void reposition_obj(PlayCtx* ctx, int obj);
+static int query_objs(PlayCtx* ctx, int list, int xmin, int xmax, int* result,
+	int count);
+static void reorder_obj(PlayCtx* ctx, int obj);
+static void move_gush(PlayCtx* ctx, Gush* gush);
+static void update_active_ranges(PlayCtx* ctx);
+static void add_event(PlayCtx* ctx, int type, int value);
+static uint32_t hash_words(uint32_t hash, const void* data, size_t size);
+static uint32_t hash_int(uint32_t hash, int value);
+static uint32_t hash_num(uint32_t hash, PlayNum value);
+static size_t arena_reserve(size_t* size, size_t bytes);
+static bool arena_fit(PlayArena* arena, size_t size);
+static void* rebase(const PlayCtx* src, PlayCtx* dst, const void* ptr);
+static uint64_t arena_offset(const PlayCtx* ctx, const void* ptr);
+static bool array_fits(uint64_t arena_size, uint64_t offset, int count,
+	size_t elem_size);
+static void* arena_at(PlayCtx* ctx, uint64_t offset);
+static bool snapshot_valid(const PlayCtx* ctx, const PlaySnapshotHeader* hdr,
+	const char* data);
+static bool snapshot_gush_valid(const Gush* gush, int max_objs);
+static bool index_valid(int index, int count, bool none_allowed);
+static bool range_valid(const ActiveRange* r, int count);
+
+//------------------------------------------------------------------------------
+
+//Clears a gameplay context, which needs to be done before loading a level
+//
+//The score is kept, as it accumulates from one level to the next, and so is the
+//memory of the arena, which is released only by play_free() (a context must be
+//zero-initialized before its first use)
+void play_clear(PlayCtx* ctx)
+{
+	int i;
 
-static float delta_time; //Time elapsed since the previous frame
+	ctx->delta_time = 0;
+
+	ctx->ignore_user_input = true;
+	ctx->input_left = false;
+	ctx->input_right = false;
+	ctx->input_jump = false;
+	ctx->old_input_left = false;
+	ctx->old_input_right = false;
+	ctx->old_input_jump = false;
+	ctx->jump_timeout = 0;
+
+	ctx->difficulty = 0;
+	ctx->level_num = 0;
+	ctx->last_level = false;
+	ctx->ending = false;
+	ctx->level_size = 0;
+	ctx->bg_color = 0;
+	ctx->bgm = 0;
+	ctx->goal_scene = 0;
+
+	ctx->time = 90;
+	ctx->time_running = false;
+	ctx->time_up = false;
+	ctx->goal_reached = false;
+	ctx->counting_score = false;
+	ctx->can_pause = false;
+
+	ctx->crate_push_remaining = PN(0.75f);
+
+	ctx->cam.x = 0;
+	ctx->cam.y = 0;
+	ctx->cam.xvel = 0;
+	ctx->cam.yvel = 0;
+	ctx->cam.xdest = 0;
+	ctx->cam.follow_player = false;
+	ctx->cam.fixed_at_leftmost = false;
+	ctx->cam.fixed_at_rightmost = false;
+
+	ctx->player.x = PN(96);
+	ctx->player.oldx = PN(96);
+	ctx->player.y = PN(204);
+	ctx->player.oldy = PN(200);
+	ctx->player.xvel = 0;
+	ctx->player.yvel = 0;
+	ctx->player.fell = false;
+	ctx->player.on_floor = false;
+	ctx->player.flicker_delay = 0;
+	ctx->player.anim_type = PLAYER_ANIM_STAND;
+	ctx->player.old_anim_type = PLAYER_ANIM_STAND;
+	ctx->player.state = PLAYER_STATE_NORMAL;
+	ctx->player.old_state = NONE;
+	handle_player_state_change(ctx);
+
+	ctx->bus.x = PN(24);
+	ctx->bus.xvel = 0;
+	ctx->bus.acc = 0;
+
+	ctx->grabbed_rope.obj = NONE;
+	ctx->hit_spring = NONE;
+	ctx->car.x = NONE;
+	ctx->hen.x = NONE;
+
+	ctx->cur_passageway = NONE;
+
+	//The arena's memory is kept for the next level, but no level-dependent
+	//arrays exist until play_alloc_level() is called
+	ctx->arena.size = 0;
+	ctx->num_level_columns = 0;
+	ctx->level_columns = NULL;
+	ctx->max_objs = 0;
+	ctx->objs = NULL;
+	ctx->obj_nodes = NULL;
+	ctx->obj_order = NULL;
+	ctx->obj_order_pos = NULL;
+	ctx->num_ordered_objs = 0;
+	ctx->obj_scratch = NULL;
+	ctx->max_gushes = 0;
+	ctx->num_level_gushes = 0;
+	ctx->gushes = NULL;
+	ctx->num_solids = 0;
+	ctx->max_solids = 0;
+	ctx->solids = NULL;
+	ctx->num_triggers = 0;
+	ctx->triggers = NULL;
+	ctx->num_respawn_points = 0;
+	ctx->respawn_points = NULL;
+
+	for (i = 0; i < NUM_OBJLISTS; i++) {
+		ctx->obj_lists[i].first = NONE;
+		ctx->obj_lists[i].last = NONE;
+		ctx->obj_lists[i].cursor = NONE;
+	}
 
-static bool  ignore_user_input;
-static bool  input_left,  old_input_left;
-static bool  input_right, old_input_right;
-static bool  input_jump,  old_input_jump;
-static float jump_timeout;
+	ctx->gush_phase.obj = NONE;
+	ctx->gush_phase.y = PN(GUSH_INITIAL_Y);
+	ctx->gush_phase.move_pattern = GUSH_MOVE_PATTERN_1;
+	ctx->gush_phase.move_pattern_pos = 0;
+	ctx->gush_phase.yvel = PN(data_gush_move_patterns[GUSH_MOVE_PATTERN_1][0]);
+	ctx->gush_phase.ydest = PN(data_gush_move_patterns[GUSH_MOVE_PATTERN_1][1]);
 
-//------------------------------------------------------------------------------
+	ctx->active_objs.first = 0;
+	ctx->active_objs.end = 0;
+	ctx->active_gushes.first = 0;
+	ctx->active_gushes.end = 0;
+	ctx->active_passageways.first = 0;
+	ctx->active_passageways.end = 0;
 
-//Function prototypes
-static void position_camera();
-static void set_animation(int anim, bool running, bool loop, bool reverse,
-	int num_frames, float delay);
-static void start_animation(int anim);
-static void add_crack_particles(int x, int y);
-static void move_bus_to_end();
-static void show_player_in_bus();
-static void start_score_count();
-static void begin_update();
-static void update_remaining_time();
-static void update_score_count();
-static void move_objects();
-static void handle_car_thrown_peel();
-static void move_player();
-static void handle_solids();
-static void handle_passageways();
-static void handle_player_interactions();
-static void handle_triggers();
-static void do_player_state_specifics();
-static void handle_fall_sound();
-static void handle_respawn();
-static void handle_player_state_change();
-static void move_camera();
-static void keep_player_within_limits();
-static void handle_player_animation_change();
-static void update_animations();
-static void move_push_arrow();
-static void position_bus_stop_sign();
-static void position_light_pole();
-static void update_sequence();
+	ctx->next_trigger = 0;
+	ctx->respawn_point = NONE;
 
-//------------------------------------------------------------------------------
+	for (i = 0; i < MAX_MOVING_PEELS; i++) {
+		ctx->moving_peels[i].obj = NONE;
+	}
+
+	for (i = 0; i < MAX_PASSAGEWAYS; i++) {
+		ctx->passageways[i].x = NONE;
+		ctx->passageways[i].exit_opened = false;
+	}
+
+	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
+		ctx->pushable_crates[i].obj = NONE;
+		ctx->pushable_crates[i].pushed = false;
+		ctx->pushable_crates[i].show_arrow = false;
+	}
+
+	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
+		ctx->cutscene_objects[i].sprite = NONE;
+		ctx->cutscene_objects[i].x = 0;
+		ctx->cutscene_objects[i].y = 0;
+		ctx->cutscene_objects[i].xvel = 0;
+		ctx->cutscene_objects[i].yvel = 0;
+		ctx->cutscene_objects[i].acc = 0;
+		ctx->cutscene_objects[i].grav = 0;
+		ctx->cutscene_objects[i].in_bus = false;
+	}
+
+	for (i = 0; i < MAX_COIN_SPARKS; i++) {
+		ctx->coin_sparks[i].x = NONE;
+	}
 
-PlayCtx* play_init(DisplayParams* dp)
+	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
+		ctx->crack_particles[i].x = NONE;
+	}
+
+	set_animation(ctx, ANIM_PLAYER, true, true, false, 1, PN(0.1f));
+	set_animation(ctx, ANIM_COINS, true, true, false, 3, PN(0.1f));
+	set_animation(ctx, ANIM_GUSHES, true, true, false, 3, PN(0.05f));
+	set_animation(ctx, ANIM_HIT_SPRING, false, false, false, 6, PN(0.02f));
+	set_animation(ctx, ANIM_CRACK_PARTICLES, true, true, false, 2, PN(0.1f));
+	set_animation(ctx, ANIM_BUS_WHEELS, false, true, false, 3, PN(0.1f));
+	set_animation(ctx, ANIM_BUS_DOOR_REAR, false, false, false, 4, PN(0.1f));
+	set_animation(ctx, ANIM_BUS_DOOR_FRONT, false, false, false, 4, PN(0.1f));
+	set_animation(ctx, ANIM_CAR_WHEELS, false, true, false, 2, PN(0.05f));
+	set_animation(ctx, ANIM_HEN, false, true, false, 4, PN(0.05f));
+
+	for (i = 0; i < MAX_COIN_SPARKS; i++) {
+		set_animation(ctx, ANIM_COIN_SPARKS + i, false, false, false, 4, PN(0.05f));
+	}
+	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
+		set_animation(ctx, ANIM_CUTSCENE_OBJECTS + i, false, false, false, 1, 0);
+	}
+
+	ctx->next_coin_spark = 0;
+	ctx->next_crack_particle = 0;
+
+	ctx->push_arrow.xoffs = 0;
+	ctx->push_arrow.xvel = 0;
+	ctx->push_arrow.delay = PN(1);
+
+	ctx->player_reached_flagman = false;
+	ctx->hen_reached_flagman = false;
+	ctx->bus_reached_flagman = false;
+
+	ctx->sequence_step = 0;
+	ctx->sequence_delay = 0;
+	ctx->wipe_in = false;
+	ctx->wipe_out = false;
+
+	ctx->first_event = 0;
+	ctx->num_events = 0;
+}
+
+void play_set_input(PlayCtx* ctx, int input_state)
 {
-	display_params = dp;
+	if (ctx->ignore_user_input) return;
+
+	ctx->old_input_left  = ctx->input_left;
+	ctx->old_input_right = ctx->input_right;
+	ctx->old_input_jump  = ctx->input_jump;
 
-	return &ctx;
+	ctx->input_left  = (input_state & INPUT_LEFT)  > 0;
+	ctx->input_right = (input_state & INPUT_RIGHT) > 0;
+	ctx->input_jump  = (input_state & INPUT_JUMP)  > 0;
+
+	if (ctx->input_jump && !ctx->old_input_jump) {
+		ctx->jump_timeout = PN(JUMP_TIMEOUT);
+	}
 }
 
-void play_clear()
+//Runs the gameplay logic for the given time, which is split into equal steps
+//no longer than a tick, so that nothing moves far enough in a single step to
+//pass through a solid, a spring, or a passageway exit, however long the time
+//(the game and the simulation always pass exactly one tick)
+void play_update(PlayCtx* ctx, float dt)
 {
+	//The tolerance keeps rounding errors from splitting a single tick
+	int num_steps = (int)ceilf(dt / PLAY_DT - 0.001f);
 	int i;
 
-	delta_time = 0;
-
-	ignore_user_input = true;
-	input_left = false;
-	input_right = false;
-	input_jump = false;
-	jump_timeout = 0;
-
-	ctx.difficulty = 0;
-	ctx.level_num = 0;
-	ctx.last_level = false;
-	ctx.ending = false;
-	ctx.level_size = 0;
-	ctx.bg_color = 0;
-	ctx.bgm = 0;
-	ctx.goal_scene = 0;
-
-	ctx.time = 90;
-	ctx.time_running = false;
-	ctx.time_up = false;
-	ctx.goal_reached = false;
-	ctx.counting_score = false;
-	ctx.can_pause = false;
-
-	ctx.crate_push_remaining = 0.75f;
-
-	ctx.cam.x = 0;
-	ctx.cam.y = 0;
-	ctx.cam.xvel = 0;
-	ctx.cam.yvel = 0;
-	ctx.cam.follow_player = false;
-	ctx.cam.fixed_at_leftmost = false;
-	ctx.cam.fixed_at_rightmost = false;
-
-	ctx.player.x = 96;
-	ctx.player.oldx = 96;
-	ctx.player.y = 204;
-	ctx.player.oldy = 200;
-	ctx.player.xvel = 0;
-	ctx.player.yvel = 0;
-	ctx.player.fell = false;
-	ctx.player.on_floor = false;
-	ctx.player.anim_type = PLAYER_ANIM_STAND;
-	ctx.player.old_anim_type = PLAYER_ANIM_STAND;
-	ctx.player.state = PLAYER_STATE_NORMAL;
-	ctx.player.old_state = NONE;
-	handle_player_state_change();
-
-	ctx.bus.x = 24;
-	ctx.bus.xvel = 0;
-	ctx.bus.acc = 0;
-
-	ctx.grabbed_rope.obj = NONE;
-	ctx.hit_spring = NONE;
-	ctx.car.x = NONE;
-	ctx.hen.x = NONE;
-
-	ctx.cur_passageway = NONE;
-
-	for (i = 0; i < MAX_LEVEL_COLUMNS; i++) {
-		ctx.level_columns[i].type = LVLCOL_NORMAL_FLOOR;
-		ctx.level_columns[i].num_crates = 0;
-	}
-
-	for (i = 0; i < MAX_OBJS; i++) {
-		ctx.objs[i].type = NONE;
-	}
-
-	for (i = 0; i < MAX_GUSHES; i++) {
-		ctx.gushes[i].obj = NONE;
+	if (num_steps <= 1) {
+		update_step(ctx, dt);
+		return;
 	}
 
-	for (i = 0; i < MAX_MOVING_PEELS; i++) {
-		ctx.moving_peels[i].obj = NONE;
+	for (i = 0; i < num_steps; i++) {
+		update_step(ctx, dt / num_steps);
 	}
+}
 
-	for (i = 0; i < MAX_PASSAGEWAYS; i++) {
-		ctx.passageways[i].x = NONE;
-		ctx.passageways[i].exit_opened = false;
+void play_adapt_to_screen_size(PlayCtx* ctx, int vscreen_width)
+{
+	PlayCamera* cam = &ctx->cam;
+
+	cam->xmin = 0;
+	cam->xmax = PN(ctx->level_size - vscreen_width);
+	cam->follow_player_min_x = PN(64);
+	cam->follow_player_max_x = PN(vscreen_width / 2);
+
+	if (vscreen_width <= 256) {
+		cam->follow_player_min_x  = PN(32);
+		cam->follow_player_max_x -= PN(64);
+		cam->xmin = PN(40);
+	} else if (vscreen_width <= 320) {
+		cam->follow_player_min_x  = PN(32);
+		cam->follow_player_max_x -= PN(56);
+		cam->xmin = PN(40);
 	}
 
+	position_camera(ctx);
+	update_active_ranges(ctx);
+}
+
+//Takes the oldest event produced by play_update(), returning false if there is
+//none
+//
+//The events are meant to be taken once per rendered frame, not necessarily
+//after every update, and simply accumulate (or are eventually overwritten) if
+//no one takes them
+bool play_take_event(PlayCtx* ctx, PlayEvent* evt)
+{
+	if (ctx->num_events == 0) return false;
+
+	*evt = ctx->events[ctx->first_event];
+	ctx->first_event = (ctx->first_event + 1) % MAX_PLAY_EVENTS;
+	ctx->num_events--;
+
+	return true;
+}
+
+//Computes a hash of each part of the gameplay state that must be the same in
+//two runs of a level with the same input, which is cheap enough to be done on
+//every tick
+//
+//Arrays whose elements contain only 32-bit fields are hashed as raw words,
+//including the objects and gushes outside the active window, as they must not
+//change either
+void play_state_hash(const PlayCtx* ctx, StateHash* hash)
+{
+	const Player* pl = &ctx->player;
+	const PlayCamera* cam = &ctx->cam;
+	uint32_t h;
+	int i;
+
+	h = 2166136261u;
+	h = hash_int(h, pl->state);
+	h = hash_int(h, pl->visible);
+	h = hash_int(h, pl->on_floor);
+	h = hash_int(h, pl->fell);
+	h = hash_int(h, pl->height);
+	h = hash_int(h, pl->anim_type);
+	h = hash_num(h, pl->flicker_delay);
+	h = hash_num(h, pl->x);
+	h = hash_num(h, pl->y);
+	h = hash_num(h, pl->xvel);
+	h = hash_num(h, pl->yvel);
+	h = hash_num(h, pl->acc);
+	h = hash_num(h, pl->dec);
+	h = hash_num(h, pl->grav);
+	hash->parts[PLAYHASH_PLAYER] = h;
+
+	h = 2166136261u;
+	h = hash_num(h, ctx->bus.x);
+	h = hash_num(h, ctx->bus.xvel);
+	h = hash_num(h, ctx->bus.acc);
+	h = hash_int(h, ctx->bus.route_sign);
+	h = hash_int(h, ctx->bus.num_characters);
+	hash->parts[PLAYHASH_BUS] = h;
+
+	h = 2166136261u;
+	h = hash_num(h, cam->x);
+	h = hash_num(h, cam->y);
+	h = hash_num(h, cam->xvel);
+	h = hash_num(h, cam->yvel);
+	h = hash_num(h, cam->xdest);
+	h = hash_int(h, cam->follow_player);
+	h = hash_int(h, cam->fixed_at_leftmost);
+	h = hash_int(h, cam->fixed_at_rightmost);
+	hash->parts[PLAYHASH_CAM] = h;
+
+	h = 2166136261u;
+	h = hash_words(h, ctx->objs, ctx->max_objs * sizeof(Obj));
+	hash->parts[PLAYHASH_OBJS] = h;
+
+	h = 2166136261u;
+	h = hash_words(h, &ctx->gush_phase, sizeof(Gush));
+	h = hash_words(h, ctx->gushes, ctx->max_gushes * sizeof(Gush));
+	hash->parts[PLAYHASH_GUSHES] = h;
+
+	//Unused peels and crates keep the fields of a previous level
+	h = 2166136261u;
+	for (i = 0; i < MAX_MOVING_PEELS; i++) {
+		const MovingPeel* peel = &ctx->moving_peels[i];
+
+		h = hash_int(h, peel->obj);
+		if (peel->obj == NONE) continue;
+
+		h = hash_words(h, peel, sizeof(MovingPeel));
+	}
+	hash->parts[PLAYHASH_MOVING_PEELS] = h;
+
+	h = 2166136261u;
 	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
-		ctx.pushable_crates[i].obj = NONE;
-		ctx.pushable_crates[i].pushed = false;
-		ctx.pushable_crates[i].show_arrow = false;
+		const PushableCrate* crate = &ctx->pushable_crates[i];
+
+		h = hash_int(h, crate->obj);
+		if (crate->obj == NONE) continue;
+
+		h = hash_num(h, crate->x);
+		h = hash_int(h, crate->show_arrow);
+		h = hash_int(h, crate->pushed);
+		h = hash_num(h, crate->xmax);
+	}
+	hash->parts[PLAYHASH_PUSHABLE_CRATES] = h;
+
+	h = 2166136261u;
+	h = hash_int(h, ctx->sequence_step);
+	h = hash_num(h, ctx->sequence_delay);
+	h = hash_int(h, ctx->goal_reached);
+	h = hash_int(h, ctx->time_up);
+	hash->parts[PLAYHASH_SEQUENCE] = h;
+
+	hash->parts[PLAYHASH_SCORE] = hash_int(2166136261u, ctx->score);
+	hash->parts[PLAYHASH_TIME] = hash_int(2166136261u, ctx->time);
+}
+
+//Allocates the level-dependent arrays of a gameplay context from its arena,
+//which is enlarged if needed, returning false if out of memory
+//
+//This is the only allocation made for a level, and none is made during play
+bool play_alloc_level(PlayCtx* ctx, int num_level_columns, int max_objs,
+	int max_gushes, int max_solids, int num_triggers, int num_respawn_points)
+{
+	size_t size = 0;
+	size_t level_columns, objs, obj_nodes, obj_order, obj_order_pos, obj_scratch;
+	size_t gushes, solids, triggers, respawn_points;
+	char* data;
+	int i;
+
+	level_columns = arena_reserve(&size, num_level_columns * sizeof(LevelColumn));
+	objs = arena_reserve(&size, max_objs * sizeof(Obj));
+	obj_nodes = arena_reserve(&size, max_objs * sizeof(ObjListNode));
+	obj_order = arena_reserve(&size, max_objs * sizeof(int));
+	obj_order_pos = arena_reserve(&size, max_objs * sizeof(int));
+	obj_scratch = arena_reserve(&size, max_objs * sizeof(int));
+	gushes = arena_reserve(&size, max_gushes * sizeof(Gush));
+	solids = arena_reserve(&size, max_solids * sizeof(Solid));
+	triggers = arena_reserve(&size, num_triggers * sizeof(Trigger));
+	respawn_points = arena_reserve(&size, num_respawn_points * sizeof(RespawnPoint));
+
+	if (!arena_fit(&ctx->arena, size)) {
+		return false;
 	}
 
-	for (i = 0; i < MAX_RESPAWN_POINTS; i++) {
-		ctx.respawn_points[i].x = NONE;
+	//Leave nothing from the previous level, so the state (and its hash) does
+	//not depend on which levels were played before
+	data = ctx->arena.data;
+	memset(data, 0, size);
+
+	ctx->num_level_columns = num_level_columns;
+	ctx->level_columns = (LevelColumn*)(data + level_columns);
+	ctx->max_objs = max_objs;
+	ctx->objs = (Obj*)(data + objs);
+	ctx->obj_nodes = (ObjListNode*)(data + obj_nodes);
+	ctx->obj_order = (int*)(data + obj_order);
+	ctx->obj_order_pos = (int*)(data + obj_order_pos);
+	ctx->obj_scratch = (int*)(data + obj_scratch);
+	ctx->max_gushes = max_gushes;
+	ctx->gushes = (Gush*)(data + gushes);
+	ctx->max_solids = max_solids;
+	ctx->solids = (Solid*)(data + solids);
+	ctx->num_triggers = num_triggers;
+	ctx->triggers = (Trigger*)(data + triggers);
+	ctx->num_respawn_points = num_respawn_points;
+	ctx->respawn_points = (RespawnPoint*)(data + respawn_points);
+
+	for (i = 0; i < num_level_columns; i++) {
+		ctx->level_columns[i].type = LVLCOL_NORMAL_FLOOR;
+		ctx->level_columns[i].num_crates = 0;
+		ctx->level_columns[i].num_solids = 0;
 	}
 
-	for (i = 0; i < MAX_SOLIDS; i++) {
-		ctx.solids[i].type = NONE;
+	for (i = 0; i < max_objs; i++) {
+		ctx->objs[i].type = NONE;
+		ctx->obj_nodes[i].list = NONE;
+		ctx->obj_order_pos[i] = NONE;
 	}
 
-	for (i = 0; i < MAX_TRIGGERS; i++) {
-		ctx.triggers[i].x = NONE;
+	for (i = 0; i < max_gushes; i++) {
+		ctx->gushes[i].obj = NONE;
 	}
 
-	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
-		ctx.cutscene_objects[i].sprite = NONE;
-		ctx.cutscene_objects[i].x = 0;
-		ctx.cutscene_objects[i].y = 0;
-		ctx.cutscene_objects[i].xvel = 0;
-		ctx.cutscene_objects[i].yvel = 0;
-		ctx.cutscene_objects[i].acc = 0;
-		ctx.cutscene_objects[i].grav = 0;
-		ctx.cutscene_objects[i].in_bus = false;
+	for (i = 0; i < max_solids; i++) {
+		ctx->solids[i].type = NONE;
 	}
 
-	for (i = 0; i < MAX_COIN_SPARKS; i++) {
-		ctx.coin_sparks[i].x = NONE;
+	for (i = 0; i < num_triggers; i++) {
+		ctx->triggers[i].x = NONE;
 	}
 
-	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
-		ctx.crack_particles[i].x = NONE;
+	for (i = 0; i < num_respawn_points; i++) {
+		ctx->respawn_points[i].x = NONE;
 	}
 
-	set_animation(ANIM_PLAYER, true, true, false, 1, 0.1f);
-	set_animation(ANIM_COINS, true, true, false, 3, 0.1f);
-	set_animation(ANIM_GUSHES, true, true, false, 3, 0.05f);
-	set_animation(ANIM_HIT_SPRING, false, false, false, 6, 0.02f);
-	set_animation(ANIM_CRACK_PARTICLES, true, true, false, 2, 0.1f);
-	set_animation(ANIM_BUS_WHEELS, false, true, false, 3, 0.1f);
-	set_animation(ANIM_BUS_DOOR_REAR, false, false, false, 4, 0.1f);
-	set_animation(ANIM_BUS_DOOR_FRONT, false, false, false, 4, 0.1f);
-	set_animation(ANIM_CAR_WHEELS, false, true, false, 2, 0.05f);
-	set_animation(ANIM_HEN, false, true, false, 4, 0.05f);
+	return true;
+}
+
+//Copies a gameplay context, including its level-dependent arrays, returning
+//false if out of memory
+//
+//The destination's arena is enlarged if needed, so copying between contexts
+//holding the same level does not allocate memory
+bool play_copy(PlayCtx* dst, const PlayCtx* src)
+{
+	PlayArena arena = dst->arena;
 
-	for (i = 0; i < MAX_COIN_SPARKS; i++) {
-		set_animation(ANIM_COIN_SPARKS + i, false, false, false, 4, 0.05f);
+	if (!arena_fit(&arena, src->arena.size)) {
+		return false;
 	}
-	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
-		set_animation(ANIM_CUTSCENE_OBJECTS + i, false, false, false, 1, 0);
+
+	memcpy(arena.data, src->arena.data, src->arena.size);
+
+	*dst = *src;
+	dst->arena = arena;
+
+	dst->level_columns = rebase(src, dst, src->level_columns);
+	dst->objs = rebase(src, dst, src->objs);
+	dst->obj_nodes = rebase(src, dst, src->obj_nodes);
+	dst->obj_order = rebase(src, dst, src->obj_order);
+	dst->obj_order_pos = rebase(src, dst, src->obj_order_pos);
+	dst->obj_scratch = rebase(src, dst, src->obj_scratch);
+	dst->gushes = rebase(src, dst, src->gushes);
+	dst->solids = rebase(src, dst, src->solids);
+	dst->triggers = rebase(src, dst, src->triggers);
+	dst->respawn_points = rebase(src, dst, src->respawn_points);
+
+	return true;
+}
+
+//Copies a gameplay context to be modified and drawn by the renderer, returning
+//false if out of memory
+//
+//Only objs[] is actually copied, and the other level-dependent arrays are
+//shared with the source, so the copy remains valid only until the source is
+//cleared
+bool play_copy_for_drawing(PlayCtx* dst, const PlayCtx* src)
+{
+	PlayArena arena = dst->arena;
+
+	if (!arena_fit(&arena, src->arena.size)) {
+		return false;
 	}
 
-	ctx.next_coin_spark = 0;
-	ctx.next_crack_particle = 0;
+	*dst = *src;
+	dst->arena = arena;
+
+	if (src->objs != NULL) {
+		dst->objs = rebase(src, dst, src->objs);
+		memcpy(dst->objs, src->objs, src->max_objs * sizeof(Obj));
+	}
+
+	return true;
+}
+
+//Gets the number of bytes needed by a snapshot of a gameplay context
+size_t play_snapshot_size(const PlayCtx* ctx)
+{
+	return sizeof(PlaySnapshotHeader) + sizeof(PlayCtx) + ctx->arena.size;
+}
+
+//Captures the complete state of a gameplay context into a buffer, which can
+//later be passed to play_restore(), returning the number of bytes written or
+//zero if the buffer is too small (see play_snapshot_size())
+size_t play_snapshot(const PlayCtx* ctx, void* buf, size_t bufsize)
+{
+	PlaySnapshotHeader hdr;
+	PlayCtx copy;
+	char* dst = buf;
+	size_t size = play_snapshot_size(ctx);
 
-	ctx.push_arrow.xoffs = 0;
-	ctx.push_arrow.xvel = 0;
-	ctx.push_arrow.delay = 1;
+	if (bufsize < size) {
+		return 0;
+	}
 
-	ctx.player_reached_flagman = false;
-	ctx.hen_reached_flagman = false;
-	ctx.bus_reached_flagman = false;
+	memcpy(hdr.magic, "AVBS", 4);
+	hdr.ctx_size = sizeof(PlayCtx);
+	hdr.arena_size = ctx->arena.size;
+	hdr.offsets[0] = arena_offset(ctx, ctx->level_columns);
+	hdr.offsets[1] = arena_offset(ctx, ctx->objs);
+	hdr.offsets[2] = arena_offset(ctx, ctx->obj_nodes);
+	hdr.offsets[3] = arena_offset(ctx, ctx->obj_order);
+	hdr.offsets[4] = arena_offset(ctx, ctx->obj_order_pos);
+	hdr.offsets[5] = arena_offset(ctx, ctx->obj_scratch);
+	hdr.offsets[6] = arena_offset(ctx, ctx->gushes);
+	hdr.offsets[7] = arena_offset(ctx, ctx->solids);
+	hdr.offsets[8] = arena_offset(ctx, ctx->triggers);
+	hdr.offsets[9] = arena_offset(ctx, ctx->respawn_points);
+
+	//Leave no pointers in the snapshot
+	copy = *ctx;
+	copy.arena.data = NULL;
+	copy.arena.capacity = 0;
+	copy.level_columns = NULL;
+	copy.objs = NULL;
+	copy.obj_nodes = NULL;
+	copy.obj_order = NULL;
+	copy.obj_order_pos = NULL;
+	copy.obj_scratch = NULL;
+	copy.gushes = NULL;
+	copy.solids = NULL;
+	copy.triggers = NULL;
+	copy.respawn_points = NULL;
+
+	memcpy(dst, &hdr, sizeof(hdr));
+	memcpy(dst + sizeof(hdr), &copy, sizeof(copy));
+
+	if (ctx->arena.size > 0) {
+		memcpy(dst + sizeof(hdr) + sizeof(copy), ctx->arena.data, ctx->arena.size);
+	}
 
-	ctx.sequence_step = 0;
-	ctx.sequence_delay = 0;
-	ctx.wipe_in = false;
-	ctx.wipe_out = false;
+	return size;
 }
 
-void play_set_input(int input_state)
+//Replaces the state of a gameplay context with one captured by play_snapshot(),
+//returning false if the snapshot is invalid or if out of memory, in which case
+//the context is left unchanged
+//
+//As with play_copy(), the context's arena is reused if large enough, so
+//restoring snapshots of the same level does not allocate memory
+bool play_restore(PlayCtx* ctx, const void* buf, size_t size)
 {
-	if (ignore_user_input) return;
+	PlaySnapshotHeader hdr;
+	PlayCtx copy;
+	PlayArena arena = ctx->arena;
+	const char* src = buf;
+	uint64_t n;
+	bool valid;
+
+	if (size < sizeof(hdr) + sizeof(copy)) {
+		return false;
+	}
 
-	old_input_left  = input_left;
-	old_input_right = input_right;
-	old_input_jump  = input_jump;
+	memcpy(&hdr, src, sizeof(hdr));
+	memcpy(&copy, src + sizeof(hdr), sizeof(copy));
 
-	input_left  = (input_state & INPUT_LEFT)  > 0;
-	input_right = (input_state & INPUT_RIGHT) > 0;
-	input_jump  = (input_state & INPUT_JUMP)  > 0;
+	if (memcmp(hdr.magic, "AVBS", 4) != 0 || hdr.ctx_size != sizeof(PlayCtx) ||
+			hdr.arena_size != size - sizeof(hdr) - sizeof(copy)) {
 
-	if (input_jump && !old_input_jump) {
-		jump_timeout = JUMP_TIMEOUT;
+		return false;
 	}
+
+	//Check the arrays against the snapshot's arena before modifying the
+	//context
+	n = hdr.arena_size;
+	valid = array_fits(n, hdr.offsets[0], copy.num_level_columns, sizeof(LevelColumn)) &&
+		array_fits(n, hdr.offsets[1], copy.max_objs, sizeof(Obj)) &&
+		array_fits(n, hdr.offsets[2], copy.max_objs, sizeof(ObjListNode)) &&
+		array_fits(n, hdr.offsets[3], copy.max_objs, sizeof(int)) &&
+		array_fits(n, hdr.offsets[4], copy.max_objs, sizeof(int)) &&
+		array_fits(n, hdr.offsets[5], copy.max_objs, sizeof(int)) &&
+		array_fits(n, hdr.offsets[6], copy.max_gushes, sizeof(Gush)) &&
+		array_fits(n, hdr.offsets[7], copy.max_solids, sizeof(Solid)) &&
+		array_fits(n, hdr.offsets[8], copy.num_triggers, sizeof(Trigger)) &&
+		array_fits(n, hdr.offsets[9], copy.num_respawn_points, sizeof(RespawnPoint));
+
+	//A snapshot read from a file may have been truncated or edited, so every
+	//index within it is also checked
+	valid = valid && snapshot_valid(&copy, &hdr, src + sizeof(hdr) + sizeof(copy));
+
+	if (!valid || !arena_fit(&arena, hdr.arena_size)) {
+		return false;
+	}
+
+	if (hdr.arena_size > 0) {
+		memcpy(arena.data, src + sizeof(hdr) + sizeof(copy), hdr.arena_size);
+	}
+
+	*ctx = copy;
+	ctx->arena = arena;
+
+	ctx->level_columns = arena_at(ctx, hdr.offsets[0]);
+	ctx->objs = arena_at(ctx, hdr.offsets[1]);
+	ctx->obj_nodes = arena_at(ctx, hdr.offsets[2]);
+	ctx->obj_order = arena_at(ctx, hdr.offsets[3]);
+	ctx->obj_order_pos = arena_at(ctx, hdr.offsets[4]);
+	ctx->obj_scratch = arena_at(ctx, hdr.offsets[5]);
+	ctx->gushes = arena_at(ctx, hdr.offsets[6]);
+	ctx->solids = arena_at(ctx, hdr.offsets[7]);
+	ctx->triggers = arena_at(ctx, hdr.offsets[8]);
+	ctx->respawn_points = arena_at(ctx, hdr.offsets[9]);
+
+	return true;
 }
 
-void play_update(float dt)
+//Releases the memory of a gameplay context's arena
+void play_free(PlayCtx* ctx)
 {
-	delta_time = dt;
+	play_clear(ctx);
 
-	begin_update();
-	update_remaining_time();
-	update_score_count();
-	move_objects();
-	handle_car_thrown_peel();
-	move_player();
-	handle_solids();
-	handle_passageways();
-	handle_player_interactions();
-	handle_triggers();
-	do_player_state_specifics();
-	handle_fall_sound();
-	handle_respawn();
-	handle_player_state_change();
-	move_camera();
-	keep_player_within_limits();
-	handle_player_animation_change();
-	update_animations();
-	move_push_arrow();
-	position_bus_stop_sign();
-	position_light_pole();
-	update_sequence();
+	free(ctx->arena.data);
+	ctx->arena.data = NULL;
+	ctx->arena.capacity = 0;
 }
 
-void play_adapt_to_screen_size()
+//Adds a solid to the lists of the level columns it overlaps, returning false
+//without changing any list if any of them is full
+bool play_index_solid(PlayCtx* ctx, int solid)
 {
-	PlayCamera* cam = &ctx.cam;
-	int vscreen_width = display_params->vscreen_width;
+	Solid* sol = &ctx->solids[solid];
+	int first, last;
+	int i;
 
-	cam->xmin = 0;
-	cam->xmax = ctx.level_size - vscreen_width;
-	cam->follow_player_min_x = 64;
-	cam->follow_player_max_x = vscreen_width / 2;
+	get_column_range(ctx, sol->left, sol->right, &first, &last);
 
-	if (vscreen_width <= 256) {
-		cam->follow_player_min_x  = 32;
-		cam->follow_player_max_x -= 64;
-		cam->xmin = 40;
-	} else if (vscreen_width <= 320) {
-		cam->follow_player_min_x  = 32;
-		cam->follow_player_max_x -= 56;
-		cam->xmin = 40;
+	for (i = first; i <= last; i++) {
+		if (ctx->level_columns[i].num_solids >= MAX_COLUMN_SOLIDS) {
+			return false;
+		}
+	}
+
+	for (i = first; i <= last; i++) {
+		LevelColumn* col = &ctx->level_columns[i];
+		int j;
+
+		//Keep the list in ascending order
+		for (j = col->num_solids; j > 0 && col->solids[j - 1] > solid; j--) {
+			col->solids[j] = col->solids[j - 1];
+		}
+
+		col->solids[j] = solid;
+		col->num_solids++;
+	}
+
+	return true;
+}
+
+//Moves an object to one of the object lists (OBJLIST_* constants), keeping the
+//list in ascending order of X position, or just removes the object from its
+//current list if the new list is NONE
+void play_set_obj_list(PlayCtx* ctx, int obj, int list)
+{
+	ObjListNode* node = &ctx->obj_nodes[obj];
+	ObjList* lst;
+	int x = ctx->objs[obj].x;
+	int prev, next;
+
+	if (node->list == list) return;
+
+	if (node->list != NONE) {
+		unlink_obj(ctx, obj);
+	}
+
+	if (list == NONE) return;
+
+	lst = &ctx->obj_lists[list];
+
+	//Find the first object placed to the right, starting from the cursor
+	next = (lst->cursor != NONE) ? lst->cursor : lst->first;
+	while (next != NONE) {
+		prev = ctx->obj_nodes[next].prev;
+		if (prev == NONE || ctx->objs[prev].x <= x) break;
+		next = prev;
+	}
+	while (next != NONE && ctx->objs[next].x <= x) {
+		next = ctx->obj_nodes[next].next;
 	}
 
-	position_camera();
+	prev = (next != NONE) ? ctx->obj_nodes[next].prev : lst->last;
+
+	node->list = list;
+	node->prev = prev;
+	node->next = next;
+
+	if (prev != NONE) {
+		ctx->obj_nodes[prev].next = obj;
+	} else {
+		lst->first = obj;
+	}
+
+	if (next != NONE) {
+		ctx->obj_nodes[next].prev = obj;
+	} else {
+		lst->last = obj;
+	}
+
+	lst->cursor = obj;
 }
 
 //------------------------------------------------------------------------------
 
-static void position_camera()
+static void position_camera(PlayCtx* ctx)
 {
-	PlayCamera* cam = &ctx.cam;
+	PlayCamera* cam = &ctx->cam;
 
 	if (cam->follow_player) {
 		if (cam->xvel == 0) {
-			if (ctx.player.x > cam->x + cam->follow_player_max_x) {
+			if (ctx->player.x > cam->x + cam->follow_player_max_x) {
 				//Move right
-				cam->x = ctx.player.x - cam->follow_player_max_x;
-			} else if (ctx.player.x < cam->x + cam->follow_player_min_x) {
+				cam->x = ctx->player.x - cam->follow_player_max_x;
+			} else if (ctx->player.x < cam->x + cam->follow_player_min_x) {
 				//Move left
-				cam->x = ctx.player.x - cam->follow_player_min_x;
+				cam->x = ctx->player.x - cam->follow_player_min_x;
 			}
 		}
 
@@ -344,8 +860,8 @@ static void position_camera()
 			//This is not the final Y position of the camera, as the camera's
 			//vertical movement is ignored if it is over the floor and the
 			//virtual screen (vscreen) is high enough
-			if (ctx.player.y < 104) {
-				cam->y = ctx.player.y - 104;
+			if (ctx->player.y < PN(104)) {
+				cam->y = ctx->player.y - PN(104);
 			}
 		}
 	}
@@ -361,10 +877,10 @@ static void position_camera()
 	}
 }
 
-static void set_animation(int anim, bool running, bool loop, bool reverse,
-	int num_frames, float delay)
+static void set_animation(PlayCtx* ctx, int anim, bool running, bool loop, bool reverse,
+	int num_frames, PlayNum delay)
 {
-	Anim* a = &ctx.anims[anim];
+	Anim* a = &ctx->anims[anim];
 
 	a->running = running;
 	a->loop = loop;
@@ -375,106 +891,148 @@ static void set_animation(int anim, bool running, bool loop, bool reverse,
 	a->max_delay = delay;
 }
 
-static void start_animation(int anim)
+static void start_animation(PlayCtx* ctx, int anim)
 {
-	Anim* a = &ctx.anims[anim];
+	Anim* a = &ctx->anims[anim];
 
 	a->running = true;
 	a->delay = a->max_delay;
 	a->frame = a->reverse ? a->num_frames - 1 : 0;
 }
 
-static void add_crack_particles(int x, int y)
-{
-	ctx.crack_particles[ctx.next_crack_particle].x = x;
-	ctx.crack_particles[ctx.next_crack_particle].y = y;
-	ctx.crack_particles[ctx.next_crack_particle].xvel = -15;
-	ctx.crack_particles[ctx.next_crack_particle].yvel = -120;
-	ctx.crack_particles[ctx.next_crack_particle].grav =  198;
-	ctx.next_crack_particle++;
-	ctx.next_crack_particle %= MAX_CRACK_PARTICLES;
-
-	ctx.crack_particles[ctx.next_crack_particle].x = x;
-	ctx.crack_particles[ctx.next_crack_particle].y = y;
-	ctx.crack_particles[ctx.next_crack_particle].xvel = -6;
-	ctx.crack_particles[ctx.next_crack_particle].yvel = -192;
-	ctx.crack_particles[ctx.next_crack_particle].grav =  198;
-	ctx.next_crack_particle++;
-	ctx.next_crack_particle %= MAX_CRACK_PARTICLES;
-
-	ctx.crack_particles[ctx.next_crack_particle].x = x;
-	ctx.crack_particles[ctx.next_crack_particle].y = y;
-	ctx.crack_particles[ctx.next_crack_particle].xvel =  15;
-	ctx.crack_particles[ctx.next_crack_particle].yvel = -120;
-	ctx.crack_particles[ctx.next_crack_particle].grav =  198;
-	ctx.next_crack_particle++;
-	ctx.next_crack_particle %= MAX_CRACK_PARTICLES;
-
-	ctx.crack_particles[ctx.next_crack_particle].x = x;
-	ctx.crack_particles[ctx.next_crack_particle].y = y;
-	ctx.crack_particles[ctx.next_crack_particle].xvel =  6;
-	ctx.crack_particles[ctx.next_crack_particle].yvel = -192;
-	ctx.crack_particles[ctx.next_crack_particle].grav =  198;
-	ctx.next_crack_particle++;
-	ctx.next_crack_particle %= MAX_CRACK_PARTICLES;
+static void add_crack_particles(PlayCtx* ctx, int x, int y)
+{
+	ctx->crack_particles[ctx->next_crack_particle].x = PN(x);
+	ctx->crack_particles[ctx->next_crack_particle].y = PN(y);
+	ctx->crack_particles[ctx->next_crack_particle].xvel = PN(-15);
+	ctx->crack_particles[ctx->next_crack_particle].yvel = PN(-120);
+	ctx->crack_particles[ctx->next_crack_particle].grav =  PN(198);
+	ctx->next_crack_particle++;
+	ctx->next_crack_particle %= MAX_CRACK_PARTICLES;
+
+	ctx->crack_particles[ctx->next_crack_particle].x = PN(x);
+	ctx->crack_particles[ctx->next_crack_particle].y = PN(y);
+	ctx->crack_particles[ctx->next_crack_particle].xvel = PN(-6);
+	ctx->crack_particles[ctx->next_crack_particle].yvel = PN(-192);
+	ctx->crack_particles[ctx->next_crack_particle].grav =  PN(198);
+	ctx->next_crack_particle++;
+	ctx->next_crack_particle %= MAX_CRACK_PARTICLES;
+
+	ctx->crack_particles[ctx->next_crack_particle].x = PN(x);
+	ctx->crack_particles[ctx->next_crack_particle].y = PN(y);
+	ctx->crack_particles[ctx->next_crack_particle].xvel =  PN(15);
+	ctx->crack_particles[ctx->next_crack_particle].yvel = PN(-120);
+	ctx->crack_particles[ctx->next_crack_particle].grav =  PN(198);
+	ctx->next_crack_particle++;
+	ctx->next_crack_particle %= MAX_CRACK_PARTICLES;
+
+	ctx->crack_particles[ctx->next_crack_particle].x = PN(x);
+	ctx->crack_particles[ctx->next_crack_particle].y = PN(y);
+	ctx->crack_particles[ctx->next_crack_particle].xvel =  PN(6);
+	ctx->crack_particles[ctx->next_crack_particle].yvel = PN(-192);
+	ctx->crack_particles[ctx->next_crack_particle].grav =  PN(198);
+	ctx->next_crack_particle++;
+	ctx->next_crack_particle %= MAX_CRACK_PARTICLES;
 }
 
 //Moves the bus to the end of the level
-static void move_bus_to_end()
+static void move_bus_to_end(PlayCtx* ctx)
 {
-	ctx.bus.acc = 0;
-	ctx.bus.xvel = 0;
-	ctx.bus.x = ctx.level_size - 456;
+	ctx->bus.acc = 0;
+	ctx->bus.xvel = 0;
+	ctx->bus.x = PN(ctx->level_size - 456);
 
 	//Make rear door closed
-	ctx.anims[ANIM_BUS_DOOR_REAR].running = false;
-	ctx.anims[ANIM_BUS_DOOR_REAR].frame = 0;
-	ctx.anims[ANIM_BUS_DOOR_REAR].reverse = false;
+	ctx->anims[ANIM_BUS_DOOR_REAR].running = false;
+	ctx->anims[ANIM_BUS_DOOR_REAR].frame = 0;
+	ctx->anims[ANIM_BUS_DOOR_REAR].reverse = false;
 
 	//Make front door open
-	ctx.anims[ANIM_BUS_DOOR_FRONT].running = false;
-	ctx.anims[ANIM_BUS_DOOR_FRONT].frame = 3;
-	ctx.anims[ANIM_BUS_DOOR_FRONT].reverse = true;
+	ctx->anims[ANIM_BUS_DOOR_FRONT].running = false;
+	ctx->anims[ANIM_BUS_DOOR_FRONT].frame = 3;
+	ctx->anims[ANIM_BUS_DOOR_FRONT].reverse = true;
 
 	//Bus route sign
-	if (ctx.last_level) {
+	if (ctx->last_level) {
 		//Finish (checkered flag) sign
-		ctx.bus.route_sign = 0;
+		ctx->bus.route_sign = 0;
 	} else {
 		//Sign corresponding to the next level
-		ctx.bus.route_sign = ctx.level_num + 1;
+		ctx->bus.route_sign = ctx->level_num + 1;
 	}
 }
 
-static void show_player_in_bus()
+static void show_player_in_bus(PlayCtx* ctx)
 {
-	CutsceneObject* cutscene_player = &ctx.cutscene_objects[0];
-	Anim* anim = &ctx.anims[ANIM_CUTSCENE_OBJECTS + 0];
+	CutsceneObject* cutscene_player = &ctx->cutscene_objects[0];
+	Anim* anim = &ctx->anims[ANIM_CUTSCENE_OBJECTS + 0];
 
 	cutscene_player->sprite = SPR_PLAYER_STAND;
 	cutscene_player->in_bus = true;
-	cutscene_player->x = 342;
-	cutscene_player->y = BUS_Y + 36;
+	cutscene_player->x = PN(342);
+	cutscene_player->y = PN(BUS_Y + 36);
 
 	anim->frame = 0;
 	anim->num_frames = 1;
 
-	ctx.player.state = PLAYER_STATE_INACTIVE;
-	ctx.player.visible = false;
+	ctx->player.state = PLAYER_STATE_INACTIVE;
+	ctx->player.visible = false;
 }
 
-static void start_score_count()
+static void start_score_count(PlayCtx* ctx)
 {
-	ctx.counting_score = true;
-	ctx.time_delay = 0.1f;
+	ctx->counting_score = true;
+	ctx->time_delay = PN(0.1f);
 }
 
 //------------------------------------------------------------------------------
 
+//Runs a single step of the gameplay logic
+static void update_step(PlayCtx* ctx, float dt)
+{
+	int sequence_step = ctx->sequence_step;
+
+	ctx->delta_time = dt;
+#ifdef PLAY_FIXED_POINT
+	ctx->delta_frac = (int64_t)(dt * 4294967296.0);
+#endif
+
+	PERF_BEGIN(PERFZONE_PLAY_UPDATE);
+	PERF_MARK();
+	begin_update(ctx);                   PERF_LAP(PERF_BEGIN_UPDATE);
+	update_remaining_time(ctx);          PERF_LAP(PERF_UPDATE_REMAINING_TIME);
+	update_score_count(ctx);             PERF_LAP(PERF_UPDATE_SCORE_COUNT);
+	move_objects(ctx);                   PERF_LAP(PERF_MOVE_OBJECTS);
+	handle_car_thrown_peel(ctx);         PERF_LAP(PERF_HANDLE_CAR_THROWN_PEEL);
+	move_player(ctx);                    PERF_LAP(PERF_MOVE_PLAYER);
+	handle_solids(ctx);                  PERF_LAP(PERF_HANDLE_SOLIDS);
+	handle_passageways(ctx);             PERF_LAP(PERF_HANDLE_PASSAGEWAYS);
+	handle_player_interactions(ctx);     PERF_LAP(PERF_HANDLE_PLAYER_INTERACTIONS);
+	handle_triggers(ctx);                PERF_LAP(PERF_HANDLE_TRIGGERS);
+	do_player_state_specifics(ctx);      PERF_LAP(PERF_DO_PLAYER_STATE_SPECIFICS);
+	handle_fall_sound(ctx);              PERF_LAP(PERF_HANDLE_FALL_SOUND);
+	handle_respawn(ctx);                 PERF_LAP(PERF_HANDLE_RESPAWN);
+	handle_player_state_change(ctx);     PERF_LAP(PERF_HANDLE_PLAYER_STATE_CHANGE);
+	move_camera(ctx);                    PERF_LAP(PERF_MOVE_CAMERA);
+	update_active_ranges(ctx);           PERF_LAP(PERF_UPDATE_ACTIVE_RANGES);
+	keep_player_within_limits(ctx);      PERF_LAP(PERF_KEEP_PLAYER_WITHIN_LIMITS);
+	handle_player_animation_change(ctx); PERF_LAP(PERF_HANDLE_PLAYER_ANIMATION_CHANGE);
+	update_animations(ctx);              PERF_LAP(PERF_UPDATE_ANIMATIONS);
+	move_push_arrow(ctx);                PERF_LAP(PERF_MOVE_PUSH_ARROW);
+	position_bus_stop_sign(ctx);         PERF_LAP(PERF_POSITION_BUS_STOP_SIGN);
+	position_light_pole(ctx);            PERF_LAP(PERF_POSITION_LIGHT_POLE);
+	update_sequence(ctx);                PERF_LAP(PERF_UPDATE_SEQUENCE);
+	PERF_END(PERFZONE_PLAY_UPDATE);
+
+	if (ctx->sequence_step != sequence_step) {
+		add_event(ctx, PLAYEVT_SEQUENCE_CHANGE, ctx->sequence_step);
+	}
+}
+
 //Begins the update
-static void begin_update()
+static void begin_update(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
+	Player* pl = &ctx->player;
 
 	pl->oldx = pl->x;
 	pl->oldy = pl->y;
@@ -482,79 +1040,81 @@ static void begin_update()
 	pl->old_anim_type = pl->anim_type;
 	pl->on_floor = false;
 
-	jump_timeout -= delta_time;
-	if (jump_timeout < 0) jump_timeout = 0;
+	ctx->jump_timeout -= PN_DT(ctx);
+	if (ctx->jump_timeout < 0) ctx->jump_timeout = 0;
 }
 
 //Updates the remaining time and acts if the time has run out
-static void update_remaining_time()
+static void update_remaining_time(PlayCtx* ctx)
 {
-	if (!ctx.time_running) return;
+	if (!ctx->time_running) return;
 
-	ctx.time_delay -= delta_time;
-	if (ctx.time_delay > 0) return;
+	ctx->time_delay -= PN_DT(ctx);
+	if (ctx->time_delay > 0) return;
 
-	ctx.time_delay = 1;
-	ctx.time--;
+	ctx->time_delay = PN(1);
+	ctx->time--;
 
-	if (ctx.time <= 10 && ctx.time >= 0) {
-		audio_play_sfx(SFX_TIME);
+	if (ctx->time <= 10 && ctx->time >= 0) {
+		add_event(ctx, PLAYEVT_SFX, SFX_TIME);
 	}
 
-	if (ctx.time < 0) {
-		ctx.time = 0;
-		ctx.time_running = false;
-		ctx.time_up = true;
+	if (ctx->time < 0) {
+		ctx->time = 0;
+		ctx->time_running = false;
+		ctx->time_up = true;
 	}
 }
 
 //Does the score counting from the remaining time after the level's goal is
 //reached
-static void update_score_count()
+static void update_score_count(PlayCtx* ctx)
 {
-	if (!ctx.counting_score) return;
+	if (!ctx->counting_score) return;
 
-	if (ctx.time <= 0) {
-		ctx.time = 0;
-		ctx.counting_score = false;
+	if (ctx->time <= 0) {
+		ctx->time = 0;
+		ctx->counting_score = false;
 
 		return;
 	}
 
-	ctx.time_delay -= delta_time;
-	if (ctx.time_delay > 0) return;
+	ctx->time_delay -= PN_DT(ctx);
+	if (ctx->time_delay > 0) return;
 
-	ctx.time_delay = 0.1f;
-	ctx.time--;
-	ctx.score += 10;
-	audio_play_sfx(SFX_SCORE);
+	ctx->time_delay = PN(0.1f);
+	ctx->time--;
+	ctx->score += 10;
+	add_event(ctx, PLAYEVT_SFX, SFX_SCORE);
+	add_event(ctx, PLAYEVT_SCORE_TICK, ctx->time);
 }
 
 //Updates the positions of most game objects, not including the player
 //character and the camera
-static void move_objects()
+static void move_objects(PlayCtx* ctx)
 {
 	int i;
 
 	//Bus
-	ctx.bus.xvel += ctx.bus.acc * delta_time;
-	ctx.bus.x += ctx.bus.xvel * delta_time;
+	ctx->bus.xvel += PN_MUL_DT(ctx, ctx->bus.acc);
+	ctx->bus.x += PN_MUL_DT(ctx, ctx->bus.xvel);
 
 	//Moving banana peels
 	for (i = 0; i < MAX_MOVING_PEELS; i++) {
-		MovingPeel* peel = &ctx.moving_peels[i];
+		MovingPeel* peel = &ctx->moving_peels[i];
 		Obj* obj;
+		int peel_obj = peel->obj;
 
-		if (peel->obj == NONE) continue;
+		if (peel_obj == NONE) continue;
 
-		obj = &ctx.objs[peel->obj];
+		obj = &ctx->objs[peel_obj];
 
-		peel->yvel += peel->grav * delta_time;
-		peel->x += peel->xvel * delta_time;
-		peel->y += peel->yvel * delta_time;
+		peel->yvel += PN_MUL_DT(ctx, peel->grav);
+		peel->x += PN_MUL_DT(ctx, peel->xvel);
+		peel->y += PN_MUL_DT(ctx, peel->yvel);
 
 		//Deactivate the peel when it gets too far downwards
-		if (peel->y >= 400) {
+		if (peel->y >= PN(400)) {
 			obj->type = NONE;
 			peel->obj = NONE;
 		}
@@ -567,146 +1127,168 @@ static void move_objects()
 			peel->obj = NONE;
 		}
 
-		obj->x = (int)peel->x;
-		obj->y = (int)peel->y;
-	}
-
-	//Gushes
-	for (i = 0; i < MAX_GUSHES; i++) {
-		Gush* gush = &ctx.gushes[i];
-
-		float y = gush->y;
-		float yvel = gush->yvel;
-		float ydest = gush->ydest;
+		obj->x = PN_TO_INT(peel->x);
+		obj->y = PN_TO_INT(peel->y);
+		reorder_obj(ctx, peel_obj);
 
-		//Ignore inexistent gushes
-		if (gush->obj == NONE) continue;
+		//The player character can slip on the peel again once it has stopped
+		if (obj->type == OBJ_BANANA_PEEL) {
+			play_set_obj_list(ctx, peel_obj, OBJLIST_PEELS);
+		}
+	}
 
-		y += yvel * delta_time;
+	//Gushes from the level file (only the ones within the active window need
+	//to be up to date)
+	move_gush(ctx, &ctx->gush_phase);
+	for (i = ctx->active_gushes.first; i < ctx->active_gushes.end; i++) {
+		Gush* gush = &ctx->gushes[i];
+		int obj = gush->obj;
 
-		//If the gush reaches its destination Y position
-		if ((yvel < 0 && y <= ydest) || (yvel > 0 && y >= ydest)) {
-			y = ydest;
+		*gush = ctx->gush_phase;
+		gush->obj = obj;
+		ctx->objs[obj].y = PN_TO_INT(gush->y);
+	}
 
-			//Advance within the movement pattern and loop if its end is
-			//reached
-			gush->move_pattern_pos += 2;
-			if (gush->move_pattern[gush->move_pattern_pos] == 0) {
-				gush->move_pattern_pos = 0;
-			}
+	//Gushes opened from gush cracks
+	for (i = ctx->num_level_gushes; i < ctx->max_gushes; i++) {
+		Gush* gush = &ctx->gushes[i];
 
-			gush->yvel  = gush->move_pattern[gush->move_pattern_pos];
-			gush->ydest = gush->move_pattern[gush->move_pattern_pos + 1];
-		}
+		//No more gushes
+		if (gush->obj == NONE) break;
 
-		gush->y = y;
-		ctx.objs[gush->obj].y = (int)y;
+		move_gush(ctx, gush);
+		ctx->objs[gush->obj].y = PN_TO_INT(gush->y);
 	}
 
 	//Grabbed rope
-	if (ctx.grabbed_rope.obj != NONE) {
-		Obj* obj = &ctx.objs[ctx.grabbed_rope.obj];
-
-		ctx.grabbed_rope.x += ctx.grabbed_rope.xvel * delta_time;
-
-		if (ctx.grabbed_rope.x >= ctx.grabbed_rope.xmax) {
-			ctx.grabbed_rope.x = ctx.grabbed_rope.xmax;
-			ctx.grabbed_rope.xvel = -192;
-		} else if (ctx.grabbed_rope.x <= ctx.grabbed_rope.xmin) {
-			ctx.grabbed_rope.x = ctx.grabbed_rope.xmin;
-			ctx.grabbed_rope.obj = NONE;
+	if (ctx->grabbed_rope.obj != NONE) {
+		int rope = ctx->grabbed_rope.obj;
+		Obj* obj = &ctx->objs[rope];
+
+		ctx->grabbed_rope.x += PN_MUL_DT(ctx, ctx->grabbed_rope.xvel);
+
+		if (ctx->grabbed_rope.x >= ctx->grabbed_rope.xmax) {
+			ctx->grabbed_rope.x = ctx->grabbed_rope.xmax;
+			ctx->grabbed_rope.xvel = PN(-192);
+		} else if (ctx->grabbed_rope.x <= ctx->grabbed_rope.xmin) {
+			ctx->grabbed_rope.x = ctx->grabbed_rope.xmin;
+			ctx->grabbed_rope.obj = NONE;
 		}
 
-		obj->x = (int)ctx.grabbed_rope.x;
+		obj->x = PN_TO_INT(ctx->grabbed_rope.x);
+		reposition_obj(ctx, rope);
+		reorder_obj(ctx, rope);
 	}
 
 	//Pushable crates
 	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
-		PushableCrate* crate = &ctx.pushable_crates[i];
+		PushableCrate* crate = &ctx->pushable_crates[i];
 
 		if (crate->obj != NONE && crate->pushed) {
-			Solid* sol = &ctx.solids[crate->solid];
+			Solid* sol = &ctx->solids[crate->solid];
+			PlayNum old_x = crate->x;
+			int old_first, old_last, first, last;
 
-			crate->x += 72 * delta_time;
+			crate->x += PN_MUL_DT(ctx, PN(72));
 			if (crate->x >= crate->xmax) crate->x = crate->xmax;
 
-			ctx.objs[crate->obj].x = (int)crate->x;
-			sol->left = (int)crate->x;
-			sol->right = (int)crate->x + 24;
+			get_column_range(ctx, sol->left, sol->right, &old_first, &old_last);
+			get_column_range(ctx, PN_TO_INT(crate->x), PN_TO_INT(crate->x) + 24,
+				&first, &last);
+
+			//Move the crate's solid to the level columns it now overlaps
+			if (first != old_first || last != old_last) {
+				unindex_solid(ctx, crate->solid);
+			}
+
+			ctx->objs[crate->obj].x = PN_TO_INT(crate->x);
+			sol->left = PN_TO_INT(crate->x);
+			sol->right = PN_TO_INT(crate->x) + 24;
+
+			if ((first != old_first || last != old_last) &&
+					!play_index_solid(ctx, crate->solid)) {
+				//The level columns ahead are full, so the crate stays where
+				//it was, in the slots it has just freed
+				crate->x = old_x;
+				ctx->objs[crate->obj].x = PN_TO_INT(crate->x);
+				sol->left = PN_TO_INT(crate->x);
+				sol->right = PN_TO_INT(crate->x) + 24;
+				play_index_solid(ctx, crate->solid);
+			}
 		}
 	}
 
 	//Passing car
-	if (ctx.car.x != NONE) {
-		ctx.car.x += ctx.car.xvel * delta_time;
+	if (ctx->car.x != NONE) {
+		ctx->car.x += PN_MUL_DT(ctx, ctx->car.xvel);
 
-		if (ctx.car.x >= ctx.cam.x + VSCREEN_MAX_WIDTH + 64) {
-			ctx.car.x = NONE;
+		if (ctx->car.x >= ctx->cam.x + PN(VSCREEN_MAX_WIDTH) + PN(64)) {
+			ctx->car.x = NONE;
 		}
 	}
 
 	//Hen
-	if (ctx.hen.x != NONE) {
-		ctx.hen.xvel += ctx.hen.acc * delta_time;
-		ctx.hen.x += ctx.hen.xvel * delta_time;
+	if (ctx->hen.x != NONE) {
+		ctx->hen.xvel += PN_MUL_DT(ctx, ctx->hen.acc);
+		ctx->hen.x += PN_MUL_DT(ctx, ctx->hen.xvel);
 
-		if (ctx.hen.x > ctx.cam.x + VSCREEN_MAX_WIDTH + 64) {
-			ctx.hen.x = NONE;
+		if (ctx->hen.x > ctx->cam.x + PN(VSCREEN_MAX_WIDTH) + PN(64)) {
+			ctx->hen.x = NONE;
 		}
 	}
 
 	//Crack particles
 	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
-		CrackParticle* ptcl = &ctx.crack_particles[i];
+		CrackParticle* ptcl = &ctx->crack_particles[i];
 
 		//Ignore inexistent particles
 		if (ptcl->x == NONE) continue;
 
-		ptcl->yvel += ptcl->grav * delta_time;
-		ptcl->x += ptcl->xvel * delta_time;
-		ptcl->y += ptcl->yvel * delta_time;
+		ptcl->yvel += PN_MUL_DT(ctx, ptcl->grav);
+		ptcl->x += PN_MUL_DT(ctx, ptcl->xvel);
+		ptcl->y += PN_MUL_DT(ctx, ptcl->yvel);
 
-		if (ptcl->y >= 400) {
+		if (ptcl->y >= PN(400)) {
 			ptcl->x = NONE;
 		}
 	}
 
 	//Cutscene objects
 	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
-		CutsceneObject* cobj = &ctx.cutscene_objects[i];
+		CutsceneObject* cobj = &ctx->cutscene_objects[i];
 
 		//Ignore inexistent cutscene objects
 		if (cobj->sprite == NONE) continue;
 
-		cobj->xvel += cobj->acc * delta_time;
-		cobj->yvel += cobj->grav * delta_time;
-		cobj->x += cobj->xvel * delta_time;
-		cobj->y += cobj->yvel * delta_time;
+		cobj->xvel += PN_MUL_DT(ctx, cobj->acc);
+		cobj->yvel += PN_MUL_DT(ctx, cobj->grav);
+		cobj->x += PN_MUL_DT(ctx, cobj->xvel);
+		cobj->y += PN_MUL_DT(ctx, cobj->yvel);
 	}
 }
 
 //Acts if the passing car has reached the X position at which it throws a
 //banana peel
-static void handle_car_thrown_peel()
+static void handle_car_thrown_peel(PlayCtx* ctx)
 {
-	if (ctx.car.x == NONE || ctx.car.threw_peel) return;
-	if (ctx.car.x < ctx.car.peel_throw_x) return;
+	if (ctx->car.x == NONE || ctx->car.threw_peel) return;
+	if (ctx->car.x < PN(ctx->car.peel_throw_x)) return;
 
-	for (int i = 0; i < MAX_OBJS; i++) {
-		if (ctx.objs[i].type == NONE) {
-			MovingPeel* peel = &ctx.moving_peels[MOVING_PEEL_THROWN];
+	for (int i = 0; i < ctx->max_objs; i++) {
+		if (ctx->objs[i].type == NONE) {
+			MovingPeel* peel = &ctx->moving_peels[MOVING_PEEL_THROWN];
 
 			peel->obj = i;
-			peel->x = ctx.car.peel_throw_x + 90;
-			peel->y = 200;
-			peel->xvel = 144;
-			peel->yvel = -12;
-			peel->grav = 504;
-			peel->xdest = peel->x + 70;
-			peel->ydest = 256;
+			peel->x = PN(ctx->car.peel_throw_x + 90);
+			peel->y = PN(200);
+			peel->xvel = PN(144);
+			peel->yvel = PN(-12);
+			peel->grav = PN(504);
+			peel->xdest = peel->x + PN(70);
+			peel->ydest = PN(256);
 
-			ctx.objs[i].type = OBJ_BANANA_PEEL_MOVING;
-			ctx.car.threw_peel = true;
+			ctx->objs[i].type = OBJ_BANANA_PEEL_MOVING;
+			ctx->car.threw_peel = true;
 
 			break;
 		}
@@ -715,102 +1297,120 @@ static void handle_car_thrown_peel()
 
 //Updates the position of the player character (without taking solids into
 //account, as solids are handled by handle_solids())
-static void move_player()
+static void move_player(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
+	Player* pl = &ctx->player;
 
 	if (pl->state == PLAYER_STATE_INACTIVE) return;
 
 	//Deceleration and acceleration
 	if (pl->xvel > 0 && pl->acc <= 0) {
-		pl->xvel -= pl->dec * delta_time;
+		pl->xvel -= PN_MUL_DT(ctx, pl->dec);
 		if (pl->xvel <= 0) pl->xvel = 0;
 	} else if (pl->xvel < 0 && pl->acc >= 0) {
-		pl->xvel += pl->dec * delta_time;
+		pl->xvel += PN_MUL_DT(ctx, pl->dec);
 		if (pl->xvel >= 0) pl->xvel = 0;
 	} else {
-		pl->xvel += pl->acc * delta_time;
+		pl->xvel += PN_MUL_DT(ctx, pl->acc);
 
 		//Limit velocity
-		if (pl->xvel < -90) pl->xvel = -90;
-		if (pl->xvel > 210) pl->xvel = 210;
+		if (pl->xvel < PN(-90)) pl->xvel = PN(-90);
+		if (pl->xvel > PN(210)) pl->xvel = PN(210);
 	}
 
 	//Gravity
-	pl->yvel += pl->grav * delta_time;
-	if (pl->yvel > 300) pl->yvel = 300; //Limit velocity
+	pl->yvel += PN_MUL_DT(ctx, pl->grav);
+	if (pl->yvel > PN(300)) pl->yvel = PN(300); //Limit velocity
 
 	//Update position
-	pl->x += pl->xvel * delta_time;
-	pl->y += pl->yvel * delta_time;
+	pl->x += PN_MUL_DT(ctx, pl->xvel);
+	pl->y += PN_MUL_DT(ctx, pl->yvel);
 
 	//Update position relative to the rope if grabbing one
 	if (pl->state == PLAYER_STATE_GRABROPE) {
-		if (pl->y >= 167) {
-			pl->y = 167;
+		if (pl->y >= PN(167)) {
+			pl->y = PN(167);
 			pl->yvel = 0;
 		}
 
-		pl->x = ctx.grabbed_rope.x - 19;
+		pl->x = ctx->grabbed_rope.x - PN(19);
 	}
 }
 
 //Prevents the player character from moving across solids
-static void handle_solids()
+static void handle_solids(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
+	Player* pl = &ctx->player;
 
-	int pl_left   = (int)pl->oldx + PLAYER_BOX_OFFSET_X;
+	int pl_left   = PN_TO_INT(pl->oldx) + PLAYER_BOX_OFFSET_X;
 	int pl_right  = pl_left + PLAYER_BOX_WIDTH;
-	int pl_top    = (int)pl->oldy;
+	int pl_top    = PN_TO_INT(pl->oldy);
 	int pl_bottom = pl_top + pl->height;
 
 	//Do the X axis (if the player character has moved in this axis)
 	if (pl->x != pl->oldx) {
 		bool moved_right = (pl->x > pl->oldx);
-		int limit = moved_right ? 30000 : 0;
-		int i;
+		int limit = moved_right ? INT_MAX : 0;
+		int new_left = PN_TO_INT(pl->x) + PLAYER_BOX_OFFSET_X;
+		int new_right = new_left + PLAYER_BOX_WIDTH;
+		int solids[MAX_SOLID_QUERY_COLUMNS * MAX_COLUMN_SOLIDS];
+		int first, last, col;
+
+		//Only the solids whose edges lie within the horizontal span swept by
+		//the player character's bounding box can stop it
+		if (moved_right) {
+			get_column_range(ctx, pl_right, new_right, &first, &last);
+		} else {
+			get_column_range(ctx, new_left, pl_left, &first, &last);
+		}
 
-		//Iterate through the solids to find the horizontal limit
-		for (i = 0; i < MAX_SOLIDS; i++) {
-			Solid* sol = &ctx.solids[i];
+		//Iterate through the solids to find the horizontal limit, taking a
+		//few level columns at a time in case of a long movement
+		for (col = first; col <= last; col += MAX_SOLID_QUERY_COLUMNS) {
+			int col_last = col + MAX_SOLID_QUERY_COLUMNS - 1;
+			int num_solids;
+			int i;
 
-			//No more solids
-			if (sol->type == NONE) break;
+			if (col_last > last) col_last = last;
+			num_solids = query_solids(ctx, col, col_last, solids);
 
-			//Only solids of type SOL_FULL are taken into account
-			if (sol->type != SOL_FULL) continue;
+			for (i = 0; i < num_solids; i++) {
+				Solid* sol = &ctx->solids[solids[i]];
 
-			//Ignore solids that are out of the reach of the player character's
-			//bounding box in the opposite axis (Y)
-			if (sol->top >= pl_bottom || sol->bottom < pl_top) continue;
+				//Only solids of type SOL_FULL are taken into account
+				if (sol->type != SOL_FULL) continue;
 
-			if (moved_right) {
-				if (sol->left < limit && sol->left >= pl_right) {
-					limit = sol->left;
-				}
-			} else {
-				if (sol->right > limit && sol->right <= pl_left) {
-					limit = sol->right;
+				//Ignore solids that are out of the reach of the player
+				//character's bounding box in the opposite axis (Y)
+				if (sol->top >= pl_bottom || sol->bottom < pl_top) continue;
+
+				if (moved_right) {
+					if (sol->left < limit && sol->left >= pl_right) {
+						limit = sol->left;
+					}
+				} else {
+					if (sol->right > limit && sol->right <= pl_left) {
+						limit = sol->right;
+					}
 				}
 			}
 		}
 
-		pl_left = (int)pl->x + PLAYER_BOX_OFFSET_X;
-		pl_right = pl_left + PLAYER_BOX_WIDTH;
+		pl_left = new_left;
+		pl_right = new_right;
 
 		if (moved_right) {
 			if (pl_right >= limit) {
 				pl_right = limit;
 				pl_left = pl_right - PLAYER_BOX_WIDTH;
-				pl->x = pl_left - PLAYER_BOX_OFFSET_X;
+				pl->x = PN(pl_left - PLAYER_BOX_OFFSET_X);
 				pl->xvel = 0;
 			}
 		} else {
 			if (pl_left <= limit) {
 				pl_left = limit;
 				pl_right = pl_left + PLAYER_BOX_WIDTH;
-				pl->x = pl_left - PLAYER_BOX_OFFSET_X;
+				pl->x = PN(pl_left - PLAYER_BOX_OFFSET_X);
 				pl->xvel = 0;
 			}
 		}
@@ -819,20 +1419,27 @@ static void handle_solids()
 	//Do the Y axis (if the player character has moved in this axis)
 	if (pl->y != pl->oldy) {
 		bool moved_down = (pl->y > pl->oldy);
-		int limit = moved_down ? 30000 : 0;
+		int limit = moved_down ? INT_MAX : 0;
 		int ledge_right = 0;
+		int solids[MAX_SOLID_QUERY_COLUMNS * MAX_COLUMN_SOLIDS];
+		int first, last;
+		int num_solids;
 		int i;
 
+		//Only the solids within the horizontal span of the player character's
+		//bounding box (which is narrower than MAX_SOLID_QUERY_COLUMNS level
+		//columns) are relevant, and they are checked in the same order as in
+		//the solids[] array, which the ledge detection below depends on
+		get_column_range(ctx, pl_left, pl_right, &first, &last);
+		num_solids = query_solids(ctx, first, last, solids);
+
 		//Detect if the player character's bounding box is on a ledge while
 		//the sprite appears to be standing on the air, so we can prevent
 		//this weird visual effect
-		for (i = 0; i < MAX_SOLIDS; i++) {
-			Solid* sol = &ctx.solids[i];
+		for (i = 0; i < num_solids; i++) {
+			Solid* sol = &ctx->solids[solids[i]];
 			int type = sol->type;
 
-			//No more solids
-			if (type == NONE) break;
-
 			//Only solids of these two types are taken into account
 			if (type != SOL_FULL && type != SOL_PASSAGEWAY_EXIT) continue;
 
@@ -856,11 +1463,8 @@ static void handle_solids()
 		}
 
 		//Iterate through the solids to find the vertical limit
-		for (i = 0; i < MAX_SOLIDS; i++) {
-			Solid* sol = &ctx.solids[i];
-
-			//No more solids
-			if (sol->type == NONE) break;
+		for (i = 0; i < num_solids; i++) {
+			Solid* sol = &ctx->solids[solids[i]];
 
 			//Ignore solids that are out of the reach of the player character's
 			//bounding box in the opposite axis (X)
@@ -905,7 +1509,7 @@ static void handle_solids()
 					limit = top;
 				}
 			} else {
-				if (sol->type == SOL_PASSAGEWAY_EXIT && pl->yvel < -160) {
+				if (sol->type == SOL_PASSAGEWAY_EXIT && pl->yvel < PN(-160)) {
 					//Ignore passageway exit solids if the player character is
 					//moving upwards at a high enough velocity, as when hitting
 					//a spring
@@ -918,20 +1522,22 @@ static void handle_solids()
 			}
 		}
 
+		//With no solid below, the limit is left at INT_MAX, which does not
+		//fit in a PlayNum when using fixed-point numbers
 		if (moved_down) {
-			if (pl->y + pl->height >= limit) {
+			if (limit != INT_MAX && pl->y + PN(pl->height) >= PN(limit)) {
 				//Move the player character if on a ledge
 				if (ledge_right != 0) {
-					pl->x = ledge_right - PLAYER_BOX_OFFSET_X;
+					pl->x = PN(ledge_right - PLAYER_BOX_OFFSET_X);
 				}
 
-				pl->y = limit - pl->height;
+				pl->y = PN(limit - pl->height);
 				pl->yvel = 0;
 				pl->on_floor = true;
 			}
 		} else {
-			if (pl->y <= limit) {
-				pl->y = limit;
+			if (pl->y <= PN(limit)) {
+				pl->y = PN(limit);
 				pl->yvel = 0;
 			}
 		}
@@ -941,59 +1547,56 @@ static void handle_solids()
 //Acts if the player character is entering or leaving an underground
 //passageway, which includes the vertical camera movement and opening the
 //exit of the passageway
-static void handle_passageways()
+static void handle_passageways(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
-	int pl_left = (int)pl->x + PLAYER_BOX_OFFSET_X;
-	int pl_top = (int)pl->y;
+	Player* pl = &ctx->player;
+	int pl_left = PN_TO_INT(pl->x) + PLAYER_BOX_OFFSET_X;
+	int pl_top = PN_TO_INT(pl->y);
 	int pl_bottom = pl_top + pl->height;
 	int i;
 
-	for (i = 0; i < MAX_PASSAGEWAYS; i++) {
-		Passageway* pw = &ctx.passageways[i];
+	//The player character is always within the active window
+	for (i = ctx->active_passageways.first; i < ctx->active_passageways.end; i++) {
+		Passageway* pw = &ctx->passageways[i];
 		int pw_left = pw->x;
 		int pw_entry_right = pw_left + LEVEL_BLOCK_SIZE;
 
-		if (pw_left == NONE) {
-			break; //No more passageways
-		}
-
 		//Check if the player character is entering a passageway
-		if (ctx.cur_passageway == NONE && pl_bottom >= FLOOR_Y + 4) {
+		if (ctx->cur_passageway == NONE && pl_bottom >= FLOOR_Y + 4) {
 			if (pl_left > pw_left && pl_left < pw_entry_right) {
-				ctx.cur_passageway = i;
+				ctx->cur_passageway = i;
 
 				//Move camera down
-				if (!ctx.time_up) {
-					ctx.cam.yvel = CAMERA_YVEL;
+				if (!ctx->time_up) {
+					ctx->cam.yvel = PN(CAMERA_YVEL);
 				}
 			}
 		}
 	}
 
 	//Check if the player character is leaving a passageway
-	if (ctx.cur_passageway != NONE) {
-		Passageway* pw = &ctx.passageways[ctx.cur_passageway];
+	if (ctx->cur_passageway != NONE) {
+		Passageway* pw = &ctx->passageways[ctx->cur_passageway];
 		int pw_right = pw->x + pw->width;
 
 		if (pl_left > pw_right - 32) {
 			//Check if the player character is opening the passageway exit, but
 			//only if moving upwards at a high enough velocity, as is the case 
 			//when hitting a spring
-			if (pl->yvel < -162 && pl_top < FLOOR_Y + 8) {
+			if (pl->yvel < PN(-162) && pl_top < FLOOR_Y + 8) {
 				if (!pw->exit_opened) {
-					audio_play_sfx(SFX_HOLE);
-					add_crack_particles(pw_right - 16, 276);
+					add_event(ctx, PLAYEVT_SFX, SFX_HOLE);
+					add_crack_particles(ctx, pw_right - 16, 276);
 					pw->exit_opened = true;
 				}
 			}
 
 			if (pl_top < FLOOR_Y - 54) {
-				ctx.cur_passageway = NONE;
+				ctx->cur_passageway = NONE;
 
 				//Move camera up
-				if (!ctx.time_up) {
-					ctx.cam.yvel = -CAMERA_YVEL;
+				if (!ctx->time_up) {
+					ctx->cam.yvel = PN(-CAMERA_YVEL);
 				}
 			}
 		}
@@ -1001,35 +1604,47 @@ static void handle_passageways()
 }
 
 //Handles the interactions between the player character and most other objects
-static void handle_player_interactions()
+static void handle_player_interactions(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
-	int pl_left = (int)pl->x + PLAYER_BOX_OFFSET_X;
-	int pl_top = (int)pl->y;
+	Player* pl = &ctx->player;
+	int pl_left = PN_TO_INT(pl->x) + PLAYER_BOX_OFFSET_X;
+	int pl_top = PN_TO_INT(pl->y);
 	int pl_right = pl_left + PLAYER_BOX_WIDTH;
 	int pl_bottom = pl_top + pl->height;
 	bool collected_coin = false;
 	bool slipped = false;
 	bool thrown_back = false;
-	int i, j;
+	int* nearby = ctx->obj_scratch;
+	int num_nearby = 0;
+	int i, j, n;
+
+	//Only objects in the object lists are interactive, and only those whose
+	//X position is close enough can be reached (the rightmost point checked
+	//is the one used for vertical ropes)
+	for (i = 0; i < NUM_OBJLISTS; i++) {
+		num_nearby = query_objs(ctx, i, pl_left - OBJ_MAX_INTERACTION_WIDTH,
+			pl_right + 1, nearby, num_nearby);
+	}
+
+	//Handle the objects in the same order as they appear in ctx->objs[]
+	for (i = 1; i < num_nearby; i++) {
+		int obj = nearby[i];
 
-	for (i = 0; i < MAX_OBJS; i++) {
+		for (j = i; j > 0 && nearby[j - 1] > obj; j--) {
+			nearby[j] = nearby[j - 1];
+		}
+
+		nearby[j] = obj;
+	}
+
+	for (n = 0; n < num_nearby; n++) {
 		CoinSpark* spk;
-		Obj* obj = &ctx.objs[i];
+		Obj* obj;
 		int obj_left, obj_right, obj_top, obj_bottom;
+		int points;
 
-		//Ignore inexistent objects
-		if (obj->type == NONE) continue;
-
-		//Ignore objects the player character does not interact with
-		if (obj->type == OBJ_BANANA_PEEL_MOVING) continue;
-		if (obj->type == OBJ_HYDRANT) continue;
-		if (obj->type == OBJ_OVERHEAD_SIGN) continue;
-		if (obj->type == OBJ_PARKED_CAR_BLUE) continue;
-		if (obj->type == OBJ_PARKED_CAR_SILVER) continue;
-		if (obj->type == OBJ_PARKED_CAR_YELLOW) continue;
-		if (obj->type == OBJ_PARKED_TRUCK) continue;
-		if (obj->type == OBJ_ROPE_HORIZONTAL) continue;
+		i = nearby[n];
+		obj = &ctx->objs[i];
 
 		//Except for coins, the player character only interacts with other
 		//objects when in the normal state
@@ -1087,8 +1702,8 @@ static void handle_player_interactions()
 		if (obj->type == OBJ_ROPE_VERTICAL) {
 			//For vertical ropes, check interaction using a point close to
 			//the player character
-			int px = (int)pl->x + 21;
-			int py = (int)pl->y + 28;
+			int px = PN_TO_INT(pl->x) + 21;
+			int py = PN_TO_INT(pl->y) + 28;
 
 			if (px < obj_left || px > obj_right)  continue;
 			if (py < obj_top  || py > obj_bottom) continue;
@@ -1101,31 +1716,35 @@ static void handle_player_interactions()
 
 		switch (obj->type) {
 			case OBJ_BANANA_PEEL:
-				ctx.moving_peels[MOVING_PEEL_SLIPPED].obj = i;
-				ctx.moving_peels[MOVING_PEEL_SLIPPED].x = obj->x;
-				ctx.moving_peels[MOVING_PEEL_SLIPPED].y = obj->y;
+				ctx->moving_peels[MOVING_PEEL_SLIPPED].obj = i;
+				ctx->moving_peels[MOVING_PEEL_SLIPPED].x = PN(obj->x);
+				ctx->moving_peels[MOVING_PEEL_SLIPPED].y = PN(obj->y);
 				obj->type = OBJ_BANANA_PEEL_MOVING;
+				play_set_obj_list(ctx, i, NONE);
 				slipped = true;
 				break;
 
 			case OBJ_COIN_SILVER:
 			case OBJ_COIN_GOLD:
+				points = (obj->type == OBJ_COIN_GOLD) ? 100 : 50;
 				collected_coin = true;
-				ctx.score += (obj->type == OBJ_COIN_GOLD) ? 100 : 50;
+				ctx->score += points;
+				add_event(ctx, PLAYEVT_COIN_COLLECTED, points);
 
 				//Add spark
-				spk = &ctx.coin_sparks[ctx.next_coin_spark];
+				spk = &ctx->coin_sparks[ctx->next_coin_spark];
 				spk->x = obj->x;
 				spk->y = obj->y;
 				spk->gold = (obj->type == OBJ_COIN_GOLD);
 
-				start_animation(ANIM_COIN_SPARKS + ctx.next_coin_spark);
+				start_animation(ctx, ANIM_COIN_SPARKS + ctx->next_coin_spark);
 
-				ctx.next_coin_spark++;
-				ctx.next_coin_spark %= MAX_COIN_SPARKS;
+				ctx->next_coin_spark++;
+				ctx->next_coin_spark %= MAX_COIN_SPARKS;
 
 				//Remove the coin
 				obj->type = NONE;
+				play_set_obj_list(ctx, i, NONE);
 
 				break;
 
@@ -1135,17 +1754,18 @@ static void handle_player_interactions()
 
 			case OBJ_GUSH_CRACK:
 				obj->type = OBJ_GUSH;
+				play_set_obj_list(ctx, i, OBJLIST_GUSHES);
 
-				for (j = 0; j < MAX_GUSHES; j++) {
-					if (ctx.gushes[j].obj == NONE) {
-						ctx.gushes[j].obj = i;
-						ctx.gushes[j].y = 266;
-						ctx.gushes[j].move_pattern = data_gush_move_pattern_2;
-						ctx.gushes[j].move_pattern_pos = 0;
-						ctx.gushes[j].yvel = -144;
-						ctx.gushes[j].ydest = data_gush_move_pattern_2[1];
+				for (j = 0; j < ctx->max_gushes; j++) {
+					if (ctx->gushes[j].obj == NONE) {
+						ctx->gushes[j].obj = i;
+						ctx->gushes[j].y = PN(266);
+						ctx->gushes[j].move_pattern = GUSH_MOVE_PATTERN_2;
+						ctx->gushes[j].move_pattern_pos = 0;
+						ctx->gushes[j].yvel = PN(-144);
+						ctx->gushes[j].ydest = PN(data_gush_move_patterns[GUSH_MOVE_PATTERN_2][1]);
 
-						add_crack_particles(obj->x + 6, 276);
+						add_crack_particles(ctx, obj->x + 6, 276);
 
 						if (pl->state == PLAYER_STATE_NORMAL) {
 							thrown_back = true;
@@ -1158,35 +1778,37 @@ static void handle_player_interactions()
 				break;
 
 			case OBJ_ROPE_VERTICAL:
-				if (ctx.grabbed_rope.obj == i) {
+				if (ctx->grabbed_rope.obj == i) {
 					//Cannot grab the same rope again right after releasing it
-					if (ctx.grabbed_rope.x > ctx.grabbed_rope.xmax - 64) {
+					if (ctx->grabbed_rope.x > ctx->grabbed_rope.xmax - PN(64)) {
 						break;
 					}
-				} else if (ctx.grabbed_rope.obj != NONE) {
-					Obj* rope = &ctx.objs[ctx.grabbed_rope.obj];
-					rope->x = (int)ctx.grabbed_rope.xmin;
-					ctx.grabbed_rope.obj = NONE;
+				} else if (ctx->grabbed_rope.obj != NONE) {
+					Obj* rope = &ctx->objs[ctx->grabbed_rope.obj];
+					rope->x = PN_TO_INT(ctx->grabbed_rope.xmin);
+					reposition_obj(ctx, ctx->grabbed_rope.obj);
+					reorder_obj(ctx, ctx->grabbed_rope.obj);
+					ctx->grabbed_rope.obj = NONE;
 				}
 
-				if (ctx.grabbed_rope.obj == NONE) {
-					ctx.grabbed_rope.xmin = obj->x;
-					ctx.grabbed_rope.xmax = obj->x + 352;
+				if (ctx->grabbed_rope.obj == NONE) {
+					ctx->grabbed_rope.xmin = PN(obj->x);
+					ctx->grabbed_rope.xmax = PN(obj->x + 352);
 				}
 
 				pl->state = PLAYER_STATE_GRABROPE;
-				ctx.grabbed_rope.obj = i;
-				ctx.grabbed_rope.x = obj->x;
-				ctx.grabbed_rope.xvel = 258;
+				ctx->grabbed_rope.obj = i;
+				ctx->grabbed_rope.x = PN(obj->x);
+				ctx->grabbed_rope.xvel = PN(258);
 
 				break;
 
 			case OBJ_SPRING:
 				if (pl->yvel >= 0) {
-					audio_play_sfx(SFX_SPRING);
-					pl->yvel = -246;
-					ctx.hit_spring = i;
-					start_animation(ANIM_HIT_SPRING);
+					add_event(ctx, PLAYEVT_SFX, SFX_SPRING);
+					pl->yvel = PN(-246);
+					ctx->hit_spring = i;
+					start_animation(ctx, ANIM_HIT_SPRING);
 				}
 				break;
 		}
@@ -1194,47 +1816,47 @@ static void handle_player_interactions()
 
 	//Play a sound effect if the player character has collected a coin
 	if (collected_coin) {
-		audio_play_sfx(SFX_COIN);
+		add_event(ctx, PLAYEVT_SFX, SFX_COIN);
 	}
 
 	//Act if the player character has slipped on a banana peel
 	if (slipped) {
-		MovingPeel* peel = &ctx.moving_peels[MOVING_PEEL_SLIPPED];
+		MovingPeel* peel = &ctx->moving_peels[MOVING_PEEL_SLIPPED];
 
-		audio_play_sfx(SFX_SLIP);
+		add_event(ctx, PLAYEVT_SFX, SFX_SLIP);
 		pl->state = PLAYER_STATE_SLIP;
 
-		peel->xvel = 150;
-		peel->yvel = -204;
-		peel->grav = 504;
+		peel->xvel = PN(150);
+		peel->yvel = PN(-204);
+		peel->grav = PN(504);
 
 		//For the destination Y position, use a value below the limit,
 		//which is 400
 		peel->xdest = 0;
-		peel->ydest = 500;
+		peel->ydest = PN(500);
 
 	}
 
 	//Act if the player character has been thrown back by a gush
 	if (thrown_back) {
-		audio_play_sfx(SFX_HIT);
+		add_event(ctx, PLAYEVT_SFX, SFX_HIT);
 		pl->state = PLAYER_STATE_THROWBACK;
 	}
 
 	//Handle pushable crates
-	if (!input_right) ctx.crate_push_remaining = 0.75f;
+	if (!ctx->input_right) ctx->crate_push_remaining = PN(0.75f);
 	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
-		PushableCrate* crate = &ctx.pushable_crates[i];
+		PushableCrate* crate = &ctx->pushable_crates[i];
 		Solid* sol;
-		int x = (int)ctx.player.x + 24;
-		int y = (int)ctx.player.y + 48;
+		int x = PN_TO_INT(ctx->player.x) + 24;
+		int y = PN_TO_INT(ctx->player.y) + 48;
 
 		//Skip crates that do not exist or have been pushed
 		if (crate->obj == NONE || crate->pushed) continue;
 
 		//If the point does not overlap the crate's solid, then the player
 		//is not pushing the crate
-		sol = &ctx.solids[crate->solid];
+		sol = &ctx->solids[crate->solid];
 		if (sol->type == NONE) continue;
 		if (x < sol->left) continue;
 		if (x > sol->right) continue;
@@ -1242,67 +1864,69 @@ static void handle_player_interactions()
 		if (y > sol->bottom) continue;
 
 		//If we got here, then the player is pushing the crate
-		ctx.crate_push_remaining -= delta_time;
-		if (ctx.crate_push_remaining <= 0) {
+		ctx->crate_push_remaining -= PN_DT(ctx);
+		if (ctx->crate_push_remaining <= 0) {
 			//Finished pushing
-			ctx.crate_push_remaining = 0.75f;
+			ctx->crate_push_remaining = PN(0.75f);
 			crate->show_arrow = false;
 			crate->pushed = true;
-			audio_play_sfx(SFX_CRATE);
+			add_event(ctx, PLAYEVT_SFX, SFX_CRATE);
 		}
 	}
 }
 
 //Acts when the player character reaches the X position of a trigger, which
 //causes the appearance of a passing car or hen
-static void handle_triggers()
+static void handle_triggers(PlayCtx* ctx)
 {
-	int plx = (int)ctx.player.x;
-	int i;
+	int plx = PN_TO_INT(ctx->player.x);
 
-	for (i = 0; i < MAX_TRIGGERS; i++) {
-		Trigger* tr = &ctx.triggers[i];
+	//As triggers are in ascending order of X position, they are reached one
+	//after another
+	while (ctx->next_trigger < ctx->num_triggers) {
+		Trigger* tr = &ctx->triggers[ctx->next_trigger];
 
-		//Ignore triggers that do not exist or the player character has not
-		//reached
-		if (tr->x == NONE || tr->x > plx) continue;
+		//Stop on the first trigger that does not exist or the player
+		//character has not reached
+		if (tr->x == NONE || tr->x > plx) break;
 
 		if (tr->what == TRIGGER_HEN) {
-			ctx.hen.x = tr->x - (VSCREEN_MAX_WIDTH / 2) - 32;
-			ctx.hen.xvel = 360;
-			ctx.hen.acc = 0;
-			start_animation(ANIM_HEN);
+			ctx->hen.x = PN(tr->x - (VSCREEN_MAX_WIDTH / 2) - 32);
+			ctx->hen.xvel = PN(360);
+			ctx->hen.acc = 0;
+			start_animation(ctx, ANIM_HEN);
 		} else { //If not a hen, then trigger a passing car
-			ctx.car.x = tr->x - (VSCREEN_MAX_WIDTH / 2) - 128;
-			ctx.car.xvel = 1200;
-			ctx.car.type = tr->what;
-			ctx.car.threw_peel = false;
-			ctx.car.peel_throw_x = tr->x + 72;
-			start_animation(ANIM_CAR_WHEELS);
+			ctx->car.x = PN(tr->x - (VSCREEN_MAX_WIDTH / 2) - 128);
+			ctx->car.xvel = PN(1200);
+			ctx->car.type = tr->what;
+			ctx->car.threw_peel = false;
+			ctx->car.peel_throw_x = tr->x + 72;
+			start_animation(ctx, ANIM_CAR_WHEELS);
 		}
 
 		tr->x = NONE;
+		ctx->next_trigger++;
 	}
 }
 
 //Does the specifics of the player character's current state
-static void do_player_state_specifics()
+static void do_player_state_specifics(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
+	Player* pl = &ctx->player;
 	bool state_changed = (pl->state != pl->old_state);
 
 	if (pl->state == PLAYER_STATE_NORMAL) {
 		pl->acc = 0;
-		if (input_right) {
-			pl->acc = 216;
-		} else if (input_left) {
-			pl->acc = -216;
+		if (ctx->input_right) {
+			pl->acc = PN(216);
+		} else if (ctx->input_left) {
+			pl->acc = PN(-216);
 		}
 
 		//Jump
-		if (pl->on_floor && jump_timeout > 0) {
-			pl->yvel = -156;
-			jump_timeout = 0;
+		if (pl->on_floor && ctx->jump_timeout > 0) {
+			pl->yvel = PN(-156);
+			ctx->jump_timeout = 0;
 		}
 
 		//Decide animation type
@@ -1320,20 +1944,20 @@ static void do_player_state_specifics()
 			pl->xvel = 0;
 
 			//Get up on player input
-			if (input_left && !old_input_left) {
+			if (ctx->input_left && !ctx->old_input_left) {
 				pl->state = PLAYER_STATE_GETUP;
 			}
-			if (input_right && !old_input_right) {
+			if (ctx->input_right && !ctx->old_input_right) {
 				pl->state = PLAYER_STATE_GETUP;
 			}
-			if (input_jump && !old_input_jump) {
+			if (ctx->input_jump && !ctx->old_input_jump) {
 				pl->state = PLAYER_STATE_GETUP;
 			}
 		}
 	} else if (pl->state == PLAYER_STATE_GETUP) {
 		//Prevent jump if the button is held until the character finishes
 		//getting up
-		jump_timeout = 0;
+		ctx->jump_timeout = 0;
 
 		if (pl->yvel >= 0) {
 			pl->height = PLAYER_HEIGHT_NORMAL;
@@ -1346,18 +1970,20 @@ static void do_player_state_specifics()
 			pl->state = PLAYER_STATE_NORMAL;
 		}
 	} else if (pl->state == PLAYER_STATE_GRABROPE) {
-		GrabbedRope rope = ctx.grabbed_rope;
-		if (pl->x < rope.xmax - 16 && rope.xvel <= 0) {
+		GrabbedRope rope = ctx->grabbed_rope;
+		if (pl->x < rope.xmax - PN(16) && rope.xvel <= 0) {
 			//Release the rope
 			pl->state = PLAYER_STATE_NORMAL;
 		}
 	} else if (pl->state == PLAYER_STATE_FLICKER) {
 		//Prevent jump if the button is held until the flicker finishes
-		jump_timeout = 0;
+		ctx->jump_timeout = 0;
 
-		pl->visible = !pl->visible;
+		pl->flicker_delay -= PN_DT(ctx);
+
+		//Toggle visibility 60 times per second, regardless of the tick rate
+		pl->visible = (PN_TO_INT(pl->flicker_delay * 60) % 2 == 0);
 
-		pl->flicker_delay -= delta_time;
 		if (pl->flicker_delay <= 0) {
 			pl->state = PLAYER_STATE_NORMAL;
 		}
@@ -1366,15 +1992,16 @@ static void do_player_state_specifics()
 
 //Checks if the player character has fallen into a deep hole on the ground
 //and plays the fall sound effect if so
-static void handle_fall_sound()
+static void handle_fall_sound(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
-	int pl_bottom = (int)pl->y + pl->height;
-	bool in_passageway = (ctx.cur_passageway != NONE);
+	Player* pl = &ctx->player;
+	int pl_bottom = PN_TO_INT(pl->y) + pl->height;
+	bool in_passageway = (ctx->cur_passageway != NONE);
 
-	if (!ctx.time_up && !pl->fell && !in_passageway) {
+	if (!ctx->time_up && !pl->fell && !in_passageway) {
 		if (pl_bottom > FLOOR_Y + 8 && pl->yvel > 0) {
-			audio_play_sfx(SFX_FALL);
+			add_event(ctx, PLAYEVT_SFX, SFX_FALL);
+			add_event(ctx, PLAYEVT_FALL, 0);
 			pl->fell = true;
 		}
 	}
@@ -1382,47 +2009,55 @@ static void handle_fall_sound()
 
 //Handles the respawning (reappearance) of the player character after
 //falling into a deep hole
-static void handle_respawn()
+static void handle_respawn(PlayCtx* ctx)
 {
+	RespawnPoint* points = ctx->respawn_points;
+	int i = ctx->respawn_point;
 	int rx = 0, ry = 0;
-	int i;
 
 	//No respawn on time up or if the player character's Y position is
 	//above (lower than) 324
-	if (ctx.time_up || ctx.player.y < 324) return;
+	if (ctx->time_up || ctx->player.y < PN(324)) return;
 
-	for (i = 0; i < MAX_RESPAWN_POINTS; i++) {
-		RespawnPoint* rp = &ctx.respawn_points[i];
+	//Find the last respawn point to the left of the player character, starting
+	//from the one found on the previous respawn
+	while (i >= 0 && PN(points[i].x) > ctx->player.x) {
+		i--;
+	}
+	while (i + 1 < ctx->num_respawn_points && points[i + 1].x != NONE &&
+			PN(points[i + 1].x) <= ctx->player.x) {
+		i++;
+	}
 
-		//Leave the loop on the first respawn point that does not exist or
-		//is to the right of the player character
-		if (rp->x == NONE || rp->x > ctx.player.x) break;
+	ctx->respawn_point = i;
 
-		rx = rp->x;
-		ry = rp->y;
+	if (i != NONE) {
+		rx = points[i].x;
+		ry = points[i].y;
 	}
 
-	ctx.player.x = rx;
-	ctx.player.y = ry;
-	ctx.player.oldx = rx;
-	ctx.player.oldy = ry;
-	ctx.player.state = PLAYER_STATE_FLICKER;
-	ctx.player.fell = false;
+	ctx->player.x = PN(rx);
+	ctx->player.y = PN(ry);
+	ctx->player.oldx = PN(rx);
+	ctx->player.oldy = PN(ry);
+	ctx->player.state = PLAYER_STATE_FLICKER;
+	ctx->player.fell = false;
 
 	//Retreat camera if needed
-	if (ctx.cam.x > rx - 64) {
-		ctx.cam.xdest = rx - 64;
-		ctx.cam.xvel = -CAMERA_XVEL;
+	if (ctx->cam.x > PN(rx - 64)) {
+		ctx->cam.xdest = PN(rx - 64);
+		ctx->cam.xvel = PN(-CAMERA_XVEL);
 	}
 
-	audio_stop_sfx(SFX_FALL);
-	audio_play_sfx(SFX_RESPAWN);
+	add_event(ctx, PLAYEVT_SFX_STOP, SFX_FALL);
+	add_event(ctx, PLAYEVT_SFX, SFX_RESPAWN);
+	add_event(ctx, PLAYEVT_RESPAWN, i);
 }
 
 //Acts if the player character's state has changed
-static void handle_player_state_change()
+static void handle_player_state_change(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
+	Player* pl = &ctx->player;
 
 	//Nothing to do if the state has not changed
 	if (pl->state == pl->old_state) return;
@@ -1434,39 +2069,39 @@ static void handle_player_state_change()
 
 	switch (pl->state) {
 		case PLAYER_STATE_NORMAL:
-			pl->dec = 252;
-			pl->grav = 234;
+			pl->dec = PN(252);
+			pl->grav = PN(234);
 			break;
 
 		case PLAYER_STATE_SLIP:
-			pl->xvel = -12;
-			pl->yvel = -24;
+			pl->xvel = PN(-12);
+			pl->yvel = PN(-24);
 			pl->height = PLAYER_HEIGHT_SLIP;
 			pl->anim_type = PLAYER_ANIM_SLIP;
 			break;
 
 		case PLAYER_STATE_GETUP:
 			pl->xvel = 0;
-			pl->yvel = -120;
+			pl->yvel = PN(-120);
 			pl->height = PLAYER_HEIGHT_SLIP;
 			pl->anim_type = PLAYER_ANIM_SLIPREV;
 			break;
 
 		case PLAYER_STATE_THROWBACK:
-			pl->xvel = -102;
-			pl->yvel = -144;
+			pl->xvel = PN(-102);
+			pl->yvel = PN(-144);
 			pl->anim_type = PLAYER_ANIM_THROWBACK;
 			break;
 
 		case PLAYER_STATE_GRABROPE:
 			pl->grav = 0;
 			pl->xvel = 0;
-			pl->yvel = 120;
+			pl->yvel = PN(120);
 			pl->anim_type = PLAYER_ANIM_GRABROPE;
 			break;
 
 		case PLAYER_STATE_FLICKER:
-			pl->flicker_delay = 0.5f;
+			pl->flicker_delay = PN(0.5f);
 			pl->grav = 0;
 			pl->xvel = 0;
 			pl->yvel = 0;
@@ -1474,8 +2109,8 @@ static void handle_player_state_change()
 			break;
 
 		case PLAYER_STATE_INACTIVE:
-			pl->x = -1;
-			pl->y = -1;
+			pl->x = PN(-1);
+			pl->y = PN(-1);
 			pl->xvel = 0;
 			pl->yvel = 0;
 			pl->acc = 0;
@@ -1486,13 +2121,13 @@ static void handle_player_state_change()
 }
 
 //Updates the position of the camera
-static void move_camera()
+static void move_camera(PlayCtx* ctx)
 {
-	PlayCamera* cam = &ctx.cam;
+	PlayCamera* cam = &ctx->cam;
 
 	//Horizontal camera movement
 	if (cam->xvel != 0) {
-		cam->x += cam->xvel * delta_time;
+		cam->x += PN_MUL_DT(ctx, cam->xvel);
 
 		if (cam->xvel > 0 && cam->x >= cam->xdest) {
 			cam->xvel = 0;
@@ -1503,102 +2138,102 @@ static void move_camera()
 
 	//Vertical camera movement
 	if (cam->yvel != 0) {
-		cam->y += cam->yvel * delta_time;
+		cam->y += PN_MUL_DT(ctx, cam->yvel);
 		if (cam->yvel < 0 && cam->y <= 0) {
 			cam->y = 0;
 			cam->yvel = 0;
-		} else if (cam->yvel > 0 && cam->y >= 95) {
-			cam->y = 95;
+		} else if (cam->yvel > 0 && cam->y >= PN(95)) {
+			cam->y = PN(95);
 			cam->yvel = 0;
 		}
 	}
 
-	position_camera();
+	position_camera(ctx);
 }
 
 //Prevents the player character from moving off the level's boundaries
-static void keep_player_within_limits()
+static void keep_player_within_limits(PlayCtx* ctx)
 {
-	if (ctx.player.x < 48) {
-		ctx.player.x = 48;
-		ctx.player.xvel = 0;
+	if (ctx->player.x < PN(48)) {
+		ctx->player.x = PN(48);
+		ctx->player.xvel = 0;
 
-		if (ctx.player.on_floor) {
-			ctx.player.anim_type = PLAYER_ANIM_STAND;
+		if (ctx->player.on_floor) {
+			ctx->player.anim_type = PLAYER_ANIM_STAND;
 		}
 	}
 }
 
 //Acts if the player character's animation type has changed
-static void handle_player_animation_change()
+static void handle_player_animation_change(PlayCtx* ctx)
 {
-	int anim_type = ctx.player.anim_type;
+	int anim_type = ctx->player.anim_type;
 
 	//Nothing to do if the animation has not changed
-	if (anim_type == ctx.player.old_anim_type) return;
+	if (anim_type == ctx->player.old_anim_type) return;
 
 	switch (anim_type) {
 		case PLAYER_ANIM_STAND:
-			set_animation(ANIM_PLAYER, true, false, false, 1, 0.0f);
+			set_animation(ctx, ANIM_PLAYER, true, false, false, 1, PN(0.0f));
 			break;
 
 		case PLAYER_ANIM_WALK:
-			set_animation(ANIM_PLAYER, true, true,  false, 6, 0.1f);
+			set_animation(ctx, ANIM_PLAYER, true, true,  false, 6, PN(0.1f));
 			break;
 
 		case PLAYER_ANIM_WALKBACK:
-			set_animation(ANIM_PLAYER, true, true,  true,  6, 0.1f);
+			set_animation(ctx, ANIM_PLAYER, true, true,  true,  6, PN(0.1f));
 			break;
 
 		case PLAYER_ANIM_JUMP:
-			set_animation(ANIM_PLAYER, true, true,  false, 1, 0.0f);
+			set_animation(ctx, ANIM_PLAYER, true, true,  false, 1, PN(0.0f));
 			break;
 
 		case PLAYER_ANIM_SLIP:
-			set_animation(ANIM_PLAYER, true, false, false, 4, 0.05f);
+			set_animation(ctx, ANIM_PLAYER, true, false, false, 4, PN(0.05f));
 			break;
 
 		case PLAYER_ANIM_SLIPREV:
-			set_animation(ANIM_PLAYER, true, false, true,  4, 0.05f);
+			set_animation(ctx, ANIM_PLAYER, true, false, true,  4, PN(0.05f));
 			break;
 
 		case PLAYER_ANIM_THROWBACK:
-			set_animation(ANIM_PLAYER, true, false, false, 3, 0.05f);
+			set_animation(ctx, ANIM_PLAYER, true, false, false, 3, PN(0.05f));
 			break;
 
 		case PLAYER_ANIM_GRABROPE:
-			set_animation(ANIM_PLAYER, true, false, false, 1, 0.05f);
+			set_animation(ctx, ANIM_PLAYER, true, false, false, 1, PN(0.05f));
 			break;
 	}
 }
 
 //Updates all animations
-static void update_animations()
+static void update_animations(PlayCtx* ctx)
 {
 	int i;
 
 	//Set animation speed for bus wheels
-	ctx.anims[ANIM_BUS_WHEELS].running = false;
-	if (ctx.bus.xvel > 0) {
-		float max_delay = 0.1f;
-		if (ctx.bus.xvel > 84)  max_delay = 0.05f;
-		if (ctx.bus.xvel > 132) max_delay = 0.025f;
+	ctx->anims[ANIM_BUS_WHEELS].running = false;
+	if (ctx->bus.xvel > 0) {
+		PlayNum max_delay = PN(0.1f);
+		if (ctx->bus.xvel > PN(84))  max_delay = PN(0.05f);
+		if (ctx->bus.xvel > PN(132)) max_delay = PN(0.025f);
 
-		ctx.anims[ANIM_BUS_WHEELS].running = true;
-		ctx.anims[ANIM_BUS_WHEELS].max_delay = max_delay;
+		ctx->anims[ANIM_BUS_WHEELS].running = true;
+		ctx->anims[ANIM_BUS_WHEELS].max_delay = max_delay;
 
-		if (ctx.anims[ANIM_BUS_WHEELS].delay > max_delay) {
-			ctx.anims[ANIM_BUS_WHEELS].delay = max_delay;
+		if (ctx->anims[ANIM_BUS_WHEELS].delay > max_delay) {
+			ctx->anims[ANIM_BUS_WHEELS].delay = max_delay;
 		}
 	}
 
 	//Update animations
 	for (i = 0; i < NUM_ANIMS; i++) {
-		Anim* anim = &ctx.anims[i];
+		Anim* anim = &ctx->anims[i];
 
 		if (!anim->running) continue;
 
-		anim->delay -= delta_time;
+		anim->delay -= PN_DT(ctx);
 		if (anim->delay > 0) continue;
 
 		anim->delay = anim->max_delay;
@@ -1620,47 +2255,47 @@ static void update_animations()
 }
 
 //Moves the arrows indicating that a crate is pushable
-static void move_push_arrow()
+static void move_push_arrow(PlayCtx* ctx)
 {
-	ctx.push_arrow.xoffs += ctx.push_arrow.xvel * delta_time;
-	if (ctx.push_arrow.xoffs >= 8) {
-		ctx.push_arrow.xoffs = 8;
-		ctx.push_arrow.xvel = -30;
+	ctx->push_arrow.xoffs += PN_MUL_DT(ctx, ctx->push_arrow.xvel);
+	if (ctx->push_arrow.xoffs >= PN(8)) {
+		ctx->push_arrow.xoffs = PN(8);
+		ctx->push_arrow.xvel = PN(-30);
 	}
-	if (ctx.push_arrow.xvel < 0 && ctx.push_arrow.xoffs <= 0) {
-		ctx.push_arrow.xoffs = 0;
-		ctx.push_arrow.xvel = 0;
+	if (ctx->push_arrow.xvel < 0 && ctx->push_arrow.xoffs <= 0) {
+		ctx->push_arrow.xoffs = 0;
+		ctx->push_arrow.xvel = 0;
 	}
 
-	ctx.push_arrow.delay -= delta_time;
-	if (ctx.push_arrow.delay <= 0) {
-		ctx.push_arrow.delay = 0;
+	ctx->push_arrow.delay -= PN_DT(ctx);
+	if (ctx->push_arrow.delay <= 0) {
+		ctx->push_arrow.delay = 0;
 
-		if (ctx.push_arrow.xoffs == 0) {
-			ctx.push_arrow.xvel = 30;
-			ctx.push_arrow.delay = 1;
+		if (ctx->push_arrow.xoffs == 0) {
+			ctx->push_arrow.xvel = PN(30);
+			ctx->push_arrow.delay = PN(1);
 		}
 	}
 }
 
 //Positions the bus stop sign
-static void position_bus_stop_sign()
+static void position_bus_stop_sign(PlayCtx* ctx)
 {
-	if (ctx.level_num == 1 || ctx.cam.x > VSCREEN_MAX_WIDTH) {
+	if (ctx->level_num == 1 || ctx->cam.x > PN(VSCREEN_MAX_WIDTH)) {
 		//The sign is at the end of the level
-		ctx.bus_stop_sign_x = ctx.level_size - 40;
+		ctx->bus_stop_sign_x = ctx->level_size - 40;
 	} else {
 		//The sign is at the start of the level
-		ctx.bus_stop_sign_x = 176;
+		ctx->bus_stop_sign_x = 176;
 	}
 }
 
 //Positions the first light pole (the position of the second pole is calculated
 //later when rendering)
-static void position_light_pole()
+static void position_light_pole(PlayCtx* ctx)
 {
-	int camx = (int)ctx.cam.x + (VSCREEN_MAX_WIDTH / 2);
-	ctx.pole_x = camx - (camx % POLE_DISTANCE) + 16;
+	int camx = PN_TO_INT(ctx->cam.x) + (VSCREEN_MAX_WIDTH / 2);
+	ctx->pole_x = camx - (camx % POLE_DISTANCE) + 16;
 }
 
 //Updates the sequences, like the player character entering the bus when the
@@ -1668,75 +2303,75 @@ static void position_light_pole()
 //
 //Normal play (SEQ_NORMAL_PLAY) is treated as one of the sequences and is where
 //the start of a "goal reached" or "time up" sequence is checked
-static void update_sequence()
+static void update_sequence(PlayCtx* ctx)
 {
-	Player* pl = &ctx.player;
-	Bus* bus = &ctx.bus;
-	PlayCamera* cam = &ctx.cam;
-	int level_size = ctx.level_size;
+	Player* pl = &ctx->player;
+	Bus* bus = &ctx->bus;
+	PlayCamera* cam = &ctx->cam;
+	int level_size = ctx->level_size;
 
-	MovingPeel* thrown_peel = &ctx.moving_peels[MOVING_PEEL_THROWN];
+	MovingPeel* thrown_peel = &ctx->moving_peels[MOVING_PEEL_THROWN];
 
 	//Cutscene objects
-	CutsceneObject* cutscene_player = &ctx.cutscene_objects[0];
-	CutsceneObject* bearded_man = &ctx.cutscene_objects[1];
-	CutsceneObject* bird = &ctx.cutscene_objects[1];
-	CutsceneObject* dung = &ctx.cutscene_objects[0];
-	CutsceneObject* flagman = &ctx.cutscene_objects[1];
+	CutsceneObject* cutscene_player = &ctx->cutscene_objects[0];
+	CutsceneObject* bearded_man = &ctx->cutscene_objects[1];
+	CutsceneObject* bird = &ctx->cutscene_objects[1];
+	CutsceneObject* dung = &ctx->cutscene_objects[0];
+	CutsceneObject* flagman = &ctx->cutscene_objects[1];
 
 	//Cutscene object animations
-	Anim* cutscene_player_anim = &ctx.anims[ANIM_CUTSCENE_OBJECTS + 0];
-	Anim* bearded_man_anim = &ctx.anims[ANIM_CUTSCENE_OBJECTS + 1];
-	Anim* bird_anim = &ctx.anims[ANIM_CUTSCENE_OBJECTS + 1];
-	Anim* flagman_anim = &ctx.anims[ANIM_CUTSCENE_OBJECTS + 1];
+	Anim* cutscene_player_anim = &ctx->anims[ANIM_CUTSCENE_OBJECTS + 0];
+	Anim* bearded_man_anim = &ctx->anims[ANIM_CUTSCENE_OBJECTS + 1];
+	Anim* bird_anim = &ctx->anims[ANIM_CUTSCENE_OBJECTS + 1];
+	Anim* flagman_anim = &ctx->anims[ANIM_CUTSCENE_OBJECTS + 1];
 
-	ctx.wipe_in = false;
-	ctx.wipe_out = false;
+	ctx->wipe_in = false;
+	ctx->wipe_out = false;
 
-	ctx.sequence_delay -= delta_time;
-	if (ctx.sequence_delay > 0) return;
+	ctx->sequence_delay -= PN_DT(ctx);
+	if (ctx->sequence_delay > 0) return;
 
-	ctx.sequence_delay = 0;
+	ctx->sequence_delay = 0;
 
-	switch (ctx.sequence_step) {
+	switch (ctx->sequence_step) {
 		//----------------------------------------------------------------------
 		case 0: //SEQ_NORMAL_PLAY_START
-			move_bus_to_end();
-			ignore_user_input = false;
+			move_bus_to_end(ctx);
+			ctx->ignore_user_input = false;
 			cam->follow_player = true;
 			cam->fixed_at_leftmost = false;
-			ctx.time_running = true;
-			ctx.time_delay = 1;
-			ctx.can_pause = true;
-			ctx.sequence_step = SEQ_NORMAL_PLAY;
+			ctx->time_running = true;
+			ctx->time_delay = PN(1);
+			ctx->can_pause = true;
+			ctx->sequence_step = SEQ_NORMAL_PLAY;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 1: //SEQ_NORMAL_PLAY
-			if (pl->x >= level_size - 426) {
-				ctx.goal_reached = true;
-				ctx.time_up = false;
+			if (pl->x >= PN(level_size - 426)) {
+				ctx->goal_reached = true;
+				ctx->time_up = false;
 			}
-			if (ctx.time_up || ctx.goal_reached) {
-				ctx.can_pause = false;
-				ctx.time_running = false;
-				ignore_user_input = true;
-				input_left = false;
-				input_right = false;
-				input_jump = false;
-				jump_timeout = 0;
-
-				if (ctx.time_up) {
-					ctx.sequence_delay = 1;
-					if (pl->x >= level_size - 960) {
-						ctx.sequence_step = SEQ_TIMEUP_BUS_NEAR;
+			if (ctx->time_up || ctx->goal_reached) {
+				ctx->can_pause = false;
+				ctx->time_running = false;
+				ctx->ignore_user_input = true;
+				ctx->input_left = false;
+				ctx->input_right = false;
+				ctx->input_jump = false;
+				ctx->jump_timeout = 0;
+
+				if (ctx->time_up) {
+					ctx->sequence_delay = PN(1);
+					if (pl->x >= PN(level_size - 960)) {
+						ctx->sequence_step = SEQ_TIMEUP_BUS_NEAR;
 					} else {
-						ctx.sequence_step = SEQ_TIMEUP_BUS_FAR;
+						ctx->sequence_step = SEQ_TIMEUP_BUS_FAR;
 					}
 				} else { //Goal reached
-					input_right = true;
-					ctx.sequence_step = SEQ_GOAL_REACHED;
+					ctx->input_right = true;
+					ctx->sequence_step = SEQ_GOAL_REACHED;
 				}
 			}
 			break;
@@ -1745,63 +2380,63 @@ static void update_sequence()
 		//----------------------------------------------------------------------
 		case 10: //SEQ_INITIAL
 			//Start with bus rear door open
-			ctx.anims[ANIM_BUS_DOOR_REAR].frame = 3;
-			ctx.anims[ANIM_BUS_DOOR_REAR].reverse = true;
+			ctx->anims[ANIM_BUS_DOOR_REAR].frame = 3;
+			ctx->anims[ANIM_BUS_DOOR_REAR].reverse = true;
 
-			ignore_user_input = true;
-			ctx.time_running = false;
+			ctx->ignore_user_input = true;
+			ctx->time_running = false;
 
-			if (ctx.level_num == 1 || ctx.skip_initial_sequence) {
-				move_bus_to_end();
-				ctx.sequence_step = SEQ_NORMAL_PLAY_START;
+			if (ctx->level_num == 1 || ctx->skip_initial_sequence) {
+				move_bus_to_end(ctx);
+				ctx->sequence_step = SEQ_NORMAL_PLAY_START;
 			} else {
-				ctx.sequence_step++;
+				ctx->sequence_step++;
 			}
-			ctx.sequence_delay = 1;
+			ctx->sequence_delay = PN(1);
 
 			break;
 
 		case 11:
-			start_animation(ANIM_BUS_DOOR_REAR);
-			bus->acc = 252;
-			bus->xvel = 6;
-			ctx.sequence_delay = 2;
-			ctx.sequence_step = SEQ_NORMAL_PLAY_START;
+			start_animation(ctx, ANIM_BUS_DOOR_REAR);
+			bus->acc = PN(252);
+			bus->xvel = PN(6);
+			ctx->sequence_delay = PN(2);
+			ctx->sequence_step = SEQ_NORMAL_PLAY_START;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 20: //SEQ_BUS_LEAVING
 			//Bus leaves while closing the front door
-			start_animation(ANIM_BUS_DOOR_FRONT);
-			bus->acc = 252;
-			bus->xvel = 6;
-			ctx.sequence_delay = 2;
-			ctx.sequence_step++;
+			start_animation(ctx, ANIM_BUS_DOOR_FRONT);
+			bus->acc = PN(252);
+			bus->xvel = PN(6);
+			ctx->sequence_delay = PN(2);
+			ctx->sequence_step++;
 			break;
 
 		case 21:
 			//Screen wipes to black
-			ctx.wipe_out = true;
-			ctx.sequence_delay = 1;
-			ctx.sequence_step++;
+			ctx->wipe_out = true;
+			ctx->sequence_delay = PN(1);
+			ctx->sequence_step++;
 			break;
 
 		case 22:
-			ctx.sequence_step = SEQ_FINISHED;
+			ctx->sequence_step = SEQ_FINISHED;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 30: //SEQ_TIMEUP_BUS_NEAR
 			//Camera moves towards the bus
-			if (ctx.car.x != NONE) break; //Wait until the car and hen are
-			if (ctx.hen.x != NONE) break; //not visible anymore
+			if (ctx->car.x != NONE) break; //Wait until the car and hen are
+			if (ctx->hen.x != NONE) break; //not visible anymore
 			cam->follow_player = false;
-			cam->xdest = level_size;
-			cam->xvel = CAMERA_XVEL;
+			cam->xdest = PN(level_size);
+			cam->xvel = PN(CAMERA_XVEL);
 			cam->yvel = 0;
-			ctx.sequence_step++;
+			ctx->sequence_step++;
 			break;
 
 		case 31:
@@ -1809,8 +2444,8 @@ static void update_sequence()
 			if (cam->xvel != 0) break;
 			if (cam->yvel != 0) break;
 			cam->fixed_at_rightmost = true;
-			ctx.sequence_delay = 0.2f;
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->sequence_delay = PN(0.2f);
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
@@ -1820,9 +2455,9 @@ static void update_sequence()
 			cam->follow_player = false;
 			cam->xvel = 0;
 			cam->yvel = 0;
-			ctx.wipe_out = true;
-			ctx.sequence_delay = 0.6f;
-			ctx.sequence_step++;
+			ctx->wipe_out = true;
+			ctx->sequence_delay = PN(0.6f);
+			ctx->sequence_step++;
 			break;
 
 		case 41:
@@ -1832,207 +2467,208 @@ static void update_sequence()
 			cam->x = cam->xmax;
 			cam->y = 0;
 			cam->fixed_at_rightmost = true;
-			ctx.car.x = NONE;
-			ctx.hen.x = NONE;
-			ctx.wipe_in = true;
-			ctx.sequence_delay = 0.6f;
-			ctx.sequence_step++;
+			ctx->car.x = NONE;
+			ctx->hen.x = NONE;
+			ctx->wipe_in = true;
+			ctx->sequence_delay = PN(0.6f);
+			ctx->sequence_step++;
 			break;
 
 		case 42:
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 50: //SEQ_GOAL_REACHED
-			if (ctx.goal_scene == 3) {
-				if (pl->x > bus->x + 192) {
+			if (ctx->goal_scene == 3) {
+				if (pl->x > bus->x + PN(192)) {
 					//A banana peel is thrown from the right side of the screen
-					ctx.objs[0].type = OBJ_BANANA_PEEL_MOVING;
-					ctx.objs[0].x = level_size;
-					ctx.objs[0].y = BUS_Y + 72;
+					ctx->objs[0].type = OBJ_BANANA_PEEL_MOVING;
+					play_set_obj_list(ctx, 0, NONE);
+					ctx->objs[0].x = level_size;
+					ctx->objs[0].y = BUS_Y + 72;
 					thrown_peel->obj = 0;
-					thrown_peel->x = ctx.objs[0].x;
-					thrown_peel->y = ctx.objs[0].y;
-					thrown_peel->xvel = -510;
-					thrown_peel->yvel = 204;
-					thrown_peel->grav = 504;
-					thrown_peel->xdest = (int)bus->x + 345;
-					thrown_peel->ydest = 256;
-					ctx.sequence_step++;
+					thrown_peel->x = PN(ctx->objs[0].x);
+					thrown_peel->y = PN(ctx->objs[0].y);
+					thrown_peel->xvel = PN(-510);
+					thrown_peel->yvel = PN(204);
+					thrown_peel->grav = PN(504);
+					thrown_peel->xdest = PN(PN_TO_INT(bus->x) + 345);
+					thrown_peel->ydest = PN(256);
+					ctx->sequence_step++;
 				}
-			} else if (ctx.goal_scene == 4) {
-				if (pl->x >= bus->x + 120) {
+			} else if (ctx->goal_scene == 4) {
+				if (pl->x >= bus->x + PN(120)) {
 					//A bird appears
 					bird->sprite = SPR_BIRD;
-					bird->x = cam->x - 16;
-					bird->y = 120;
-					bird->xvel = 300;
+					bird->x = cam->x - PN(16);
+					bird->y = PN(120);
+					bird->xvel = PN(300);
 					bird_anim->running = true;
 					bird_anim->frame = 0;
 					bird_anim->num_frames = 4;
-					bird_anim->delay = 0.1f;
-					bird_anim->max_delay = 0.1f;
+					bird_anim->delay = PN(0.1f);
+					bird_anim->max_delay = PN(0.1f);
 					bird_anim->loop = true;
-					ctx.sequence_step++;
+					ctx->sequence_step++;
 				}
 			} else {
-				ctx.sequence_step++;
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 51:
-			if (pl->x >= bus->x + 256) {
+			if (pl->x >= bus->x + PN(256)) {
 				//Player character decelerates
-				pl->x = bus->x + 256;
-				input_right = false;
-				ctx.sequence_step++;
+				pl->x = bus->x + PN(256);
+				ctx->input_right = false;
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 52:
 			if (pl->state == PLAYER_STATE_SLIP) {
-				input_right = false;
-				ctx.sequence_step++;
+				ctx->input_right = false;
+				ctx->sequence_step++;
 			} else if (bird->sprite == SPR_BIRD) {
-				ctx.sequence_step++;
-			} else if (pl->xvel <= 0 || pl->x >= bus->x + 342) {
+				ctx->sequence_step++;
+			} else if (pl->xvel <= 0 || pl->x >= bus->x + PN(342)) {
 				//Player character jumps into the bus
-				pl->x = bus->x + 342;
+				pl->x = bus->x + PN(342);
 				pl->xvel = 0;
-				jump_timeout = JUMP_TIMEOUT; //Trigger a jump
-				ctx.sequence_step++;
+				ctx->jump_timeout = PN(JUMP_TIMEOUT); //Trigger a jump
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 53:
-			ctx.sequence_step = SEQ_GOAL_REACHED_SCENE1;
-			switch (ctx.goal_scene) {
-				case 2: ctx.sequence_step = SEQ_GOAL_REACHED_SCENE2; break;
-				case 3: ctx.sequence_step = SEQ_GOAL_REACHED_SCENE3; break;
-				case 4: ctx.sequence_step = SEQ_GOAL_REACHED_SCENE4; break;
-				case 5: ctx.sequence_step = SEQ_GOAL_REACHED_SCENE5; break;
+			ctx->sequence_step = SEQ_GOAL_REACHED_SCENE1;
+			switch (ctx->goal_scene) {
+				case 2: ctx->sequence_step = SEQ_GOAL_REACHED_SCENE2; break;
+				case 3: ctx->sequence_step = SEQ_GOAL_REACHED_SCENE3; break;
+				case 4: ctx->sequence_step = SEQ_GOAL_REACHED_SCENE4; break;
+				case 5: ctx->sequence_step = SEQ_GOAL_REACHED_SCENE5; break;
 			}
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 60: //SEQ_GOAL_REACHED_SCENE1
-			input_jump = false;
-			if (pl->yvel > 0 && pl->y >= BUS_Y + 36) {
+			ctx->input_jump = false;
+			if (pl->yvel > 0 && pl->y >= PN(BUS_Y + 36)) {
 				//Player character is now in the bus and score count starts
-				show_player_in_bus();
-				start_score_count();
-				ctx.sequence_step++;
+				show_player_in_bus(ctx);
+				start_score_count(ctx);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 61:
-			if (!ctx.counting_score) {
+			if (!ctx->counting_score) {
 				//Score count finished
-				ctx.sequence_delay = 0.5f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.5f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 62:
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 70: //SEQ_GOAL_REACHED_SCENE2
-			input_jump = false;
-			if (pl->yvel > 0 && pl->y >= BUS_Y + 36) {
+			ctx->input_jump = false;
+			if (pl->yvel > 0 && pl->y >= PN(BUS_Y + 36)) {
 				//Player character is now in the bus and score count starts
-				show_player_in_bus();
-				start_score_count();
-				ctx.sequence_step++;
+				show_player_in_bus(ctx);
+				start_score_count(ctx);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 71:
-			if (!ctx.counting_score) {
+			if (!ctx->counting_score) {
 				//Score count finished
-				ctx.sequence_delay = 0.5f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.5f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 72:
 			//Bus front door closes
-			start_animation(ANIM_BUS_DOOR_FRONT);
-			ctx.sequence_delay = 0.5f;
-			ctx.sequence_step++;
+			start_animation(ctx, ANIM_BUS_DOOR_FRONT);
+			ctx->sequence_delay = PN(0.5f);
+			ctx->sequence_step++;
 			break;
 
 		case 73:
 			//Bearded man comes from the right side of the screen
 			cutscene_player->sprite = NONE;
 			bearded_man->sprite = SPR_BEARDED_MAN_WALK;
-			bearded_man->x = ctx.level_size;
-			bearded_man->y = 203;
-			bearded_man->xvel = -150;
+			bearded_man->x = PN(ctx->level_size);
+			bearded_man->y = PN(203);
+			bearded_man->xvel = PN(-150);
 			bearded_man_anim->running = true;
 			bearded_man_anim->frame = 0;
 			bearded_man_anim->num_frames = 6;
-			bearded_man_anim->delay = 0.1f;
-			bearded_man_anim->max_delay = 0.1f;
+			bearded_man_anim->delay = PN(0.1f);
+			bearded_man_anim->max_delay = PN(0.1f);
 			bearded_man_anim->loop = true;
-			ctx.sequence_step++;
+			ctx->sequence_step++;
 			break;
 
 		case 74:
-			if (bearded_man->x <= bus->x + 380) {
+			if (bearded_man->x <= bus->x + PN(380)) {
 				//Bearded man decelerates
-				bearded_man->x = bus->x + 380;
-				bearded_man->acc = 252;
-				ctx.sequence_step++;
+				bearded_man->x = bus->x + PN(380);
+				bearded_man->acc = PN(252);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 75:
-			if (bearded_man->xvel >= 0 || bearded_man->x <= bus->x + 337) {
+			if (bearded_man->xvel >= 0 || bearded_man->x <= bus->x + PN(337)) {
 				//Bearded man stops and bus front door opens
 				bearded_man->sprite = SPR_BEARDED_MAN_STAND;
-				bearded_man->x = bus->x + 337;
+				bearded_man->x = bus->x + PN(337);
 				bearded_man->xvel = 0;
 				bearded_man->acc = 0;
 				bearded_man_anim->frame = 0;
 				bearded_man_anim->num_frames = 1;
-				ctx.anims[ANIM_BUS_DOOR_FRONT].reverse = false;
-				start_animation(ANIM_BUS_DOOR_FRONT);
-				ctx.sequence_delay = 0.5f;
-				ctx.sequence_step++;
+				ctx->anims[ANIM_BUS_DOOR_FRONT].reverse = false;
+				start_animation(ctx, ANIM_BUS_DOOR_FRONT);
+				ctx->sequence_delay = PN(0.5f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 76:
 			//Bearded man jumps into the bus
 			bearded_man->sprite = SPR_BEARDED_MAN_JUMP;
-			bearded_man->yvel = -156;
-			bearded_man->grav = 234;
-			ctx.sequence_step++;
+			bearded_man->yvel = PN(-156);
+			bearded_man->grav = PN(234);
+			ctx->sequence_step++;
 			break;
 
 		case 77:
-			if (bearded_man->y >= BUS_Y + 35 && bearded_man->yvel > 0) {
+			if (bearded_man->y >= PN(BUS_Y + 35) && bearded_man->yvel > 0) {
 				//Bearded man is now in the bus
 				bearded_man->sprite = SPR_BEARDED_MAN_STAND;
 				bearded_man->grav = 0;
 				bearded_man->yvel = 0;
 				bearded_man->x -= bus->x; //Make position relative to the bus
-				bearded_man->y = BUS_Y + 35;
+				bearded_man->y = PN(BUS_Y + 35);
 				bearded_man->in_bus = true;
-				ctx.sequence_delay = 0.25f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.25f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 78:
-			ctx.anims[ANIM_BUS_DOOR_FRONT].reverse = true;
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->anims[ANIM_BUS_DOOR_FRONT].reverse = true;
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
@@ -2040,75 +2676,75 @@ static void update_sequence()
 		case 80: //SEQ_GOAL_REACHED_SCENE3
 			//Player character slips on a banana peel and hits the floor
 			if (pl->on_floor) {
-				ctx.sequence_delay = 0.25f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.25f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 81:
-			input_right = !input_right;
-			old_input_right = !input_right;
+			ctx->input_right = !ctx->input_right;
+			ctx->old_input_right = !ctx->input_right;
 			if (pl->state == PLAYER_STATE_GETUP) {
 				//Player character gets up after slipping on a banana peel
 				//and starts walking again
-				input_right = true;
-				old_input_right = false;
-				ctx.sequence_step++;
+				ctx->input_right = true;
+				ctx->old_input_right = false;
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 82:
-			if (pl->x >= bus->x + 342) {
+			if (pl->x >= bus->x + PN(342)) {
 				//Player character jumps into the bus
-				pl->x = bus->x + 342;
+				pl->x = bus->x + PN(342);
 				pl->xvel = 0;
-				input_right = false;
-				jump_timeout = JUMP_TIMEOUT; //Trigger a jump
-				ctx.sequence_step++;
+				ctx->input_right = false;
+				ctx->jump_timeout = PN(JUMP_TIMEOUT); //Trigger a jump
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 83:
-			if (pl->yvel > 0 && pl->y >= BUS_Y + 36) {
+			if (pl->yvel > 0 && pl->y >= PN(BUS_Y + 36)) {
 				//Player character is now in the bus and score count starts
-				show_player_in_bus();
-				start_score_count();
-				ctx.sequence_step++;
+				show_player_in_bus(ctx);
+				start_score_count(ctx);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 84:
-			if (!ctx.counting_score) {
+			if (!ctx->counting_score) {
 				//Score count finished
-				ctx.sequence_delay = 0.25f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.25f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 85:
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 90: //SEQ_GOAL_REACHED_SCENE4
-			if (pl->x >= bus->x + 342) {
+			if (pl->x >= bus->x + PN(342)) {
 				//Player character stops at bus front door
-				pl->x = bus->x + 342;
+				pl->x = bus->x + PN(342);
 				pl->xvel = 0;
 			}
-			if (bird->x >= bus->x + 354) {
+			if (bird->x >= bus->x + PN(354)) {
 				//Bird dung appears
 				dung->sprite = SPR_DUNG;
-				dung->x = bus->x + 354;
+				dung->x = bus->x + PN(354);
 				dung->y = bird->y;
-				dung->yvel = 252;
-				ctx.sequence_step++;
+				dung->yvel = PN(252);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 91:
-			if (dung->y >= pl->y + 12) {
+			if (dung->y >= pl->y + PN(12)) {
 				//Bird dung hits the player character
 				dung->sprite = NONE;
 				dung->yvel = 0;
@@ -2116,8 +2752,8 @@ static void update_sequence()
 				cutscene_player->sprite = SPR_PLAYER_CLEAN_DUNG;
 				cutscene_player->x = pl->x;
 				cutscene_player->y = pl->y;
-				ctx.sequence_delay = 0.25f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.25f);
+				ctx->sequence_step++;
 			}
 			break;
 
@@ -2126,60 +2762,60 @@ static void update_sequence()
 			cutscene_player_anim->running = true;
 			cutscene_player_anim->frame = 0;
 			cutscene_player_anim->num_frames = 9;
-			cutscene_player_anim->delay = 0.2f;
-			cutscene_player_anim->max_delay = 0.2f;
+			cutscene_player_anim->delay = PN(0.2f);
+			cutscene_player_anim->max_delay = PN(0.2f);
 			cutscene_player_anim->loop = false;
-			ctx.sequence_delay = 2.0f;
-			ctx.sequence_step++;
+			ctx->sequence_delay = PN(2.0f);
+			ctx->sequence_step++;
 			break;
 
 		case 93:
 			//Player character finishes cleaning the dung
 			pl->visible = true;
 			cutscene_player->sprite = NONE;
-			ctx.sequence_delay = 0.25f;
-			ctx.sequence_step++;
+			ctx->sequence_delay = PN(0.25f);
+			ctx->sequence_step++;
 			break;
 
 		case 94:
 			//Player character jumps into the bus
-			jump_timeout = JUMP_TIMEOUT; //Trigger a jump
-			ctx.sequence_step++;
+			ctx->jump_timeout = PN(JUMP_TIMEOUT); //Trigger a jump
+			ctx->sequence_step++;
 			break;
 
 		case 95:
-			if (pl->yvel > 0 && pl->y >= BUS_Y + 36) {
+			if (pl->yvel > 0 && pl->y >= PN(BUS_Y + 36)) {
 				//Player character is now in the bus and score count starts
-				show_player_in_bus();
-				start_score_count();
-				ctx.sequence_step++;
+				show_player_in_bus(ctx);
+				start_score_count(ctx);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 96:
-			if (!ctx.counting_score) {
+			if (!ctx->counting_score) {
 				//Score count finished
-				ctx.sequence_delay = 0.5f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.5f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 97:
-			ctx.sequence_step = SEQ_BUS_LEAVING;
+			ctx->sequence_step = SEQ_BUS_LEAVING;
 			break;
 
 
 		//----------------------------------------------------------------------
 		case 100: //SEQ_GOAL_REACHED_SCENE5
 			//Bus leaves before the player character can enter it
-			start_animation(ANIM_BUS_DOOR_FRONT);
-			bus->acc = 252;
-			bus->xvel = 6;
-			ctx.sequence_step++;
+			start_animation(ctx, ANIM_BUS_DOOR_FRONT);
+			bus->acc = PN(252);
+			bus->xvel = PN(6);
+			ctx->sequence_step++;
 			break;
 
 		case 101:
-			if (bus->x >= ctx.level_size + 32) {
+			if (bus->x >= PN(ctx->level_size + 32)) {
 				//Player character starts running crazily
 				bus->acc = 0;
 				bus->xvel = 0;
@@ -2187,43 +2823,43 @@ static void update_sequence()
 				cutscene_player->sprite = SPR_PLAYER_RUN;
 				cutscene_player->x = pl->x;
 				cutscene_player->y = pl->y;
-				cutscene_player->xvel = 126;
-				cutscene_player->acc = 504;
+				cutscene_player->xvel = PN(126);
+				cutscene_player->acc = PN(504);
 				cutscene_player_anim->running = true;
 				cutscene_player_anim->num_frames = 4;
 				cutscene_player_anim->loop = true;
-				cutscene_player_anim->delay = 0.1f;
-				cutscene_player_anim->max_delay = 0.1f;
-				ctx.sequence_step++;
+				cutscene_player_anim->delay = PN(0.1f);
+				cutscene_player_anim->max_delay = PN(0.1f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 102:
-			if (cutscene_player->x >= ctx.level_size + 32) {
+			if (cutscene_player->x >= PN(ctx->level_size + 32)) {
 				//Score count starts
-				start_score_count();
+				start_score_count(ctx);
 				cutscene_player->xvel = 0;
-				ctx.sequence_step++;
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 103:
-			if (!ctx.counting_score) {
+			if (!ctx->counting_score) {
 				//Score count finished
-				ctx.sequence_delay = 0.5f;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(0.5f);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 104:
 			//Screen wipes to black
-			ctx.wipe_out = true;
-			ctx.sequence_delay = 1;
-			ctx.sequence_step++;
+			ctx->wipe_out = true;
+			ctx->sequence_delay = PN(1);
+			ctx->sequence_step++;
 			break;
 
 		case 105:
-			ctx.sequence_step = SEQ_FINISHED;
+			ctx->sequence_step = SEQ_FINISHED;
 			break;
 
 
@@ -2233,53 +2869,53 @@ static void update_sequence()
 			pl->visible = false;
 			pl->state = PLAYER_STATE_INACTIVE;
 
-			cam->x = VSCREEN_MAX_WIDTH + 24;
+			cam->x = PN(VSCREEN_MAX_WIDTH + 24);
 
-			bus->x = 96;
+			bus->x = PN(96);
 			bus->xvel = 0;
 			bus->route_sign = 0; //Finish (checkered flag) sign
 
 			flagman->sprite = SPR_FLAGMAN;
-			flagman->x = VSCREEN_MAX_WIDTH * 2 + 32;
-			flagman->y = 180;
+			flagman->x = PN(VSCREEN_MAX_WIDTH * 2 + 32);
+			flagman->y = PN(180);
 			flagman_anim->running = false;
 			flagman_anim->loop = false;
 			flagman_anim->reverse = false;
 			flagman_anim->frame = 3;
 			flagman_anim->num_frames = 4;
-			flagman_anim->delay = 0.1f;
-			flagman_anim->max_delay = 0.1f;
+			flagman_anim->delay = PN(0.1f);
+			flagman_anim->max_delay = PN(0.1f);
 
-			ctx.sequence_delay = 1;
-			ctx.sequence_step++;
+			ctx->sequence_delay = PN(1);
+			ctx->sequence_step++;
 			break;
 
 		case 111:
 			//Camera moves to the right
-			cam->xvel = CAMERA_XVEL / 4;
-			cam->xdest = VSCREEN_MAX_WIDTH * 2 - 136;
-			ctx.sequence_delay = 3;
-			ctx.sequence_step++;
+			cam->xvel = PN(CAMERA_XVEL / 4);
+			cam->xdest = PN(VSCREEN_MAX_WIDTH * 2 - 136);
+			ctx->sequence_delay = PN(3);
+			ctx->sequence_step++;
 			break;
 
 		case 112:
 			//Traffic jam starts moving
-			bus->xvel = 72;
-			ctx.anims[ANIM_CAR_WHEELS].delay = 0.1f;
-			ctx.anims[ANIM_CAR_WHEELS].max_delay = 0.1f;
-			start_animation(ANIM_CAR_WHEELS);
-			ctx.sequence_step++;
+			bus->xvel = PN(72);
+			ctx->anims[ANIM_CAR_WHEELS].delay = PN(0.1f);
+			ctx->anims[ANIM_CAR_WHEELS].max_delay = PN(0.1f);
+			start_animation(ctx, ANIM_CAR_WHEELS);
+			ctx->sequence_step++;
 			break;
 
 		case 113:
-			if (bus->x >= 232) {
+			if (bus->x >= PN(232)) {
 				//Traffic jam stops
-				bus->x = 232;
+				bus->x = PN(232);
 				bus->xvel = 0;
-				ctx.anims[ANIM_CAR_WHEELS].running = false;
-				ctx.anims[ANIM_CAR_WHEELS].frame = 0;
-				ctx.sequence_delay = 1;
-				ctx.sequence_step++;
+				ctx->anims[ANIM_CAR_WHEELS].running = false;
+				ctx->anims[ANIM_CAR_WHEELS].frame = 0;
+				ctx->sequence_delay = PN(1);
+				ctx->sequence_step++;
 			}
 			break;
 
@@ -2287,142 +2923,735 @@ static void update_sequence()
 			//Player character appears from the left side of the screen and
 			//is running crazily
 			cutscene_player->sprite = SPR_PLAYER_RUN;
-			cutscene_player->x = cam->x - 80;
-			cutscene_player->y = 204;
-			cutscene_player->xvel = 210;
+			cutscene_player->x = cam->x - PN(80);
+			cutscene_player->y = PN(204);
+			cutscene_player->xvel = PN(210);
 			cutscene_player_anim->running = true;
 			cutscene_player_anim->num_frames = 4;
 			cutscene_player_anim->loop = true;
-			cutscene_player_anim->delay = 0.1f;
-			cutscene_player_anim->max_delay = 0.1f;
-			ctx.sequence_step++;
+			cutscene_player_anim->delay = PN(0.1f);
+			cutscene_player_anim->max_delay = PN(0.1f);
+			ctx->sequence_step++;
 			break;
 
 		case 115:
-			if (cutscene_player->x > flagman->x && !ctx.player_reached_flagman) {
+			if (cutscene_player->x > flagman->x && !ctx->player_reached_flagman) {
 				//Player character reaches the flagman, who swings the flag
-				ctx.player_reached_flagman = true;
+				ctx->player_reached_flagman = true;
 				flagman_anim->frame = 0;
 				flagman_anim->running = true;
 			}
-			if (cutscene_player->x >= cam->x + 304) {
+			if (cutscene_player->x >= cam->x + PN(304)) {
 				//Player character decelerates
-				cutscene_player->x = cam->x + 304;
-				cutscene_player->acc = -252;
-				ctx.sequence_step++;
+				cutscene_player->x = cam->x + PN(304);
+				cutscene_player->acc = PN(-252);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 116:
-			if (cutscene_player->xvel <= 128) {
+			if (cutscene_player->xvel <= PN(128)) {
 				if (cutscene_player->sprite == SPR_PLAYER_RUN) {
 					cutscene_player->sprite = SPR_PLAYER_WALK;
-					cutscene_player->x += 8;
+					cutscene_player->x += PN(8);
 				}
 			}
-			if (cutscene_player->xvel <= 0 || cutscene_player->x >= cam->x + 392) {
+			if (cutscene_player->xvel <= 0 || cutscene_player->x >= cam->x + PN(392)) {
 				//Player character stops
-				cutscene_player->x = cam->x + 392;
+				cutscene_player->x = cam->x + PN(392);
 				cutscene_player->xvel = 0;
 				cutscene_player->acc = 0;
 				cutscene_player->sprite = SPR_PLAYER_STAND;
 				cutscene_player_anim->running = false;
 				cutscene_player_anim->frame = 0;
-				ctx.sequence_delay = 1;
-				ctx.sequence_step++;
+				ctx->sequence_delay = PN(1);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 117:
 			//Traffic jam starts moving
-			bus->xvel = 72;
-			start_animation(ANIM_CAR_WHEELS);
-			ctx.sequence_step++;
+			bus->xvel = PN(72);
+			start_animation(ctx, ANIM_CAR_WHEELS);
+			ctx->sequence_step++;
 			break;
 
 		case 118:
-			if (bus->x >= 504) {
+			if (bus->x >= PN(504)) {
 				//Traffic jam stops
-				bus->x = 504;
+				bus->x = PN(504);
 				bus->xvel = 0;
-				ctx.anims[ANIM_CAR_WHEELS].running = false;
-				ctx.anims[ANIM_CAR_WHEELS].frame = 0;
-				ctx.sequence_delay = 1;
-				ctx.sequence_step++;
+				ctx->anims[ANIM_CAR_WHEELS].running = false;
+				ctx->anims[ANIM_CAR_WHEELS].frame = 0;
+				ctx->sequence_delay = PN(1);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 119:
 			//Hen appears from the left side of the screen
-			ctx.hen.x = cam->x - 64;
-			ctx.hen.xvel = 360;
-			start_animation(ANIM_HEN);
-			ctx.sequence_step++;
+			ctx->hen.x = cam->x - PN(64);
+			ctx->hen.xvel = PN(360);
+			start_animation(ctx, ANIM_HEN);
+			ctx->sequence_step++;
 			break;
 
 		case 120:
-			if (ctx.hen.x >= cam->x + 120) {
+			if (ctx->hen.x >= cam->x + PN(120)) {
 				//Hen decelerates
-				ctx.hen.x = cam->x + 120;
-				ctx.hen.acc = -252;
-				ctx.sequence_step++;
+				ctx->hen.x = cam->x + PN(120);
+				ctx->hen.acc = PN(-252);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 121:
-			if (ctx.hen.x > flagman->x && !ctx.hen_reached_flagman) {
+			if (ctx->hen.x > flagman->x && !ctx->hen_reached_flagman) {
 				//Hen reaches the flagman, who swings the flag
-				ctx.hen_reached_flagman = true;
+				ctx->hen_reached_flagman = true;
 				flagman_anim->frame = 0;
 				flagman_anim->running = true;
 			}
-			if (ctx.hen.xvel <= 0 || ctx.hen.x >= cam->x + 352) {
+			if (ctx->hen.xvel <= 0 || ctx->hen.x >= cam->x + PN(352)) {
 				//Hen stops
-				ctx.hen.x = cam->x + 352;
-				ctx.hen.xvel = 0;
-				ctx.hen.acc = 0;
-				ctx.anims[ANIM_HEN].running = false;
-				ctx.anims[ANIM_HEN].frame = 1;
-				ctx.sequence_delay = 1;
-				ctx.sequence_step++;
+				ctx->hen.x = cam->x + PN(352);
+				ctx->hen.xvel = 0;
+				ctx->hen.acc = 0;
+				ctx->anims[ANIM_HEN].running = false;
+				ctx->anims[ANIM_HEN].frame = 1;
+				ctx->sequence_delay = PN(1);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 122:
 			//Traffic jam starts moving
-			bus->xvel = 72;
-			start_animation(ANIM_CAR_WHEELS);
-			ctx.sequence_step++;
+			bus->xvel = PN(72);
+			start_animation(ctx, ANIM_CAR_WHEELS);
+			ctx->sequence_step++;
 			break;
 
 		case 123:
-			if (bus->x >= cam->x - 60) {
+			if (bus->x >= cam->x - PN(60)) {
 				//Bus reaches the flagman, who swings the flag
-				ctx.bus_reached_flagman = true;
+				ctx->bus_reached_flagman = true;
 				flagman_anim->frame = 0;
 				flagman_anim->running = true;
 
 				//Traffic jam stops
-				bus->x = cam->x - 60;
+				bus->x = cam->x - PN(60);
 				bus->xvel = 0;
-				ctx.anims[ANIM_CAR_WHEELS].running = false;
-				ctx.anims[ANIM_CAR_WHEELS].frame = 0;
-				start_animation(ANIM_BUS_DOOR_FRONT);
-				ctx.sequence_delay = 3;
-				ctx.sequence_step++;
+				ctx->anims[ANIM_CAR_WHEELS].running = false;
+				ctx->anims[ANIM_CAR_WHEELS].frame = 0;
+				start_animation(ctx, ANIM_BUS_DOOR_FRONT);
+				ctx->sequence_delay = PN(3);
+				ctx->sequence_step++;
 			}
 			break;
 
 		case 124:
 			//Screen wipes to black
-			ctx.wipe_out = true;
-			ctx.sequence_delay = 1;
-			ctx.sequence_step++;
+			ctx->wipe_out = true;
+			ctx->sequence_delay = PN(1);
+			ctx->sequence_step++;
 			break;
 
 		case 125:
-			ctx.sequence_step = SEQ_FINISHED;
+			ctx->sequence_step = SEQ_FINISHED;
 			break;
 	}
 }
 
+//Gets the range of level columns overlapped by a horizontal span, which is
+//empty (last < first) if the level has no columns
+static void get_column_range(PlayCtx* ctx, int left, int right, int* first,
+	int* last)
+{
+	int max_col = ctx->num_level_columns - 1;
+
+	*first = left / LEVEL_BLOCK_SIZE;
+	*last = right / LEVEL_BLOCK_SIZE;
+
+	if (*first < 0) *first = 0;
+	if (*last < 0) *last = 0;
+	if (*first > max_col) *first = max_col;
+	if (*last > max_col) *last = max_col;
+	if (max_col < 0) *first = 0;
+}
+
+//Removes a solid from the lists of the level columns it overlaps
+static void unindex_solid(PlayCtx* ctx, int solid)
+{
+	Solid* sol = &ctx->solids[solid];
+	int first, last;
+	int i;
+
+	get_column_range(ctx, sol->left, sol->right, &first, &last);
+
+	for (i = first; i <= last; i++) {
+		LevelColumn* col = &ctx->level_columns[i];
+		int j;
+
+		for (j = 0; j < col->num_solids; j++) {
+			if (col->solids[j] == solid) break;
+		}
+
+		if (j == col->num_solids) continue;
+
+		col->num_solids--;
+		for (; j < col->num_solids; j++) {
+			col->solids[j] = col->solids[j + 1];
+		}
+	}
+}
+
+//Fills result[] with the indices of the solids overlapping a range of at most
+//MAX_SOLID_QUERY_COLUMNS level columns, in ascending order and without
+//duplicates, returning the number of solids found
+static int query_solids(PlayCtx* ctx, int first, int last, int* result)
+{
+	int heads[MAX_SOLID_QUERY_COLUMNS];
+	int count = 0;
+	int i;
+
+	for (i = first; i <= last; i++) {
+		heads[i - first] = 0;
+	}
+
+	//Merge the sorted lists of the level columns, as a solid overlapping
+	//multiple level columns is present in each of their lists
+	while (1) {
+		int next = NONE;
+
+		for (i = first; i <= last; i++) {
+			LevelColumn* col = &ctx->level_columns[i];
+			int h = heads[i - first];
+
+			if (h < col->num_solids && (next == NONE || col->solids[h] < next)) {
+				next = col->solids[h];
+			}
+		}
+
+		if (next == NONE) break;
+
+		for (i = first; i <= last; i++) {
+			LevelColumn* col = &ctx->level_columns[i];
+			int h = heads[i - first];
+
+			if (h < col->num_solids && col->solids[h] == next) {
+				heads[i - first]++;
+			}
+		}
+
+		result[count++] = next;
+	}
+
+	return count;
+}
+
+//Removes an object from its object list
+static void unlink_obj(PlayCtx* ctx, int obj)
+{
+	ObjListNode* node = &ctx->obj_nodes[obj];
+	ObjList* lst = &ctx->obj_lists[node->list];
+
+	if (node->prev != NONE) {
+		ctx->obj_nodes[node->prev].next = node->next;
+	} else {
+		lst->first = node->next;
+	}
+
+	if (node->next != NONE) {
+		ctx->obj_nodes[node->next].prev = node->prev;
+	} else {
+		lst->last = node->prev;
+	}
+
+	if (lst->cursor == obj) {
+		lst->cursor = (node->next != NONE) ? node->next : node->prev;
+	}
+
+	node->list = NONE;
+}
+
+//Restores the order of an object's list after the object has moved
+static void reposition_obj(PlayCtx* ctx, int obj)
+{
+	int list = ctx->obj_nodes[obj].list;
+
+	if (list == NONE) return;
+
+	unlink_obj(ctx, obj);
+	play_set_obj_list(ctx, obj, list);
+}
+
+//Appends to result[] the objects of an object list whose X position is within
+//a range, returning the new number of objects in result[]
+static int query_objs(PlayCtx* ctx, int list, int xmin, int xmax, int* result,
+	int count)
+{
+	ObjList* lst = &ctx->obj_lists[list];
+	int obj = (lst->cursor != NONE) ? lst->cursor : lst->first;
+
+	//Walk from the cursor to the first object within the range
+	while (obj != NONE) {
+		int prev = ctx->obj_nodes[obj].prev;
+
+		if (prev == NONE || ctx->objs[prev].x < xmin) break;
+		obj = prev;
+	}
+	while (obj != NONE && ctx->objs[obj].x < xmin) {
+		obj = ctx->obj_nodes[obj].next;
+	}
+
+	if (obj != NONE) {
+		lst->cursor = obj;
+	}
+
+	while (obj != NONE && ctx->objs[obj].x <= xmax) {
+		result[count++] = obj;
+		obj = ctx->obj_nodes[obj].next;
+	}
+
+	return count;
+}
+
+//Restores the order of ctx->obj_order[] after an object has moved, adding the
+//object if not yet present
+static void reorder_obj(PlayCtx* ctx, int obj)
+{
+	int* order = ctx->obj_order;
+	int pos = ctx->obj_order_pos[obj];
+	int x = ctx->objs[obj].x;
+
+	if (pos == NONE) {
+		pos = ctx->num_ordered_objs;
+		ctx->num_ordered_objs++;
+	}
+
+	while (pos > 0 && ctx->objs[order[pos - 1]].x > x) {
+		order[pos] = order[pos - 1];
+		ctx->obj_order_pos[order[pos]] = pos;
+		pos--;
+	}
+
+	while (pos < ctx->num_ordered_objs - 1 && ctx->objs[order[pos + 1]].x < x) {
+		order[pos] = order[pos + 1];
+		ctx->obj_order_pos[order[pos]] = pos;
+		pos++;
+	}
+
+	order[pos] = obj;
+	ctx->obj_order_pos[obj] = pos;
+}
+
+//Moves a gush according to its movement pattern
+static void move_gush(PlayCtx* ctx, Gush* gush)
+{
+	const int* pattern = data_gush_move_patterns[gush->move_pattern];
+	PlayNum y = gush->y;
+	PlayNum yvel = gush->yvel;
+	PlayNum ydest = gush->ydest;
+
+	y += PN_MUL_DT(ctx, yvel);
+
+	//If the gush reaches its destination Y position
+	if ((yvel < 0 && y <= ydest) || (yvel > 0 && y >= ydest)) {
+		y = ydest;
+
+		//Advance within the movement pattern and loop if its end is reached
+		gush->move_pattern_pos += 2;
+		if (pattern[gush->move_pattern_pos] == 0) {
+			gush->move_pattern_pos = 0;
+		}
+
+		gush->yvel  = PN(pattern[gush->move_pattern_pos]);
+		gush->ydest = PN(pattern[gush->move_pattern_pos + 1]);
+	}
+
+	gush->y = y;
+}
+
+//Advances the bounds of the active ranges to follow the camera, which takes
+//time proportional to how much the camera has moved rather than to the length
+//of the level
+static void update_active_ranges(PlayCtx* ctx)
+{
+	int xmin = PN_TO_INT(ctx->cam.x) - ACTIVE_WINDOW_MARGIN;
+	int xmax = PN_TO_INT(ctx->cam.x) + VSCREEN_MAX_WIDTH + ACTIVE_WINDOW_MARGIN;
+	Obj* objs = ctx->objs;
+	int* order = ctx->obj_order;
+	Gush* gushes = ctx->gushes;
+	Passageway* pws = ctx->passageways;
+	ActiveRange* r;
+	int n;
+
+	//Objects
+	r = &ctx->active_objs;
+	n = ctx->num_ordered_objs;
+	while (r->first > 0 && objs[order[r->first - 1]].x >= xmin) {
+		r->first--;
+	}
+	while (r->first < n && objs[order[r->first]].x < xmin) {
+		r->first++;
+	}
+	while (r->end < n && objs[order[r->end]].x <= xmax) {
+		r->end++;
+	}
+	while (r->end > 0 && objs[order[r->end - 1]].x > xmax) {
+		r->end--;
+	}
+
+	//Gushes from the level file
+	r = &ctx->active_gushes;
+	n = ctx->num_level_gushes;
+	while (r->first > 0 && objs[gushes[r->first - 1].obj].x >= xmin) {
+		r->first--;
+	}
+	while (r->first < n && objs[gushes[r->first].obj].x < xmin) {
+		r->first++;
+	}
+	while (r->end < n && objs[gushes[r->end].obj].x <= xmax) {
+		r->end++;
+	}
+	while (r->end > 0 && objs[gushes[r->end - 1].obj].x > xmax) {
+		r->end--;
+	}
+
+	//Passageways, which can be wider than ACTIVE_WINDOW_MARGIN, so their right
+	//ends are checked against the left side of the window
+	r = &ctx->active_passageways;
+	n = MAX_PASSAGEWAYS;
+	while (r->first > 0 && pws[r->first - 1].x + pws[r->first - 1].width >= xmin) {
+		r->first--;
+	}
+	while (r->first < n && pws[r->first].x != NONE &&
+			pws[r->first].x + pws[r->first].width < xmin) {
+		r->first++;
+	}
+	while (r->end < n && pws[r->end].x != NONE && pws[r->end].x <= xmax) {
+		r->end++;
+	}
+	while (r->end > 0 && pws[r->end - 1].x > xmax) {
+		r->end--;
+	}
+}
+
+//Reserves space for an array within an arena of a given size, returning its
+//offset
+static size_t arena_reserve(size_t* size, size_t bytes)
+{
+	//Keep every array aligned to 16 bytes
+	size_t offset = (*size + 15) & ~(size_t)15;
+
+	*size = offset + bytes;
+
+	return offset;
+}
+
+//Ensures an arena can hold a given number of bytes, returning false if out of
+//memory
+static bool arena_fit(PlayArena* arena, size_t size)
+{
+	if (size > arena->capacity) {
+		free(arena->data);
+
+		arena->data = malloc(size);
+		arena->size = 0;
+		arena->capacity = 0;
+
+		if (arena->data == NULL) {
+			return false;
+		}
+
+		arena->capacity = size;
+	}
+
+	arena->size = size;
+
+	return true;
+}
+
+//Converts a pointer into the arena of a gameplay context into the equivalent
+//pointer into the arena of a copy
+static void* rebase(const PlayCtx* src, PlayCtx* dst, const void* ptr)
+{
+	if (ptr == NULL) {
+		return NULL;
+	}
+
+	return dst->arena.data + ((const char*)ptr - src->arena.data);
+}
+
+//Hashes an array of 32-bit words (size in bytes) in four independent lanes,
+//which lets the compiler use SIMD instructions, combining them at the end
+static uint32_t hash_words(uint32_t hash, const void* data, size_t size)
+{
+	const uint32_t* words = data;
+	size_t num_words = size / sizeof(uint32_t);
+	uint32_t lanes[4];
+	size_t i;
+	int j;
+
+	for (j = 0; j < 4; j++) {
+		lanes[j] = hash + j;
+	}
+
+	for (i = 0; i + 4 <= num_words; i += 4) {
+		for (j = 0; j < 4; j++) {
+			lanes[j] = (lanes[j] ^ words[i + j]) * 16777619u;
+		}
+	}
+
+	for (; i < num_words; i++) {
+		lanes[0] = (lanes[0] ^ words[i]) * 16777619u;
+	}
+
+	for (j = 0; j < 4; j++) {
+		hash = (hash ^ lanes[j]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t hash_int(uint32_t hash, int value)
+{
+	return (hash ^ (uint32_t)value) * 16777619u;
+}
+
+//Hashes the exact bits of a PlayNum, which is either a float or a fixed-point
+//number of the same size
+static uint32_t hash_num(uint32_t hash, PlayNum value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+
+	return (hash ^ bits) * 16777619u;
+}
+
+//Gets the offset of a pointer within the arena of a gameplay context
+static uint64_t arena_offset(const PlayCtx* ctx, const void* ptr)
+{
+	if (ptr == NULL) {
+		return UINT64_MAX;
+	}
+
+	return (uint64_t)((const char*)ptr - ctx->arena.data);
+}
+
+//Checks whether an array from a snapshot, given its offset (as returned by
+//arena_offset()) and number of elements, fits within the snapshot's arena
+static bool array_fits(uint64_t arena_size, uint64_t offset, int count,
+	size_t elem_size)
+{
+	if (offset == UINT64_MAX) {
+		return (count == 0);
+	}
+
+	//Arrays are aligned to 16 bytes by arena_reserve()
+	if (offset % 16 != 0) {
+		return false;
+	}
+
+	return (count >= 0 && offset <= arena_size &&
+		(uint64_t)count * elem_size <= arena_size - offset);
+}
+
+//Converts an offset returned by arena_offset() back into a pointer
+static void* arena_at(PlayCtx* ctx, uint64_t offset)
+{
+	if (offset == UINT64_MAX || ctx->arena.data == NULL) {
+		return NULL;
+	}
+
+	return ctx->arena.data + offset;
+}
+
+//Checks the counts and indices of a gameplay context taken from a snapshot,
+//along with those within the level-dependent arrays in the snapshot's arena
+//(data), whose extents have already been checked by array_fits()
+//
+//The elements are copied out of the arena, which may not be aligned
+static bool snapshot_valid(const PlayCtx* ctx, const PlaySnapshotHeader* hdr,
+	const char* data)
+{
+	int max_objs = ctx->max_objs;
+	int i, j;
+
+	if (ctx->num_ordered_objs < 0 || ctx->num_ordered_objs > max_objs) {
+		return false;
+	}
+	if (ctx->num_level_gushes < 0 || ctx->num_level_gushes > ctx->max_gushes) {
+		return false;
+	}
+	if (ctx->num_solids < 0 || ctx->num_solids > ctx->max_solids) {
+		return false;
+	}
+
+	for (i = 0; i < NUM_OBJLISTS; i++) {
+		const ObjList* lst = &ctx->obj_lists[i];
+
+		if (!index_valid(lst->first, max_objs, true)) return false;
+		if (!index_valid(lst->last, max_objs, true)) return false;
+		if (!index_valid(lst->cursor, max_objs, true)) return false;
+	}
+
+	if (!range_valid(&ctx->active_objs, ctx->num_ordered_objs)) return false;
+	if (!range_valid(&ctx->active_gushes, ctx->num_level_gushes)) return false;
+	if (!range_valid(&ctx->active_passageways, MAX_PASSAGEWAYS)) return false;
+
+	if (ctx->next_trigger < 0 || ctx->next_trigger > ctx->num_triggers) {
+		return false;
+	}
+	if (!index_valid(ctx->respawn_point, ctx->num_respawn_points, true)) {
+		return false;
+	}
+
+	for (i = 0; i < MAX_MOVING_PEELS; i++) {
+		if (!index_valid(ctx->moving_peels[i].obj, max_objs, true)) return false;
+	}
+
+	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
+		const PushableCrate* crate = &ctx->pushable_crates[i];
+
+		if (!index_valid(crate->obj, max_objs, true)) return false;
+
+		if (crate->obj != NONE && !index_valid(crate->solid, ctx->num_solids, false)) {
+			return false;
+		}
+	}
+
+	if (!index_valid(ctx->grabbed_rope.obj, max_objs, true)) return false;
+	if (!index_valid(ctx->hit_spring, max_objs, true)) return false;
+	if (!index_valid(ctx->cur_passageway, MAX_PASSAGEWAYS, true)) return false;
+	if (!index_valid(ctx->player.anim_type, NUM_PLAYER_ANIMS, false)) return false;
+	if (!snapshot_gush_valid(&ctx->gush_phase, max_objs)) return false;
+
+	if (!index_valid(ctx->next_coin_spark, MAX_COIN_SPARKS, false)) return false;
+	if (!index_valid(ctx->next_crack_particle, MAX_CRACK_PARTICLES, false)) {
+		return false;
+	}
+	if (!index_valid(ctx->first_event, MAX_PLAY_EVENTS, false)) return false;
+	if (ctx->num_events < 0 || ctx->num_events > MAX_PLAY_EVENTS) return false;
+
+	//Level columns
+	for (i = 0; i < ctx->num_level_columns; i++) {
+		LevelColumn col;
+
+		memcpy(&col, data + hdr->offsets[0] + i * sizeof(col), sizeof(col));
+
+		if (!index_valid(col.type, NUM_LVLCOL_TYPES, false)) return false;
+		if (col.num_solids < 0 || col.num_solids > MAX_COLUMN_SOLIDS) {
+			return false;
+		}
+
+		for (j = 0; j < col.num_solids; j++) {
+			if (col.solids[j] >= ctx->num_solids) return false;
+		}
+	}
+
+	//Objects, their list links, and their order by X position, in which the
+	//first num_ordered_objs entries must refer to objects
+	for (i = 0; i < max_objs; i++) {
+		Obj obj;
+		ObjListNode node;
+		int order, pos;
+
+		memcpy(&obj, data + hdr->offsets[1] + i * sizeof(obj), sizeof(obj));
+		memcpy(&node, data + hdr->offsets[2] + i * sizeof(node), sizeof(node));
+		memcpy(&order, data + hdr->offsets[3] + i * sizeof(int), sizeof(int));
+		memcpy(&pos, data + hdr->offsets[4] + i * sizeof(int), sizeof(int));
+
+		if (!index_valid(obj.type, NUM_OBJ_TYPES, true)) return false;
+		if (!index_valid(node.list, NUM_OBJLISTS, true)) return false;
+		if (!index_valid(pos, ctx->num_ordered_objs, true)) return false;
+
+		if (node.list != NONE) {
+			if (!index_valid(node.prev, max_objs, true)) return false;
+			if (!index_valid(node.next, max_objs, true)) return false;
+		}
+
+		if (i < ctx->num_ordered_objs && !index_valid(order, max_objs, false)) {
+			return false;
+		}
+	}
+
+	//Gushes, of which the ones from the level file must refer to objects (the
+	//others are unused if not)
+	for (i = 0; i < ctx->max_gushes; i++) {
+		Gush gush;
+
+		memcpy(&gush, data + hdr->offsets[6] + i * sizeof(gush), sizeof(gush));
+
+		if (gush.obj == NONE) {
+			if (i < ctx->num_level_gushes) return false;
+			continue;
+		}
+
+		if (!snapshot_gush_valid(&gush, max_objs)) return false;
+	}
+
+	return true;
+}
+
+//Checks the object index (if any) and the position within the movement pattern
+//of a gush taken from a snapshot
+static bool snapshot_gush_valid(const Gush* gush, int max_objs)
+{
+	const int* pattern;
+	int i;
+
+	if (!index_valid(gush->obj, max_objs, true)) return false;
+
+	if (gush->move_pattern != GUSH_MOVE_PATTERN_1 &&
+			gush->move_pattern != GUSH_MOVE_PATTERN_2) {
+
+		return false;
+	}
+
+	if (gush->move_pattern_pos < 0 || gush->move_pattern_pos % 2 != 0) {
+		return false;
+	}
+
+	//Each pattern ends with a zero velocity
+	pattern = data_gush_move_patterns[gush->move_pattern];
+	for (i = 0; i < gush->move_pattern_pos; i += 2) {
+		if (pattern[i] == 0) return false;
+	}
+
+	return true;
+}
+
+//Checks if an index is within an array of a given size, or if it is NONE when
+//none_allowed is true
+static bool index_valid(int index, int count, bool none_allowed)
+{
+	if (index == NONE) return none_allowed;
+
+	return (index >= 0 && index < count);
+}
+
+//Checks if the bounds of an active range are within an array of a given size
+static bool range_valid(const ActiveRange* r, int count)
+{
+	return (r->first >= 0 && r->first <= r->end && r->end <= count);
+}
+
+//Adds an event to be taken by play_take_event(), overwriting the oldest one if
+//the buffer is full
+static void add_event(PlayCtx* ctx, int type, int value)
+{
+	int pos;
+
+	if (ctx->num_events == MAX_PLAY_EVENTS) {
+		ctx->first_event = (ctx->first_event + 1) % MAX_PLAY_EVENTS;
+		ctx->num_events--;
+	}
+
+	pos = (ctx->first_event + ctx->num_events) % MAX_PLAY_EVENTS;
+	ctx->events[pos].type = type;
+	ctx->events[pos].value = value;
+	ctx->num_events++;
+}
+
@@ -22,7 +22,9 @@
  * renderer.c
  *
  * Description:
- * Rendering of graphics
+ * Rendering of graphics, which is done with OpenGL, except when built without
+ * a GPU for the headless simulation program (PLATFORM_HEADLESS), in which case
+ * the virtual screen is drawn in software to a framebuffer in memory
  *
  */
 
@@ -31,7 +33,9 @@
 #include "defs.h"
 
 #include <raylib.h>
+#ifndef PLATFORM_HEADLESS
 #include <rlgl.h>
+#endif
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -50,33 +54,177 @@
 #define STBI_NO_SIMD
 #endif
 
+//With only the PNG decoder, some of stb_image's helper functions go unused
 #define STB_IMAGE_IMPLEMENTATION
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
 #include "external/stb_image.h"
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
 
 //------------------------------------------------------------------------------
 
+#ifndef PLATFORM_HEADLESS
 //From menu.c
 bool menu_is_open();
 int menu_center_tile_y();
 int menu_item_x(MenuItem* item);
 int menu_item_y(MenuItem* item);
+#else
+//From swrender.c
+bool swrender_load_atlas(const unsigned char* pixels, int width, int height);
+void swrender_set_target(uint32_t* pixels, int width, int height, int pitch);
+void swrender_blit(int sx, int sy, int sw, int sh, int dx, int dy, int dw,
+	int dh, bool hflip, bool vflip, int alpha);
+void swrender_free();
+
+//From util.c
+int get_file_size(const char* path);
+char* load_file_text(const char* path);
+void unload_file_text(char* text);
+#endif
+
+//From play.c
+bool play_copy_for_drawing(PlayCtx* dst, const PlayCtx* src);
+void play_free(PlayCtx* ctx);
+
+#if defined(PERF_OVERLAY) || defined(PERF_TRACE)
+//From perf.c
+void perf_mark();
+void perf_lap(int phase);
+bool perf_is_visible();
+void perf_get_stats(PerfStats* stats);
+#endif
 
 //From data.c
 extern const int data_sprites[];
 extern const int data_player_anim_sprites[];
 extern const int data_obj_sprites[];
 extern const int data_level_column_blocks[];
+#ifdef PERF_OVERLAY
+extern const char* data_perf_phase_names[];
+#endif
 
 //------------------------------------------------------------------------------
 
+#ifndef PLATFORM_HEADLESS
 static RenderTexture2D vscreen;
 static Texture2D gfx;
 
+//Level blocks of the level columns, drawn when they come into view, with the
+//column at position i stored at slot i % LEVEL_LAYER_COLUMNS, and the type of
+//the column (LVLCOL_*) last drawn to each slot, as the blocks depend only on it
+static RenderTexture2D level_layer;
+static int level_layer_types[LEVEL_LAYER_COLUMNS];
+
+//Normalized texture coordinates of the first frame of each sprite (left, top,
+//width, and height), computed when gfx is loaded, and the size of a texel
+static float sprite_uvs[NUM_SPRITES * 4];
+static float gfx_texel_width;
+static float gfx_texel_height;
+
+//Quads drawn from gfx and not yet sent to rlgl, which are sent together with
+//a single texture bind when something else is drawn or the target changes, so
+//the whole run takes a single draw call
+static SpriteQuad sprite_batch[SPRITE_BATCH_MAX_QUADS];
+static int sprite_batch_len;
+static int sprite_run_len; //Including the quads already sent
+
+//Blocks of text drawn before, with their glyphs and copies of their text
+//stored one after another in the pools, which are emptied when any is full
+static TextCacheEntry text_cache[TEXT_CACHE_MAX_ENTRIES];
+static int text_cache_len;
+static char text_cache_chars[TEXT_CACHE_MAX_CHARS];
+static int text_cache_chars_len;
+static SpriteQuad text_cache_glyphs[TEXT_CACHE_MAX_GLYPHS];
+static int text_cache_glyphs_len;
+
+//Shader that draws the virtual screen on the physical screen with the
+//scanlines, darkening the last row of pixels of each line in the same pass
+//instead of drawing a quad over it, along with the locations of its uniforms
+//
+//If it cannot be loaded, the scanlines are drawn as quads
+static Shader scanline_shader;
+static bool scanline_shader_loaded;
+static int scanline_top_loc;
+static int scanline_scale_loc;
+static int scanline_level_loc;
+
+#if defined(GRAPHICS_API_OPENGL_ES2)
+#define SCANLINE_SHADER_HEADER \
+	"#version 100\n" \
+	"#ifdef GL_FRAGMENT_PRECISION_HIGH\n" \
+	"precision highp float;\n" \
+	"#else\n" \
+	"precision mediump float;\n" \
+	"#endif\n"
+#else
+#define SCANLINE_SHADER_HEADER "#version 120\n"
+#endif
+
+//The same as raylib's default vertex shader, except for passing on the Y
+//position on the screen
+static const char* scanline_vs =
+	SCANLINE_SHADER_HEADER
+	"attribute vec3 vertexPosition;\n"
+	"attribute vec2 vertexTexCoord;\n"
+	"attribute vec4 vertexColor;\n"
+	"varying vec2 fragTexCoord;\n"
+	"varying vec4 fragColor;\n"
+	"varying float fragY;\n"
+	"uniform mat4 mvp;\n"
+	"void main()\n"
+	"{\n"
+	"	fragTexCoord = vertexTexCoord;\n"
+	"	fragColor = vertexColor;\n"
+	"	fragY = vertexPosition.y;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+//Darkens the pixels whose distance from the top of the virtual screen, in
+//multiples of the scale, ends in the last row of a line
+static const char* scanline_fs =
+	SCANLINE_SHADER_HEADER
+	"varying vec2 fragTexCoord;\n"
+	"varying vec4 fragColor;\n"
+	"varying float fragY;\n"
+	"uniform sampler2D texture0;\n"
+	"uniform vec4 colDiffuse;\n"
+	"uniform float scanlineTop;\n"
+	"uniform float scanlineScale;\n"
+	"uniform float scanlineLevel;\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 color = texture2D(texture0, fragTexCoord) * colDiffuse * fragColor;\n"
+	"	if (mod(fragY - scanlineTop, scanlineScale) >= scanlineScale - 1.0) {\n"
+	"		color.rgb *= scanlineLevel;\n"
+	"	}\n"
+	"	gl_FragColor = color;\n"
+	"}\n";
+
+//Draw calls and quads of the frame being drawn and of the last one
+static int frame_draw_calls;
+static int frame_quads;
+static int last_draw_calls;
+static int last_quads;
+#endif
+
 static DisplayParams* display_params;
 static Config* config;
 static PlayCtx* play_ctx;
 static MenuCtx* menu_ctx;
 
+//Gameplay context from before the last tick and how far (from 0 to 1) the
+//current frame is between that tick and the next one
+static PlayCtx* prev_play_ctx;
+static float interp_alpha;
+
+//Gameplay context with interpolated positions, which is what gets drawn
+static PlayCtx interp_play_ctx;
+
 static bool save_failed;
 
 static int draw_offset_x;
@@ -85,18 +233,55 @@ static int draw_offset_y;
 static int draw_max_x;
 static int draw_max_y;
 
+//Sprites of the objects within the camera's view, sorted by layer (RLAYER_*)
+static RenderItem render_queue[NUM_RLAYERS][RENDER_QUEUE_MAX_ITEMS];
+static int render_queue_len[NUM_RLAYERS];
+
+//Distance from the X position of an object to the right edge of the widest
+//sprite drawn for it, computed on first use
+static int obj_max_width;
+
 //------------------------------------------------------------------------------
 
 //Function prototypes
+static PlayCtx* interpolate_play_ctx();
+static float interpolate(float prev, float cur);
+static PlayNum interpolate_num(PlayNum prev, PlayNum cur);
+static void draw_vscreen(int screen_type, int wipe_value);
 static void draw_play();
+static void draw_level_columns(PlayCtx* ctx, int first_column);
+static void draw_level_column(int type, int x, int y);
+static int level_column_type(PlayCtx* ctx, int col);
+static void queue_objs(PlayCtx* ctx);
+static void queue_sprite(int layer, int spr, int x, int y, int frame);
+static void queue_sprite_part(int layer, int spr, int x, int y, int sx, int sy,
+		int sw, int sh);
+static void queue_item(int layer, const RenderItem* item, int w, int h);
+static void draw_queued(int layer);
 static void draw_hud();
 static void draw_final_score();
+#ifndef PLATFORM_HEADLESS
+static RenderTexture2D load_render_texture(int width, int height);
+static void draw_level_layer(PlayCtx* ctx, int first_column);
 static void draw_menu();
 static void draw_menu_item(MenuItem* item, bool selected);
 static void draw_menu_border(int x, int y, int width, int height,
 		bool selected, bool disabled);
 static void draw_texture(Texture2D texture, Rectangle src, Rectangle dst,
 		bool hflip, bool vflip, int alpha);
+static void batch_quad(Rectangle dst, float u0, float v0, float u1, float v1,
+		bool hflip, bool vflip, int alpha);
+static void flush_sprite_batch();
+static void send_sprite_batch();
+static bool draw_cached_text(const char* text, int color, int x, int y);
+static int begin_text_capture(const char* text);
+static void end_text_capture(const char* text, int color, int x, int y,
+		int start);
+static uint32_t hash_text(const char* text, int len);
+#else
+static bool menu_is_open();
+#endif
+static bool is_onscreen(Rectangle dst);
 static void draw_gfx(Rectangle src, Rectangle dst, bool vflip, bool hflip, int alpha);
 static void draw_sprite_part(int spr, int dx, int dy, int sx, int sy, int sw, int sh);
 static void draw_sprite_flip(int spr, int dx, int dy, int frame, bool hflip, bool vflip);
@@ -104,45 +289,59 @@ static void draw_sprite(int spr, int dx, int dy, int frame);
 static void draw_sprite_stretch(int spr, int dx, int dy, int w, int h);
 static void draw_digits(int value, int width, int x, int y);
 static void draw_text(const char* text, int color, int x, int y);
+#ifndef PLATFORM_HEADLESS
 static void draw_touch_buttons(int input_state);
+static bool scanlines_shown();
 static void draw_scanlines();
+#endif
+#ifdef PERF_OVERLAY
+static void draw_perf_overlay();
+static void draw_perf_bar(int spr, int x, int y, int w, int h);
+#endif
 
 //------------------------------------------------------------------------------
 
+#ifndef PLATFORM_HEADLESS
+
 bool renderer_init(DisplayParams* dp, Config* cfg, PlayCtx* pctx, MenuCtx* mctx)
 {
-	int width  = VSCREEN_MAX_WIDTH;
-	int height = VSCREEN_MAX_HEIGHT;
-	int format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+	int i;
 
 	display_params = dp;
 	config = cfg;
 	play_ctx = pctx;
 	menu_ctx = mctx;
 
-	vscreen.id = rlLoadFramebuffer(width, height);
+	vscreen = load_render_texture(VSCREEN_MAX_WIDTH, VSCREEN_MAX_HEIGHT);
 	if (vscreen.id <= 0) {
 		return false;
 	}
 
-	rlEnableFramebuffer(vscreen.id);
-
-	//Create color texture
-	vscreen.texture.id      = rlLoadTexture(NULL, width, height, format, 1);
-	vscreen.texture.width   = width;
-	vscreen.texture.height  = height;
-	vscreen.texture.format  = format;
-	vscreen.texture.mipmaps = 1;
+	//The level blocks are drawn directly if the texture caching them cannot
+	//be created
+	level_layer = load_render_texture(LEVEL_LAYER_COLUMNS * LEVEL_BLOCK_SIZE,
+		9 * LEVEL_BLOCK_SIZE);
 
-	vscreen.depth.id = 0;
+	if (level_layer.id > 0) {
+		BeginTextureMode(level_layer);
+		ClearBackground((Color){ 0x00, 0x00, 0x00, 0x00 });
+		EndTextureMode();
+	}
 
-	//Attach color texture and depth renderbuffer/texture to FBO
-	rlFramebufferAttach(vscreen.id, vscreen.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+	for (i = 0; i < LEVEL_LAYER_COLUMNS; i++) {
+		level_layer_types[i] = NONE;
+	}
 
-	rlDisableFramebuffer();
+	//raylib returns its default shader if the shader fails to compile or link
+	scanline_shader = LoadShaderFromMemory(scanline_vs, scanline_fs);
+	scanline_shader_loaded = (scanline_shader.id > 0
+		&& scanline_shader.id != rlGetShaderIdDefault());
 
-	rlTextureParameters(vscreen.texture.id, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_NEAREST);
-	rlTextureParameters(vscreen.texture.id, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_NEAREST);
+	if (scanline_shader_loaded) {
+		scanline_top_loc   = GetShaderLocation(scanline_shader, "scanlineTop");
+		scanline_scale_loc = GetShaderLocation(scanline_shader, "scanlineScale");
+		scanline_level_loc = GetShaderLocation(scanline_shader, "scanlineLevel");
+	}
 
 	return true;
 }
@@ -183,6 +382,19 @@ bool renderer_load_gfx()
 	gfx.format = format;
 	gfx.mipmaps = 1;
 
+	if (width != 0 && height != 0) {
+		int i;
+
+		gfx_texel_width  = 1.0f / width;
+		gfx_texel_height = 1.0f / height;
+
+		for (i = 0; i < NUM_SPRITES * 4; i++) {
+			float texel = (i % 2 == 0) ? gfx_texel_width : gfx_texel_height;
+
+			sprite_uvs[i] = data_sprites[i] * texel;
+		}
+	}
+
 	return true;
 }
 
@@ -197,9 +409,205 @@ void renderer_draw(int screen_type, int input_state, int wipe_value)
 	Rectangle src;
 	Rectangle dst;
 
+	frame_draw_calls = 0;
+	frame_quads = 0;
+
 	//Start drawing on the game's virtual screen
 	BeginTextureMode(vscreen);
 
+	draw_vscreen(screen_type, wipe_value);
+
+	//Finish drawing on vscreen
+	flush_sprite_batch();
+	EndTextureMode();
+
+	//Start drawing on physical screen
+	BeginDrawing();
+
+	draw_max_x = win_width;
+	draw_max_y = win_height;
+
+	//Clear entire physical screen to black or green
+	ClearBackground((Color){ 0x00, 0x00, 0x00 });
+	if (menu_is_open() && menu_ctx->green_bg) {
+		ClearBackground((Color){ 0x00, 0x55, 0x00 });
+	}
+
+	//Draw virtual screen on physical screen
+	src.x = 0;
+	src.y = (VSCREEN_MAX_HEIGHT - vscreen_height);
+	src.width  =  vscreen_width;
+	src.height =  vscreen_height;
+	//The int casts are necessary in order to avoid display distortions
+	dst.x = (int)(win_width  - (vscreen_width  * scale)) / 2;
+	dst.y = (int)(win_height - (vscreen_height * scale)) / 2;
+	dst.width  = vscreen_width  * scale;
+	dst.height = vscreen_height * scale;
+
+	if (scanlines_shown() && scanline_shader_loaded) {
+		float level = (255 - SCANLINE_OPACITY) / 255.0f;
+
+		SetShaderValue(scanline_shader, scanline_top_loc, &dst.y, SHADER_UNIFORM_FLOAT);
+		SetShaderValue(scanline_shader, scanline_scale_loc, &scale, SHADER_UNIFORM_FLOAT);
+		SetShaderValue(scanline_shader, scanline_level_loc, &level, SHADER_UNIFORM_FLOAT);
+
+		//Nothing is pending, so the shader only applies to the virtual screen
+		flush_sprite_batch();
+		BeginShaderMode(scanline_shader);
+		draw_texture(vscreen.texture, src, dst, false, true, 255);
+		EndShaderMode();
+	} else {
+		draw_texture(vscreen.texture, src, dst, false, true, 255);
+
+		if (scanlines_shown()) {
+			draw_scanlines();
+		}
+	}
+
+	if (screen_type == SCR_PLAY) {
+		draw_touch_buttons(input_state);
+	}
+
+	flush_sprite_batch();
+	last_draw_calls = frame_draw_calls;
+	last_quads = frame_quads;
+
+	//Also swaps the buffers and waits for vertical sync
+	PERF_MARK();
+	EndDrawing();
+	PERF_LAP(PERF_PRESENT);
+}
+
+void renderer_set_interpolation(PlayCtx* prev_pctx, float alpha)
+{
+	prev_play_ctx = prev_pctx;
+	interp_alpha = alpha;
+}
+
+void renderer_show_save_error(bool show)
+{
+	save_failed = show;
+}
+
+void renderer_cleanup()
+{
+	RenderTexture2D* targets[] = { &vscreen, &level_layer };
+	int i;
+
+	for (i = 0; i < ARRAY_LENGTH(targets); i++) {
+		RenderTexture2D* target = targets[i];
+
+		if (target->id > 0) {
+			if (target->texture.id > 0) {
+				rlUnloadTexture(target->texture.id);
+				target->texture.id = 0;
+			}
+
+			rlUnloadFramebuffer(target->id);
+			target->id = 0;
+		}
+	}
+
+	if (gfx.id > 0) {
+		rlUnloadTexture(gfx.id);
+		gfx.id = 0;
+	}
+
+	if (scanline_shader_loaded) {
+		UnloadShader(scanline_shader);
+		scanline_shader_loaded = false;
+	}
+
+	play_free(&interp_play_ctx);
+}
+
+#else //PLATFORM_HEADLESS
+
+bool renderer_init(DisplayParams* dp, Config* cfg, PlayCtx* pctx, MenuCtx* mctx)
+{
+	display_params = dp;
+	config = cfg;
+	play_ctx = pctx;
+	menu_ctx = mctx;
+
+	return true;
+}
+
+//Decodes the image containing the game's graphics into the atlas used by the
+//software rasterizer
+bool renderer_load_gfx()
+{
+	char filename[530];
+	int file_size;
+	char* file_data;
+	void* img_data;
+	int width;
+	int height;
+	int comp;
+	bool ok;
+
+	snprintf(filename, ARRAY_LENGTH(filename), "%sgfx.png", config->assets_dir);
+
+	file_size = get_file_size(filename);
+	file_data = load_file_text(filename);
+	if (file_data == NULL) {
+		return false;
+	}
+
+	img_data = stbi_load_from_memory((unsigned char*)file_data, file_size,
+		&width, &height, &comp, 4);
+	unload_file_text(file_data);
+
+	if (img_data == NULL) {
+		return false;
+	}
+
+	ok = swrender_load_atlas(img_data, width, height);
+	RL_FREE(img_data);
+
+	return ok;
+}
+
+//Draws the virtual screen to a framebuffer of vscreen_width by vscreen_height
+//pixels, each stored as the bytes R, G, B, and A, with the same contents as
+//the virtual screen drawn with OpenGL by the game
+void renderer_draw_pixels(uint32_t* pixels, int screen_type, int wipe_value)
+{
+	int vscreen_width  = display_params->vscreen_width;
+	int vscreen_height = display_params->vscreen_height;
+
+	swrender_set_target(pixels, vscreen_width, vscreen_height, vscreen_width);
+	draw_vscreen(screen_type, wipe_value);
+	swrender_set_target(NULL, 0, 0, 0);
+}
+
+void renderer_set_interpolation(PlayCtx* prev_pctx, float alpha)
+{
+	prev_play_ctx = prev_pctx;
+	interp_alpha = alpha;
+}
+
+void renderer_show_save_error(bool show)
+{
+	save_failed = show;
+}
+
+void renderer_cleanup()
+{
+	swrender_free();
+	play_free(&interp_play_ctx);
+}
+
+#endif //PLATFORM_HEADLESS
+
+//------------------------------------------------------------------------------
+
+//Draws everything shown on the virtual screen
+static void draw_vscreen(int screen_type, int wipe_value)
+{
+	int vscreen_width  = display_params->vscreen_width;
+	int vscreen_height = display_params->vscreen_height;
+
 	draw_max_x = vscreen_width;
 	draw_max_y = vscreen_height;
 
@@ -214,8 +622,10 @@ void renderer_draw(int screen_type, int input_state, int wipe_value)
 		case SCR_PLAY:
 		case SCR_PLAY_FREEZE:
 			if (!(menu_is_open() && menu_ctx->fill_screen)) {
+				PERF_MARK();
 				draw_play();
 				draw_hud();
+				PERF_LAP(PERF_DRAW_PLAY);
 			}
 			break;
 
@@ -232,77 +642,111 @@ void renderer_draw(int screen_type, int input_state, int wipe_value)
 		draw_text(msg, TXTCOL_WHITE, TILE_SIZE * x, TILE_SIZE * 3);
 	}
 
+#ifndef PLATFORM_HEADLESS
 	if (menu_is_open()) {
+		PERF_MARK();
 		draw_menu();
+		PERF_LAP(PERF_DRAW_MENU);
 	}
+#endif
+
+#ifdef PERF_OVERLAY
+	draw_perf_overlay();
+#endif
 
 	//Draw screen wiping effects
 	draw_sprite_stretch(SPR_BG_BLACK, 0, 0, wipe_value, vscreen_height);
+}
 
-	//Finish drawing on vscreen
-	EndTextureMode();
+//Produces the gameplay context to be drawn, with the positions of moving
+//elements interpolated between the two most recent ticks
+static PlayCtx* interpolate_play_ctx()
+{
+	PlayCtx* prev = prev_play_ctx;
+	PlayCtx* cur = play_ctx;
+	PlayCtx* ctx = &interp_play_ctx;
+	int i;
 
-	//Start drawing on physical screen
-	BeginDrawing();
+	//Draw the current gameplay context as is if out of memory
+	if (!play_copy_for_drawing(ctx, cur)) {
+		return cur;
+	}
 
-	draw_max_x = win_width;
-	draw_max_y = win_height;
+	if (prev == NULL) {
+		return ctx;
+	}
 
-	//Clear entire physical screen to black or green
-	ClearBackground((Color){ 0x00, 0x00, 0x00 });
-	if (menu_is_open() && menu_ctx->green_bg) {
-		ClearBackground((Color){ 0x00, 0x55, 0x00 });
+	ctx->cam.x = interpolate_num(prev->cam.x, cur->cam.x);
+	ctx->cam.y = interpolate_num(prev->cam.y, cur->cam.y);
+	ctx->player.x = interpolate_num(prev->player.x, cur->player.x);
+	ctx->player.y = interpolate_num(prev->player.y, cur->player.y);
+	ctx->bus.x = interpolate_num(prev->bus.x, cur->bus.x);
+	ctx->push_arrow.xoffs = interpolate_num(prev->push_arrow.xoffs, cur->push_arrow.xoffs);
+
+	if (prev->car.x != NONE && cur->car.x != NONE) {
+		ctx->car.x = interpolate_num(prev->car.x, cur->car.x);
 	}
 
-	//Draw virtual screen on physical screen
-	src.x = 0;
-	src.y = (VSCREEN_MAX_HEIGHT - vscreen_height);
-	src.width  =  vscreen_width;
-	src.height =  vscreen_height;
-	//The int casts are necessary in order to avoid display distortions
-	dst.x = (int)(win_width  - (vscreen_width  * scale)) / 2;
-	dst.y = (int)(win_height - (vscreen_height * scale)) / 2;
-	dst.width  = vscreen_width  * scale;
-	dst.height = vscreen_height * scale;
-	draw_texture(vscreen.texture, src, dst, false, true, 255);
+	if (prev->hen.x != NONE && cur->hen.x != NONE) {
+		ctx->hen.x = interpolate_num(prev->hen.x, cur->hen.x);
+	}
 
-	draw_scanlines();
+	for (i = cur->active_objs.first; i < cur->active_objs.end; i++) {
+		Obj* prev_obj = &prev->objs[cur->obj_order[i]];
+		Obj* obj = &ctx->objs[cur->obj_order[i]];
 
-	if (screen_type == SCR_PLAY) {
-		draw_touch_buttons(input_state);
+		if (obj->type == NONE || obj->type != prev_obj->type) continue;
+
+		obj->x = (int)interpolate(prev_obj->x, obj->x);
+		obj->y = (int)interpolate(prev_obj->y, obj->y);
 	}
 
-	EndDrawing();
-}
+	for (i = 0; i < MAX_CUTSCENE_OBJECTS; i++) {
+		CutsceneObject* prev_cobj = &prev->cutscene_objects[i];
+		CutsceneObject* cobj = &ctx->cutscene_objects[i];
 
-void renderer_show_save_error(bool show)
-{
-	save_failed = show;
+		if (cobj->sprite == NONE || cobj->in_bus != prev_cobj->in_bus) continue;
+
+		cobj->x = interpolate_num(prev_cobj->x, cobj->x);
+		cobj->y = interpolate_num(prev_cobj->y, cobj->y);
+	}
+
+	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
+		CrackParticle* prev_part = &prev->crack_particles[i];
+		CrackParticle* part = &ctx->crack_particles[i];
+
+		if (part->x == NONE || prev_part->x == NONE) continue;
+
+		part->x = interpolate_num(prev_part->x, part->x);
+		part->y = interpolate_num(prev_part->y, part->y);
+	}
+
+	return ctx;
 }
 
-void renderer_cleanup()
+//Interpolates a single value, unless the difference between the previous and
+//current values is too large, which means the position changed instantly
+//(like when the player character respawns)
+static float interpolate(float prev, float cur)
 {
-	if (vscreen.id > 0) {
-		if (vscreen.texture.id > 0) {
-			rlUnloadTexture(vscreen.texture.id);
-			vscreen.texture.id = 0;
-		}
+	float diff = cur - prev;
 
-		rlUnloadFramebuffer(vscreen.id);
-		vscreen.id = 0;
+	if (diff > INTERP_MAX_DISTANCE || diff < -INTERP_MAX_DISTANCE) {
+		return cur;
 	}
 
-	if (gfx.id > 0) {
-		rlUnloadTexture(gfx.id);
-		gfx.id = 0;
-	}
+	return prev + diff * interp_alpha;
 }
 
-//------------------------------------------------------------------------------
+//Interpolates a position or other PlayNum of the gameplay context
+static PlayNum interpolate_num(PlayNum prev, PlayNum cur)
+{
+	return PN(interpolate(PN_TO_FLOAT(prev), PN_TO_FLOAT(cur)));
+}
 
 static void draw_play()
 {
-	PlayCtx* ctx = play_ctx;
+	PlayCtx* ctx = interpolate_play_ctx();
 
 	int vscreen_width  = display_params->vscreen_width;
 	int vscreen_height = display_params->vscreen_height;
@@ -317,7 +761,7 @@ static void draw_play()
 	//Background color
 	draw_sprite_stretch(ctx->bg_color, 0, 0, vscreen_width, vscreen_height);
 
-	camy = (int)ctx->cam.y;
+	camy = PN_TO_INT(ctx->cam.y);
 
 	//Determine topmost camera Y position from virtual screen (vscreen) height
 	topcamy = 0;
@@ -329,7 +773,7 @@ static void draw_play()
 		camy = topcamy;
 	}
 
-	draw_offset_x = (int)ctx->cam.x;
+	draw_offset_x = PN_TO_INT(ctx->cam.x);
 	draw_offset_y = camy - (vscreen_height - VSCREEN_MAX_HEIGHT);
 
 	if (vscreen_width <= 320 && ctx->ending) {
@@ -340,35 +784,10 @@ static void draw_play()
 
 	//Level blocks from level columns, including the background image, floor,
 	//deep holes, and passageways, but not yet the crates
-	for (i = 0; i < 9; i++) {
-		for (j = 0; j < 21; j++) {
-			int col = first_column + j;
-
-			if (i < 3) { //Background image (common for all level column types)
-				spr = SPR_LEVEL_BLOCK_0 + (i + 1);
-			} else { //Floor, deep hole, or passageway
-				int block_num;
-				int type;
-
-				type = LVLCOL_NORMAL_FLOOR;
-				if (col < MAX_LEVEL_COLUMNS) {
-					type = ctx->level_columns[col].type;
-				}
-
-				block_num = data_level_column_blocks[(type * 8) + (i - 3)];
-
-				spr = SPR_LEVEL_BLOCK_0 + block_num;
-			}
-
-			x = LEVEL_BLOCK_SIZE * col;
-			y = LEVEL_BLOCK_SIZE * (i + 7);
-
-			draw_sprite(spr, x, y, 0);
-		}
-	}
+	draw_level_columns(ctx, first_column);
 
 	//Unopened passageway exits
-	for (i = 0; i < MAX_PASSAGEWAYS; i++) {
+	for (i = ctx->active_passageways.first; i < ctx->active_passageways.end; i++) {
 		int w = ctx->passageways[i].width;
 
 		if (ctx->passageways[i].exit_opened) continue;
@@ -381,7 +800,7 @@ static void draw_play()
 	}
 
 	//Bus body, wheels, and route sign
-	x = (int)ctx->bus.x;
+	x = PN_TO_INT(ctx->bus.x);
 	y = BUS_Y;
 	draw_sprite(SPR_BUS, x, y, 0);
 	if (ctx->bus.route_sign != NONE) {
@@ -420,14 +839,14 @@ static void draw_play()
 		if (cobj->sprite == NONE || !cobj->in_bus) continue;
 
 		spr = cobj->sprite;
-		x = (int)cobj->x + (int)ctx->bus.x;
-		y = (int)cobj->y;
+		x = PN_TO_INT(cobj->x) + PN_TO_INT(ctx->bus.x);
+		y = PN_TO_INT(cobj->y);
 		frame = ctx->anims[ANIM_CUTSCENE_OBJECTS + i].frame;
 		draw_sprite(spr, x, y, frame);
 	}
 
 	//Bus doors
-	x = (int)ctx->bus.x;
+	x = PN_TO_INT(ctx->bus.x);
 	y = BUS_Y;
 	frame = ctx->anims[ANIM_BUS_DOOR_REAR].frame;
 	draw_sprite(SPR_BUS_DOOR, x + 64,  y + 16, frame);
@@ -436,7 +855,7 @@ static void draw_play()
 
 	//Ending sequence traffic jam cars
 	if (ctx->ending) {
-		x = (int)ctx->bus.x + 400;
+		x = PN_TO_INT(ctx->bus.x) + 400;
 		y = PASSING_CAR_Y;
 		frame = ctx->anims[ANIM_CAR_WHEELS].frame;
 		spr = SPR_CAR_BLUE;
@@ -460,7 +879,7 @@ static void draw_play()
 
 	//Passing car
 	if (ctx->car.x != NONE) {
-		x = (int)ctx->car.x;
+		x = PN_TO_INT(ctx->car.x);
 		y = PASSING_CAR_Y;
 		frame = ctx->anims[ANIM_CAR_WHEELS].frame;
 
@@ -479,7 +898,7 @@ static void draw_play()
 	//Hen
 	if (ctx->hen.x != NONE) {
 		frame = ctx->anims[ANIM_HEN].frame;
-		draw_sprite(SPR_HEN, (int)ctx->hen.x, HEN_Y, frame);
+		draw_sprite(SPR_HEN, PN_TO_INT(ctx->hen.x), HEN_Y, frame);
 	}
 
 	//Light poles (at most two are visible)
@@ -494,7 +913,7 @@ static void draw_play()
 		int col = first_column + i;
 		int h;
 
-		if (col >= MAX_LEVEL_COLUMNS) break;
+		if (col >= ctx->num_level_columns) break;
 
 		h = ctx->level_columns[col].num_crates;
 
@@ -509,50 +928,14 @@ static void draw_play()
 	}
 
 	//Objects that use PlayCtx.objs[] and are drawn behind the player character
-	for (i = 0; i < MAX_OBJS; i++) {
-		Obj* obj = &ctx->objs[i];
-
-		//Ignore inexistent objects
-		if (obj->type == NONE) continue;
-
-		//Skip objects that are drawn in front of the player character, as
-		//those will be drawn later
-		if (obj->type == OBJ_COIN_SILVER) continue;
-		if (obj->type == OBJ_COIN_GOLD) continue;
-		if (obj->type == OBJ_BANANA_PEEL) continue;
-		if (obj->type == OBJ_BANANA_PEEL_MOVING) continue;
-
-		if (obj->type == OBJ_GUSH) {
-			int w = data_sprites[SPR_GUSH * 4 + 2];
-			int h = 265 - obj->y;
-			if (h <= 0) h = 1;
-
-			frame = ctx->anims[ANIM_GUSHES].frame;
-
-			draw_sprite_part(SPR_GUSH, obj->x, obj->y, frame * w, 0, w, h);
-
-			//Gush hole
-			draw_sprite(SPR_GUSH_HOLE, obj->x, 263, 0);
-		} else {
-			frame = 0;
-
-			if (obj->type == OBJ_SPRING) {
-				frame = 5;
-
-				if (i == ctx->hit_spring) {
-					frame = ctx->anims[ANIM_HIT_SPRING].frame;
-				}
-			}
-
-			draw_sprite(data_obj_sprites[obj->type], obj->x, obj->y, frame);
-		}
-	}
+	queue_objs(ctx);
+	draw_queued(RLAYER_OBJS_BEHIND);
 
 	//Player character
 	if (ctx->player.visible) {
 		spr = data_player_anim_sprites[ctx->player.anim_type];
-		x = (int)ctx->player.x;
-		y = (int)ctx->player.y;
+		x = PN_TO_INT(ctx->player.x);
+		y = PN_TO_INT(ctx->player.y);
 		frame = ctx->anims[ANIM_PLAYER].frame;
 		draw_sprite(spr, x, y, frame);
 	}
@@ -564,15 +947,15 @@ static void draw_play()
 		if (cobj->sprite == NONE || cobj->in_bus) continue;
 
 		spr = cobj->sprite;
-		x = (int)cobj->x;
-		y = (int)cobj->y;
+		x = PN_TO_INT(cobj->x);
+		y = PN_TO_INT(cobj->y);
 		frame = ctx->anims[ANIM_CUTSCENE_OBJECTS + i].frame;
 		draw_sprite(spr, x, y, frame);
 	}
 
 	//Medal icons (used in the ending sequence)
 	if (ctx->player_reached_flagman) {
-		x = (int)ctx->cutscene_objects[0].x;
+		x = PN_TO_INT(ctx->cutscene_objects[0].x);
 		y = 160;
 
 		if (ctx->cutscene_objects[0].sprite == SPR_PLAYER_RUN) {
@@ -582,12 +965,12 @@ static void draw_play()
 		draw_sprite(SPR_MEDAL1, x, y, 0);
 	}
 	if (ctx->hen_reached_flagman) {
-		x = (int)ctx->hen.x;
+		x = PN_TO_INT(ctx->hen.x);
 		y = 184;
 		draw_sprite(SPR_MEDAL2, x, y, 0);
 	}
 	if (ctx->bus_reached_flagman) {
-		x = (int)ctx->bus.x + 343;
+		x = PN_TO_INT(ctx->bus.x) + 343;
 		y = 120;
 		draw_sprite(SPR_MEDAL3, x, y, 0);
 	}
@@ -599,7 +982,7 @@ static void draw_play()
 		x = col * LEVEL_BLOCK_SIZE;
 		y = FLOOR_Y;
 
-		if (col >= MAX_LEVEL_COLUMNS) break;
+		if (col >= ctx->num_level_columns) break;
 
 		switch (ctx->level_columns[col].type) {
 			case LVLCOL_DEEP_HOLE_LEFT:
@@ -610,108 +993,293 @@ static void draw_play()
 				spr = SPR_PASSAGEWAY_LEFT_FG;
 				break;
 
-			case LVLCOL_PASSAGEWAY_RIGHT:
-				spr = SPR_PASSAGEWAY_RIGHT_FG;
+			case LVLCOL_PASSAGEWAY_RIGHT:
+				spr = SPR_PASSAGEWAY_RIGHT_FG;
+				break;
+
+			default:
+				continue;
+		}
+
+		draw_sprite(spr, x, y, 0);
+	}
+
+	//When slipping, the player character is drawn in front of hole foregrounds
+	if (ctx->player.visible) {
+		int state = ctx->player.state;
+
+		if (state == PLAYER_STATE_SLIP || state == PLAYER_STATE_GETUP) {
+			spr = data_player_anim_sprites[ctx->player.anim_type];
+			x = PN_TO_INT(ctx->player.x);
+			y = PN_TO_INT(ctx->player.y);
+			frame = ctx->anims[ANIM_PLAYER].frame;
+			draw_sprite(spr, x, y, frame);
+		}
+	}
+
+	//Objects that use PlayCtx.objs[] and are drawn in front of the player
+	//character
+	draw_queued(RLAYER_OBJS_FRONT);
+
+	//Pushable crate arrows
+	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
+		PushableCrate* crate = &ctx->pushable_crates[i];
+
+		if (crate->obj != NONE && crate->show_arrow) {
+			x = ctx->objs[crate->obj].x - 48 + PN_TO_INT(ctx->push_arrow.xoffs);
+			y = FLOOR_Y - 24;
+
+			draw_sprite(SPR_PUSH_ARROW, x, y, 0);
+		}
+	}
+
+	//Overhead sign bases
+	draw_queued(RLAYER_SIGN_BASES);
+
+	//Crack particles
+	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
+		x = PN_TO_INT(ctx->crack_particles[i].x);
+		y = PN_TO_INT(ctx->crack_particles[i].y);
+		frame = ctx->anims[ANIM_CRACK_PARTICLES].frame;
+
+		if (x != NONE) {
+			draw_sprite(SPR_CRACK_PARTICLE, x, y, frame);
+		}
+	}
+
+	//Coin sparks
+	for (i = 0; i < MAX_COIN_SPARKS; i++) {
+		x = ctx->coin_sparks[i].x;
+		y = ctx->coin_sparks[i].y;
+
+		if (x != NONE) {
+			bool gold = ctx->coin_sparks[i].gold;
+			spr = gold ? SPR_COIN_SPARK_GOLD : SPR_COIN_SPARK_SILVER;
+			frame = ctx->anims[ANIM_COIN_SPARKS + i].frame;
+			draw_sprite(spr, x, y, frame);
+		}
+	}
+
+	//Reset draw offset
+	draw_offset_x = 0;
+	draw_offset_y = 0;
+}
+
+//Sorts the sprites of the objects within the camera's view into the layers of
+//the render queue in a single pass, in the same order as in obj_order[]
+//
+//The first object that may be visible is found by a binary search of the
+//current gameplay context's obj_order[], which is sorted by X position, unlike
+//the interpolated positions, which may differ by up to INTERP_MAX_DISTANCE
+static void queue_objs(PlayCtx* ctx)
+{
+	PlayCtx* cur = play_ctx;
+	int xmin, xmax;
+	int lo, hi;
+	int i, j;
+
+	if (obj_max_width == 0) {
+		int extents[] = {
+			data_sprites[SPR_GUSH_HOLE * 4 + 2],
+			data_sprites[SPR_OVERHEAD_SIGN_BASE_TOP * 4 + 2] + 16,
+			data_sprites[SPR_OVERHEAD_SIGN_BASE * 4 + 2] + 24,
+		};
+
+		for (i = 0; i < NUM_OBJ_TYPES; i++) {
+			int w = data_sprites[data_obj_sprites[i] * 4 + 2];
+
+			if (w > obj_max_width) obj_max_width = w;
+		}
+
+		for (i = 0; i < ARRAY_LENGTH(extents); i++) {
+			if (extents[i] > obj_max_width) obj_max_width = extents[i];
+		}
+	}
+
+	for (i = 0; i < NUM_RLAYERS; i++) {
+		render_queue_len[i] = 0;
+	}
+
+	xmin = draw_offset_x - obj_max_width - INTERP_MAX_DISTANCE;
+	xmax = draw_offset_x + display_params->vscreen_width + INTERP_MAX_DISTANCE;
+
+	lo = cur->active_objs.first;
+	hi = cur->active_objs.end;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (cur->objs[cur->obj_order[mid]].x < xmin) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (j = lo; j < cur->active_objs.end; j++) {
+		int obj_num = cur->obj_order[j];
+		Obj* obj = &ctx->objs[obj_num];
+		int spr;
+		int frame = 0;
+
+		if (cur->objs[obj_num].x > xmax) break;
+
+		//Collected coins and deactivated banana peels are left in obj_order[]
+		if (obj->type == NONE) continue;
+
+		spr = data_obj_sprites[obj->type];
+
+		switch (obj->type) {
+			case OBJ_COIN_SILVER:
+			case OBJ_COIN_GOLD:
+				frame = ctx->anims[ANIM_COINS].frame;
+				queue_sprite(RLAYER_OBJS_FRONT, spr, obj->x, obj->y, frame);
+				break;
+
+			case OBJ_BANANA_PEEL:
+			case OBJ_BANANA_PEEL_MOVING:
+				queue_sprite(RLAYER_OBJS_FRONT, spr, obj->x, obj->y, 0);
+				break;
+
+			case OBJ_GUSH: {
+				int w = data_sprites[SPR_GUSH * 4 + 2];
+				int h = 265 - obj->y;
+				if (h <= 0) h = 1;
+
+				frame = ctx->anims[ANIM_GUSHES].frame;
+
+				queue_sprite_part(RLAYER_OBJS_BEHIND, SPR_GUSH, obj->x, obj->y,
+					frame * w, 0, w, h);
+
+				//Gush hole
+				queue_sprite(RLAYER_OBJS_BEHIND, SPR_GUSH_HOLE, obj->x, 263, 0);
+				break;
+			}
+
+			case OBJ_OVERHEAD_SIGN: {
+				int y = obj->y + 32;
+				int h = 272 - y;
+
+				queue_sprite(RLAYER_OBJS_BEHIND, spr, obj->x, obj->y, 0);
+
+				queue_sprite(RLAYER_SIGN_BASES, SPR_OVERHEAD_SIGN_BASE_TOP,
+					obj->x + 16, obj->y + 8, 0);
+				queue_sprite_part(RLAYER_SIGN_BASES, SPR_OVERHEAD_SIGN_BASE,
+					obj->x + 24, y, 0, 320 - h, 8, h);
 				break;
+			}
 
 			default:
-				continue;
-		}
+				if (obj->type == OBJ_SPRING) {
+					frame = 5;
 
-		draw_sprite(spr, x, y, 0);
-	}
-
-	//When slipping, the player character is drawn in front of hole foregrounds
-	if (ctx->player.visible) {
-		int state = ctx->player.state;
+					if (obj_num == ctx->hit_spring) {
+						frame = ctx->anims[ANIM_HIT_SPRING].frame;
+					}
+				}
 
-		if (state == PLAYER_STATE_SLIP || state == PLAYER_STATE_GETUP) {
-			spr = data_player_anim_sprites[ctx->player.anim_type];
-			x = (int)ctx->player.x;
-			y = (int)ctx->player.y;
-			frame = ctx->anims[ANIM_PLAYER].frame;
-			draw_sprite(spr, x, y, frame);
+				queue_sprite(RLAYER_OBJS_BEHIND, spr, obj->x, obj->y, frame);
+				break;
 		}
 	}
+}
 
-	//Objects that use PlayCtx.objs[] and are drawn in front of the player
-	//character
-	for (i = 0; i < MAX_OBJS; i++) {
-		Obj* obj = &ctx->objs[i];
-
-		if (obj->type == OBJ_BANANA_PEEL) {
-			frame = 0;
-		} else if (obj->type == OBJ_BANANA_PEEL_MOVING) {
-			frame = 0;
-		} else if (obj->type == OBJ_COIN_SILVER) {
-			frame = ctx->anims[ANIM_COINS].frame;
-		} else if (obj->type == OBJ_COIN_GOLD) {
-			frame = ctx->anims[ANIM_COINS].frame;
-		} else {
-			continue;
-		}
+static void queue_sprite(int layer, int spr, int x, int y, int frame)
+{
+	RenderItem item = { spr, x, y, frame, 0, 0, NONE, 0 };
 
-		draw_sprite(data_obj_sprites[obj->type], obj->x, obj->y, frame);
-	}
+	queue_item(layer, &item, data_sprites[spr * 4 + 2], data_sprites[spr * 4 + 3]);
+}
 
-	//Pushable crate arrows
-	for (i = 0; i < MAX_PUSHABLE_CRATES; i++) {
-		PushableCrate* crate = &ctx->pushable_crates[i];
+static void queue_sprite_part(int layer, int spr, int x, int y, int sx, int sy,
+		int sw, int sh)
+{
+	RenderItem item = { spr, x, y, 0, sx, sy, sw, sh };
 
-		if (crate->obj != NONE && crate->show_arrow) {
-			x = ctx->objs[crate->obj].x - 48 + (int)ctx->push_arrow.xoffs;
-			y = FLOOR_Y - 24;
+	queue_item(layer, &item, sw, sh);
+}
 
-			draw_sprite(SPR_PUSH_ARROW, x, y, 0);
+//Adds a sprite of the given size to a layer of the render queue, unless it is
+//outside the screen
+static void queue_item(int layer, const RenderItem* item, int w, int h)
+{
+	Rectangle dst;
+
+	dst.x = item->x - draw_offset_x;
+	dst.y = item->y - draw_offset_y;
+	dst.width  = w;
+	dst.height = h;
+
+	if (!is_onscreen(dst)) return;
+	if (render_queue_len[layer] >= RENDER_QUEUE_MAX_ITEMS) return;
+
+	render_queue[layer][render_queue_len[layer]] = *item;
+	render_queue_len[layer]++;
+}
+
+static void draw_queued(int layer)
+{
+	int i;
+
+	for (i = 0; i < render_queue_len[layer]; i++) {
+		RenderItem* item = &render_queue[layer][i];
+
+		if (item->sw == NONE) {
+			draw_sprite(item->spr, item->x, item->y, item->frame);
+		} else {
+			draw_sprite_part(item->spr, item->x, item->y, item->sx, item->sy,
+				item->sw, item->sh);
 		}
 	}
+}
 
-	//Overhead sign bases
-	for (i = 0; i < MAX_OBJS; i++) {
-		Obj* obj = &ctx->objs[i];
-		int h;
+//Draws the level blocks of the visible level columns
+static void draw_level_columns(PlayCtx* ctx, int first_column)
+{
+	int j;
 
-		if (obj->type == OBJ_OVERHEAD_SIGN) {
-			spr = SPR_OVERHEAD_SIGN_BASE_TOP;
-			x = obj->x + 16;
-			y = obj->y + 8;
-			draw_sprite(spr, x, y, 0);
-
-			spr = SPR_OVERHEAD_SIGN_BASE;
-			x = obj->x + 24;
-			y = obj->y + 32;
-			h = 272 - y;
-			draw_sprite_part(spr, x, y, 0, 320 - h, 8, h);
-		}
+#ifndef PLATFORM_HEADLESS
+	if (level_layer.id > 0 && first_column >= 0) {
+		draw_level_layer(ctx, first_column);
+		return;
 	}
+#endif
 
-	//Crack particles
-	for (i = 0; i < MAX_CRACK_PARTICLES; i++) {
-		x = (int)ctx->crack_particles[i].x;
-		y = (int)ctx->crack_particles[i].y;
-		frame = ctx->anims[ANIM_CRACK_PARTICLES].frame;
+	for (j = 0; j <= VSCREEN_MAX_WIDTH_LEVEL_BLOCKS; j++) {
+		int col = first_column + j;
 
-		if (x != NONE) {
-			draw_sprite(SPR_CRACK_PARTICLE, x, y, frame);
-		}
+		draw_level_column(level_column_type(ctx, col), LEVEL_BLOCK_SIZE * col,
+			LEVEL_BLOCK_SIZE * 7);
 	}
+}
 
-	//Coin sparks
-	for (i = 0; i < MAX_COIN_SPARKS; i++) {
-		x = ctx->coin_sparks[i].x;
-		y = ctx->coin_sparks[i].y;
+//Draws the level blocks of a level column of the given type (LVLCOL_*) from top
+//to bottom
+static void draw_level_column(int type, int x, int y)
+{
+	int spr;
+	int i;
 
-		if (x != NONE) {
-			bool gold = ctx->coin_sparks[i].gold;
-			spr = gold ? SPR_COIN_SPARK_GOLD : SPR_COIN_SPARK_SILVER;
-			frame = ctx->anims[ANIM_COIN_SPARKS + i].frame;
-			draw_sprite(spr, x, y, frame);
+	for (i = 0; i < 9; i++) {
+		if (i < 3) { //Background image (common for all level column types)
+			spr = SPR_LEVEL_BLOCK_0 + (i + 1);
+		} else { //Floor, deep hole, or passageway
+			int block_num = data_level_column_blocks[(type * 8) + (i - 3)];
+
+			spr = SPR_LEVEL_BLOCK_0 + block_num;
 		}
+
+		draw_sprite(spr, x, y + LEVEL_BLOCK_SIZE * i, 0);
 	}
+}
 
-	//Reset draw offset
-	draw_offset_x = 0;
-	draw_offset_y = 0;
+//Columns beyond the end of the level have a normal floor
+static int level_column_type(PlayCtx* ctx, int col)
+{
+	if (col < 0 || col >= ctx->num_level_columns) {
+		return LVLCOL_NORMAL_FLOOR;
+	}
+
+	return ctx->level_columns[col].type;
 }
 
 static void draw_hud()
@@ -779,6 +1347,123 @@ static void draw_final_score()
 	draw_text(msg, TXTCOL_WHITE, x, cy + TILE_SIZE);
 }
 
+#ifndef PLATFORM_HEADLESS
+//Creates a render texture without a depth buffer, returning one whose id is
+//zero on failure
+static RenderTexture2D load_render_texture(int width, int height)
+{
+	RenderTexture2D target = { 0 };
+	int format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+
+	target.id = rlLoadFramebuffer(width, height);
+	if (target.id <= 0) {
+		target.id = 0;
+		return target;
+	}
+
+	rlEnableFramebuffer(target.id);
+
+	//Create color texture
+	target.texture.id      = rlLoadTexture(NULL, width, height, format, 1);
+	target.texture.width   = width;
+	target.texture.height  = height;
+	target.texture.format  = format;
+	target.texture.mipmaps = 1;
+
+	target.depth.id = 0;
+
+	//Attach color texture and depth renderbuffer/texture to FBO
+	rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+
+	rlDisableFramebuffer();
+
+	rlTextureParameters(target.texture.id, RL_TEXTURE_MIN_FILTER, RL_TEXTURE_FILTER_NEAREST);
+	rlTextureParameters(target.texture.id, RL_TEXTURE_MAG_FILTER, RL_TEXTURE_FILTER_NEAREST);
+
+	return target;
+}
+
+//Draws the level blocks of the visible level columns from the texture caching
+//them, with one quad or, where the slots wrap around, two
+//
+//Columns whose slot holds a different type are drawn to it first, which only
+//happens as new columns come into view, so most frames draw no blocks at all
+//(the only transparent pixels are in the background image, which is the same
+//for every type, so a slot needs no clearing before being drawn to again)
+static void draw_level_layer(PlayCtx* ctx, int first_column)
+{
+	int num_columns = VSCREEN_MAX_WIDTH_LEVEL_BLOCKS + 1;
+	int offset_x = draw_offset_x;
+	int offset_y = draw_offset_y;
+	int max_x = draw_max_x;
+	int max_y = draw_max_y;
+	bool drawing_to_layer = false;
+	int j;
+
+	for (j = 0; j < num_columns; j++) {
+		int col = first_column + j;
+		int slot = col % LEVEL_LAYER_COLUMNS;
+		int type = level_column_type(ctx, col);
+
+		if (level_layer_types[slot] == type) continue;
+
+		//The virtual screen keeps its contents while the texture is drawn to
+		if (!drawing_to_layer) {
+			flush_sprite_batch();
+			EndTextureMode();
+			BeginTextureMode(level_layer);
+
+			draw_offset_x = 0;
+			draw_offset_y = 0;
+			draw_max_x = level_layer.texture.width;
+			draw_max_y = level_layer.texture.height;
+			drawing_to_layer = true;
+		}
+
+		draw_level_column(type, LEVEL_BLOCK_SIZE * slot, 0);
+		level_layer_types[slot] = type;
+	}
+
+	if (drawing_to_layer) {
+		flush_sprite_batch();
+		EndTextureMode();
+		BeginTextureMode(vscreen);
+
+		draw_offset_x = offset_x;
+		draw_offset_y = offset_y;
+		draw_max_x = max_x;
+		draw_max_y = max_y;
+	}
+
+	j = 0;
+	while (j < num_columns) {
+		int col = first_column + j;
+		int slot = col % LEVEL_LAYER_COLUMNS;
+		int count = LEVEL_LAYER_COLUMNS - slot;
+		Rectangle src;
+		Rectangle dst;
+
+		if (count > num_columns - j) {
+			count = num_columns - j;
+		}
+
+		//Render textures are stored upside down
+		src.x = LEVEL_BLOCK_SIZE * slot;
+		src.y = 0;
+		src.width  = LEVEL_BLOCK_SIZE * count;
+		src.height = level_layer.texture.height;
+
+		dst.x = LEVEL_BLOCK_SIZE * col - draw_offset_x;
+		dst.y = LEVEL_BLOCK_SIZE * 7 - draw_offset_y;
+		dst.width  = src.width;
+		dst.height = src.height;
+
+		draw_texture(level_layer.texture, src, dst, false, true, 255);
+
+		j += count;
+	}
+}
+
 static void draw_menu()
 {
 	MenuCtx* ctx = menu_ctx;
@@ -1025,6 +1710,9 @@ static void draw_texture(Texture2D texture, Rectangle src, Rectangle dst,
 {
 	//This function has been adapted from raylib's DrawTexturePro()
 
+	//Draws on top of the quads drawn from gfx so far
+	flush_sprite_batch();
+
 	if (texture.id > 0) {
 		float width  = (float)texture.width;
 		float height = (float)texture.height;
@@ -1074,7 +1762,227 @@ static void draw_texture(Texture2D texture, Rectangle src, Rectangle dst,
 
 		rlEnd();
 		rlSetTexture(0);
+
+		frame_draw_calls++;
+		frame_quads++;
+	}
+}
+
+//Adds a quad drawn from gfx to the sprite batch, sending the batch to rlgl if
+//full (which continues the same draw call)
+static void batch_quad(Rectangle dst, float u0, float v0, float u1, float v1,
+		bool hflip, bool vflip, int alpha)
+{
+	SpriteQuad* quad;
+
+	if (gfx.id == 0) return;
+
+	if (sprite_batch_len >= SPRITE_BATCH_MAX_QUADS) {
+		send_sprite_batch();
+	}
+
+	quad = &sprite_batch[sprite_batch_len];
+	quad->left   = dst.x;
+	quad->top    = dst.y;
+	quad->right  = dst.x + dst.width;
+	quad->bottom = dst.y + dst.height;
+	quad->u0 = hflip ? u1 : u0;
+	quad->u1 = hflip ? u0 : u1;
+	quad->v0 = vflip ? v1 : v0;
+	quad->v1 = vflip ? v0 : v1;
+	quad->alpha = alpha;
+
+	sprite_batch_len++;
+	sprite_run_len++;
+}
+
+//Sends the quads of the sprite batch to rlgl and ends the draw call, which
+//must be done before drawing anything else or changing the render target
+static void flush_sprite_batch()
+{
+	if (sprite_run_len == 0) return;
+
+	send_sprite_batch();
+
+	frame_draw_calls++;
+	frame_quads += sprite_run_len;
+	sprite_run_len = 0;
+}
+
+static void send_sprite_batch()
+{
+	int alpha = NONE;
+	int i;
+
+	if (sprite_batch_len == 0) return;
+
+	rlSetTexture(gfx.id);
+	rlBegin(RL_QUADS);
+
+	rlNormal3f(0.0f, 0.0f, 1.0f); //Normal vector pointing towards the viewer
+
+	for (i = 0; i < sprite_batch_len; i++) {
+		const SpriteQuad* quad = &sprite_batch[i];
+
+		if (quad->alpha != alpha) {
+			alpha = quad->alpha;
+			rlColor4ub(255, 255, 255, alpha);
+		}
+
+		rlTexCoord2f(quad->u0, quad->v0);
+		rlVertex2f(quad->left, quad->top);
+
+		rlTexCoord2f(quad->u0, quad->v1);
+		rlVertex2f(quad->left, quad->bottom);
+
+		rlTexCoord2f(quad->u1, quad->v1);
+		rlVertex2f(quad->right, quad->bottom);
+
+		rlTexCoord2f(quad->u1, quad->v0);
+		rlVertex2f(quad->right, quad->top);
+	}
+
+	rlEnd();
+	rlSetTexture(0);
+
+	sprite_batch_len = 0;
+}
+
+//Draws a block of text from the text cache, returning false if not found
+static bool draw_cached_text(const char* text, int color, int x, int y)
+{
+	int len = strlen(text);
+	uint32_t hash = hash_text(text, len);
+	int i;
+
+	x -= draw_offset_x;
+	y -= draw_offset_y;
+
+	for (i = 0; i < text_cache_len; i++) {
+		TextCacheEntry* entry = &text_cache[i];
+		const SpriteQuad* glyphs;
+		int num_glyphs;
+
+		if (entry->hash != hash || entry->len != len) continue;
+		if (entry->color != color || entry->x != x || entry->y != y) continue;
+		if (entry->max_x != draw_max_x || entry->max_y != draw_max_y) continue;
+		if (memcmp(&text_cache_chars[entry->text_start], text, len) != 0) continue;
+
+		if (gfx.id == 0) return true;
+
+		//Copy the glyphs to the sprite batch, sending it whenever full
+		glyphs = &text_cache_glyphs[entry->first_glyph];
+		num_glyphs = entry->num_glyphs;
+		while (num_glyphs > 0) {
+			int count = SPRITE_BATCH_MAX_QUADS - sprite_batch_len;
+
+			if (count == 0) {
+				send_sprite_batch();
+				continue;
+			}
+
+			if (count > num_glyphs) count = num_glyphs;
+
+			memcpy(&sprite_batch[sprite_batch_len], glyphs, count * sizeof(SpriteQuad));
+			sprite_batch_len += count;
+			sprite_run_len += count;
+			glyphs += count;
+			num_glyphs -= count;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+//Makes room in the sprite batch for the glyphs of a block of text about to be
+//laid out, so they can be taken from it afterwards, returning where they start
+//or NONE if the text cannot be cached
+static int begin_text_capture(const char* text)
+{
+	int len = strlen(text);
+
+	if (len > SPRITE_BATCH_MAX_QUADS || len > TEXT_CACHE_MAX_CHARS) return NONE;
+
+	if (sprite_batch_len + len > SPRITE_BATCH_MAX_QUADS) {
+		send_sprite_batch();
+	}
+
+	return sprite_batch_len;
+}
+
+//Adds a block of text that has just been laid out to the text cache, along
+//with its glyphs, which are in the sprite batch from the given position
+static void end_text_capture(const char* text, int color, int x, int y,
+		int start)
+{
+	int len = strlen(text);
+	int num_glyphs = sprite_batch_len - start;
+	TextCacheEntry* entry;
+
+	if (start == NONE || gfx.id == 0) return;
+
+	if (text_cache_len >= TEXT_CACHE_MAX_ENTRIES
+			|| text_cache_chars_len + len > TEXT_CACHE_MAX_CHARS
+			|| text_cache_glyphs_len + num_glyphs > TEXT_CACHE_MAX_GLYPHS) {
+		text_cache_len = 0;
+		text_cache_chars_len = 0;
+		text_cache_glyphs_len = 0;
+	}
+
+	entry = &text_cache[text_cache_len];
+	entry->hash = hash_text(text, len);
+	entry->len = len;
+	entry->color = color;
+	entry->x = x - draw_offset_x;
+	entry->y = y - draw_offset_y;
+	entry->max_x = draw_max_x;
+	entry->max_y = draw_max_y;
+	entry->text_start = text_cache_chars_len;
+	entry->first_glyph = text_cache_glyphs_len;
+	entry->num_glyphs = num_glyphs;
+
+	memcpy(&text_cache_chars[text_cache_chars_len], text, len);
+	memcpy(&text_cache_glyphs[text_cache_glyphs_len], &sprite_batch[start],
+		num_glyphs * sizeof(SpriteQuad));
+
+	text_cache_len++;
+	text_cache_chars_len += len;
+	text_cache_glyphs_len += num_glyphs;
+}
+
+//FNV-1a hash of a block of text
+static uint32_t hash_text(const char* text, int len)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char)text[i]) * 16777619u;
 	}
+
+	return hash;
+}
+
+#else //PLATFORM_HEADLESS
+
+//The headless simulation program has no menus
+static bool menu_is_open()
+{
+	return false;
+}
+
+#endif //PLATFORM_HEADLESS
+
+//Checks if a quad (in screen coordinates) is at least partially within the
+//area being drawn on
+static bool is_onscreen(Rectangle dst)
+{
+	if (dst.x < -dst.width  || dst.x > draw_max_x) return false;
+	if (dst.y < -dst.height || dst.y > draw_max_y) return false;
+
+	return true;
 }
 
 //Draws a region of the image containing the game's graphics
@@ -1084,10 +1992,16 @@ static void draw_gfx(Rectangle src, Rectangle dst, bool hflip, bool vflip, int a
 	dst.y -= draw_offset_y;
 
 	//Skip drawing what is outside the screen
-	if (dst.x < -dst.width  || dst.x > draw_max_x) return;
-	if (dst.y < -dst.height || dst.y > draw_max_y) return;
-
-	draw_texture(gfx, src, dst, hflip, vflip, alpha);
+	if (!is_onscreen(dst)) return;
+
+#ifndef PLATFORM_HEADLESS
+	batch_quad(dst, src.x * gfx_texel_width, src.y * gfx_texel_height,
+		(src.x + src.width) * gfx_texel_width,
+		(src.y + src.height) * gfx_texel_height, hflip, vflip, alpha);
+#else
+	swrender_blit(src.x, src.y, src.width, src.height, dst.x, dst.y,
+		dst.width, dst.height, hflip, vflip, alpha);
+#endif
 }
 
 static void draw_sprite_part(int spr, int dx, int dy, int sx, int sy, int sw, int sh)
@@ -1115,6 +2029,22 @@ static void draw_sprite_flip(int spr, int dx, int dy, int frame, bool hflip, boo
 {
 	int w  = data_sprites[spr * 4 + 2];
 	int h  = data_sprites[spr * 4 + 3];
+
+#ifndef PLATFORM_HEADLESS
+	//Uses the texture coordinates computed when gfx was loaded
+	const float* uv = &sprite_uvs[spr * 4];
+	float u = uv[0] + (frame * uv[2]);
+	Rectangle dst;
+
+	dst.x = dx - draw_offset_x;
+	dst.y = dy - draw_offset_y;
+	dst.width  = w;
+	dst.height = h;
+
+	if (!is_onscreen(dst)) return;
+
+	batch_quad(dst, u, uv[1], u + uv[2], uv[1] + uv[3], hflip, vflip, 255);
+#else
 	int sx = data_sprites[spr * 4 + 0] + (frame * w);
 	int sy = data_sprites[spr * 4 + 1];
 
@@ -1132,6 +2062,7 @@ static void draw_sprite_flip(int spr, int dx, int dy, int frame, bool hflip, boo
 	dst.height = h;
 
 	draw_gfx(src, dst, hflip, vflip, 255);
+#endif
 }
 
 static void draw_sprite(int spr, int dx, int dy, int frame)
@@ -1165,6 +2096,7 @@ static void draw_sprite_stretch(int spr, int dx, int dy, int w, int h)
 static void draw_digits(int value, int width, int x, int y)
 {
 	char digits[12];
+	char text[13];
 	int num_digits = 0;
 	int i;
 
@@ -1190,10 +2122,13 @@ static void draw_digits(int value, int width, int x, int y)
 		num_digits++;
 	}
 
-	for (i = num_digits - 1; i >= 0; i--) {
-		draw_sprite_part(SPR_CHARSET_WHITE, x, y, digits[i] * 8, 8, 8, 8);
-		x += 8;
+	//Draw as text, so the digits get cached along with the rest of the text
+	for (i = 0; i < num_digits; i++) {
+		text[i] = '0' + digits[num_digits - 1 - i];
 	}
+	text[num_digits] = '\0';
+
+	draw_text(text, TXTCOL_WHITE, x, y);
 }
 
 //The character 0x1B (which corresponds to ASCII Escape) is used by this
@@ -1203,6 +2138,9 @@ static void draw_digits(int value, int width, int x, int y)
 //TXTCOL_GREEN, or TXTCOL_GRAY
 //
 //The newline (\n) character also reverts to the initial color
+//
+//Except in the headless build, the glyphs are kept in the text cache, so
+//drawing the same text at the same place again only copies them
 static void draw_text(const char* text, int color, int x, int y)
 {
 	int i;
@@ -1213,6 +2151,14 @@ static void draw_text(const char* text, int color, int x, int y)
 	int dx = x;
 	int dy = y;
 
+#ifndef PLATFORM_HEADLESS
+	int capture_start;
+
+	if (draw_cached_text(text, color, x, y)) return;
+
+	capture_start = begin_text_capture(text);
+#endif
+
 	for (i = 0; i < len; i++) {
 		int c, sx, sy;
 
@@ -1240,10 +2186,15 @@ static void draw_text(const char* text, int color, int x, int y)
 			dx += 8;
 		}
 	}
+
+#ifndef PLATFORM_HEADLESS
+	end_text_capture(text, initial_color, x, y, capture_start);
+#endif
 }
 
 //------------------------------------------------------------------------------
 
+#ifndef PLATFORM_HEADLESS
 static void draw_touch_buttons(int input_state)
 {
 	int win_width  = display_params->win_width;
@@ -1287,6 +2238,13 @@ static void draw_touch_buttons(int input_state)
 	draw_gfx(src, dst, false, false, TOUCH_BUTTON_OPACITY);
 }
 
+static bool scanlines_shown()
+{
+	return config->scanlines_enabled && display_params->scale >= 2;
+}
+
+//Draws the scanlines as a quad over the last row of pixels of each line of
+//the virtual screen, when the shader doing it could not be loaded
 static void draw_scanlines()
 {
 	int vscreen_width  = display_params->vscreen_width;
@@ -1296,8 +2254,6 @@ static void draw_scanlines()
 	int offset_y = (display_params->win_height - (vscreen_height * scale)) / 2;
 	int line;
 
-	if (!config->scanlines_enabled || scale < 2) return;
-	
 	for (line = 0; line < vscreen_height * scale; line += scale) {
 		int dy = line + (scale - 1);
 		int dw = vscreen_width * scale;
@@ -1317,7 +2273,102 @@ static void draw_scanlines()
 		dst.width  = dw;
 		dst.height = 1;
 
-		draw_gfx(src, dst, false, false, 127);
+		draw_gfx(src, dst, false, false, SCANLINE_OPACITY);
+	}
+}
+
+#endif //PLATFORM_HEADLESS
+
+#ifdef PERF_OVERLAY
+//Draws the performance overlay (toggled with F3), with all times in
+//microseconds: the minimum, average, and 99th percentile frame times, a graph
+//of the time taken by each of the last frames, and the average time taken by
+//each phase of a frame
+static void draw_perf_overlay()
+{
+	const int graph_y = 8;
+	const int graph_height = 32;
+	const int phases_y = graph_y + graph_height + 8;
+	const int rows = (NUM_PERF_PHASES + 2) / 2; //Two columns, plus "OTHER"
+	const int counts_y = phases_y + (rows * 8);
+	const int col_width = 16 * 8;
+
+	PerfStats stats;
+	int i;
+
+	if (!perf_is_visible()) return;
+
+	perf_get_stats(&stats);
+
+	draw_sprite_stretch(SPR_BG_BLACK, 0, 0, display_params->vscreen_width,
+		counts_y + 8);
+
+	//Frame time statistics
+	draw_text("MIN", TXTCOL_GREEN, 0, 0);
+	draw_digits(stats.frame_min, 5, 32, 0);
+	draw_text("AVG", TXTCOL_GREEN, 80, 0);
+	draw_digits(stats.frame_avg, 5, 112, 0);
+	draw_text("P99", TXTCOL_GREEN, 160, 0);
+	draw_digits(stats.frame_p99, 5, 192, 0);
+	draw_text("US", TXTCOL_GRAY, 240, 0);
+
+	//Frame time graph, in which the frames taking longer than the reference
+	//line (at half of PERF_GRAPH_MAX_US, which corresponds to 60 FPS) are
+	//white
+	for (i = 0; i < stats.num_frames; i++) {
+		int us = stats.frames[i];
+		int h = (int)((long)us * graph_height / PERF_GRAPH_MAX_US);
+		int spr = (us > PERF_GRAPH_MAX_US / 2) ? SPR_CHARSET_WHITE : SPR_CHARSET_GREEN;
+
+		if (h > graph_height) h = graph_height;
+		if (h < 1) h = 1;
+
+		draw_perf_bar(spr, i * 2, graph_y + graph_height - h, 2, h);
 	}
+	draw_perf_bar(SPR_CHARSET_GRAY, 0, graph_y + (graph_height / 2),
+		PERF_NUM_FRAMES * 2, 1);
+
+	//Average time of each phase, followed by the time not taken by any of
+	//them
+	for (i = 0; i <= NUM_PERF_PHASES; i++) {
+		int x = (i / rows) * col_width;
+		int y = phases_y + (i % rows) * 8;
+
+		if (i < NUM_PERF_PHASES) {
+			draw_text(data_perf_phase_names[i], TXTCOL_GRAY, x, y);
+			draw_digits(stats.phase_avg[i], 5, x + 80, y);
+		} else {
+			draw_text("OTHER", TXTCOL_GRAY, x, y);
+			draw_digits(stats.other_avg, 5, x + 80, y);
+		}
+	}
+
+	//Draw calls and quads of the last frame
+#ifndef PLATFORM_HEADLESS
+	draw_text("DRAWS", TXTCOL_GREEN, 0, counts_y);
+	draw_digits(last_draw_calls, 5, 48, counts_y);
+	draw_text("QUADS", TXTCOL_GREEN, 96, counts_y);
+	draw_digits(last_quads, 5, 144, counts_y);
+#endif
 }
 
+//Draws a solid rectangle using a pixel from the vertical bar character of a
+//charset sprite (SPR_CHARSET_*), which determines the color
+static void draw_perf_bar(int spr, int x, int y, int w, int h)
+{
+	Rectangle src;
+	Rectangle dst;
+
+	src.x = data_sprites[spr * 4 + 0] + (('|' - ' ') % 16) * 8 + 3;
+	src.y = data_sprites[spr * 4 + 1] + (('|' - ' ') / 16) * 8;
+	src.width  = 1;
+	src.height = 1;
+
+	dst.x = x;
+	dst.y = y;
+	dst.width  = w;
+	dst.height = h;
+
+	draw_gfx(src, dst, false, false, 255);
+}
+#endif
@@ -0,0 +1,478 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * replay.c
+ *
+ * Description:
+ * Recording of the input passed to the gameplay code on each tick, which allows
+ * a play session to be reproduced exactly, and reading and writing of replay
+ * files
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "defs.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+
+//Identifies a replay file and its format version
+#define REPLAY_MAGIC "AVBR"
+#define REPLAY_VERSION 2
+
+//Limit that prevents a corrupt file from causing a huge allocation
+#define REPLAY_MAX_RUNS (1 << 24)
+
+//Only these keys affect the gameplay
+#define REPLAY_INPUT_MASK (INPUT_LEFT | INPUT_RIGHT | INPUT_JUMP)
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+static int pack_input(int input);
+static int unpack_input(int bits);
+static void write_u32(FILE* f, uint32_t value);
+static bool read_u32(FILE* f, uint32_t* value);
+static void write_varint(FILE* f, unsigned long value);
+static bool read_varint(FILE* f, unsigned long* value);
+static bool write_string(FILE* f, const char* str);
+static bool read_string(FILE* f, char* str, int maxlen);
+
+//------------------------------------------------------------------------------
+
+//Starts recording a play session, discarding anything previously recorded
+//
+//The parameters are those of the level start and must be set in the same way
+//when playing the replay back
+void replay_begin(Replay* rp, const char* level, int difficulty, int level_num,
+	bool skip_initial_sequence, int vscreen_width, int score)
+{
+	snprintf(rp->build, ARRAY_LENGTH(rp->build), "%s", REPLAY_BUILD);
+	snprintf(rp->level, ARRAY_LENGTH(rp->level), "%s", level);
+
+	rp->difficulty = difficulty;
+	rp->level_num = level_num;
+	rp->skip_initial_sequence = skip_initial_sequence;
+	rp->vscreen_width = vscreen_width;
+	rp->initial_score = score;
+	rp->final_score = score;
+	rp->num_ticks = 0;
+	rp->num_runs = 0;
+	rp->hash_interval = REPLAY_HASH_INTERVAL;
+	rp->num_hashes = 0;
+}
+
+//Appends the input state of a tick, as passed to play_set_input(), returning
+//false if out of memory
+bool replay_record(Replay* rp, int input)
+{
+	ReplayRun* run;
+
+	input &= REPLAY_INPUT_MASK;
+	rp->num_ticks++;
+
+	if (rp->num_runs > 0) {
+		run = &rp->runs[rp->num_runs - 1];
+
+		if (run->input == input) {
+			run->num_ticks++;
+			return true;
+		}
+	}
+
+	if (rp->num_runs >= rp->capacity) {
+		int capacity = (rp->capacity == 0) ? 256 : rp->capacity * 2;
+		ReplayRun* runs = realloc(rp->runs, capacity * sizeof(ReplayRun));
+
+		if (runs == NULL) {
+			return false;
+		}
+
+		rp->runs = runs;
+		rp->capacity = capacity;
+	}
+
+	run = &rp->runs[rp->num_runs];
+	run->input = input;
+	run->num_ticks = 1;
+	rp->num_runs++;
+
+	return true;
+}
+
+//Checks whether the state hash is to be recorded after the tick whose input
+//was the last one recorded
+bool replay_hash_due(const Replay* rp)
+{
+	return (rp->hash_interval > 0 && rp->num_ticks % rp->hash_interval == 0);
+}
+
+//Appends a state hash, returning false if out of memory
+bool replay_record_hash(Replay* rp, const StateHash* hash)
+{
+	if (rp->num_hashes >= rp->hash_capacity) {
+		int capacity = (rp->hash_capacity == 0) ? 128 : rp->hash_capacity * 2;
+		StateHash* hashes = realloc(rp->hashes, capacity * sizeof(StateHash));
+
+		if (hashes == NULL) {
+			return false;
+		}
+
+		rp->hashes = hashes;
+		rp->hash_capacity = capacity;
+	}
+
+	rp->hashes[rp->num_hashes] = *hash;
+	rp->num_hashes++;
+
+	return true;
+}
+
+//Writes a replay file
+//
+//Each run of ticks with the same input state takes a single byte (the input
+//state in the lower 3 bits and the number of ticks in the upper 5 bits), plus
+//a variable-length number if 31 ticks or more, so a typical level fits in a few
+//hundred bytes, followed by the state hashes
+bool replay_save(Replay* rp, const char* path)
+{
+	FILE* f;
+	int i, j;
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		return false;
+	}
+
+	fwrite(REPLAY_MAGIC, 1, strlen(REPLAY_MAGIC), f);
+	fputc(REPLAY_VERSION, f);
+	write_string(f, rp->build);
+	write_string(f, rp->level);
+	fputc(rp->difficulty, f);
+	fputc(rp->level_num, f);
+	fputc(rp->skip_initial_sequence ? 1 : 0, f);
+	write_varint(f, rp->vscreen_width);
+	write_varint(f, rp->initial_score);
+	write_varint(f, rp->final_score);
+	write_varint(f, rp->num_ticks);
+	write_varint(f, rp->num_runs);
+
+	for (i = 0; i < rp->num_runs; i++) {
+		ReplayRun* run = &rp->runs[i];
+
+		if (run->num_ticks < 31) {
+			fputc(pack_input(run->input) | (run->num_ticks << 3), f);
+		} else {
+			fputc(pack_input(run->input) | (31 << 3), f);
+			write_varint(f, run->num_ticks - 31);
+		}
+	}
+
+	write_varint(f, rp->hash_interval);
+	write_varint(f, rp->num_hashes);
+	write_varint(f, NUM_PLAYHASH_PARTS);
+
+	for (i = 0; i < rp->num_hashes; i++) {
+		for (j = 0; j < NUM_PLAYHASH_PARTS; j++) {
+			write_u32(f, rp->hashes[i].parts[j]);
+		}
+	}
+
+	if (ferror(f)) {
+		fclose(f);
+		return false;
+	}
+
+	return (fclose(f) == 0);
+}
+
+//Reads a replay file, returning false if it cannot be read or is invalid
+bool replay_load(Replay* rp, const char* path)
+{
+	FILE* f;
+	char magic[4];
+	unsigned long vscreen_width, initial_score, final_score, num_ticks;
+	unsigned long num_runs;
+	unsigned long hash_interval, num_hashes, num_parts;
+	unsigned long total_ticks = 0;
+	int difficulty, level_num, flags;
+	int version;
+	int i, j;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return false;
+	}
+
+	rp->num_runs = 0;
+	rp->num_hashes = 0;
+	rp->hash_interval = 0;
+
+	//Files from version 1 have no state hashes
+	version = NONE;
+	if (fread(magic, 1, 4, f) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0) {
+		version = fgetc(f);
+	}
+
+	if (version != 1 && version != REPLAY_VERSION) {
+
+		fclose(f);
+		return false;
+	}
+
+	difficulty = NONE;
+	level_num = NONE;
+	flags = NONE;
+
+	if (read_string(f, rp->build, ARRAY_LENGTH(rp->build)) &&
+			read_string(f, rp->level, ARRAY_LENGTH(rp->level))) {
+
+		difficulty = fgetc(f);
+		level_num = fgetc(f);
+		flags = fgetc(f);
+	}
+
+	if (difficulty < 0 || difficulty > DIFFICULTY_MAX || level_num < 1 ||
+			flags < 0 || flags > 1 || !read_varint(f, &vscreen_width) ||
+			vscreen_width > VSCREEN_MAX_WIDTH ||
+			!read_varint(f, &initial_score) || !read_varint(f, &final_score) ||
+			!read_varint(f, &num_ticks) || !read_varint(f, &num_runs) ||
+			num_runs > num_ticks || num_runs > REPLAY_MAX_RUNS) {
+
+		fclose(f);
+		return false;
+	}
+
+	rp->difficulty = difficulty;
+	rp->level_num = level_num;
+	rp->skip_initial_sequence = (flags == 1);
+	rp->vscreen_width = (int)vscreen_width;
+	rp->initial_score = (int)initial_score;
+	rp->final_score = (int)final_score;
+	rp->num_ticks = (long)num_ticks;
+
+	if ((int)num_runs > rp->capacity) {
+		ReplayRun* runs = realloc(rp->runs, num_runs * sizeof(ReplayRun));
+
+		if (runs == NULL) {
+			fclose(f);
+			return false;
+		}
+
+		rp->runs = runs;
+		rp->capacity = (int)num_runs;
+	}
+
+	for (i = 0; i < (int)num_runs; i++) {
+		int b = fgetc(f);
+		unsigned long ticks;
+
+		if (b == EOF) break;
+
+		ticks = b >> 3;
+		if (ticks == 31) {
+			unsigned long extra;
+
+			if (!read_varint(f, &extra)) break;
+			ticks += extra;
+		}
+
+		rp->runs[i].input = unpack_input(b & 7);
+		rp->runs[i].num_ticks = (long)ticks;
+		total_ticks += ticks;
+	}
+
+	//Error: truncated file or inconsistent number of ticks
+	if (i < (int)num_runs || total_ticks != num_ticks) {
+		fclose(f);
+		return false;
+	}
+
+	rp->num_runs = (int)num_runs;
+
+	if (version == 1) {
+		fclose(f);
+		return true;
+	}
+
+	if (!read_varint(f, &hash_interval) || !read_varint(f, &num_hashes) ||
+			!read_varint(f, &num_parts) || num_parts != NUM_PLAYHASH_PARTS ||
+			hash_interval > num_ticks ||
+			(hash_interval == 0 && num_hashes != 0) ||
+			(hash_interval > 0 && num_hashes > num_ticks / hash_interval)) {
+
+		fclose(f);
+		return false;
+	}
+
+	if ((int)num_hashes > rp->hash_capacity) {
+		StateHash* hashes = realloc(rp->hashes, num_hashes * sizeof(StateHash));
+
+		if (hashes == NULL) {
+			fclose(f);
+			return false;
+		}
+
+		rp->hashes = hashes;
+		rp->hash_capacity = (int)num_hashes;
+	}
+
+	for (i = 0; i < (int)num_hashes; i++) {
+		for (j = 0; j < NUM_PLAYHASH_PARTS; j++) {
+			if (!read_u32(f, &rp->hashes[i].parts[j])) {
+				fclose(f);
+				return false;
+			}
+		}
+	}
+
+	fclose(f);
+
+	rp->hash_interval = (int)hash_interval;
+	rp->num_hashes = (int)num_hashes;
+
+	return true;
+}
+
+void replay_free(Replay* rp)
+{
+	free(rp->runs);
+	rp->runs = NULL;
+	rp->num_runs = 0;
+	rp->capacity = 0;
+
+	free(rp->hashes);
+	rp->hashes = NULL;
+	rp->num_hashes = 0;
+	rp->hash_capacity = 0;
+}
+
+//------------------------------------------------------------------------------
+
+//Converts an input state into 3 bits
+static int pack_input(int input)
+{
+	int bits = 0;
+
+	if (input & INPUT_LEFT)  bits |= 1;
+	if (input & INPUT_RIGHT) bits |= 2;
+	if (input & INPUT_JUMP)  bits |= 4;
+
+	return bits;
+}
+
+static int unpack_input(int bits)
+{
+	int input = 0;
+
+	if (bits & 1) input |= INPUT_LEFT;
+	if (bits & 2) input |= INPUT_RIGHT;
+	if (bits & 4) input |= INPUT_JUMP;
+
+	return input;
+}
+
+//Writes a 32-bit number in little-endian byte order
+static void write_u32(FILE* f, uint32_t value)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		fputc((value >> (i * 8)) & 0xFF, f);
+	}
+}
+
+static bool read_u32(FILE* f, uint32_t* value)
+{
+	int i;
+
+	*value = 0;
+
+	for (i = 0; i < 4; i++) {
+		int b = fgetc(f);
+
+		if (b == EOF) return false;
+
+		*value |= (uint32_t)b << (i * 8);
+	}
+
+	return true;
+}
+
+//Writes an unsigned number using 7 bits per byte, with the highest bit set in
+//all bytes but the last
+static void write_varint(FILE* f, unsigned long value)
+{
+	while (value >= 0x80) {
+		fputc((int)(value & 0x7F) | 0x80, f);
+		value >>= 7;
+	}
+
+	fputc((int)value, f);
+}
+
+static bool read_varint(FILE* f, unsigned long* value)
+{
+	int shift = 0;
+
+	*value = 0;
+
+	while (shift < 32) {
+		int b = fgetc(f);
+
+		if (b == EOF) return false;
+
+		*value |= (unsigned long)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) return true;
+
+		shift += 7;
+	}
+
+	return false;
+}
+
+//Writes a string followed by the null terminator
+static bool write_string(FILE* f, const char* str)
+{
+	return (fwrite(str, 1, strlen(str) + 1, f) == strlen(str) + 1);
+}
+
+static bool read_string(FILE* f, char* str, int maxlen)
+{
+	int i;
+
+	for (i = 0; i < maxlen; i++) {
+		int c = fgetc(f);
+
+		if (c == EOF) return false;
+
+		str[i] = (char)c;
+		if (c == '\0') return true;
+	}
+
+	return false;
+}
+
@@ -0,0 +1,351 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * avbsim.c
+ *
+ * Description:
+ * Simulation library (libalexvsbus-sim), which lets other programs create
+ * sessions from level data, step them with a given input, clone them, and
+ * observe their state, without any global state
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "../defs.h"
+#include "avbsim.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+
+struct AvbSim {
+	PlayCtx ctx;
+	long ticks;
+	int coins_collected;
+	int falls;
+};
+
+//------------------------------------------------------------------------------
+
+//From play.c
+void play_clear(PlayCtx* ctx);
+bool play_copy(PlayCtx* dst, const PlayCtx* src);
+void play_set_input(PlayCtx* ctx, int input_held);
+void play_update(PlayCtx* ctx, float dt);
+void play_adapt_to_screen_size(PlayCtx* ctx, int vscreen_width);
+void play_free(PlayCtx* ctx);
+bool play_take_event(PlayCtx* ctx, PlayEvent* evt);
+
+//From levelload.c
+int levelload_load_text(PlayCtx* ctx, const char* text);
+
+//From data.c
+extern const int data_difficulty_num_levels[];
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+static int find_first_obj(const PlayCtx* ctx, int xmin);
+
+//------------------------------------------------------------------------------
+
+//Sets up a level that has just been loaded to start from the beginning, which
+//the headless simulation program also uses
+void avbsim_setup_level(PlayCtx* ctx, int level_num, int difficulty)
+{
+	ctx->difficulty = difficulty;
+	ctx->level_num = level_num;
+	ctx->last_level = (level_num == data_difficulty_num_levels[difficulty]);
+	ctx->sequence_step = SEQ_INITIAL;
+	ctx->skip_initial_sequence = false;
+
+	if (ctx->last_level) {
+		ctx->bus.num_characters = 3;
+	} else {
+		switch (level_num) {
+			case 1: ctx->bus.num_characters = 0; break;
+			case 2: ctx->bus.num_characters = 0; break;
+			case 3: ctx->bus.num_characters = 1; break;
+			case 4: ctx->bus.num_characters = 2; break;
+			case 5: ctx->bus.num_characters = 3; break;
+		}
+	}
+
+	ctx->bus.route_sign = level_num;
+	ctx->cam.fixed_at_leftmost = true;
+
+	play_adapt_to_screen_size(ctx, VSCREEN_MAX_WIDTH);
+}
+
+//Creates a session from the contents of a level file (which need not be
+//null-terminated), returning NULL on error, in which case the error
+//(AVBSIM_ERR_*) is stored in err (if not NULL)
+//
+//The level starts with the score at zero and the camera set up as for the
+//largest virtual screen size, like in the headless simulation program
+AvbSim* avbsim_create(const char* level_data, size_t size, int level_num,
+	int difficulty, bool skip_initial_sequence, int* err)
+{
+	AvbSim* sim;
+	char* text;
+	int lvlerr;
+
+	if (err != NULL) *err = AVBSIM_ERR_NONE;
+
+	if (difficulty < 0 || difficulty > DIFFICULTY_MAX) {
+		if (err != NULL) *err = AVBSIM_ERR_INVALID;
+		return NULL;
+	}
+
+	if (size > MAX_LEVEL_FILE_SIZE) {
+		if (err != NULL) *err = AVBSIM_ERR_TOO_LARGE;
+		return NULL;
+	}
+
+	//A gameplay context must be zero-initialized before its first use
+	sim = calloc(1, sizeof(AvbSim));
+	text = malloc(size + 1);
+	if (sim == NULL || text == NULL) {
+		free(sim);
+		free(text);
+		if (err != NULL) *err = AVBSIM_ERR_NO_MEMORY;
+		return NULL;
+	}
+
+	memcpy(text, level_data, size);
+	text[size] = '\0';
+
+	play_clear(&sim->ctx);
+	lvlerr = levelload_load_text(&sim->ctx, text);
+	free(text);
+
+	if (lvlerr != LVLERR_NONE) {
+		play_free(&sim->ctx);
+		free(sim);
+		if (err != NULL) {
+			*err = (lvlerr == LVLERR_TOO_LARGE) ? AVBSIM_ERR_TOO_LARGE : AVBSIM_ERR_INVALID;
+		}
+		return NULL;
+	}
+
+	avbsim_setup_level(&sim->ctx, level_num, difficulty);
+	sim->ctx.skip_initial_sequence = skip_initial_sequence;
+
+	return sim;
+}
+
+//Creates a session holding a copy of a gameplay context in which a level has
+//been set up, which the headless simulation program uses for the levels it
+//loads itself, returning NULL if out of memory
+AvbSim* avbsim_create_from_ctx(const PlayCtx* ctx)
+{
+	AvbSim* sim = calloc(1, sizeof(AvbSim));
+
+	if (sim == NULL) return NULL;
+
+	if (!play_copy(&sim->ctx, ctx)) {
+		free(sim);
+		return NULL;
+	}
+
+	return sim;
+}
+
+//Creates a session in the same state as another one, returning NULL if out of
+//memory
+AvbSim* avbsim_clone(const AvbSim* sim)
+{
+	AvbSim* clone = calloc(1, sizeof(AvbSim));
+
+	if (clone == NULL) return NULL;
+
+	if (!avbsim_copy(clone, sim)) {
+		free(clone);
+		return NULL;
+	}
+
+	return clone;
+}
+
+//Puts a session in the same state as another one, returning false if out of
+//memory
+//
+//Copying between sessions of the same level does not allocate memory, so
+//searches can restore a saved state after every step without any cost other
+//than copying
+bool avbsim_copy(AvbSim* dst, const AvbSim* src)
+{
+	if (!play_copy(&dst->ctx, &src->ctx)) {
+		return false;
+	}
+
+	dst->ticks = src->ticks;
+	dst->coins_collected = src->coins_collected;
+	dst->falls = src->falls;
+
+	return true;
+}
+
+void avbsim_destroy(AvbSim* sim)
+{
+	if (sim == NULL) return;
+
+	play_free(&sim->ctx);
+	free(sim);
+}
+
+//Runs a number of ticks with the given input (AVBSIM_INPUT_* bitfield) held,
+//returning the number of ticks actually run, which is less than requested if
+//the level finished
+int avbsim_step(AvbSim* sim, int num_ticks, int input)
+{
+	PlayCtx* ctx = &sim->ctx;
+	PlayEvent evt;
+	int input_held = 0;
+	int i;
+
+	if (input & AVBSIM_INPUT_LEFT)  input_held |= INPUT_LEFT;
+	if (input & AVBSIM_INPUT_RIGHT) input_held |= INPUT_RIGHT;
+	if (input & AVBSIM_INPUT_JUMP)  input_held |= INPUT_JUMP;
+
+	for (i = 0; i < num_ticks; i++) {
+		if (ctx->sequence_step == SEQ_FINISHED) break;
+
+		play_set_input(ctx, input_held);
+		play_update(ctx, PLAY_DT);
+		sim->ticks++;
+
+		while (play_take_event(ctx, &evt)) {
+			if (evt.type == PLAYEVT_COIN_COLLECTED) sim->coins_collected++;
+			if (evt.type == PLAYEVT_FALL) sim->falls++;
+		}
+	}
+
+	return i;
+}
+
+//Fills an observation with the state of a session, including the objects and
+//solids within a horizontal distance (in pixels) of the player character
+void avbsim_observe(const AvbSim* sim, int range, AvbSimObs* obs)
+{
+	const PlayCtx* ctx = &sim->ctx;
+	const Player* pl = &ctx->player;
+	int xmin, xmax;
+	int first, last, max_col;
+	int i, j;
+
+	obs->ticks = sim->ticks;
+
+	obs->player_left = PN_TO_INT(pl->x) + PLAYER_BOX_OFFSET_X;
+	obs->player_right = obs->player_left + PLAYER_BOX_WIDTH;
+	obs->player_top = PN_TO_INT(pl->y);
+	obs->player_bottom = obs->player_top + pl->height;
+	obs->player_xvel = PN_TO_FLOAT(pl->xvel);
+	obs->player_yvel = PN_TO_FLOAT(pl->yvel);
+	obs->player_state = pl->state;
+	obs->player_on_floor = pl->on_floor;
+
+	obs->score = ctx->score;
+	obs->time = ctx->time;
+	obs->coins_collected = sim->coins_collected;
+	obs->falls = sim->falls;
+	obs->goal_reached = ctx->goal_reached;
+	obs->time_up = ctx->time_up;
+	obs->finished = (ctx->sequence_step == SEQ_FINISHED);
+
+	xmin = obs->player_left - range;
+	xmax = obs->player_right + range;
+
+	//Objects, which are found in obj_order[] in ascending order of X position
+	obs->num_objs = 0;
+	for (i = find_first_obj(ctx, xmin); i < ctx->num_ordered_objs; i++) {
+		const Obj* obj = &ctx->objs[ctx->obj_order[i]];
+		AvbSimObj* o;
+
+		if (obj->x > xmax) break;
+		if (obs->num_objs >= AVBSIM_MAX_OBJS) break;
+		if (obj->type == NONE) continue;
+
+		o = &obs->objs[obs->num_objs++];
+		o->type = obj->type;
+		o->x = obj->x;
+		o->y = obj->y;
+	}
+
+	//Solids, which are found in the lists of the level columns they overlap
+	obs->num_solids = 0;
+	if (ctx->num_level_columns == 0) return;
+
+	max_col = ctx->num_level_columns - 1;
+	first = xmin / LEVEL_BLOCK_SIZE;
+	last = xmax / LEVEL_BLOCK_SIZE;
+	if (first < 0) first = 0;
+	if (last > max_col) last = max_col;
+
+	for (i = first; i <= last; i++) {
+		const LevelColumn* col = &ctx->level_columns[i];
+
+		for (j = 0; j < col->num_solids; j++) {
+			const Solid* sol = &ctx->solids[col->solids[j]];
+			int sol_first = sol->left / LEVEL_BLOCK_SIZE;
+			AvbSimSolid* s;
+
+			//A solid overlapping multiple level columns is only taken from
+			//the first one within the range
+			if (sol_first < first) sol_first = first;
+			if (sol_first != i) continue;
+
+			if (obs->num_solids >= AVBSIM_MAX_SOLIDS) return;
+
+			s = &obs->solids[obs->num_solids++];
+			s->type = sol->type;
+			s->left = sol->left;
+			s->right = sol->right;
+			s->top = sol->top;
+			s->bottom = sol->bottom;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+//Finds the position within obj_order[] of the first object whose X position is
+//not less than xmin
+static int find_first_obj(const PlayCtx* ctx, int xmin)
+{
+	int lo = 0;
+	int hi = ctx->num_ordered_objs;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (ctx->objs[ctx->obj_order[mid]].x < xmin) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
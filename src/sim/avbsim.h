@@ -0,0 +1,195 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * avbsim.h
+ *
+ * Description:
+ * Public interface of the simulation library (libalexvsbus-sim), which runs
+ * the gameplay logic for bots and other programs embedding it, and the only
+ * header meant to be included by them
+ *
+ */
+
+#ifndef ALEXVSBUS_AVBSIM_H
+#define ALEXVSBUS_AVBSIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Marks the functions exported by the simulation library, which is built with
+//every other symbol hidden (AVBSIM_BUILD is only defined when building it)
+#if defined(AVBSIM_BUILD) && defined(_WIN32)
+#define AVBSIM_API __declspec(dllexport)
+#elif defined(AVBSIM_BUILD) && defined(__GNUC__)
+#define AVBSIM_API __attribute__((visibility("default")))
+#else
+#define AVBSIM_API
+#endif
+
+//Input actions passed to avbsim_step() (bitfield)
+#define AVBSIM_INPUT_LEFT  (1 << 0)
+#define AVBSIM_INPUT_RIGHT (1 << 1)
+#define AVBSIM_INPUT_JUMP  (1 << 2)
+
+//Errors returned by avbsim_create()
+#define AVBSIM_ERR_NONE 0
+#define AVBSIM_ERR_TOO_LARGE 2
+#define AVBSIM_ERR_INVALID 3
+#define AVBSIM_ERR_NO_MEMORY 4
+
+//Maximum numbers of objects and solids returned by avbsim_observe()
+#define AVBSIM_MAX_OBJS 64
+#define AVBSIM_MAX_SOLIDS 64
+
+//Simulation session, holding the state of a level being played
+typedef struct AvbSim AvbSim;
+
+//Object near the player character, with the type being one of the OBJ_*
+//constants of the game's source code (0 and 1 are silver and gold coins)
+typedef struct {
+	int type;
+	int x, y;
+} AvbSimObj;
+
+//Area the player character cannot pass through, with the type being one of
+//the SOL_* constants of the game's source code (0 is a full solid)
+typedef struct {
+	int type;
+	int left, right, top, bottom;
+} AvbSimSolid;
+
+//State of a session as seen by a bot, with positions in pixels
+typedef struct {
+	long ticks; //Ticks run since the session was created
+
+	//Player character's bounding box and velocity (in pixels per second)
+	int player_left, player_right, player_top, player_bottom;
+	float player_xvel, player_yvel;
+	int player_state; //PLAYER_STATE_* constants of the game's source code
+	bool player_on_floor;
+
+	int score;
+	int time; //Remaining time in seconds
+	int coins_collected;
+	int falls;
+	bool goal_reached;
+	bool time_up;
+	bool finished;
+
+	//Objects (in ascending order of X position) and solids within the range
+	//passed to avbsim_observe()
+	int num_objs;
+	AvbSimObj objs[AVBSIM_MAX_OBJS];
+	int num_solids;
+	AvbSimSolid solids[AVBSIM_MAX_SOLIDS];
+} AvbSimObs;
+
+//------------------------------------------------------------------------------
+
+//Shared memory of the environment server (alexvsbus-sim --serve), which holds
+//an AvbEnvHeader followed by the actions (one int32_t per session) at
+//actions_offset and the observations (one AvbEnvObs per session) at obs_offset
+#define AVBENV_MAGIC 0x45425641 //"AVBE"
+#define AVBENV_VERSION 1
+
+//Action that resets a session instead of stepping it (any other action is an
+//AVBSIM_INPUT_* bitfield)
+#define AVBENV_ACTION_RESET -1
+
+//Maximum number of objects in an observation of the environment server
+#define AVBENV_MAX_OBJS 16
+
+//Start of the shared memory, whose fields are set by the server, except for
+//request_seq and shutdown
+//
+//To step all sessions, a client writes the actions, increments request_seq,
+//calls FUTEX_WAKE on request_seq, and waits until response_seq equals it, at
+//which point the observations have been written. The wake is required, as the
+//server sleeps on request_seq with FUTEX_WAIT unless the next batch comes
+//right away, and it is otherwise only noticed after a timeout, which would
+//hold up nearly every batch of a client taking any time to choose its actions.
+//The server calls FUTEX_WAKE on response_seq after updating it, so a client
+//can either sleep on it or poll.
+//
+//The magic number is written last, once the observations of the initial state
+//are ready.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_envs;
+	uint32_t obs_size; //sizeof(AvbEnvObs)
+	uint32_t actions_offset;
+	uint32_t obs_offset;
+	uint32_t action_repeat; //Ticks run by each step
+	uint32_t auto_reset;
+	uint32_t obs_range; //Range passed to avbsim_observe()
+	uint32_t request_seq;
+	uint32_t response_seq;
+
+	//Set to 1 by a client before incrementing request_seq (and waking the
+	//server) to stop the server
+	uint32_t shutdown;
+
+	uint32_t reserved[4];
+} AvbEnvHeader;
+
+//Object of an AvbEnvObs (the same as AvbSimObj)
+typedef struct {
+	int32_t type;
+	int32_t x, y;
+} AvbEnvObj;
+
+//State of a session after a step, with the same meaning as in AvbSimObs
+//
+//When a session reaches the goal or runs out of time, done is set and the
+//ended_* fields describe how the episode ended; otherwise, they are all zero.
+//With auto-reset, the rest of the observation is then already that of the next
+//episode.
+typedef struct {
+	int32_t ticks; //Ticks run since the start of the episode
+	int32_t player_left, player_right, player_top, player_bottom;
+	float player_xvel, player_yvel;
+	int32_t player_state;
+	int32_t player_on_floor;
+	int32_t score;
+	int32_t time;
+	int32_t coins_collected;
+	int32_t falls;
+	int32_t done;
+	int32_t ended_goal_reached;
+	int32_t ended_time_up;
+	int32_t ended_score;
+	int32_t num_objs;
+	AvbEnvObj objs[AVBENV_MAX_OBJS];
+} AvbEnvObs;
+
+//------------------------------------------------------------------------------
+
+AVBSIM_API AvbSim* avbsim_create(const char* level_data, size_t size,
+	int level_num, int difficulty, bool skip_initial_sequence, int* err);
+AVBSIM_API AvbSim* avbsim_clone(const AvbSim* sim);
+AVBSIM_API bool avbsim_copy(AvbSim* dst, const AvbSim* src);
+AVBSIM_API void avbsim_destroy(AvbSim* sim);
+AVBSIM_API int avbsim_step(AvbSim* sim, int num_ticks, int input);
+AVBSIM_API void avbsim_observe(const AvbSim* sim, int range, AvbSimObs* obs);
+
+#endif //ALEXVSBUS_AVBSIM_H
@@ -0,0 +1,576 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * batch.c
+ *
+ * Description:
+ * Batch mode of the headless simulation program, which runs the jobs (pairs of
+ * level file and input script) listed in a manifest on a work-stealing pool of
+ * threads, each with its own gameplay context
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "../defs.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+
+//Header of the results and maximum length of a line of them, which holds two
+//paths and the values of a job
+#define BATCH_RESULTS_HEADER \
+	"level\tscript\tstatus\tticks\tscore\ttime\tgoal_reached\ttime_up\thash"
+#define BATCH_MAX_LINE 2048
+
+//------------------------------------------------------------------------------
+
+//From play.c
+bool play_copy(PlayCtx* dst, const PlayCtx* src);
+void play_free(PlayCtx* ctx);
+
+//From sim.c
+bool sim_load_script(const char* path, SimScript* script);
+void sim_free_script(SimScript* script);
+int sim_start_level(PlayCtx* ctx, const char* path);
+void sim_show_level_error(int err, const char* path);
+void sim_run(PlayCtx* ctx, const SimScript* script, long max_ticks,
+	SimResult* result);
+double sim_time_ms();
+
+//------------------------------------------------------------------------------
+
+//Manifest contents
+static char* manifest_data;
+static BatchJob* jobs;
+static int num_jobs;
+
+//Distinct levels, each loaded once and then copied for every job using it
+static const char** level_paths;
+static PlayCtx* level_ctxs;
+static int num_levels;
+
+static BatchWorker* workers;
+static int num_workers;
+
+static long max_ticks;
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+static bool read_manifest(const char* path);
+static int add_level(const char* path);
+static bool load_levels();
+static void* worker_main(void* arg);
+static bool take_job(BatchWorker* worker, int* job);
+static bool steal_jobs(BatchWorker* worker);
+static bool write_results(const char* path);
+static bool compare_baseline(const char* path);
+static void format_result(int job, char* buf, int size);
+static void show_throughput(double elapsed_ms);
+static void cleanup();
+
+//------------------------------------------------------------------------------
+
+bool batch_run(const char* manifest_path, const char* output_path,
+	const char* baseline_path, int num_threads, long ticks)
+{
+	pthread_t* threads;
+	double start_time;
+	bool ok = false;
+	int i;
+
+	max_ticks = ticks;
+
+	if (!read_manifest(manifest_path)) {
+		fprintf(stderr, "Invalid manifest: %s\n", manifest_path);
+		cleanup();
+		return false;
+	}
+
+	if (!load_levels()) {
+		cleanup();
+		return false;
+	}
+
+	//Use one thread per CPU core by default
+	if (num_threads <= 0) {
+		num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_threads <= 0) num_threads = 1;
+	}
+	if (num_threads > num_jobs) {
+		num_threads = num_jobs;
+	}
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+
+	num_workers = num_threads;
+	workers = calloc(num_workers, sizeof(BatchWorker));
+	threads = calloc(num_workers, sizeof(pthread_t));
+
+	if (workers == NULL || threads == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		free(threads);
+		cleanup();
+		return false;
+	}
+
+	//Split the jobs evenly among the workers, which then steal from one
+	//another as they run out of work
+	for (i = 0; i < num_workers; i++) {
+		uint64_t first = (uint64_t)num_jobs * i / num_workers;
+		uint64_t end = (uint64_t)num_jobs * (i + 1) / num_workers;
+
+		workers[i].index = i;
+		workers[i].jobs = (end << 32) | first;
+	}
+
+	start_time = sim_time_ms();
+
+	for (i = 1; i < num_workers; i++) {
+		if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0) {
+			//The other workers will steal the jobs of this one
+			workers[i].index = NONE;
+		}
+	}
+
+	//The calling thread acts as the first worker
+	worker_main(&workers[0]);
+
+	for (i = 1; i < num_workers; i++) {
+		if (workers[i].index != NONE) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	show_throughput(sim_time_ms() - start_time);
+
+	ok = write_results(output_path);
+	if (!ok) {
+		fprintf(stderr, "Unable to write results: %s\n", output_path);
+	}
+
+	if (ok && baseline_path != NULL) {
+		ok = compare_baseline(baseline_path);
+	}
+
+	free(threads);
+	cleanup();
+
+	return ok;
+}
+
+//------------------------------------------------------------------------------
+
+//Reads the manifest, in which each line contains the path to a level file and
+//the path to an input script, separated by whitespace
+static bool read_manifest(const char* path)
+{
+	FILE* f;
+	long size;
+	char* line;
+	int capacity = 0;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	manifest_data = malloc(size + 1);
+	if (size < 0 || manifest_data == NULL) {
+		fclose(f);
+		return false;
+	}
+
+	size = fread(manifest_data, 1, size, f);
+	manifest_data[size] = '\0';
+	fclose(f);
+
+	//The paths point directly into the manifest's data
+	line = manifest_data;
+	while (line != NULL && *line != '\0') {
+		char* next = strchr(line, '\n');
+		char* level_path;
+		char* script_path;
+		char* extra;
+
+		if (next != NULL) {
+			*next = '\0';
+			next++;
+		}
+
+		level_path = strtok(line, " \t\r");
+		script_path = strtok(NULL, " \t\r");
+		extra = strtok(NULL, " \t\r");
+		line = next;
+
+		//Skip empty lines and comments
+		if (level_path == NULL || level_path[0] == '#') continue;
+
+		if (script_path == NULL || extra != NULL) {
+			return false;
+		}
+
+		if (num_jobs >= capacity) {
+			BatchJob* new_jobs;
+
+			capacity = (capacity == 0) ? 256 : capacity * 2;
+			new_jobs = realloc(jobs, capacity * sizeof(BatchJob));
+
+			if (new_jobs == NULL) {
+				return false;
+			}
+
+			jobs = new_jobs;
+		}
+
+		jobs[num_jobs].level = add_level(level_path);
+		jobs[num_jobs].script_path = script_path;
+		jobs[num_jobs].script_invalid = false;
+		jobs[num_jobs].out_of_memory = false;
+		num_jobs++;
+
+		if (jobs[num_jobs - 1].level == NONE) {
+			return false;
+		}
+	}
+
+	return (num_jobs > 0);
+}
+
+//Returns the index of a level within the list of distinct levels, adding it
+//if not yet present
+static int add_level(const char* path)
+{
+	const char** new_paths;
+	int i;
+
+	for (i = 0; i < num_levels; i++) {
+		if (strcmp(level_paths[i], path) == 0) {
+			return i;
+		}
+	}
+
+	new_paths = realloc(level_paths, (num_levels + 1) * sizeof(const char*));
+	if (new_paths == NULL) {
+		return NONE;
+	}
+
+	level_paths = new_paths;
+	level_paths[num_levels] = path;
+	num_levels++;
+
+	return num_levels - 1;
+}
+
+static bool load_levels()
+{
+	int i;
+
+	level_ctxs = calloc(num_levels, sizeof(PlayCtx));
+	if (level_ctxs == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+
+	for (i = 0; i < num_levels; i++) {
+		int err = sim_start_level(&level_ctxs[i], level_paths[i]);
+
+		if (err != LVLERR_NONE) {
+			sim_show_level_error(err, level_paths[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void* worker_main(void* arg)
+{
+	BatchWorker* worker = arg;
+	double start_time = sim_time_ms();
+	int job;
+
+	do {
+		while (take_job(worker, &job)) {
+			BatchJob* j = &jobs[job];
+			SimScript script;
+
+			if (!sim_load_script(j->script_path, &script)) {
+				j->script_invalid = true;
+				continue;
+			}
+
+			if (!play_copy(&worker->ctx, &level_ctxs[j->level])) {
+				j->out_of_memory = true;
+				sim_free_script(&script);
+				continue;
+			}
+
+			sim_run(&worker->ctx, &script, max_ticks, &j->result);
+			sim_free_script(&script);
+
+			worker->num_jobs_run++;
+			worker->num_ticks += j->result.ticks;
+		}
+	} while (steal_jobs(worker));
+
+	worker->elapsed_ms = sim_time_ms() - start_time;
+
+	return NULL;
+}
+
+//Takes the first job from the worker's own range
+static bool take_job(BatchWorker* worker, int* job)
+{
+	uint64_t range = __atomic_load_n(&worker->jobs, __ATOMIC_ACQUIRE);
+
+	while (1) {
+		uint32_t first = (uint32_t)range;
+		uint32_t end = (uint32_t)(range >> 32);
+		uint64_t new_range;
+
+		if (first >= end) {
+			return false;
+		}
+
+		new_range = ((uint64_t)end << 32) | (first + 1);
+
+		if (__atomic_compare_exchange_n(&worker->jobs, &range, new_range,
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*job = first;
+			return true;
+		}
+	}
+}
+
+//Steals half of the remaining jobs from the end of another worker's range,
+//trying each of the other workers in turn
+static bool steal_jobs(BatchWorker* worker)
+{
+	int i;
+
+	for (i = 1; i < num_workers; i++) {
+		BatchWorker* victim = &workers[(worker - workers + i) % num_workers];
+		uint64_t range = __atomic_load_n(&victim->jobs, __ATOMIC_ACQUIRE);
+
+		while (1) {
+			uint32_t first = (uint32_t)range;
+			uint32_t end = (uint32_t)(range >> 32);
+			uint32_t num_stolen;
+			uint64_t new_range;
+
+			if (first >= end) {
+				break;
+			}
+
+			num_stolen = (end - first + 1) / 2;
+			new_range = ((uint64_t)(end - num_stolen) << 32) | first;
+
+			if (__atomic_compare_exchange_n(&victim->jobs, &range, new_range,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				new_range = ((uint64_t)end << 32) | (end - num_stolen);
+				__atomic_store_n(&worker->jobs, new_range, __ATOMIC_RELEASE);
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+//Writes the results as tab-separated values, one line per job in the same order
+//as in the manifest
+static bool write_results(const char* path)
+{
+	FILE* f = stdout;
+	int i;
+
+	if (path != NULL) {
+		f = fopen(path, "w");
+		if (f == NULL) {
+			return false;
+		}
+	}
+
+	fprintf(f, "%s\n", BATCH_RESULTS_HEADER);
+
+	for (i = 0; i < num_jobs; i++) {
+		char line[BATCH_MAX_LINE];
+
+		format_result(i, line, ARRAY_LENGTH(line));
+		fprintf(f, "%s\n", line);
+	}
+
+	if (f != stdout) {
+		return (fclose(f) == 0);
+	}
+
+	return true;
+}
+
+//Compares the results against those written by a previous run (or another
+//build), line by line, and reports the jobs whose results differ, returning
+//false if there is any or if the number of jobs differs
+static bool compare_baseline(const char* path)
+{
+	FILE* f;
+	char line[BATCH_MAX_LINE];
+	char expected[BATCH_MAX_LINE];
+	int num_differences = 0;
+	int i = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open baseline: %s\n", path);
+		return false;
+	}
+
+	//Skip the header
+	if (fgets(expected, ARRAY_LENGTH(expected), f) == NULL) {
+		expected[0] = '\0';
+	}
+
+	while (fgets(expected, ARRAY_LENGTH(expected), f) != NULL) {
+		expected[strcspn(expected, "\r\n")] = '\0';
+
+		if (i >= num_jobs) {
+			fprintf(stderr, "Extra line in the baseline: %s\n", expected);
+			num_differences++;
+			continue;
+		}
+
+		format_result(i, line, ARRAY_LENGTH(line));
+
+		if (strcmp(line, expected) != 0) {
+			fprintf(stderr, "Expected: %s\nGot:      %s\n", expected, line);
+			num_differences++;
+		}
+
+		i++;
+	}
+
+	fclose(f);
+
+	for (; i < num_jobs; i++) {
+		format_result(i, line, ARRAY_LENGTH(line));
+		fprintf(stderr, "Missing from the baseline: %s\n", line);
+		num_differences++;
+	}
+
+	if (num_differences > 0) {
+		fprintf(stderr, "%d difference(s) from %s\n", num_differences, path);
+		return false;
+	}
+
+	fprintf(stderr, "No differences from %s\n", path);
+
+	return true;
+}
+
+//Formats the results of a job as a line of tab-separated values (without the
+//line break)
+static void format_result(int job, char* buf, int size)
+{
+	BatchJob* j = &jobs[job];
+	SimResult* r = &j->result;
+	const char* level = level_paths[j->level];
+
+	if (j->script_invalid) {
+		snprintf(buf, size, "%s\t%s\tinvalid_script\t0\t0\t0\t0\t0\t00000000",
+			level, j->script_path);
+		return;
+	}
+
+	if (j->out_of_memory) {
+		snprintf(buf, size, "%s\t%s\tout_of_memory\t0\t0\t0\t0\t0\t00000000",
+			level, j->script_path);
+		return;
+	}
+
+	snprintf(buf, size, "%s\t%s\t%s\t%ld\t%d\t%d\t%d\t%d\t%08x",
+		level, j->script_path, r->finished ? "finished" : "timeout",
+		r->ticks, r->score, r->time,
+		r->goal_reached ? 1 : 0, r->time_up ? 1 : 0, r->hash);
+}
+
+//Reports the throughput of each worker thread and the total
+static void show_throughput(double elapsed_ms)
+{
+	long total_ticks = 0;
+	int i;
+
+	for (i = 0; i < num_workers; i++) {
+		BatchWorker* w = &workers[i];
+		double secs = w->elapsed_ms / 1000.0;
+
+		total_ticks += w->num_ticks;
+
+		fprintf(stderr, "thread=%d jobs=%d ticks=%ld ticks_per_sec=%.0f\n",
+			i, w->num_jobs_run, w->num_ticks,
+			(secs > 0) ? w->num_ticks / secs : 0);
+	}
+
+	fprintf(stderr, "threads=%d jobs=%d ticks=%ld elapsed_ms=%.3f ticks_per_sec=%.0f\n",
+		num_workers, num_jobs, total_ticks, elapsed_ms,
+		(elapsed_ms > 0) ? total_ticks / (elapsed_ms / 1000.0) : 0);
+}
+
+static void cleanup()
+{
+	int i;
+
+	for (i = 0; workers != NULL && i < num_workers; i++) {
+		play_free(&workers[i].ctx);
+	}
+
+	for (i = 0; level_ctxs != NULL && i < num_levels; i++) {
+		play_free(&level_ctxs[i]);
+	}
+
+	free(workers);
+	free(level_ctxs);
+	free(level_paths);
+	free(jobs);
+	free(manifest_data);
+
+	workers = NULL;
+	level_ctxs = NULL;
+	level_paths = NULL;
+	jobs = NULL;
+	manifest_data = NULL;
+	num_workers = 0;
+	num_levels = 0;
+	num_jobs = 0;
+}
+
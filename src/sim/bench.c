@@ -0,0 +1,398 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * bench.c
+ *
+ * Description:
+ * Benchmark mode of the headless simulation program, which measures the time
+ * taken by each tick and by level loading for every shipped level, and can
+ * compare the results against a baseline from a previous run
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "../defs.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------
+
+//Minimum time (in milliseconds) over which a level is loaded again and again
+//to measure the loading time, as a fixed number of loads of a small level takes
+//too little time to be measured reliably
+#define BENCH_MIN_LOAD_MS 100
+
+//Number of times the measurements are repeated for each level
+#define BENCH_NUM_REPEATS 5
+
+//Maximum number of levels of a single difficulty
+#define BENCH_MAX_LEVELS 5
+
+//------------------------------------------------------------------------------
+
+//From play.c
+void play_set_input(PlayCtx* ctx, int input_held);
+void play_update(PlayCtx* ctx, float dt);
+bool play_take_event(PlayCtx* ctx, PlayEvent* evt);
+void play_free(PlayCtx* ctx);
+
+//From sim.c
+int sim_start_level(PlayCtx* ctx, const char* path);
+void sim_show_level_error(int err, const char* path);
+double sim_time_ms();
+
+//From util.c
+const char* file_from_path(const char* path);
+
+//From data.c
+extern const int data_difficulty_num_levels[];
+
+//------------------------------------------------------------------------------
+
+//Fixed input used for every level, repeated until the number of ticks is
+//reached: wait for the initial sequence, then keep running to the right with
+//jumps of different lengths and some stops
+static const SimInputRun bench_input[] = {
+	{ 240, 0 },
+	{ 90,  INPUT_RIGHT },
+	{ 12,  INPUT_RIGHT | INPUT_JUMP },
+	{ 60,  INPUT_RIGHT },
+	{ 30,  INPUT_RIGHT | INPUT_JUMP },
+	{ 20,  0 },
+	{ 40,  INPUT_LEFT },
+	{ 8,   INPUT_LEFT | INPUT_JUMP },
+	{ 120, INPUT_RIGHT },
+	{ 4,   INPUT_JUMP },
+};
+
+static PlayCtx bench_ctx;
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+static bool bench_level(const char* path, long ticks, double* tick_ns,
+	BenchResult* result, bool first);
+static double run_ticks(const char* path, long ticks, double* tick_ns);
+static int input_at(long tick);
+static double time_ns();
+static int compare_ns(const void* a, const void* b);
+static bool write_results(const char* path, BenchResult* results, int count);
+static bool compare_baseline(const char* path, BenchResult* results, int count,
+	double threshold);
+
+//------------------------------------------------------------------------------
+
+//Runs the benchmark on the levels found in a directory, writes the results to
+//a file, and compares them against a baseline file (if not NULL), returning
+//false on error or if a regression beyond the threshold (a percentage) is found
+bool bench_run(const char* levels_dir, const char* output_path,
+	const char* baseline_path, double threshold, long ticks)
+{
+	BenchResult results[(DIFFICULTY_MAX + 1) * BENCH_MAX_LEVELS];
+	char paths[(DIFFICULTY_MAX + 1) * BENCH_MAX_LEVELS][512];
+	const char difficulty_chars[] = "nhs";
+	double* tick_ns;
+	int count = 0;
+	bool ok = true;
+	int rep;
+	int d, i;
+
+	for (d = 0; d <= DIFFICULTY_MAX; d++) {
+		for (i = 1; i <= data_difficulty_num_levels[d]; i++) {
+			snprintf(paths[count], ARRAY_LENGTH(paths[count]), "%s/level%d%c",
+				levels_dir, i, difficulty_chars[d]);
+
+			count++;
+		}
+	}
+
+	tick_ns = malloc(ticks * sizeof(double));
+	if (tick_ns == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+
+	//Each repetition goes through all levels, so the ones of a level are
+	//spread over the whole run and a moment of load from other processes
+	//cannot affect all of them
+	for (rep = 0; rep < BENCH_NUM_REPEATS; rep++) {
+		for (i = 0; i < count; i++) {
+			if (!bench_level(paths[i], ticks, tick_ns, &results[i], rep == 0)) {
+				free(tick_ns);
+				play_free(&bench_ctx);
+				return false;
+			}
+		}
+	}
+
+	free(tick_ns);
+	play_free(&bench_ctx);
+
+	printf("%-10s %10s %12s %10s %10s %12s\n",
+		"level", "ticks", "ns_per_tick", "p50_ns", "p99_ns", "loads_per_sec");
+
+	for (i = 0; i < count; i++) {
+		BenchResult* r = &results[i];
+
+		printf("%-10s %10ld %12.1f %10.0f %10.0f %12.1f\n", r->level,
+			r->ticks, r->ns_per_tick, r->p50_ns, r->p99_ns,
+			r->loads_per_sec);
+	}
+
+	if (!write_results(output_path, results, count)) {
+		fprintf(stderr, "Unable to write results: %s\n", output_path);
+		return false;
+	}
+
+	if (baseline_path != NULL) {
+		ok = compare_baseline(baseline_path, results, count, threshold);
+	}
+
+	return ok;
+}
+
+//------------------------------------------------------------------------------
+
+//Measures the loading time of a level and the time taken by each of a number
+//of ticks (using tick_ns[] as room for the time of each), keeping the best
+//results of all repetitions to reduce the noise from other processes, with
+//first being true for the first repetition
+static bool bench_level(const char* path, long ticks, double* tick_ns,
+	BenchResult* result, bool first)
+{
+	double start_time = sim_time_ms();
+	double elapsed_ms;
+	double loads_per_sec;
+	double ns_per_tick;
+	long num_loads = 0;
+
+	if (first) {
+		snprintf(result->level, ARRAY_LENGTH(result->level), "%s",
+			file_from_path(path));
+
+		result->ticks = ticks;
+		result->ns_per_tick = 0;
+		result->loads_per_sec = 0;
+	}
+
+	//Loading
+	do {
+		int err = sim_start_level(&bench_ctx, path);
+
+		if (err != LVLERR_NONE) {
+			sim_show_level_error(err, path);
+			return false;
+		}
+
+		num_loads++;
+		elapsed_ms = sim_time_ms() - start_time;
+	} while (elapsed_ms < BENCH_MIN_LOAD_MS);
+
+	loads_per_sec = num_loads / (elapsed_ms / 1000.0);
+	if (loads_per_sec > result->loads_per_sec) {
+		result->loads_per_sec = loads_per_sec;
+	}
+
+	//Ticks
+	ns_per_tick = run_ticks(path, ticks, tick_ns);
+	if (first || ns_per_tick < result->ns_per_tick) {
+		qsort(tick_ns, ticks, sizeof(double), compare_ns);
+
+		result->ns_per_tick = ns_per_tick;
+		result->p50_ns = tick_ns[ticks / 2];
+		result->p99_ns = tick_ns[ticks * 99 / 100];
+	}
+
+	return true;
+}
+
+//Runs a number of ticks of the level that has just been loaded, restarting it
+//whenever it finishes, storing the time taken by each tick in tick_ns[] and
+//returning the mean
+static double run_ticks(const char* path, long ticks, double* tick_ns)
+{
+	double total_ns = 0;
+	long t;
+
+	for (t = 0; t < ticks; t++) {
+		PlayEvent evt;
+		double tick_start;
+
+		if (bench_ctx.sequence_step == SEQ_FINISHED) {
+			sim_start_level(&bench_ctx, path);
+		}
+
+		play_set_input(&bench_ctx, input_at(t));
+
+		tick_start = time_ns();
+		play_update(&bench_ctx, PLAY_DT);
+		tick_ns[t] = time_ns() - tick_start;
+
+		total_ns += tick_ns[t];
+
+		//There is no audio or UI to take the events
+		while (play_take_event(&bench_ctx, &evt));
+	}
+
+	return total_ns / ticks;
+}
+
+//Gets the input state of a tick from the fixed input
+static int input_at(long tick)
+{
+	long period = 0;
+	int i;
+
+	for (i = 0; i < (int)ARRAY_LENGTH(bench_input); i++) {
+		period += bench_input[i].num_ticks;
+	}
+
+	//The initial wait is not repeated
+	if (tick >= period) {
+		long wait = bench_input[0].num_ticks;
+
+		tick = wait + (tick - period) % (period - wait);
+	}
+
+	for (i = 0; i < (int)ARRAY_LENGTH(bench_input); i++) {
+		if (tick < bench_input[i].num_ticks) break;
+		tick -= bench_input[i].num_ticks;
+	}
+
+	return bench_input[i].input;
+}
+
+static double time_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_ns(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+
+	return (x > y) - (x < y);
+}
+
+//Writes the results as tab-separated values, one line per level
+static bool write_results(const char* path, BenchResult* results, int count)
+{
+	FILE* f;
+	int i;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		return false;
+	}
+
+	fprintf(f, "level\tticks\tns_per_tick\tp50_ns\tp99_ns\tloads_per_sec\n");
+
+	for (i = 0; i < count; i++) {
+		BenchResult* r = &results[i];
+
+		fprintf(f, "%s\t%ld\t%.1f\t%.0f\t%.0f\t%.1f\n", r->level, r->ticks,
+			r->ns_per_tick, r->p50_ns, r->p99_ns, r->loads_per_sec);
+	}
+
+	return (fclose(f) == 0);
+}
+
+//Reads a file written by write_results() and reports the levels whose time per
+//tick or loading rate got worse by more than the threshold (a percentage),
+//returning false if there is any
+static bool compare_baseline(const char* path, BenchResult* results, int count,
+	double threshold)
+{
+	FILE* f;
+	char line[256];
+	int num_regressions = 0;
+	int num_compared = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open baseline: %s\n", path);
+		return false;
+	}
+
+	printf("\nChange in time against %s (threshold: %.1f%%)\n", path,
+		threshold);
+
+	while (fgets(line, ARRAY_LENGTH(line), f) != NULL) {
+		BenchResult base;
+		double tick_change, load_change; //Percentages of time increase
+		int i;
+
+		if (sscanf(line, "%15s %ld %lf %lf %lf %lf", base.level, &base.ticks,
+				&base.ns_per_tick, &base.p50_ns, &base.p99_ns,
+				&base.loads_per_sec) != 6) {
+
+			//Header or invalid line
+			continue;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (strcmp(results[i].level, base.level) == 0) break;
+		}
+
+		if (i == count) continue;
+
+		tick_change = (results[i].ns_per_tick / base.ns_per_tick - 1) * 100;
+		load_change = (base.loads_per_sec / results[i].loads_per_sec - 1) * 100;
+
+		printf("%-10s tick %+7.1f%%  load %+7.1f%%", base.level, tick_change,
+			load_change);
+
+		if (tick_change > threshold || load_change > threshold) {
+			printf("  REGRESSION");
+			num_regressions++;
+		}
+
+		printf("\n");
+		num_compared++;
+	}
+
+	fclose(f);
+
+	if (num_compared == 0) {
+		fprintf(stderr, "No levels in common with the baseline: %s\n", path);
+		return false;
+	}
+
+	if (num_regressions > 0) {
+		printf("%d regression(s) found\n", num_regressions);
+		return false;
+	}
+
+	printf("No regressions found\n");
+
+	return true;
+}
+
@@ -0,0 +1,554 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * server.c
+ *
+ * Description:
+ * Environment server mode of the headless simulation program, which hosts a
+ * number of sessions of a level and steps all of them in parallel whenever a
+ * client (such as a training program) writes a batch of actions to shared
+ * memory, writing the observations back in place (only supported on Linux, as
+ * it relies on futexes)
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "../defs.h"
+#include "avbsim.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------
+
+//Number of times a sequence number is checked before sleeping on it, which
+//avoids the cost of a system call when the next batch comes right away
+#define SERVER_SPIN_COUNT 4000
+
+//How long the server sleeps at most while waiting for a batch, which is only a
+//safeguard for noticing when it is interrupted (a signal arriving right before
+//the sleep would otherwise not end it), as the client wakes the server up after
+//each batch
+#define SERVER_WAIT_TIMEOUT_MS 100
+
+//------------------------------------------------------------------------------
+
+//From play.c
+void play_free(PlayCtx* ctx);
+
+//From sim.c
+int sim_start_level(PlayCtx* ctx, const char* path);
+void sim_show_level_error(int err, const char* path);
+
+//From avbsim.c
+AvbSim* avbsim_create_from_ctx(const PlayCtx* ctx);
+
+//------------------------------------------------------------------------------
+
+static const char* shm_name;
+static uint8_t* shm;
+static size_t shm_size;
+static AvbEnvHeader* header;
+static int32_t* actions;
+static AvbEnvObs* observations;
+
+//Session in the initial state of the level, copied over the others to reset
+//them
+static AvbSim* start;
+
+static AvbSim** envs;
+static int num_envs;
+
+static pthread_t* threads;
+static int num_workers;
+static int num_threads_started;
+
+//Incremented by the calling thread to have the workers step a batch, and
+//decremented by each worker as it finishes its share
+static uint32_t batch_seq;
+static uint32_t workers_busy;
+static bool stopping;
+
+static volatile sig_atomic_t interrupted;
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+static bool create_shm(int action_repeat, bool auto_reset, int obs_range);
+static bool create_envs(const char* level_path);
+static bool start_workers();
+static void run_batches();
+static void* worker_main(void* arg);
+static void step_envs(int worker);
+static void step_env(int index);
+static void write_obs(AvbEnvObs* dst, const AvbSimObs* src);
+static bool wait_change(uint32_t* addr, uint32_t value, bool shared);
+static void futex_wait(uint32_t* addr, uint32_t value, bool shared,
+	bool timeout);
+static void futex_wake(uint32_t* addr, bool shared);
+static void on_signal(int sig);
+static void cleanup();
+
+//------------------------------------------------------------------------------
+
+bool server_run(const char* name, const char* level_path, int count,
+	int num_threads, int action_repeat, bool auto_reset, int obs_range)
+{
+	struct sigaction action;
+
+	shm_name = name;
+	num_envs = count;
+
+	if (!create_envs(level_path)) {
+		cleanup();
+		return false;
+	}
+
+	if (!create_shm(action_repeat, auto_reset, obs_range)) {
+		fprintf(stderr, "Unable to create the shared memory: %s\n", name);
+		cleanup();
+		return false;
+	}
+
+	//Use one thread per CPU core by default
+	if (num_threads <= 0) {
+		num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_threads <= 0) num_threads = 1;
+	}
+	if (num_threads > num_envs) {
+		num_threads = num_envs;
+	}
+
+	num_workers = num_threads;
+	if (!start_workers()) {
+		fprintf(stderr, "Unable to start the worker threads\n");
+		cleanup();
+		return false;
+	}
+
+	//Without SA_RESTART, a signal ends the sleep on request_seq right away
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	printf("Serving %d sessions of %s on %s with %d threads\n", num_envs,
+		level_path, name, num_workers);
+	fflush(stdout);
+
+	run_batches();
+
+	cleanup();
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+//Creates the shared memory and writes the header and the observations of the
+//initial state to it
+static bool create_shm(int action_repeat, bool auto_reset, int obs_range)
+{
+	size_t actions_offset = 64;
+	size_t obs_offset;
+	AvbSimObs obs;
+	int fd;
+	int i;
+
+	//Keep the observations away from the cache lines of the actions
+	obs_offset = actions_offset + num_envs * sizeof(int32_t);
+	obs_offset = (obs_offset + 63) & ~(size_t)63;
+	shm_size = obs_offset + num_envs * sizeof(AvbEnvObs);
+
+	fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) return false;
+
+	if (ftruncate(fd, shm_size) != 0) {
+		close(fd);
+		shm_unlink(shm_name);
+		return false;
+	}
+
+	shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (shm == MAP_FAILED) {
+		shm = NULL;
+		shm_unlink(shm_name);
+		return false;
+	}
+
+	header = (AvbEnvHeader*)shm;
+	actions = (int32_t*)(shm + actions_offset);
+	observations = (AvbEnvObs*)(shm + obs_offset);
+
+	header->version = AVBENV_VERSION;
+	header->num_envs = num_envs;
+	header->obs_size = sizeof(AvbEnvObs);
+	header->actions_offset = actions_offset;
+	header->obs_offset = obs_offset;
+	header->action_repeat = action_repeat;
+	header->auto_reset = auto_reset;
+	header->obs_range = obs_range;
+
+	avbsim_observe(start, obs_range, &obs);
+	for (i = 0; i < num_envs; i++) {
+		write_obs(&observations[i], &obs);
+	}
+
+	__atomic_store_n(&header->magic, AVBENV_MAGIC, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+//Loads the level once and copies it to every session
+static bool create_envs(const char* level_path)
+{
+	PlayCtx* ctx;
+	int err;
+	int i;
+
+	//A gameplay context must be zero-initialized before its first use
+	ctx = calloc(1, sizeof(PlayCtx));
+	envs = calloc(num_envs, sizeof(AvbSim*));
+	if (ctx == NULL || envs == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		free(ctx);
+		return false;
+	}
+
+	err = sim_start_level(ctx, level_path);
+	if (err != LVLERR_NONE) {
+		sim_show_level_error(err, level_path);
+		play_free(ctx);
+		free(ctx);
+		return false;
+	}
+
+	//Training has no use for the bus arriving at the start of the level
+	ctx->skip_initial_sequence = true;
+
+	start = avbsim_create_from_ctx(ctx);
+	play_free(ctx);
+	free(ctx);
+
+	if (start == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+
+	for (i = 0; i < num_envs; i++) {
+		envs[i] = avbsim_clone(start);
+		if (envs[i] == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool start_workers()
+{
+	sigset_t signals, old_signals;
+	bool ok = true;
+	int i;
+
+	threads = calloc(num_workers, sizeof(pthread_t));
+	if (threads == NULL) return false;
+
+	//The workers inherit a mask that blocks SIGINT and SIGTERM, so they are
+	//delivered to the calling thread, whose sleep they cut short
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+	//The calling thread acts as the first worker
+	for (i = 1; i < num_workers; i++) {
+		if (pthread_create(&threads[i], NULL, worker_main, (void*)(intptr_t)i) != 0) {
+			ok = false;
+			break;
+		}
+
+		num_threads_started = i;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+	return ok;
+}
+
+//Steps all sessions each time the client increments request_seq, until it
+//asks the server to stop or the program is interrupted
+static void run_batches()
+{
+	uint32_t seq = 0;
+
+	for (;;) {
+		if (!wait_change(&header->request_seq, seq, true)) break;
+
+		seq = __atomic_load_n(&header->request_seq, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&header->shutdown, __ATOMIC_ACQUIRE)) break;
+
+		//The atomic operations on batch_seq and workers_busy also make the
+		//actions visible to the workers and their observations to the client
+		__atomic_store_n(&workers_busy, num_workers, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&batch_seq, 1, __ATOMIC_RELEASE);
+		if (num_workers > 1) futex_wake(&batch_seq, false);
+
+		step_envs(0);
+
+		if (__atomic_sub_fetch(&workers_busy, 1, __ATOMIC_ACQ_REL) != 0) {
+			uint32_t busy;
+
+			while ((busy = __atomic_load_n(&workers_busy, __ATOMIC_ACQUIRE)) != 0) {
+				wait_change(&workers_busy, busy, false);
+			}
+		}
+
+		__atomic_store_n(&header->response_seq, seq, __ATOMIC_RELEASE);
+		futex_wake(&header->response_seq, true);
+	}
+}
+
+static void* worker_main(void* arg)
+{
+	int worker = (int)(intptr_t)arg;
+	uint32_t seq = 0;
+
+	for (;;) {
+		wait_change(&batch_seq, seq, false);
+		seq = __atomic_load_n(&batch_seq, __ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) break;
+
+		step_envs(worker);
+
+		if (__atomic_sub_fetch(&workers_busy, 1, __ATOMIC_ACQ_REL) == 0) {
+			futex_wake(&workers_busy, false);
+		}
+	}
+
+	return NULL;
+}
+
+//Steps the sessions assigned to a worker, which are split evenly, as all of
+//them take about the same time
+static void step_envs(int worker)
+{
+	int first = (int)((int64_t)num_envs * worker / num_workers);
+	int end = (int)((int64_t)num_envs * (worker + 1) / num_workers);
+	int i;
+
+	for (i = first; i < end; i++) {
+		step_env(i);
+	}
+}
+
+static void step_env(int index)
+{
+	AvbSim* sim = envs[index];
+	AvbEnvObs* dst = &observations[index];
+	int action = actions[index];
+	AvbSimObs obs;
+
+	dst->done = false;
+	dst->ended_goal_reached = false;
+	dst->ended_time_up = false;
+	dst->ended_score = 0;
+
+	if (action == AVBENV_ACTION_RESET) {
+		avbsim_copy(sim, start);
+		avbsim_observe(sim, header->obs_range, &obs);
+		write_obs(dst, &obs);
+		return;
+	}
+
+	avbsim_step(sim, header->action_repeat, action);
+	avbsim_observe(sim, header->obs_range, &obs);
+
+	if (obs.goal_reached || obs.time_up) {
+		dst->done = true;
+		dst->ended_goal_reached = obs.goal_reached;
+		dst->ended_time_up = obs.time_up;
+		dst->ended_score = obs.score;
+
+		if (header->auto_reset) {
+			avbsim_copy(sim, start);
+			avbsim_observe(sim, header->obs_range, &obs);
+		}
+	}
+
+	write_obs(dst, &obs);
+}
+
+static void write_obs(AvbEnvObs* dst, const AvbSimObs* src)
+{
+	int i;
+
+	dst->ticks = src->ticks;
+	dst->player_left = src->player_left;
+	dst->player_right = src->player_right;
+	dst->player_top = src->player_top;
+	dst->player_bottom = src->player_bottom;
+	dst->player_xvel = src->player_xvel;
+	dst->player_yvel = src->player_yvel;
+	dst->player_state = src->player_state;
+	dst->player_on_floor = src->player_on_floor;
+	dst->score = src->score;
+	dst->time = src->time;
+	dst->coins_collected = src->coins_collected;
+	dst->falls = src->falls;
+
+	dst->num_objs = src->num_objs;
+	if (dst->num_objs > AVBENV_MAX_OBJS) {
+		dst->num_objs = AVBENV_MAX_OBJS;
+	}
+
+	for (i = 0; i < dst->num_objs; i++) {
+		dst->objs[i].type = src->objs[i].type;
+		dst->objs[i].x = src->objs[i].x;
+		dst->objs[i].y = src->objs[i].y;
+	}
+}
+
+//Waits until the value at an address is no longer the given one, spinning for
+//a while before sleeping, and returns false if the program was interrupted
+static bool wait_change(uint32_t* addr, uint32_t value, bool shared)
+{
+	int i;
+
+	for (i = 0; i < SERVER_SPIN_COUNT; i++) {
+		if (__atomic_load_n(addr, __ATOMIC_ACQUIRE) != value) return true;
+	}
+
+	while (__atomic_load_n(addr, __ATOMIC_ACQUIRE) == value) {
+		//Only the waits on the client time out and can be interrupted, as
+		//the others always end once the workers finish
+		if (shared && interrupted) return false;
+
+		futex_wait(addr, value, shared, shared);
+	}
+
+	return true;
+}
+
+//Sleeps until woken up if the value at an address is still the given one, with
+//shared being false for addresses only used within this process
+static void futex_wait(uint32_t* addr, uint32_t value, bool shared,
+	bool timeout)
+{
+	struct timespec ts;
+	int op = shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = SERVER_WAIT_TIMEOUT_MS * 1000000L;
+
+	syscall(SYS_futex, addr, op, value, timeout ? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t* addr, bool shared)
+{
+	int op = shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE;
+
+	syscall(SYS_futex, addr, op, INT_MAX, NULL, NULL, 0);
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+
+	interrupted = 1;
+}
+
+static void cleanup()
+{
+	int i;
+
+	if (num_threads_started > 0) {
+		__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&batch_seq, 1, __ATOMIC_RELEASE);
+		futex_wake(&batch_seq, false);
+
+		for (i = 1; i <= num_threads_started; i++) {
+			pthread_join(threads[i], NULL);
+		}
+	}
+
+	if (shm != NULL) {
+		munmap(shm, shm_size);
+		shm_unlink(shm_name);
+	}
+
+	if (envs != NULL) {
+		for (i = 0; i < num_envs; i++) {
+			avbsim_destroy(envs[i]);
+		}
+	}
+
+	avbsim_destroy(start);
+	free(envs);
+	free(threads);
+
+	shm = NULL;
+	envs = NULL;
+	start = NULL;
+	threads = NULL;
+	num_threads_started = 0;
+}
+
+#else //__linux__
+
+bool server_run(const char* name, const char* level_path, int count,
+	int num_threads, int action_repeat, bool auto_reset, int obs_range)
+{
+	(void)name;
+	(void)level_path;
+	(void)count;
+	(void)num_threads;
+	(void)action_repeat;
+	(void)auto_reset;
+	(void)obs_range;
+
+	fprintf(stderr, "The environment server is only supported on Linux\n");
+
+	return false;
+}
+
+#endif //__linux__
@@ -0,0 +1,1092 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * sim.c
+ *
+ * Description:
+ * Headless simulation program, which runs the gameplay logic of a level as fast
+ * as possible, without a window, graphics, or audio, and with the player's
+ * input read from a script
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "../defs.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------
+
+//Default maximum number of ticks to run (enough for the level's 90 seconds
+//plus the initial and goal sequences)
+#define SIM_DEFAULT_MAX_TICKS (150 * PLAY_TICK_RATE)
+
+//Default percentage by which the benchmark results can get worse than the
+//baseline before being reported as a regression
+#define SIM_DEFAULT_BENCH_THRESHOLD 10
+
+//Default horizontal distance (in pixels) from the player character within
+//which the environment server observes objects
+#define SIM_DEFAULT_OBS_RANGE 240
+
+//------------------------------------------------------------------------------
+
+//From play.c
+void play_clear(PlayCtx* ctx);
+void play_set_input(PlayCtx* ctx, int input_held);
+void play_update(PlayCtx* ctx, float dt);
+void play_adapt_to_screen_size(PlayCtx* ctx, int vscreen_width);
+void play_free(PlayCtx* ctx);
+bool play_take_event(PlayCtx* ctx, PlayEvent* evt);
+void play_state_hash(const PlayCtx* ctx, StateHash* hash);
+
+//From replay.c
+void replay_begin(Replay* rp, const char* level, int difficulty, int level_num,
+	bool skip_initial_sequence, int vscreen_width, int score);
+bool replay_record(Replay* rp, int input);
+bool replay_hash_due(const Replay* rp);
+bool replay_record_hash(Replay* rp, const StateHash* hash);
+bool replay_save(Replay* rp, const char* path);
+bool replay_load(Replay* rp, const char* path);
+void replay_free(Replay* rp);
+
+//From levelload.c
+int levelload_load(PlayCtx* ctx, const char* filename);
+
+//From util.c
+const char* file_from_path(const char* path);
+
+//From data.c
+extern const char* data_playhash_part_names[];
+
+//From renderer.c
+bool renderer_init(DisplayParams* dp, Config* cfg, PlayCtx* pctx, MenuCtx* mctx);
+bool renderer_load_gfx();
+void renderer_draw_pixels(uint32_t* pixels, int screen_type, int wipe_value);
+void renderer_cleanup();
+
+//From avbsim.c
+void avbsim_setup_level(PlayCtx* ctx, int level_num, int difficulty);
+
+//From batch.c
+bool batch_run(const char* manifest_path, const char* output_path,
+	const char* baseline_path, int num_threads, long max_ticks);
+
+//From bench.c
+bool bench_run(const char* levels_dir, const char* output_path,
+	const char* baseline_path, double threshold, long ticks);
+
+//From server.c
+bool server_run(const char* name, const char* level_path, int count,
+	int num_threads, int action_repeat, bool auto_reset, int obs_range);
+
+//------------------------------------------------------------------------------
+
+//Command-line parameters
+static struct {
+	bool error;
+	bool help;
+	const char* level_path;
+	const char* script_path;
+	const char* batch_path;
+	const char* bench_dir;
+	const char* replay_path;
+	const char* record_path;
+	const char* baseline_path;
+	const char* output_path;
+	const char* screenshot_path;
+	const char* serve_name;
+	double threshold;
+	int hash_interval;
+	long max_ticks;
+	int num_runs;
+	int num_threads;
+	int num_envs;
+	int action_repeat;
+	int obs_range;
+	bool no_auto_reset;
+} cli;
+
+static PlayCtx play_session;
+
+static Replay replay;
+
+//Level file used in replay mode if not given in the command line
+static char replay_level_path[512];
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+bool sim_load_script(const char* path, SimScript* script);
+void sim_free_script(SimScript* script);
+int sim_start_level(PlayCtx* ctx, const char* path);
+void sim_show_level_error(int err, const char* path);
+void sim_run(PlayCtx* ctx, const SimScript* script, long max_ticks,
+	SimResult* result);
+uint32_t sim_state_hash(const PlayCtx* ctx);
+double sim_time_ms();
+static void parse_cli(int argc, char* argv[]);
+static void show_help();
+static void run_tick(PlayCtx* ctx, int input, SimResult* result);
+static void get_result(PlayCtx* ctx, long ticks, SimResult* result);
+static bool run_replay();
+static bool play_back(PlayCtx* ctx, SimResult* result);
+static bool compare_hashes(const StateHash* recorded, const StateHash* hash,
+	long tick);
+static bool record_script(const SimScript* script, SimResult* result);
+static bool write_screenshot(PlayCtx* ctx);
+static bool parse_keys(const char* str, int* input);
+static void show_result(SimResult* result, double elapsed_ms);
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	PlayCtx* ctx = &play_session;
+	SimScript script = { NULL, 0 };
+	SimResult result;
+	double start_time;
+	double elapsed_ms;
+	int err;
+	int i;
+
+	parse_cli(argc, argv);
+
+	if (cli.error) {
+		show_help();
+		return 1;
+	} else if (cli.help) {
+		show_help();
+		return 0;
+	}
+
+	if (cli.batch_path != NULL) {
+		bool ok = batch_run(cli.batch_path, cli.output_path, cli.baseline_path,
+			cli.num_threads, cli.max_ticks);
+
+		return ok ? 0 : 1;
+	}
+
+	if (cli.serve_name != NULL) {
+		bool ok = server_run(cli.serve_name, cli.level_path, cli.num_envs,
+			cli.num_threads, cli.action_repeat, !cli.no_auto_reset,
+			cli.obs_range);
+
+		return ok ? 0 : 1;
+	}
+
+	if (cli.bench_dir != NULL) {
+		const char* output_path = cli.output_path;
+		bool ok;
+
+		if (output_path == NULL) output_path = "bench_output.txt";
+
+		ok = bench_run(cli.bench_dir, output_path, cli.baseline_path,
+			cli.threshold, cli.max_ticks);
+
+		return ok ? 0 : 1;
+	}
+
+	if (cli.replay_path != NULL) {
+		bool ok = run_replay();
+
+		replay_free(&replay);
+		play_free(ctx);
+
+		return ok ? 0 : 1;
+	}
+
+	if (cli.script_path != NULL && !sim_load_script(cli.script_path, &script)) {
+		fprintf(stderr, "Invalid input script: %s\n", cli.script_path);
+		return 1;
+	}
+
+	start_time = sim_time_ms();
+
+	for (i = 0; i < cli.num_runs; i++) {
+		err = sim_start_level(ctx, cli.level_path);
+		if (err != LVLERR_NONE) {
+			sim_show_level_error(err, cli.level_path);
+			return 1;
+		}
+
+		sim_run(ctx, &script, cli.max_ticks, &result);
+	}
+
+	elapsed_ms = sim_time_ms() - start_time;
+
+	show_result(&result, elapsed_ms);
+
+	err = 0;
+
+	if (cli.screenshot_path != NULL && !write_screenshot(ctx)) {
+		err = 1;
+	}
+
+	if (cli.record_path != NULL && !record_script(&script, &result)) {
+		fprintf(stderr, "Unable to write the input recording: %s\n",
+			cli.record_path);
+
+		err = 1;
+	}
+
+	sim_free_script(&script);
+	replay_free(&replay);
+	play_free(ctx);
+
+	return err;
+}
+
+//Reads an input script, in which each line contains a number of ticks followed
+//by the keys held during them
+bool sim_load_script(const char* path, SimScript* script)
+{
+	FILE* f;
+	char line[256];
+	int capacity = 0;
+
+	script->runs = NULL;
+	script->num_runs = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return false;
+	}
+
+	while (fgets(line, ARRAY_LENGTH(line), f) != NULL) {
+		char keys[16];
+		int ticks;
+		int input;
+		int num_fields;
+
+		//Skip comments
+		if (line[0] == '#') continue;
+
+		num_fields = sscanf(line, "%d %15s", &ticks, keys);
+
+		//Skip empty lines
+		if (num_fields == EOF) continue;
+
+		if (num_fields != 2 || ticks < 0 || !parse_keys(keys, &input)) {
+			fclose(f);
+			sim_free_script(script);
+			return false;
+		}
+
+		if (script->num_runs >= capacity) {
+			SimInputRun* runs;
+
+			capacity = (capacity == 0) ? 64 : capacity * 2;
+			runs = realloc(script->runs, capacity * sizeof(SimInputRun));
+
+			if (runs == NULL) {
+				fclose(f);
+				sim_free_script(script);
+				return false;
+			}
+
+			script->runs = runs;
+		}
+
+		script->runs[script->num_runs].num_ticks = ticks;
+		script->runs[script->num_runs].input = input;
+		script->num_runs++;
+	}
+
+	fclose(f);
+
+	return true;
+}
+
+void sim_free_script(SimScript* script)
+{
+	free(script->runs);
+	script->runs = NULL;
+	script->num_runs = 0;
+}
+
+//Clears the gameplay context and loads a level into it, in the same way as
+//start_level() in main.c
+//
+//The level number and difficulty are determined from the filename (example:
+//"level3h" refers to level 3 on hard difficulty)
+int sim_start_level(PlayCtx* ctx, const char* path)
+{
+	const char* filename = file_from_path(path);
+	char diffch = '\0';
+	int level_num = 0;
+	int difficulty = DIFFICULTY_NORMAL;
+	int err;
+
+	if (sscanf(filename, "level%d%c", &level_num, &diffch) == 2) {
+		switch (diffch) {
+			case 'n': difficulty = DIFFICULTY_NORMAL; break;
+			case 'h': difficulty = DIFFICULTY_HARD;   break;
+			case 's': difficulty = DIFFICULTY_SUPER;  break;
+		}
+	}
+
+	ctx->score = 0;
+	play_clear(ctx);
+
+	err = levelload_load(ctx, path);
+	if (err != LVLERR_NONE) {
+		return err;
+	}
+
+	avbsim_setup_level(ctx, level_num, difficulty);
+
+	return LVLERR_NONE;
+}
+
+void sim_show_level_error(int err, const char* path)
+{
+	switch (err) {
+		case LVLERR_CANNOT_OPEN:
+			fprintf(stderr, "Cannot open level file: ");
+			break;
+
+		case LVLERR_TOO_LARGE:
+			fprintf(stderr, "Level file too large: ");
+			break;
+
+		case LVLERR_INVALID:
+			fprintf(stderr, "Invalid level file: ");
+			break;
+	}
+
+	fprintf(stderr, "%s\n", path);
+}
+
+//Runs a level that has already been loaded until it finishes or the maximum
+//number of ticks is reached
+void sim_run(PlayCtx* ctx, const SimScript* script, long max_ticks,
+	SimResult* result)
+{
+	int run_index = 0;
+	int run_ticks = 0;
+	long ticks;
+
+	result->coins_collected = 0;
+	result->falls = 0;
+
+	for (ticks = 0; ticks < max_ticks; ticks++) {
+		int input = 0;
+
+		//Get the input state from the script
+		while (run_index < script->num_runs) {
+			if (run_ticks < script->runs[run_index].num_ticks) {
+				input = script->runs[run_index].input;
+				run_ticks++;
+				break;
+			}
+
+			run_index++;
+			run_ticks = 0;
+		}
+
+		run_tick(ctx, input, result);
+
+		if (ctx->sequence_step == SEQ_FINISHED) {
+			ticks++;
+			break;
+		}
+	}
+
+	get_result(ctx, ticks, result);
+}
+
+//Computes a single hash of the gameplay state, which allows checking whether
+//two runs ended up in exactly the same state, by folding together the hashes of
+//its parts computed by play_state_hash() (the same ones stored in replays)
+uint32_t sim_state_hash(const PlayCtx* ctx)
+{
+	StateHash state;
+	uint32_t hash = 2166136261u;
+	int i;
+
+	play_state_hash(ctx, &state);
+
+	for (i = 0; i < NUM_PLAYHASH_PARTS; i++) {
+		hash ^= state.parts[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+double sim_time_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+//------------------------------------------------------------------------------
+
+static void parse_cli(int argc, char* argv[])
+{
+	int i;
+
+	cli.max_ticks = SIM_DEFAULT_MAX_TICKS;
+	cli.num_runs = 1;
+	cli.num_threads = 0;
+	cli.threshold = SIM_DEFAULT_BENCH_THRESHOLD;
+	cli.hash_interval = REPLAY_HASH_INTERVAL;
+	cli.num_envs = 1;
+	cli.action_repeat = 1;
+	cli.obs_range = SIM_DEFAULT_OBS_RANGE;
+
+	for (i = 1; i < argc; i++) {
+		const char* a = argv[i];
+
+		if (strcmp(a, "-h") == 0 || strcmp(a, "--help") == 0) {
+			cli.help = true;
+			return;
+		} else if (strcmp(a, "--max-ticks") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.max_ticks = atol(argv[i]);
+			if (cli.max_ticks <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--runs") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.num_runs = atoi(argv[i]);
+			if (cli.num_runs <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--batch") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.batch_path = argv[i];
+		} else if (strcmp(a, "--bench") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.bench_dir = argv[i];
+		} else if (strcmp(a, "--replay") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.replay_path = argv[i];
+		} else if (strcmp(a, "--record") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.record_path = argv[i];
+		} else if (strcmp(a, "--screenshot") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.screenshot_path = argv[i];
+		} else if (strcmp(a, "--hash-interval") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.hash_interval = atoi(argv[i]);
+			if (cli.hash_interval < 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--baseline") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.baseline_path = argv[i];
+		} else if (strcmp(a, "--threshold") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.threshold = atof(argv[i]);
+			if (cli.threshold <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--threads") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.num_threads = atoi(argv[i]);
+			if (cli.num_threads <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--serve") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.serve_name = argv[i];
+		} else if (strcmp(a, "--envs") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.num_envs = atoi(argv[i]);
+			if (cli.num_envs <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--action-repeat") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.action_repeat = atoi(argv[i]);
+			if (cli.action_repeat <= 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--obs-range") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.obs_range = atoi(argv[i]);
+			if (cli.obs_range < 0) {
+				cli.error = true;
+				return;
+			}
+		} else if (strcmp(a, "--no-auto-reset") == 0) {
+			cli.no_auto_reset = true;
+		} else if (strcmp(a, "-o") == 0 || strcmp(a, "--output") == 0) {
+			i++;
+			if (i >= argc) {
+				cli.error = true;
+				return;
+			}
+
+			cli.output_path = argv[i];
+		} else if (a[0] == '-' && a[1] != '\0') {
+			cli.error = true;
+			return;
+		} else if (cli.level_path == NULL) {
+			cli.level_path = a;
+		} else if (cli.script_path == NULL) {
+			cli.script_path = a;
+		} else {
+			cli.error = true;
+			return;
+		}
+	}
+
+	//Exactly one of a level file, a batch manifest, a benchmark directory, or a
+	//replay is required (a level file can also be given along with a replay,
+	//but not an input script)
+	if (cli.replay_path != NULL) {
+		if (cli.batch_path != NULL || cli.bench_dir != NULL ||
+				cli.script_path != NULL || cli.record_path != NULL) {
+
+			cli.error = true;
+		}
+	} else if ((cli.level_path != NULL) + (cli.batch_path != NULL) +
+			(cli.bench_dir != NULL) != 1) {
+
+		cli.error = true;
+	}
+
+	//Recording and screenshots are only supported when running a single level
+	if ((cli.record_path != NULL || cli.screenshot_path != NULL) &&
+			(cli.level_path == NULL || cli.replay_path != NULL)) {
+
+		cli.error = true;
+	}
+
+	//A baseline is only used by the benchmark and in batch mode
+	if (cli.baseline_path != NULL && cli.bench_dir == NULL &&
+			cli.batch_path == NULL) {
+		cli.error = true;
+	}
+
+	//The environment server only takes a level file
+	if (cli.serve_name != NULL && (cli.level_path == NULL ||
+			cli.script_path != NULL || cli.replay_path != NULL ||
+			cli.record_path != NULL)) {
+
+		cli.error = true;
+	}
+}
+
+static void show_help()
+{
+	printf(
+		"Alex vs Bus: The Race (headless simulation)\n"
+		"\n"
+		"Usage: alexvsbus-sim [options] <level file> [input script]\n"
+		"       alexvsbus-sim [options] --batch <manifest>\n"
+		"       alexvsbus-sim [options] --bench <levels dir>\n"
+		"       alexvsbus-sim [options] --replay <file> [level file]\n"
+		"       alexvsbus-sim [options] --serve <name> <level file>\n"
+		"\n"
+		"-h, --help               Show this usage information and exit\n"
+		"--max-ticks <ticks>      Stop after the given number of ticks if the level\n"
+		"                         has not finished (default: %d)\n"
+		"--runs <count>           Run the level the given number of times, which is\n"
+		"                         useful for measuring performance (default: 1)\n"
+		"--batch <manifest>       Run all jobs listed in a manifest file, each line\n"
+		"                         of which contains a level file and an input script\n"
+		"--threads <count>        Number of threads used in batch mode and by --serve\n"
+		"                         (default: one per CPU core)\n"
+		"-o, --output <file>      Write the batch results to a file instead of the\n"
+		"                         standard output (or the benchmark results to a\n"
+		"                         file other than bench_output.txt)\n"
+		"--bench <levels dir>     Measure the time taken by each tick and by level\n"
+		"                         loading for every level in a directory, running\n"
+		"                         each for the number of ticks set by --max-ticks\n"
+		"--baseline <file>        Compare the benchmark results against those from\n"
+		"                         a previous run and fail on a regression, or the\n"
+		"                         batch results against earlier ones and fail if\n"
+		"                         any differs\n"
+		"--threshold <percent>    How much slower than the baseline is reported as\n"
+		"                         a regression (default: %d)\n"
+		"--replay <file>          Play back an input recording made by the game or\n"
+		"                         by --record, loading the level file it refers to\n"
+		"                         from the assets directory unless another one is\n"
+		"                         given, and fail if the final score or number of\n"
+		"                         ticks differs from the recorded ones\n"
+		"--record <file>          Write the input used to run a level to a file in\n"
+		"                         the format read by --replay\n"
+		"--hash-interval <ticks>  Number of ticks between the state hashes written\n"
+		"                         by --record, which allow --replay to report where\n"
+		"                         a playback diverged, or 0 for none (default: %d)\n"
+		"--screenshot <file>      Draw the final state of the level in software and\n"
+		"                         write it to a PPM image file, using the gfx.png\n"
+		"                         found in the same directory as the level file\n"
+		"--serve <name>           Host sessions of the level for a training program,\n"
+		"                         stepping all of them whenever it writes a batch of\n"
+		"                         actions to the shared memory with the given name\n"
+		"                         (such as /avb), until it asks the server to stop\n"
+		"--envs <count>           Number of sessions hosted by --serve (default: 1)\n"
+		"--action-repeat <ticks>  Ticks run by each step of --serve (default: 1)\n"
+		"--obs-range <pixels>     Distance from the player character within which\n"
+		"                         --serve observes objects (default: %d)\n"
+		"--no-auto-reset          Do not restart the sessions of --serve that reach\n"
+		"                         the goal or run out of time\n"
+		"\n"
+		"Each line of the input script contains a number of ticks followed by the\n"
+		"keys held during them (\"l\" for left, \"r\" for right, and \"j\" for jump,\n"
+		"in any combination, or \"-\" for none). Lines starting with \"#\" are\n"
+		"ignored. No keys are held after the script ends.\n",
+		SIM_DEFAULT_MAX_TICKS, SIM_DEFAULT_BENCH_THRESHOLD, REPLAY_HASH_INTERVAL,
+		SIM_DEFAULT_OBS_RANGE
+	);
+}
+
+//Runs a single tick with the given input state
+static void run_tick(PlayCtx* ctx, int input, SimResult* result)
+{
+	PlayEvent evt;
+
+	play_set_input(ctx, input);
+	play_update(ctx, PLAY_DT);
+
+	//There is no audio, so the events are only counted
+	while (play_take_event(ctx, &evt)) {
+		if (evt.type == PLAYEVT_COIN_COLLECTED) result->coins_collected++;
+		if (evt.type == PLAYEVT_FALL) result->falls++;
+	}
+}
+
+static void get_result(PlayCtx* ctx, long ticks, SimResult* result)
+{
+	result->ticks = ticks;
+	result->score = ctx->score;
+	result->time = ctx->time;
+	result->goal_reached = ctx->goal_reached;
+	result->time_up = ctx->time_up;
+	result->finished = (ctx->sequence_step == SEQ_FINISHED);
+	result->hash = sim_state_hash(ctx);
+}
+
+//Plays back the input recording passed to --replay
+static bool run_replay()
+{
+	PlayCtx* ctx = &play_session;
+	SimResult result;
+	double start_time;
+	double elapsed_ms;
+	bool ok = true;
+	int err;
+	int i;
+
+	if (!replay_load(&replay, cli.replay_path)) {
+		fprintf(stderr, "Invalid replay file: %s\n", cli.replay_path);
+		return false;
+	}
+
+	if (strcmp(replay.build, REPLAY_BUILD) != 0) {
+		fprintf(stderr, "Warning: replay recorded by a different build (%s)\n",
+			replay.build);
+	}
+
+	if (cli.level_path == NULL) {
+		snprintf(replay_level_path, ARRAY_LENGTH(replay_level_path),
+			"assets/%s", replay.level);
+
+		cli.level_path = replay_level_path;
+	}
+
+	start_time = sim_time_ms();
+
+	for (i = 0; i < cli.num_runs; i++) {
+		err = sim_start_level(ctx, cli.level_path);
+		if (err != LVLERR_NONE) {
+			sim_show_level_error(err, cli.level_path);
+			return false;
+		}
+
+		//Start the level in the same way as when it was recorded
+		ctx->difficulty = replay.difficulty;
+		ctx->level_num = replay.level_num;
+		ctx->skip_initial_sequence = replay.skip_initial_sequence;
+		ctx->score = replay.initial_score;
+		play_adapt_to_screen_size(ctx, replay.vscreen_width);
+
+		if (!play_back(ctx, &result)) {
+			ok = false;
+			break;
+		}
+	}
+
+	elapsed_ms = sim_time_ms() - start_time;
+
+	show_result(&result, elapsed_ms);
+
+	if (!ok) {
+		return false;
+	}
+
+	if (result.ticks != replay.num_ticks) {
+		fprintf(stderr, "Mismatch: level finished after %ld ticks instead of %ld\n",
+			result.ticks, replay.num_ticks);
+
+		ok = false;
+	}
+
+	if (result.score != replay.final_score) {
+		fprintf(stderr, "Mismatch: final score %d instead of %d\n",
+			result.score, replay.final_score);
+
+		ok = false;
+	}
+
+	return ok;
+}
+
+//Runs the level that has just been loaded with the input from the replay,
+//comparing the state hashes stored in it, and reports the first divergence,
+//returning false if there is one
+static bool play_back(PlayCtx* ctx, SimResult* result)
+{
+	long ticks = 0;
+	int next_hash = 0;
+	int i;
+
+	result->coins_collected = 0;
+	result->falls = 0;
+
+	for (i = 0; i < replay.num_runs; i++) {
+		long n;
+
+		for (n = 0; n < replay.runs[i].num_ticks; n++) {
+			run_tick(ctx, replay.runs[i].input, result);
+			ticks++;
+
+			if (replay.hash_interval > 0 && ticks % replay.hash_interval == 0 &&
+					next_hash < replay.num_hashes) {
+
+				StateHash hash;
+
+				play_state_hash(ctx, &hash);
+				if (!compare_hashes(&replay.hashes[next_hash], &hash, ticks)) {
+					get_result(ctx, ticks, result);
+					return false;
+				}
+
+				next_hash++;
+			}
+
+			if (ctx->sequence_step == SEQ_FINISHED) break;
+		}
+
+		if (ctx->sequence_step == SEQ_FINISHED) break;
+	}
+
+	get_result(ctx, ticks, result);
+
+	return true;
+}
+
+//Reports the parts of the gameplay state whose hash after a tick differs from
+//the recorded one, returning false if there is any
+static bool compare_hashes(const StateHash* recorded, const StateHash* hash,
+	long tick)
+{
+	bool first = true;
+	int i;
+
+	for (i = 0; i < NUM_PLAYHASH_PARTS; i++) {
+		if (hash->parts[i] == recorded->parts[i]) continue;
+
+		if (first) {
+			fprintf(stderr, "Divergence after tick %ld", tick);
+			if (replay.hash_interval > 1) {
+				fprintf(stderr, " (last match after tick %ld)",
+					tick - replay.hash_interval);
+			}
+			fprintf(stderr, " in:");
+
+			first = false;
+		}
+
+		fprintf(stderr, " %s", data_playhash_part_names[i]);
+	}
+
+	if (!first) {
+		fprintf(stderr, "\n");
+	}
+
+	return first;
+}
+
+//Runs the level from an input script again, writing the input and the state
+//hashes to the file passed to --record
+static bool record_script(const SimScript* script, SimResult* result)
+{
+	PlayCtx* ctx = &play_session;
+	SimResult rerun = { 0 };
+	int run_index = 0;
+	int run_ticks = 0;
+	long ticks;
+
+	sim_start_level(ctx, cli.level_path);
+
+	replay_begin(&replay, file_from_path(cli.level_path), ctx->difficulty,
+		ctx->level_num, false, VSCREEN_MAX_WIDTH, 0);
+
+	replay.hash_interval = cli.hash_interval;
+
+	for (ticks = 0; ticks < result->ticks; ticks++) {
+		int input = 0;
+
+		//As in sim_run(), no keys are held after the script ends
+		while (run_index < script->num_runs) {
+			if (run_ticks < script->runs[run_index].num_ticks) {
+				input = script->runs[run_index].input;
+				run_ticks++;
+				break;
+			}
+
+			run_index++;
+			run_ticks = 0;
+		}
+
+		if (!replay_record(&replay, input)) {
+			return false;
+		}
+
+		run_tick(ctx, input, &rerun);
+
+		if (replay_hash_due(&replay)) {
+			StateHash hash;
+
+			play_state_hash(ctx, &hash);
+			if (!replay_record_hash(&replay, &hash)) {
+				return false;
+			}
+		}
+	}
+
+	replay.final_score = ctx->score;
+
+	return replay_save(&replay, cli.record_path);
+}
+
+//Draws the final state of the level on a virtual screen of the largest size
+//and writes it to the file passed to --screenshot
+static bool write_screenshot(PlayCtx* ctx)
+{
+	const char* path = cli.screenshot_path;
+	int width  = VSCREEN_MAX_WIDTH;
+	int height = VSCREEN_MAX_HEIGHT;
+	DisplayParams display_params;
+	Config config;
+	uint32_t* pixels;
+	FILE* f;
+	bool ok;
+	int i;
+
+	memset(&config, 0, sizeof(Config));
+	snprintf(config.assets_dir, ARRAY_LENGTH(config.assets_dir), "%.*s",
+		(int)(file_from_path(cli.level_path) - cli.level_path), cli.level_path);
+
+	display_params.vscreen_width  = width;
+	display_params.vscreen_height = height;
+	display_params.win_width  = width;
+	display_params.win_height = height;
+	display_params.scale = 1;
+
+	renderer_init(&display_params, &config, ctx, NULL);
+
+	if (!renderer_load_gfx()) {
+		fprintf(stderr, "Unable to load the graphics: %sgfx.png\n",
+			config.assets_dir);
+		renderer_cleanup();
+		return false;
+	}
+
+	pixels = malloc(width * height * sizeof(uint32_t));
+	if (pixels == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		renderer_cleanup();
+		return false;
+	}
+
+	renderer_draw_pixels(pixels, SCR_PLAY, 0);
+	renderer_cleanup();
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to write the screenshot: %s\n", path);
+		free(pixels);
+		return false;
+	}
+
+	//Binary PPM, which has no alpha channel
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	for (i = 0; i < width * height; i++) {
+		fwrite(&pixels[i], 1, 3, f);
+	}
+
+	ok = !ferror(f);
+	if (fclose(f) != 0) ok = false;
+
+	if (!ok) {
+		fprintf(stderr, "Unable to write the screenshot: %s\n", path);
+	}
+
+	free(pixels);
+
+	return ok;
+}
+
+//Converts a string of keys from the input script into a combination of
+//INPUT_* constants
+static bool parse_keys(const char* str, int* input)
+{
+	int i;
+
+	*input = 0;
+
+	if (strcmp(str, "-") == 0) {
+		return true;
+	}
+
+	for (i = 0; str[i] != '\0'; i++) {
+		switch (str[i]) {
+			case 'l': case 'L': *input |= INPUT_LEFT;  break;
+			case 'r': case 'R': *input |= INPUT_RIGHT; break;
+			case 'j': case 'J': *input |= INPUT_JUMP;  break;
+			default: return false;
+		}
+	}
+
+	return true;
+}
+
+static void show_result(SimResult* result, double elapsed_ms)
+{
+	long total_ticks = result->ticks * cli.num_runs;
+
+	printf("level=%s\n", file_from_path(cli.level_path));
+	printf("ticks=%ld\n", result->ticks);
+	printf("score=%d\n", result->score);
+	printf("time=%d\n", result->time);
+	printf("goal_reached=%d\n", result->goal_reached ? 1 : 0);
+	printf("time_up=%d\n", result->time_up ? 1 : 0);
+	printf("finished=%d\n", result->finished ? 1 : 0);
+	printf("coins_collected=%d\n", result->coins_collected);
+	printf("falls=%d\n", result->falls);
+	printf("hash=%08x\n", result->hash);
+	printf("runs=%d\n", cli.num_runs);
+	printf("elapsed_ms=%.3f\n", elapsed_ms);
+
+	if (elapsed_ms > 0) {
+		printf("ticks_per_ms=%.1f\n", total_ticks / elapsed_ms);
+	}
+}
+
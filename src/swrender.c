@@ -0,0 +1,362 @@
+/*
+ * Alex vs Bus
+ * Copyright (C) 2021-2025 M374LX
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * File:
+ * swrender.c
+ *
+ * Description:
+ * Software rasterizer, which copies regions of the image containing the game's
+ * graphics (decoded once into an RGBA atlas) to a framebuffer in memory, with
+ * the same results as drawing them with OpenGL using nearest-neighbor sampling
+ * and alpha blending, and is used by the renderer when built without a GPU
+ * (PLATFORM_HEADLESS)
+ *
+ */
+
+//------------------------------------------------------------------------------
+
+#include "defs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(__TINYC__)
+#include <emmintrin.h>
+#define SWRENDER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SWRENDER_NEON
+#endif
+
+//------------------------------------------------------------------------------
+
+//Atlas, with each pixel stored as the bytes R, G, B, and A
+static uint32_t* atlas;
+static int atlas_width;
+static int atlas_height;
+
+//Whether every pixel of the atlas is either fully transparent or fully opaque,
+//in which case drawing it fully opaque is a plain copy of the opaque pixels
+static bool atlas_keyed;
+
+static uint32_t* target;
+static int target_width;
+static int target_height;
+static int target_pitch; //In pixels
+
+//------------------------------------------------------------------------------
+
+//Function prototypes
+void swrender_free();
+static void copy_row(uint32_t* dst, const uint32_t* src, int count);
+static void copy_row_hflip(uint32_t* dst, const uint32_t* src, int count);
+static void fill_row(uint32_t* dst, uint32_t color, int count);
+static bool is_uniform(int sx, int sy, int sw, int sh);
+static uint32_t blend(uint32_t dst, uint32_t src, int alpha);
+static int alpha_of(uint32_t pixel);
+
+//------------------------------------------------------------------------------
+
+//Takes a copy of the RGBA pixels of the image containing the game's graphics,
+//returning false if out of memory
+bool swrender_load_atlas(const unsigned char* pixels, int width, int height)
+{
+	long size = (long)width * height;
+	long i;
+
+	swrender_free();
+
+	atlas = malloc(size * sizeof(uint32_t));
+	if (atlas == NULL) return false;
+
+	memcpy(atlas, pixels, size * sizeof(uint32_t));
+	atlas_width = width;
+	atlas_height = height;
+
+	atlas_keyed = true;
+	for (i = 0; i < size; i++) {
+		int a = alpha_of(atlas[i]);
+
+		if (a != 0 && a != 255) {
+			atlas_keyed = false;
+			break;
+		}
+	}
+
+	return true;
+}
+
+//Sets the framebuffer to draw on, with the same byte order as the atlas
+void swrender_set_target(uint32_t* pixels, int width, int height, int pitch)
+{
+	target = pixels;
+	target_width = width;
+	target_height = height;
+	target_pitch = pitch;
+}
+
+//Draws a region of the atlas stretched to the given size (in the same way as
+//a textured quad with nearest-neighbor sampling, which takes the texel under
+//the center of each pixel), optionally flipped, with alpha (from 0 to 255)
+//applied on top of that of the atlas
+void swrender_blit(int sx, int sy, int sw, int sh, int dx, int dy, int dw,
+	int dh, bool hflip, bool vflip, int alpha)
+{
+	bool stretch = (sw != dw || sh != dh);
+	bool copy = (alpha == 255 && atlas_keyed);
+	int x0, x1, y0, y1;
+	int x, y;
+
+	if (atlas == NULL || target == NULL) return;
+	if (sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0 || alpha <= 0) return;
+
+	//Regions not fully within the atlas are not drawn, as with OpenGL
+	//sampling them would depend on the texture's wrap mode
+	if (sx < 0 || sy < 0 || sx + sw > atlas_width || sy + sh > atlas_height) {
+		return;
+	}
+
+	//Clip to the framebuffer
+	x0 = (dx < 0) ? -dx : 0;
+	y0 = (dy < 0) ? -dy : 0;
+	x1 = (dx + dw > target_width)  ? target_width  - dx : dw;
+	y1 = (dy + dh > target_height) ? target_height - dy : dh;
+	if (x0 >= x1 || y0 >= y1) return;
+
+	//A region of a single color (like the backgrounds) is simply filled
+	if (stretch && is_uniform(sx, sy, sw, sh)) {
+		uint32_t color = atlas[sy * atlas_width + sx];
+
+		if (alpha_of(color) == 0) return;
+
+		for (y = y0; y < y1; y++) {
+			uint32_t* dst = &target[(dy + y) * target_pitch + dx + x0];
+
+			if (copy) {
+				fill_row(dst, color, x1 - x0);
+			} else {
+				for (x = 0; x < x1 - x0; x++) {
+					dst[x] = blend(dst[x], color, alpha);
+				}
+			}
+		}
+
+		return;
+	}
+
+	for (y = y0; y < y1; y++) {
+		uint32_t* dst = &target[(dy + y) * target_pitch + dx];
+		const uint32_t* src;
+		int row;
+
+		row = stretch ? (int)(((2L * y + 1) * sh) / (2L * dh)) : y;
+		if (vflip) row = sh - 1 - row;
+		src = &atlas[(sy + row) * atlas_width + sx];
+
+		if (!stretch && copy) {
+			if (hflip) {
+				copy_row_hflip(&dst[x0], &src[sw - x1], x1 - x0);
+			} else {
+				copy_row(&dst[x0], &src[x0], x1 - x0);
+			}
+		} else {
+			//The source column of each pixel is found incrementally, with
+			//the numerator of the division starting at (2 * x0 + 1) * sw
+			long den = 2L * dw;
+			long num = (2L * x0 + 1) * sw;
+			int col = (int)(num / den);
+			long rem = num % den;
+			int step = (int)((2L * sw) / den);
+			long step_rem = (2L * sw) % den;
+
+			if (!stretch) {
+				col = x0;
+				rem = 0;
+				step = 1;
+				step_rem = 0;
+			}
+
+			for (x = x0; x < x1; x++) {
+				uint32_t pixel = src[hflip ? sw - 1 - col : col];
+
+				if (copy) {
+					if (alpha_of(pixel) != 0) dst[x] = pixel;
+				} else {
+					dst[x] = blend(dst[x], pixel, alpha);
+				}
+
+				col += step;
+				rem += step_rem;
+				if (rem >= den) {
+					col++;
+					rem -= den;
+				}
+			}
+		}
+	}
+}
+
+void swrender_free()
+{
+	free(atlas);
+	atlas = NULL;
+	atlas_width = 0;
+	atlas_height = 0;
+}
+
+//------------------------------------------------------------------------------
+
+//Copies the opaque pixels of a row of an alpha-keyed source
+static void copy_row(uint32_t* dst, const uint32_t* src, int count)
+{
+	int i = 0;
+
+#if defined(SWRENDER_SSE2)
+	//The arithmetic shift turns the alpha (top byte) of 0 or 255 into a mask
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+		__m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+		__m128i m = _mm_srai_epi32(s, 24);
+
+		d = _mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, d));
+		_mm_storeu_si128((__m128i*)&dst[i], d);
+	}
+#elif defined(SWRENDER_NEON)
+	for (; i + 4 <= count; i += 4) {
+		uint32x4_t s = vld1q_u32(&src[i]);
+		uint32x4_t d = vld1q_u32(&dst[i]);
+		uint32x4_t m = vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(s), 24));
+
+		vst1q_u32(&dst[i], vbslq_u32(m, s, d));
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (alpha_of(src[i]) != 0) dst[i] = src[i];
+	}
+}
+
+//Same as copy_row(), but reading the source from right to left, with src
+//pointing to the leftmost of the count pixels to be read
+static void copy_row_hflip(uint32_t* dst, const uint32_t* src, int count)
+{
+	int i = 0;
+
+#if defined(SWRENDER_SSE2)
+	for (; i + 4 <= count; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)&src[count - i - 4]);
+		__m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+		__m128i m;
+
+		s = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3));
+		m = _mm_srai_epi32(s, 24);
+
+		d = _mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, d));
+		_mm_storeu_si128((__m128i*)&dst[i], d);
+	}
+#elif defined(SWRENDER_NEON)
+	for (; i + 4 <= count; i += 4) {
+		uint32x4_t s = vrev64q_u32(vld1q_u32(&src[count - i - 4]));
+		uint32x4_t d = vld1q_u32(&dst[i]);
+		uint32x4_t m;
+
+		s = vcombine_u32(vget_high_u32(s), vget_low_u32(s));
+		m = vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(s), 24));
+
+		vst1q_u32(&dst[i], vbslq_u32(m, s, d));
+	}
+#endif
+
+	for (; i < count; i++) {
+		uint32_t pixel = src[count - 1 - i];
+
+		if (alpha_of(pixel) != 0) dst[i] = pixel;
+	}
+}
+
+static void fill_row(uint32_t* dst, uint32_t color, int count)
+{
+	int i = 0;
+
+#if defined(SWRENDER_SSE2)
+	__m128i c = _mm_set1_epi32((int)color);
+
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i*)&dst[i], c);
+	}
+#elif defined(SWRENDER_NEON)
+	uint32x4_t c = vdupq_n_u32(color);
+
+	for (; i + 4 <= count; i += 4) {
+		vst1q_u32(&dst[i], c);
+	}
+#endif
+
+	for (; i < count; i++) {
+		dst[i] = color;
+	}
+}
+
+//Checks if all pixels of a region of the atlas are the same
+static bool is_uniform(int sx, int sy, int sw, int sh)
+{
+	uint32_t color = atlas[sy * atlas_width + sx];
+	int x, y;
+
+	for (y = 0; y < sh; y++) {
+		const uint32_t* row = &atlas[(sy + y) * atlas_width + sx];
+
+		for (x = 0; x < sw; x++) {
+			if (row[x] != color) return false;
+		}
+	}
+
+	return true;
+}
+
+//Blends a pixel over another with OpenGL's default blending function
+//(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA), applied to all four channels
+static uint32_t blend(uint32_t dst, uint32_t src, int alpha)
+{
+	const uint8_t* s = (const uint8_t*)&src;
+	const uint8_t* d = (const uint8_t*)&dst;
+	uint32_t result;
+	uint8_t* r = (uint8_t*)&result;
+	int a = (s[3] * alpha + 127) / 255;
+	int i;
+
+	if (a == 0) return dst;
+
+	//The source's alpha is also multiplied by that of the quad
+	for (i = 0; i < 4; i++) {
+		int c = (i == 3) ? a : s[i];
+
+		r[i] = (uint8_t)((c * a + d[i] * (255 - a) + 127) / 255);
+	}
+
+	return result;
+}
+
+static int alpha_of(uint32_t pixel)
+{
+	return ((const uint8_t*)&pixel)[3];
+}
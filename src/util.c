@@ -34,6 +34,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -85,11 +86,80 @@ bool str_only_whitespaces(const char* str)
 	return true;
 }
 
+//When built with PLATFORM_HEADLESS (as done for the simulation target), the
+//file functions below use only the C standard library, so that raylib's core
+//module is not needed
+#ifndef PLATFORM_HEADLESS
+
 int get_file_size(const char* path)
 {
 	return GetFileLength(path);
 }
 
+char* load_file_text(const char* path)
+{
+	return LoadFileText(path);
+}
+
+void unload_file_text(char* text)
+{
+	UnloadFileText(text);
+}
+
+#else
+
+int get_file_size(const char* path)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return 0;
+	}
+
+	return (int)st.st_size;
+}
+
+char* load_file_text(const char* path)
+{
+	FILE* f;
+	char* text;
+	long size;
+	size_t num_read;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (size < 0) {
+		fclose(f);
+		return NULL;
+	}
+
+	text = malloc(size + 1);
+	if (text == NULL) {
+		fclose(f);
+		return NULL;
+	}
+
+	num_read = fread(text, 1, size, f);
+	text[num_read] = '\0';
+	fclose(f);
+
+	return text;
+}
+
+void unload_file_text(char* text)
+{
+	free(text);
+}
+
+#endif
+
 //Extracts the name of a file from a full path
 const char* file_from_path(const char* path)
 {
@@ -252,7 +322,9 @@ bool create_parent_dirs(const char* path)
 
 void msgbox_error(const char* msg)
 {
-#if defined(_WIN32)
+#if defined(PLATFORM_HEADLESS)
+	fprintf(stderr, "%s\n", msg);
+#elif defined(_WIN32)
 	win32_msgbox_error(msg);
 #elif !defined(__ANDROID__)
 	pid_t pid;